@@ -0,0 +1,326 @@
+//
+//  rule_index.c
+//  CssParser
+//
+//  Matches the rules of a stylesheet against a synthetic DOM with
+//  css_selector_matches(), once by scanning every rule per element, once
+//  through a CssRuleIndex and once more walking the tree with an ancestor
+//  bloom filter rejecting candidates. The last pass repeats the filtered one
+//  with the distinct selectors the index compiled, see
+//  css_rule_index_program().
+//
+//  Usage: rule_index_benchmark [bootstrap.css] [elements]
+//  See download.sh for the stylesheet.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "cssparser.h"
+
+#define MAX_CLASSES 4
+
+typedef struct Element {
+    const char* tag;
+    const char* id;
+    const char* classes[MAX_CLASSES];
+    size_t class_count;
+    struct Element* parent;
+    struct Element* previous;
+    struct Element* next;
+    struct Element* last_child;
+} Element;
+
+typedef struct {
+    const char** data;
+    size_t length;
+    size_t capacity;
+} Names;
+
+static const char* kTags[] = {
+    "div", "span", "a", "p", "li", "ul", "button", "input", "img", "table",
+    "tr", "td", "form", "label", "h1", "h2", "nav", "section", "small", "i",
+};
+
+static unsigned int seed = 2015;
+
+static unsigned int next_random(void)
+{
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 16) & 0x7FFF;
+}
+
+static void names_add(Names* names, const char* name)
+{
+    for (size_t i = 0; i < names->length; ++i) {
+        if ( 0 == strcmp(names->data[i], name) )
+            return;
+    }
+    if ( names->length == names->capacity ) {
+        names->capacity = names->capacity ? names->capacity * 2 : 64;
+        names->data = realloc(names->data, sizeof(char*) * names->capacity);
+    }
+    names->data[names->length++] = name;
+}
+
+static void collect_names(CssArray* rules, Names* ids, Names* classes)
+{
+    for (size_t i = 0; i < rules->length; ++i) {
+        CssRule* rule = rules->data[i];
+        if ( CssRuleMedia == rule->type && ((CssMediaRule*)rule)->rules ) {
+            collect_names(((CssMediaRule*)rule)->rules, ids, classes);
+            continue;
+        }
+        if ( CssRuleStyle != rule->type )
+            continue;
+        CssArray* selectors = ((CssStyleRule*)rule)->selectors;
+        for (size_t j = 0; j < selectors->length; ++j) {
+            for (CssSelector* cs = selectors->data[j]; cs; cs = cs->tagHistory) {
+                if ( CssSelMatchId == cs->match )
+                    names_add(ids, cs->data->value);
+                else if ( CssSelMatchClass == cs->match )
+                    names_add(classes, cs->data->value);
+            }
+        }
+    }
+}
+
+static int has_class(const Element* e, const char* name)
+{
+    for (size_t i = 0; i < e->class_count; ++i) {
+        if ( 0 == strcmp(e->classes[i], name) )
+            return 1;
+    }
+    return 0;
+}
+
+// A tree a few levels deep, each element is appended to an earlier one.
+static void build_dom(Element* elements, size_t count, Names* ids, Names* classes)
+{
+    for (size_t i = 0; i < count; ++i) {
+        Element* e = &elements[i];
+        memset(e, 0, sizeof(Element));
+        e->tag = kTags[next_random() % (sizeof(kTags) / sizeof(kTags[0]))];
+        e->id = (ids->length && 0 == next_random() % 20) ? ids->data[next_random() % ids->length] : NULL;
+        size_t wanted = classes->length >= MAX_CLASSES ? next_random() % (MAX_CLASSES + 1) : 0;
+        // Class names of an element are distinct, as the index expects.
+        while ( e->class_count < wanted ) {
+            const char* name = classes->data[next_random() % classes->length];
+            if ( !has_class(e, name) )
+                e->classes[e->class_count++] = name;
+        }
+        if ( 0 == i )
+            continue;
+        e->parent = &elements[(i - 1) / (2 + next_random() % 4)];
+        e->previous = e->parent->last_child;
+        if ( e->previous )
+            e->previous->next = e;
+        e->parent->last_child = e;
+    }
+}
+
+static const char* element_tag_name(const void* element)
+{
+    return ((const Element*)element)->tag;
+}
+
+static const char* element_id(const void* element)
+{
+    return ((const Element*)element)->id;
+}
+
+static bool element_has_class(const void* element, const char* name)
+{
+    return has_class(element, name);
+}
+
+static const char* element_attribute(const void* element, const char* name)
+{
+    return NULL;
+}
+
+static const void* element_parent(const void* element)
+{
+    return ((const Element*)element)->parent;
+}
+
+static const void* element_previous_sibling(const void* element)
+{
+    return ((const Element*)element)->previous;
+}
+
+static const void* element_next_sibling(const void* element)
+{
+    return ((const Element*)element)->next;
+}
+
+static const CssElementOps kElementOps = {
+    element_tag_name,
+    element_id,
+    element_has_class,
+    element_attribute,
+    element_parent,
+    element_previous_sibling,
+    element_next_sibling,
+    NULL,
+};
+
+static size_t match_all(CssArray* rules, const Element* e, size_t* touched)
+{
+    size_t matched = 0;
+    for (size_t i = 0; i < rules->length; ++i) {
+        CssRule* rule = rules->data[i];
+        if ( CssRuleMedia == rule->type && ((CssMediaRule*)rule)->rules ) {
+            matched += match_all(((CssMediaRule*)rule)->rules, e, touched);
+            continue;
+        }
+        if ( CssRuleStyle != rule->type )
+            continue;
+        CssArray* selectors = ((CssStyleRule*)rule)->selectors;
+        for (size_t j = 0; j < selectors->length; ++j) {
+            (*touched)++;
+            matched += css_selector_matches(selectors->data[j], e, &kElementOps);
+        }
+    }
+    return matched;
+}
+
+static size_t match_indexed(const CssRuleIndex* index, const Element* e, size_t* touched,
+                            const CssRuleIndexEntry** candidates, size_t capacity)
+{
+    size_t count = css_rule_index_collect(index, e->tag, e->id, e->classes, e->class_count, candidates, capacity);
+    size_t matched = 0;
+    *touched += count;
+    for (size_t i = 0; i < count && i < capacity; ++i) {
+        matched += css_selector_matches(candidates[i]->selector, e, &kElementOps);
+    }
+    return matched;
+}
+
+static size_t match_filtered(const CssRuleIndex* index, const Element* e, CssBloomFilter* filter, size_t* touched,
+                             const CssRuleIndexEntry** candidates, size_t capacity)
+{
+    size_t count = css_rule_index_collect(index, e->tag, e->id, e->classes, e->class_count, candidates, capacity);
+    size_t matched = 0;
+    for (size_t i = 0; i < count && i < capacity; ++i) {
+        if ( !css_bloom_filter_may_match(filter, &candidates[i]->ancestors) )
+            continue;
+        (*touched)++;
+        matched += css_selector_matches(candidates[i]->selector, e, &kElementOps);
+    }
+    css_bloom_filter_push(filter, e->tag, e->id, e->classes, e->class_count);
+    for (const Element* child = e->last_child; child; child = child->previous) {
+        matched += match_filtered(index, child, filter, touched, candidates, capacity);
+    }
+    css_bloom_filter_pop(filter, e->tag, e->id, e->classes, e->class_count);
+    return matched;
+}
+
+static size_t match_compiled(const CssRuleIndex* index, const CssSelectorProgram* program, const Element* e,
+                             CssBloomFilter* filter, const CssRuleIndexEntry** candidates, size_t capacity)
+{
+    size_t count = css_rule_index_collect(index, e->tag, e->id, e->classes, e->class_count, candidates, capacity);
+    size_t matched = 0;
+    for (size_t i = 0; i < count && i < capacity; ++i) {
+        if ( !css_bloom_filter_may_match(filter, &candidates[i]->ancestors) )
+            continue;
+        matched += css_selector_program_matches(program, candidates[i]->unique, e, &kElementOps);
+    }
+    css_bloom_filter_push(filter, e->tag, e->id, e->classes, e->class_count);
+    for (const Element* child = e->last_child; child; child = child->previous) {
+        matched += match_compiled(index, program, child, filter, candidates, capacity);
+    }
+    css_bloom_filter_pop(filter, e->tag, e->id, e->classes, e->class_count);
+    return matched;
+}
+
+static double elapsed_ms(clock_t begin)
+{
+    return (double)(clock() - begin) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+int main(int argc, const char * argv[]) {
+    const char* filename = argc > 1 ? argv[1] : "bootstrap.css";
+    size_t count = argc > 2 ? (size_t)atol(argv[2]) : 10000;
+    FILE* fp = fopen(filename, "r");
+    if ( !fp ) {
+        printf("File %s not found, see benchmarks/download.sh.\n", filename);
+        return 1;
+    }
+    CssOutput* output = css_parse_file(fp);
+    fclose(fp);
+
+    Names ids = { NULL, 0, 0 }, classes = { NULL, 0, 0 };
+    collect_names(&output->stylesheet->rules, &ids, &classes);
+    Element* elements = malloc(sizeof(Element) * (count ? count : 1));
+    build_dom(elements, count, &ids, &classes);
+
+    clock_t begin = clock();
+    CssRuleIndex* index = css_rule_index_new(output->stylesheet);
+    double build_ms = elapsed_ms(begin);
+    size_t capacity = css_rule_index_length(index);
+    const CssRuleIndexEntry** candidates = malloc(sizeof(CssRuleIndexEntry*) * (capacity ? capacity : 1));
+
+    size_t linear_touched = 0, linear_matched = 0;
+    begin = clock();
+    for (size_t i = 0; i < count; ++i) {
+        linear_matched += match_all(&output->stylesheet->rules, &elements[i], &linear_touched);
+    }
+    double linear_ms = elapsed_ms(begin);
+
+    size_t indexed_touched = 0, indexed_matched = 0;
+    begin = clock();
+    for (size_t i = 0; i < count; ++i) {
+        indexed_matched += match_indexed(index, &elements[i], &indexed_touched, candidates, capacity);
+    }
+    double indexed_ms = elapsed_ms(begin);
+
+    size_t filtered_touched = 0, filtered_matched = 0;
+    CssBloomFilter* filter = malloc(sizeof(CssBloomFilter));
+    css_bloom_filter_clear(filter);
+    begin = clock();
+    if ( count )
+        filtered_matched = match_filtered(index, &elements[0], filter, &filtered_touched, candidates, capacity);
+    double filtered_ms = elapsed_ms(begin);
+
+    // One program entry per distinct selector, against one per selector
+    size_t unique = css_rule_index_unique_count(index);
+    const CssSelectorProgram* program = css_rule_index_program(index);
+    CssArray selectors = { malloc(sizeof(void*) * (capacity ? capacity : 1)), (unsigned int)capacity, (unsigned int)capacity };
+    const CssRuleIndexEntry* const* entries = css_rule_index_by_specificity(index);
+    for (size_t i = 0; i < capacity; ++i) {
+        selectors.data[i] = entries[i]->selector;
+    }
+    CssSelectorProgram* unshared = css_selector_program_new(&selectors);
+    size_t compiled_matched = 0;
+    css_bloom_filter_clear(filter);
+    begin = clock();
+    if ( count )
+        compiled_matched = match_compiled(index, program, &elements[0], filter, candidates, capacity);
+    double compiled_ms = elapsed_ms(begin);
+
+    printf("%s: %zu selectors, %zu distinct, %zu ids, %zu classes, %zu elements\n",
+           filename, capacity, unique, ids.length, classes.length, count);
+    printf("index built in %.2fms\n", build_ms);
+    printf("linear:  %8.2fms, %10zu selectors tested, %8zu matched\n", linear_ms, linear_touched, linear_matched);
+    printf("indexed: %8.2fms, %10zu selectors tested, %8zu matched\n", indexed_ms, indexed_touched, indexed_matched);
+    printf("filtered:%8.2fms, %10zu selectors tested, %8zu matched\n", filtered_ms, filtered_touched, filtered_matched);
+    printf("bytecode:%8.2fms, %10zu selectors tested, %8zu matched, %zu bytes shared, %zu bytes unshared\n",
+           compiled_ms, filtered_touched, compiled_matched, css_selector_program_size(program),
+           css_selector_program_size(unshared));
+
+    css_selector_program_destroy(unshared);
+    free(selectors.data);
+    free(filter);
+    free(candidates);
+    css_rule_index_destroy(index);
+    free(elements);
+    free(ids.data);
+    free(classes.data);
+    css_destroy_output(output);
+    return linear_matched == indexed_matched && indexed_matched == filtered_matched
+        && filtered_matched == compiled_matched ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Ancestor filter.
+//
+// While walking down the document the host keeps the tag names, ids and
+// classes of the ancestors of the current element in a counting bloom filter.
+// A selector whose descendant or child combinators require an ancestor with
+// a name the filter has never seen can not match, and is rejected without
+// walking the tree. Each name is hashed once into 24 bits, the two 12 bits
+// halves select the two counters.
+
+// Salts keep `#a`, `.a` and `a` apart.
+#define CSSPRSR_TAG_SALT   13
+#define CSSPRSR_ID_SALT    17
+#define CSSPRSR_CLASS_SALT 19
+
+#define CSSPRSR_BLOOM_KEY_MASK ((1u << CSS_BLOOM_FILTER_KEY_BITS) - 1)
+#define CSSPRSR_BLOOM_MAX_COUNT 0xFF
+
+static unsigned int hash_name(const char* name, unsigned int salt, bool ignore_case)
+{
+    unsigned int hash = (cssprsr_string_hash(name, ignore_case) * salt) & 0xFFFFFF;
+    // Zero ends CssAncestorHashes.
+    return hash ? hash : 1;
+}
+
+static void filter_add(CssBloomFilter* filter, unsigned int hash)
+{
+    unsigned char* first = &filter->counters[hash & CSSPRSR_BLOOM_KEY_MASK];
+    unsigned char* second = &filter->counters[(hash >> CSS_BLOOM_FILTER_KEY_BITS) & CSSPRSR_BLOOM_KEY_MASK];
+    // A saturated counter stays, it no longer knows how many names it holds.
+    if ( *first < CSSPRSR_BLOOM_MAX_COUNT )
+        ++*first;
+    if ( *second < CSSPRSR_BLOOM_MAX_COUNT )
+        ++*second;
+}
+
+static void filter_remove(CssBloomFilter* filter, unsigned int hash)
+{
+    unsigned char* first = &filter->counters[hash & CSSPRSR_BLOOM_KEY_MASK];
+    unsigned char* second = &filter->counters[(hash >> CSS_BLOOM_FILTER_KEY_BITS) & CSSPRSR_BLOOM_KEY_MASK];
+    assert(*first && *second);
+    if ( *first && *first < CSSPRSR_BLOOM_MAX_COUNT )
+        --*first;
+    if ( *second && *second < CSSPRSR_BLOOM_MAX_COUNT )
+        --*second;
+}
+
+static bool filter_may_contain(const CssBloomFilter* filter, unsigned int hash)
+{
+    return filter->counters[hash & CSSPRSR_BLOOM_KEY_MASK]
+        && filter->counters[(hash >> CSS_BLOOM_FILTER_KEY_BITS) & CSSPRSR_BLOOM_KEY_MASK];
+}
+
+typedef void (*CssBloomFilterUpdate)(CssBloomFilter* filter, unsigned int hash);
+
+static void filter_update(CssBloomFilter* filter, CssBloomFilterUpdate update, const char* tag, const char* id,
+                          const char* const* classes, size_t class_count)
+{
+    if ( tag )
+        update(filter, hash_name(tag, CSSPRSR_TAG_SALT, true));
+    if ( id && *id )
+        update(filter, hash_name(id, CSSPRSR_ID_SALT, false));
+    for (size_t i = 0; i < class_count; ++i) {
+        update(filter, hash_name(classes[i], CSSPRSR_CLASS_SALT, false));
+    }
+}
+
+void css_bloom_filter_clear(CssBloomFilter* filter)
+{
+    memset(filter->counters, 0, sizeof(filter->counters));
+}
+
+void css_bloom_filter_push(CssBloomFilter* filter, const char* tag, const char* id,
+                           const char* const* classes, size_t class_count)
+{
+    filter_update(filter, filter_add, tag, id, classes, class_count);
+}
+
+void css_bloom_filter_pop(CssBloomFilter* filter, const char* tag, const char* id,
+                          const char* const* classes, size_t class_count)
+{
+    filter_update(filter, filter_remove, tag, id, classes, class_count);
+}
+
+bool css_bloom_filter_may_match(const CssBloomFilter* filter, const CssAncestorHashes* ancestors)
+{
+    for (size_t i = 0; i < CSS_ANCESTOR_HASHES_MAX && ancestors->hashes[i]; ++i) {
+        if ( !filter_may_contain(filter, ancestors->hashes[i]) )
+            return false;
+    }
+    return true;
+}
+
+static void collect_compound(const CssSelector* compound, CssAncestorHashes* ancestors, size_t* count)
+{
+    for (const CssSelector* cs = compound; cs && *count < CSS_ANCESTOR_HASHES_MAX; cs = cs->tagHistory) {
+        switch ( cs->match ) {
+        case CssSelMatchId:
+            ancestors->hashes[(*count)++] = hash_name(cs->data->value, CSSPRSR_ID_SALT, false);
+            break;
+        case CssSelMatchClass:
+            ancestors->hashes[(*count)++] = hash_name(cs->data->value, CSSPRSR_CLASS_SALT, false);
+            break;
+        case CssSelMatchTag:
+            if ( strcmp(cs->tag->local, cssAsteriskString.data) )
+                ancestors->hashes[(*count)++] = hash_name(cs->tag->local, CSSPRSR_TAG_SALT, true);
+            break;
+        default:
+            break;
+        }
+        if ( CssSelRelSubSelector != cs->relation )
+            break;
+    }
+}
+
+void css_selector_ancestor_hashes(const CssSelector* selector, CssAncestorHashes* ancestors)
+{
+    memset(ancestors, 0, sizeof(CssAncestorHashes));
+    size_t count = 0;
+    // Compounds reached through a sibling combinator are not ancestors of
+    // the element, they are skipped until the next descendant or child one.
+    bool ancestor = false;
+    for (const CssSelector* cs = selector; cs && count < CSS_ANCESTOR_HASHES_MAX; cs = cs->tagHistory) {
+        if ( ancestor )
+            collect_compound(cs, ancestors, &count);
+        while ( CssSelRelSubSelector == cs->relation && cs->tagHistory )
+            cs = cs->tagHistory;
+        switch ( cs->relation ) {
+        case CssSelRelDescendant:
+        case CssSelRelChild:
+            ancestor = true;
+            break;
+        case CssSelRelDirectAdjacent:
+        case CssSelRelIndirectAdjacent:
+            ancestor = false;
+            break;
+        default:
+            // Shadow trees are not in the filter.
+            return;
+        }
+    }
+}
@@ -0,0 +1,562 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "selector.h"
+#include "cssparser_i.h"
+
+// Selector bytecode.
+//
+// A selector list is compiled into one array of fixed size instructions and
+// one pool of names. Each compound becomes a run of tests, the cheapest
+// first, ended by its combinator, or by `CssOpMatch` for the leftmost one.
+// Everything the tree matcher looks up while running is resolved here: tag
+// names and case-insensitive attribute values are lowered, pseudo-classes
+// become their own opcodes and `:nth-*` carry the a and b of their argument.
+// `:not` and `:any` lists, and the S of `:nth-child(An+B of S)`, are compiled
+// after the main selectors and reached through the entry table.
+
+typedef enum {
+    // Tests, failing the compound
+    CssOpTag,           // a: name
+    CssOpId,            // a: name
+    CssOpClass,         // a: name
+    CssOpAttribute,     // flags: CssSelectorMatch | CSSPRSR_OP_IGNORE_CASE, a: name, b: value
+    CssOpRoot,
+    CssOpFirstChild,
+    CssOpLastChild,
+    CssOpOnlyChild,
+    CssOpOnlyOfType,
+    CssOpNth,           // flags: CSSPRSR_OP_NTH_*, a and b of An+B
+    CssOpNthOf,         // flags: CSSPRSR_OP_NTH_LAST, a and b of An+B, the next instruction holds S
+    CssOpLang,          // a: range
+    CssOpState,         // a: CssPseudoType
+    CssOpNot,           // a: first entry, b: number of entries
+    CssOpAny,           // a: first entry, b: number of entries
+    CssOpFail,
+    // Combinators, ending the compound
+    CssOpDescendant,
+    CssOpChild,
+    CssOpAdjacent,
+    CssOpSibling,
+    CssOpMatch,
+} CssOpcode;
+
+#define CSSPRSR_OP_IGNORE_CASE  0x80
+#define CSSPRSR_OP_NTH_LAST     0x01
+#define CSSPRSR_OP_NTH_OF_TYPE  0x02
+
+typedef struct {
+    unsigned char op;
+    unsigned char flags;
+    int a;
+    int b;
+} CssInstruction;
+
+typedef struct {
+    unsigned int pc;
+    const CssArray* selectors;
+} CssPendingList;
+
+struct CssInternalSelectorProgram {
+    CssInstruction* code;
+    unsigned int length;
+    unsigned int capacity;
+    // Entry points, the selectors of the compiled list come first
+    unsigned int* entries;
+    unsigned int entry_count;
+    unsigned int entry_capacity;
+    unsigned int selector_count;
+    char* strings;
+    size_t strings_length;
+    size_t strings_capacity;
+};
+
+typedef struct {
+    CssParser* parser;
+    CssSelectorProgram* program;
+    CssPendingList* pending;
+    unsigned int pending_length;
+    unsigned int pending_capacity;
+} CssCompiler;
+
+// Grows `*data` to hold `needed` items, doubling its capacity.
+static void reserve(CssParser* parser, void** data, size_t* capacity, size_t needed, size_t item_size)
+{
+    if ( needed <= *capacity )
+        return;
+    size_t new_capacity = *capacity ? *capacity : 8;
+    while ( new_capacity < needed )
+        new_capacity *= 2;
+    void* grown = cssprsr_parser_alloc(parser, new_capacity * item_size);
+    if ( *data ) {
+        memcpy(grown, *data, *capacity * item_size);
+        cssprsr_parser_free(parser, *data);
+    }
+    *data = grown;
+    *capacity = new_capacity;
+}
+
+static unsigned int emit(CssCompiler* compiler, CssOpcode op, unsigned char flags, int a, int b)
+{
+    CssSelectorProgram* program = compiler->program;
+    size_t capacity = program->capacity;
+    reserve(compiler->parser, (void**)&program->code, &capacity, program->length + 1, sizeof(CssInstruction));
+    program->capacity = (unsigned int)capacity;
+    CssInstruction* instruction = &program->code[program->length];
+    instruction->op = (unsigned char)op;
+    instruction->flags = flags;
+    instruction->a = a;
+    instruction->b = b;
+    return program->length++;
+}
+
+static int intern(CssCompiler* compiler, const char* string, bool lower)
+{
+    CssSelectorProgram* program = compiler->program;
+    size_t length = strlen(string);
+    reserve(compiler->parser, (void**)&program->strings, &program->strings_capacity,
+            program->strings_length + length + 1, sizeof(char));
+    char* copy = program->strings + program->strings_length;
+    for (size_t i = 0; i <= length; ++i) {
+        copy[i] = lower ? (char)tolower((unsigned char)string[i]) : string[i];
+    }
+    int offset = (int)program->strings_length;
+    program->strings_length += length + 1;
+    return offset;
+}
+
+static unsigned int add_entries(CssCompiler* compiler, unsigned int count)
+{
+    CssSelectorProgram* program = compiler->program;
+    size_t capacity = program->entry_capacity;
+    reserve(compiler->parser, (void**)&program->entries, &capacity, program->entry_count + count, sizeof(unsigned int));
+    program->entry_capacity = (unsigned int)capacity;
+    unsigned int first = program->entry_count;
+    program->entry_count += count;
+    return first;
+}
+
+static void defer_list(CssCompiler* compiler, unsigned int pc, const CssArray* selectors)
+{
+    size_t capacity = compiler->pending_capacity;
+    reserve(compiler->parser, (void**)&compiler->pending, &capacity, compiler->pending_length + 1, sizeof(CssPendingList));
+    compiler->pending_capacity = (unsigned int)capacity;
+    compiler->pending[compiler->pending_length].pc = pc;
+    compiler->pending[compiler->pending_length].selectors = selectors;
+    compiler->pending_length++;
+}
+
+// Relative cost of a simple selector, tests are emitted cheapest first.
+static int simple_cost(const CssSelector* selector)
+{
+    switch ( selector->match ) {
+    case CssSelMatchId:
+    case CssSelMatchClass:
+    case CssSelMatchTag:
+        return 0;
+    case CssSelMatchPseudoClass:
+        switch ( selector->pseudo ) {
+        case CssPseudoNot:
+        case CssPseudoAny:
+            return 3;
+        case CssPseudoNthChild:
+        case CssPseudoNthLastChild:
+            return selector->data->selectors ? 3 : 2;
+        case CssPseudoRoot:
+        case CssPseudoFirstChild:
+        case CssPseudoLastChild:
+        case CssPseudoOnlyChild:
+            return 1;
+        default:
+            return 2;
+        }
+    case CssSelMatchPseudoElement:
+    case CssSelMatchPagePseudoClass:
+    case CssSelMatchUnknown:
+        // Fails anyway, as early as possible
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+static void compile_pseudo_class(CssCompiler* compiler, const CssSelector* selector)
+{
+    unsigned char flags = 0;
+    switch ( selector->pseudo ) {
+    case CssPseudoRoot:
+        emit(compiler, CssOpRoot, 0, 0, 0);
+        return;
+    case CssPseudoFirstChild:
+        emit(compiler, CssOpFirstChild, 0, 0, 0);
+        return;
+    case CssPseudoLastChild:
+        emit(compiler, CssOpLastChild, 0, 0, 0);
+        return;
+    case CssPseudoOnlyChild:
+        emit(compiler, CssOpOnlyChild, 0, 0, 0);
+        return;
+    case CssPseudoFirstOfType:
+        emit(compiler, CssOpNth, CSSPRSR_OP_NTH_OF_TYPE, 0, 1);
+        return;
+    case CssPseudoLastOfType:
+        emit(compiler, CssOpNth, CSSPRSR_OP_NTH_OF_TYPE | CSSPRSR_OP_NTH_LAST, 0, 1);
+        return;
+    case CssPseudoOnlyOfType:
+        emit(compiler, CssOpOnlyOfType, 0, 0, 0);
+        return;
+    case CssPseudoNthLastOfType:
+        flags |= CSSPRSR_OP_NTH_LAST;
+        /* nobreak */
+    case CssPseudoNthOfType:
+        flags |= CSSPRSR_OP_NTH_OF_TYPE;
+        /* nobreak */
+    case CssPseudoNthChild:
+    case CssPseudoNthLastChild:
+        if ( CssPseudoNthLastChild == selector->pseudo )
+            flags |= CSSPRSR_OP_NTH_LAST;
+        if ( selector->data->selectors ) {
+            emit(compiler, CssOpNthOf, flags, selector->data->bits.nth.a, selector->data->bits.nth.b);
+            defer_list(compiler, emit(compiler, CssOpAny, 0, 0, 0), selector->data->selectors);
+            return;
+        }
+        emit(compiler, CssOpNth, flags, selector->data->bits.nth.a, selector->data->bits.nth.b);
+        return;
+    case CssPseudoLang:
+        if ( selector->data->argument )
+            emit(compiler, CssOpLang, 0, intern(compiler, selector->data->argument, false), 0);
+        else
+            emit(compiler, CssOpFail, 0, 0, 0);
+        return;
+    case CssPseudoNot:
+    case CssPseudoAny:
+        if ( NULL == selector->data->selectors ) {
+            emit(compiler, CssPseudoNot == selector->pseudo ? CssOpNot : CssOpAny, 0, 0, 0);
+            return;
+        }
+        defer_list(compiler, emit(compiler, CssPseudoNot == selector->pseudo ? CssOpNot : CssOpAny, 0, 0, 0),
+                   selector->data->selectors);
+        return;
+    case CssPseudoHost:
+    case CssPseudoHostContext:
+    case CssPseudoUnknown:
+    case CssPseudoNotParsed:
+        emit(compiler, CssOpFail, 0, 0, 0);
+        return;
+    default:
+        emit(compiler, CssOpState, 0, selector->pseudo, 0);
+        return;
+    }
+}
+
+static void compile_simple(CssCompiler* compiler, const CssSelector* selector)
+{
+    switch ( selector->match ) {
+    case CssSelMatchTag:
+        if ( strcmp(selector->tag->local, cssAsteriskString.data) )
+            emit(compiler, CssOpTag, 0, intern(compiler, selector->tag->local, true), 0);
+        break;
+    case CssSelMatchId:
+        emit(compiler, CssOpId, 0, intern(compiler, selector->data->value, false), 0);
+        break;
+    case CssSelMatchClass:
+        emit(compiler, CssOpClass, 0, intern(compiler, selector->data->value, false), 0);
+        break;
+    case CssSelMatchPseudoClass:
+        compile_pseudo_class(compiler, selector);
+        break;
+    case CssSelMatchPseudoElement:
+    case CssSelMatchPagePseudoClass:
+    case CssSelMatchUnknown:
+        emit(compiler, CssOpFail, 0, 0, 0);
+        break;
+    default: {
+        bool ignore_case = CssAMTCaseInsensitive == selector->data->bits.attrMatchType;
+        int name = intern(compiler, selector->data->attribute->local, false);
+        int value = selector->data->value ? intern(compiler, selector->data->value, ignore_case) : 0;
+        emit(compiler, CssOpAttribute, (unsigned char)(selector->match | (ignore_case ? CSSPRSR_OP_IGNORE_CASE : 0)),
+             name, value);
+        break;
+    }
+    }
+}
+
+// Emits the selector and returns its entry point.
+static unsigned int compile_selector(CssCompiler* compiler, const CssSelector* selector)
+{
+    unsigned int entry = compiler->program->length;
+    const CssSelector* compound = selector;
+    while ( compound ) {
+        const CssSelector* last = compound;
+        while ( CssSelRelSubSelector == last->relation && last->tagHistory )
+            last = last->tagHistory;
+        for (int cost = 0; cost <= 3; ++cost) {
+            for (const CssSelector* cs = compound; ; cs = cs->tagHistory) {
+                if ( simple_cost(cs) == cost )
+                    compile_simple(compiler, cs);
+                if ( cs == last )
+                    break;
+            }
+        }
+        compound = last->tagHistory;
+        if ( NULL == compound ) {
+            emit(compiler, CssOpMatch, 0, 0, 0);
+            break;
+        }
+        switch ( last->relation ) {
+        case CssSelRelDescendant:
+        case CssSelRelShadowDeep:
+            emit(compiler, CssOpDescendant, 0, 0, 0);
+            break;
+        case CssSelRelChild:
+            emit(compiler, CssOpChild, 0, 0, 0);
+            break;
+        case CssSelRelDirectAdjacent:
+            emit(compiler, CssOpAdjacent, 0, 0, 0);
+            break;
+        case CssSelRelIndirectAdjacent:
+            emit(compiler, CssOpSibling, 0, 0, 0);
+            break;
+        default:
+            // Shadow trees are not reachable through CssElementOps.
+            emit(compiler, CssOpFail, 0, 0, 0);
+            emit(compiler, CssOpMatch, 0, 0, 0);
+            return entry;
+        }
+    }
+    return entry;
+}
+
+CssSelectorProgram* css_selector_program_new(const CssArray* selectors)
+{
+    if ( NULL == selectors )
+        return NULL;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssSelectorProgram* program = cssprsr_parser_alloc(&parser, sizeof(CssSelectorProgram));
+    memset(program, 0, sizeof(CssSelectorProgram));
+    CssCompiler compiler = { &parser, program, NULL, 0, 0 };
+
+    program->selector_count = selectors->length;
+    add_entries(&compiler, selectors->length);
+    for (unsigned int i = 0; i < selectors->length; ++i) {
+        program->entries[i] = compile_selector(&compiler, selectors->data[i]);
+    }
+    // Nested lists may defer lists of their own.
+    for (unsigned int i = 0; i < compiler.pending_length; ++i) {
+        CssPendingList pending = compiler.pending[i];
+        unsigned int first = add_entries(&compiler, pending.selectors->length);
+        for (unsigned int j = 0; j < pending.selectors->length; ++j) {
+            unsigned int entry = compile_selector(&compiler, pending.selectors->data[j]);
+            program->entries[first + j] = entry;
+        }
+        program->code[pending.pc].a = (int)first;
+        program->code[pending.pc].b = (int)pending.selectors->length;
+    }
+    if ( compiler.pending )
+        cssprsr_parser_free(&parser, compiler.pending);
+    return program;
+}
+
+void css_selector_program_destroy(CssSelectorProgram* program)
+{
+    if ( NULL == program )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    if ( program->code )
+        cssprsr_parser_free(&parser, program->code);
+    if ( program->entries )
+        cssprsr_parser_free(&parser, program->entries);
+    if ( program->strings )
+        cssprsr_parser_free(&parser, program->strings);
+    cssprsr_parser_free(&parser, program);
+}
+
+static CssMatchResult run(const CssSelectorProgram* program, unsigned int pc, const void* element, const CssElementOps* ops,
+                          CssNthIndexCache* cache);
+
+static bool run_list(const CssSelectorProgram* program, const CssInstruction* instruction,
+                     const void* element, const CssElementOps* ops, CssNthIndexCache* cache)
+{
+    for (int i = 0; i < instruction->b; ++i) {
+        if ( CssMatchSuccess == run(program, program->entries[instruction->a + i], element, ops, cache) )
+            return true;
+    }
+    return false;
+}
+
+// Position among the siblings matching the list of `list`, counting the
+// element, 0 when it does not match, see selector_list_position() in
+// matcher.c.
+static int run_list_position(const CssSelectorProgram* program, const CssInstruction* list, bool forward,
+                             const void* element, const CssElementOps* ops, CssNthIndexCache* cache)
+{
+    if ( !run_list(program, list, element, ops, cache) )
+        return 0;
+    int position = 1;
+    for (const void* e = forward ? ops->previous_sibling(element) : ops->next_sibling(element);
+         e; e = forward ? ops->previous_sibling(e) : ops->next_sibling(e)) {
+        if ( run_list(program, list, e, ops, cache) )
+            position++;
+    }
+    return position;
+}
+
+// Same failure rules as match_complex() in matcher.c.
+static CssMatchResult run(const CssSelectorProgram* program, unsigned int pc, const void* element, const CssElementOps* ops,
+                          CssNthIndexCache* cache)
+{
+    const char* strings = program->strings;
+    for (;; ++pc) {
+        const CssInstruction* instruction = &program->code[pc];
+        switch ( instruction->op ) {
+        case CssOpTag:
+            if ( strcasecmp(ops->tag_name(element), strings + instruction->a) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpId: {
+            const char* id = ops->id(element);
+            if ( NULL == id || strcmp(id, strings + instruction->a) )
+                return CssMatchFailsLocally;
+            break;
+        }
+        case CssOpClass:
+            if ( !ops->has_class(element, strings + instruction->a) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpAttribute:
+            if ( !cssprsr_match_attribute_value((CssSelectorMatch)(instruction->flags & ~CSSPRSR_OP_IGNORE_CASE),
+                                                ops->attribute(element, strings + instruction->a),
+                                                strings + instruction->b,
+                                                instruction->flags & CSSPRSR_OP_IGNORE_CASE) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpRoot:
+            if ( ops->parent(element) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpFirstChild:
+            if ( ops->previous_sibling(element) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpLastChild:
+            if ( ops->next_sibling(element) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpOnlyChild:
+            if ( ops->previous_sibling(element) || ops->next_sibling(element) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpOnlyOfType:
+            if ( 1 != cssprsr_sibling_position(element, ops, cache, true, true)
+                 || 1 != cssprsr_sibling_position(element, ops, cache, false, true) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpNth: {
+            int position = cssprsr_sibling_position(element, ops, cache, !(instruction->flags & CSSPRSR_OP_NTH_LAST),
+                                                    instruction->flags & CSSPRSR_OP_NTH_OF_TYPE);
+            if ( !css_nth_matches(instruction->a, instruction->b, position) )
+                return CssMatchFailsLocally;
+            break;
+        }
+        case CssOpNthOf: {
+            int position = run_list_position(program, instruction + 1, !(instruction->flags & CSSPRSR_OP_NTH_LAST),
+                                             element, ops, cache);
+            if ( !position || !css_nth_matches(instruction->a, instruction->b, position) )
+                return CssMatchFailsLocally;
+            // Past the list
+            ++pc;
+            break;
+        }
+        case CssOpLang:
+            if ( !cssprsr_match_lang(element, ops, strings + instruction->a) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpState:
+            if ( NULL == ops->has_state || !ops->has_state(element, (CssPseudoType)instruction->a) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpNot:
+            if ( run_list(program, instruction, element, ops, cache) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpAny:
+            if ( !run_list(program, instruction, element, ops, cache) )
+                return CssMatchFailsLocally;
+            break;
+        case CssOpFail:
+            return CssMatchFailsLocally;
+        case CssOpDescendant:
+            for (const void* e = ops->parent(element); e; e = ops->parent(e)) {
+                CssMatchResult result = run(program, pc + 1, e, ops, cache);
+                if ( CssMatchSuccess == result || CssMatchFailsCompletely == result )
+                    return result;
+            }
+            return CssMatchFailsCompletely;
+        case CssOpChild: {
+            const void* parent = ops->parent(element);
+            if ( NULL == parent )
+                return CssMatchFailsCompletely;
+            CssMatchResult result = run(program, pc + 1, parent, ops, cache);
+            return CssMatchFailsAllSiblings == result ? CssMatchFailsLocally : result;
+        }
+        case CssOpAdjacent: {
+            const void* sibling = ops->previous_sibling(element);
+            if ( NULL == sibling )
+                return CssMatchFailsAllSiblings;
+            return run(program, pc + 1, sibling, ops, cache);
+        }
+        case CssOpSibling:
+            for (const void* e = ops->previous_sibling(element); e; e = ops->previous_sibling(e)) {
+                CssMatchResult result = run(program, pc + 1, e, ops, cache);
+                if ( CssMatchFailsLocally != result )
+                    return result;
+            }
+            return CssMatchFailsAllSiblings;
+        case CssOpMatch:
+        default:
+            return CssMatchSuccess;
+        }
+    }
+}
+
+bool css_selector_program_matches(const CssSelectorProgram* program, size_t selector_index,
+                                  const void* element, const CssElementOps* ops)
+{
+    return css_selector_program_matches_with_cache(program, selector_index, element, ops, NULL);
+}
+
+bool css_selector_program_matches_with_cache(const CssSelectorProgram* program, size_t selector_index,
+                                             const void* element, const CssElementOps* ops,
+                                             CssNthIndexCache* cache)
+{
+    if ( NULL == program || selector_index >= program->selector_count || NULL == element || NULL == ops )
+        return false;
+    return CssMatchSuccess == run(program, program->entries[selector_index], element, ops, cache);
+}
+
+size_t css_selector_program_size(const CssSelectorProgram* program)
+{
+    return program->length * sizeof(CssInstruction)
+         + program->entry_count * sizeof(unsigned int)
+         + program->strings_length;
+}
@@ -0,0 +1,501 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// calc().
+//
+// The grammar hands calc() its terms and operators as a flat argument list,
+// parentheses included. It is parsed once here into a tree typed the way
+// WebKit types calc: a sum needs both sides of the same category, or a
+// percentage with lengths or numbers, and a product or a quotient needs a
+// number on one side. Constant subexpressions are folded while the tree is
+// built, bottom-up: terms of the same unit anywhere in a chain of sums are
+// added together, as are absolute lengths, angles, times and frequencies
+// once brought to px, deg, ms and Hz, and products and quotients by a
+// number are distributed over the terms they apply to. What is left only
+// needs the font size, the viewport or the percentage basis, and is
+// evaluated against a context.
+
+static bool unit_category(CssValueUnit unit, CssCalcCategory* category)
+{
+    switch ( unit ) {
+    case CSS_VALUE_NUMBER:
+        *category = CssCalcNumber;
+        return true;
+    case CSS_VALUE_PERCENTAGE:
+        *category = CssCalcPercent;
+        return true;
+    case CSS_VALUE_PX:
+    case CSS_VALUE_CM:
+    case CSS_VALUE_MM:
+    case CSS_VALUE_IN:
+    case CSS_VALUE_PT:
+    case CSS_VALUE_PC:
+    case CSS_VALUE_EMS:
+    case CSS_VALUE_PARSER_Q_EMS:
+    case CSS_VALUE_EXS:
+    case CSS_VALUE_REMS:
+    case CSS_VALUE_CHS:
+    case CSS_VALUE_VW:
+    case CSS_VALUE_VH:
+    case CSS_VALUE_VMIN:
+    case CSS_VALUE_VMAX:
+        *category = CssCalcLength;
+        return true;
+    case CSS_VALUE_DEG:
+    case CSS_VALUE_RAD:
+    case CSS_VALUE_GRAD:
+    case CSS_VALUE_TURN:
+        *category = CssCalcAngle;
+        return true;
+    case CSS_VALUE_MS:
+    case CSS_VALUE_S:
+        *category = CssCalcTime;
+        return true;
+    case CSS_VALUE_HZ:
+    case CSS_VALUE_KHZ:
+        *category = CssCalcFrequency;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static CssValueUnit canonical_unit(CssCalcCategory category)
+{
+    switch ( category ) {
+    case CssCalcLength:    return CSS_VALUE_PX;
+    case CssCalcAngle:     return CSS_VALUE_DEG;
+    case CssCalcTime:      return CSS_VALUE_MS;
+    case CssCalcFrequency: return CSS_VALUE_HZ;
+    default:               return CSS_VALUE_UNKNOWN;
+    }
+}
+
+static const char* unit_suffix(CssValueUnit unit)
+{
+    switch ( unit ) {
+    case CSS_VALUE_PERCENTAGE:    return "%";
+    case CSS_VALUE_PX:            return "px";
+    case CSS_VALUE_CM:            return "cm";
+    case CSS_VALUE_MM:            return "mm";
+    case CSS_VALUE_IN:            return "in";
+    case CSS_VALUE_PT:            return "pt";
+    case CSS_VALUE_PC:            return "pc";
+    case CSS_VALUE_EMS:           return "em";
+    case CSS_VALUE_PARSER_Q_EMS:  return "__qem";
+    case CSS_VALUE_EXS:           return "ex";
+    case CSS_VALUE_REMS:          return "rem";
+    case CSS_VALUE_CHS:           return "ch";
+    case CSS_VALUE_VW:            return "vw";
+    case CSS_VALUE_VH:            return "vh";
+    case CSS_VALUE_VMIN:          return "vmin";
+    case CSS_VALUE_VMAX:          return "vmax";
+    case CSS_VALUE_DEG:           return "deg";
+    case CSS_VALUE_RAD:           return "rad";
+    case CSS_VALUE_GRAD:          return "grad";
+    case CSS_VALUE_TURN:          return "turn";
+    case CSS_VALUE_MS:            return "ms";
+    case CSS_VALUE_S:             return "s";
+    case CSS_VALUE_HZ:            return "hz";
+    case CSS_VALUE_KHZ:           return "khz";
+    default:                      return "";
+    }
+}
+
+// Category of `left op right`, false if the operation is not allowed.
+static bool operation_category(CssCalcOperator op, CssCalcCategory left, CssCalcCategory right,
+                               CssCalcCategory* category)
+{
+    switch ( op ) {
+    case CssCalcAdd:
+    case CssCalcSubtract:
+        if ( left == right ) {
+            *category = left;
+            return true;
+        }
+        if ( (CssCalcPercent == left || CssCalcPercentNumber == left || CssCalcNumber == left) &&
+             (CssCalcPercent == right || CssCalcPercentNumber == right || CssCalcNumber == right) ) {
+            *category = CssCalcPercentNumber;
+            return true;
+        }
+        if ( (CssCalcPercent == left || CssCalcPercentLength == left || CssCalcLength == left) &&
+             (CssCalcPercent == right || CssCalcPercentLength == right || CssCalcLength == right) ) {
+            *category = CssCalcPercentLength;
+            return true;
+        }
+        return false;
+    case CssCalcMultiply:
+        if ( CssCalcNumber == left ) {
+            *category = right;
+            return true;
+        }
+        if ( CssCalcNumber == right ) {
+            *category = left;
+            return true;
+        }
+        return false;
+    case CssCalcDivide:
+        if ( CssCalcNumber == right ) {
+            *category = left;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static CssCalcNode* new_leaf(CssParser* parser, double value, CssValueUnit unit, CssCalcCategory category)
+{
+    CssCalcNode* node = cssprsr_parser_alloc(parser, sizeof(CssCalcNode));
+    node->op = CssCalcLeaf;
+    node->category = category;
+    node->value = value;
+    node->unit = unit;
+    node->left = NULL;
+    node->right = NULL;
+    return node;
+}
+
+static void destroy_node(CssParser* parser, CssCalcNode* node)
+{
+    if ( NULL == node )
+        return;
+    destroy_node(parser, node->left);
+    destroy_node(parser, node->right);
+    cssprsr_parser_free(parser, node);
+}
+
+// Adds `sign * value` in `unit` to a term of the chain of sums `node`
+// measured in the same unit, or in a unit convertible to it.
+static bool add_to_sum(CssCalcNode* node, int sign, double value, CssValueUnit unit)
+{
+    switch ( node->op ) {
+    case CssCalcLeaf: {
+        if ( node->unit == unit ) {
+            node->value += sign * value;
+            return true;
+        }
+        CssCalcCategory category, node_category;
+        double from = cssprsr_unit_absolute_scale(unit), to = cssprsr_unit_absolute_scale(node->unit);
+        if ( 0 == from || 0 == to || !unit_category(unit, &category) ||
+             !unit_category(node->unit, &node_category) || category != node_category )
+            return false;
+        node->value = node->value * to + sign * value * from;
+        node->unit = canonical_unit(category);
+        return true;
+    }
+    case CssCalcAdd:
+        return add_to_sum(node->left, sign, value, unit) || add_to_sum(node->right, sign, value, unit);
+    case CssCalcSubtract:
+        return add_to_sum(node->left, sign, value, unit) || add_to_sum(node->right, -sign, value, unit);
+    default:
+        return false;
+    }
+}
+
+// Multiplies `node` by `factor`, through sums and into the left operand of
+// products and quotients.
+static void scale(CssCalcNode* node, double factor)
+{
+    switch ( node->op ) {
+    case CssCalcLeaf:
+        node->value *= factor;
+        break;
+    case CssCalcAdd:
+    case CssCalcSubtract:
+        scale(node->left, factor);
+        scale(node->right, factor);
+        break;
+    default:
+        scale(node->left, factor);
+        break;
+    }
+}
+
+static CssCalcNode* fold(CssParser* parser, CssCalcNode* node)
+{
+    CssCalcNode* left = node->left;
+    CssCalcNode* right = node->right;
+    CssCalcNode* folded = NULL;
+    switch ( node->op ) {
+    case CssCalcAdd:
+    case CssCalcSubtract:
+        if ( CssCalcLeaf == right->op &&
+             add_to_sum(left, CssCalcAdd == node->op ? 1 : -1, right->value, right->unit) ) {
+            cssprsr_parser_free(parser, right);
+            folded = left;
+        } else if ( CssCalcLeaf == left->op && CssCalcAdd == node->op &&
+                    add_to_sum(right, 1, left->value, left->unit) ) {
+            cssprsr_parser_free(parser, left);
+            folded = right;
+        }
+        break;
+    case CssCalcMultiply:
+        if ( CssCalcLeaf == right->op && CssCalcNumber == right->category ) {
+            scale(left, right->value);
+            cssprsr_parser_free(parser, right);
+            folded = left;
+        } else if ( CssCalcLeaf == left->op && CssCalcNumber == left->category ) {
+            scale(right, left->value);
+            cssprsr_parser_free(parser, left);
+            folded = right;
+        }
+        break;
+    case CssCalcDivide:
+        scale(left, 1 / right->value);
+        cssprsr_parser_free(parser, right);
+        folded = left;
+        break;
+    default:
+        break;
+    }
+    if ( NULL == folded )
+        return node;
+    // A chain of sums keeps the category of all its terms
+    folded->category = node->category;
+    cssprsr_parser_free(parser, node);
+    return folded;
+}
+
+static CssCalcNode* new_operation(CssParser* parser, CssCalcOperator op, CssCalcNode* left, CssCalcNode* right)
+{
+    CssCalcCategory category;
+    if ( NULL == left || NULL == right || !operation_category(op, left->category, right->category, &category) ) {
+        destroy_node(parser, left);
+        destroy_node(parser, right);
+        return NULL;
+    }
+    // Numbers only ever meet numbers, so a divisor is always folded already
+    if ( CssCalcDivide == op && CssCalcLeaf == right->op && 0 == right->value ) {
+        destroy_node(parser, left);
+        destroy_node(parser, right);
+        return NULL;
+    }
+    CssCalcNode* node = cssprsr_parser_alloc(parser, sizeof(CssCalcNode));
+    node->op = op;
+    node->category = category;
+    node->value = 0;
+    node->unit = CSS_VALUE_UNKNOWN;
+    node->left = left;
+    node->right = right;
+    return fold(parser, node);
+}
+
+static bool is_operator(const CssArray* args, size_t i, int op)
+{
+    if ( i >= args->length )
+        return false;
+    const CssValue* value = args->data[i];
+    return CSS_VALUE_PARSER_OPERATOR == value->unit && op == value->iValue;
+}
+
+static CssCalcNode* parse_sum(CssParser* parser, const CssArray* args, size_t* i);
+
+static CssCalcNode* parse_term(CssParser* parser, const CssArray* args, size_t* i)
+{
+    if ( *i >= args->length )
+        return NULL;
+    if ( is_operator(args, *i, '(') ) {
+        ++*i;
+        CssCalcNode* node = parse_sum(parser, args, i);
+        if ( NULL == node )
+            return NULL;
+        if ( !is_operator(args, *i, ')') ) {
+            destroy_node(parser, node);
+            return NULL;
+        }
+        ++*i;
+        return node;
+    }
+    const CssValue* value = args->data[*i];
+    CssCalcCategory category;
+    if ( !unit_category(value->unit, &category) )
+        return NULL;
+    ++*i;
+    return new_leaf(parser, value->fValue, value->unit, category);
+}
+
+static CssCalcNode* parse_product(CssParser* parser, const CssArray* args, size_t* i)
+{
+    CssCalcNode* node = parse_term(parser, args, i);
+    while ( NULL != node ) {
+        CssCalcOperator op;
+        if ( is_operator(args, *i, '*') )
+            op = CssCalcMultiply;
+        else if ( is_operator(args, *i, '/') )
+            op = CssCalcDivide;
+        else
+            break;
+        ++*i;
+        node = new_operation(parser, op, node, parse_term(parser, args, i));
+    }
+    return node;
+}
+
+static CssCalcNode* parse_sum(CssParser* parser, const CssArray* args, size_t* i)
+{
+    CssCalcNode* node = parse_product(parser, args, i);
+    while ( NULL != node ) {
+        CssCalcOperator op;
+        if ( is_operator(args, *i, '+') )
+            op = CssCalcAdd;
+        else if ( is_operator(args, *i, '-') )
+            op = CssCalcSubtract;
+        else
+            break;
+        ++*i;
+        node = new_operation(parser, op, node, parse_product(parser, args, i));
+    }
+    return node;
+}
+
+CssCalcExpression* cssprsr_calc_from_function(CssParser* parser, CssParserString* name, const CssArray* args)
+{
+    if ( !((5 == name->length && 0 == strncasecmp(name->data, "calc(", 5)) ||
+           (13 == name->length && 0 == strncasecmp(name->data, "-webkit-calc(", 13))) )
+        return NULL;
+    if ( NULL == args )
+        return NULL;
+    size_t i = 0;
+    CssCalcNode* root = parse_sum(parser, args, &i);
+    if ( NULL == root )
+        return NULL;
+    if ( i != args->length ) {
+        destroy_node(parser, root);
+        return NULL;
+    }
+    CssCalcExpression* calc = cssprsr_parser_alloc(parser, sizeof(CssCalcExpression));
+    calc->name = cssprsr_string_to_characters(parser, name);
+    calc->root = root;
+    return calc;
+}
+
+static CssCalcNode* copy_node(CssParser* parser, const CssCalcNode* node)
+{
+    if ( NULL == node )
+        return NULL;
+    CssCalcNode* copy = cssprsr_parser_alloc(parser, sizeof(CssCalcNode));
+    *copy = *node;
+    copy->left = copy_node(parser, node->left);
+    copy->right = copy_node(parser, node->right);
+    return copy;
+}
+
+CssCalcExpression* cssprsr_copy_calc(CssParser* parser, const CssCalcExpression* calc)
+{
+    CssParserString name = { (char*)calc->name, strlen(calc->name), 0 };
+    CssCalcExpression* copy = cssprsr_parser_alloc(parser, sizeof(CssCalcExpression));
+    copy->name = cssprsr_string_to_characters(parser, &name);
+    copy->root = copy_node(parser, calc->root);
+    return copy;
+}
+
+void cssprsr_destroy_calc(CssParser* parser, CssCalcExpression* calc)
+{
+    destroy_node(parser, calc->root);
+    cssprsr_parser_free(parser, (void*) calc->name);
+    cssprsr_parser_free(parser, calc);
+}
+
+static int precedence(const CssCalcNode* node)
+{
+    switch ( node->op ) {
+    case CssCalcAdd:
+    case CssCalcSubtract:
+        return 1;
+    case CssCalcMultiply:
+    case CssCalcDivide:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+static size_t append_node(const CssCalcNode* node, char* buffer, size_t size, size_t length);
+
+static size_t append_text(const char* text, char* buffer, size_t size, size_t length)
+{
+    int n = snprintf(length < size ? buffer + length : NULL, length < size ? size - length : 0, "%s", text);
+    return length + (n > 0 ? n : 0);
+}
+
+static size_t append_operand(const CssCalcNode* operand, bool parenthesize, char* buffer, size_t size, size_t length)
+{
+    if ( parenthesize )
+        length = append_text("(", buffer, size, length);
+    length = append_node(operand, buffer, size, length);
+    if ( parenthesize )
+        length = append_text(")", buffer, size, length);
+    return length;
+}
+
+static size_t append_node(const CssCalcNode* node, char* buffer, size_t size, size_t length)
+{
+    if ( CssCalcLeaf == node->op ) {
+        char number[64];
+        snprintf(number, sizeof(number), "%.6g%s", node->value, unit_suffix(node->unit));
+        return append_text(number, buffer, size, length);
+    }
+    int prec = precedence(node);
+    bool strict = CssCalcSubtract == node->op || CssCalcDivide == node->op;
+    char op[4] = { ' ', (char) node->op, ' ', '\0' };
+    length = append_operand(node->left, precedence(node->left) < prec, buffer, size, length);
+    length = append_text(op, buffer, size, length);
+    return append_operand(node->right, precedence(node->right) < prec || (strict && precedence(node->right) == prec),
+                          buffer, size, length);
+}
+
+void cssprsr_calc_to_string(const CssCalcExpression* calc, char* buffer, size_t size)
+{
+    size_t length = append_text(calc->name, buffer, size, 0);
+    length = append_node(calc->root, buffer, size, length);
+    append_text(")", buffer, size, length);
+}
+
+static double evaluate(const CssCalcNode* node, const CssUnitContext* context)
+{
+    switch ( node->op ) {
+    case CssCalcAdd:
+        return evaluate(node->left, context) + evaluate(node->right, context);
+    case CssCalcSubtract:
+        return evaluate(node->left, context) - evaluate(node->right, context);
+    case CssCalcMultiply:
+        return evaluate(node->left, context) * evaluate(node->right, context);
+    case CssCalcDivide:
+        return evaluate(node->left, context) / evaluate(node->right, context);
+    default:
+        break;
+    }
+    return node->value * cssprsr_unit_scale(node->unit, context);
+}
+
+double css_calc_evaluate(const CssCalcExpression* calc, const CssUnitContext* context)
+{
+    return evaluate(calc->root, context);
+}
+
+CssCalcCategory css_calc_category(const CssCalcExpression* calc)
+{
+    return calc->root->category;
+}
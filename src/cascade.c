@@ -0,0 +1,420 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+#include <stdint.h>
+
+// Cascade.
+//
+// The selectors matching an element are sorted by origin, specificity, then
+// position, and their declarations are applied in that order, a later one
+// replacing an earlier one unless it is weaker: `!important` declarations
+// beat normal ones, and among them the origins are reversed.
+//
+// Siblings in generated markup match the same selectors more often than
+// not. The cascaded styles are kept in a table keyed by the list of matched
+// selectors, and an element matching the same list gets the same style
+// without running the cascade again.
+
+typedef struct {
+    const CssRuleIndex* index;
+    CssCascadeOrigin origin;
+    const CssMediaQueryCache* media;
+    // Innermost `@media` rule around each entry of the index, by `order`
+    const CssMediaRule** media_rules;
+    unsigned int length;
+} CssCascadeSource;
+
+typedef struct {
+    const CssRuleIndexEntry* entry;
+    unsigned int source;
+    CssCascadeOrigin origin;
+} CssCascadeMatch;
+
+typedef struct {
+    const CssDeclaration* declaration;
+    unsigned char level;
+    unsigned int position;
+} CssCascadeCustom;
+
+typedef struct {
+    // First, handed out as the CssCascadedStyle
+    CssCascadedStyle style;
+    unsigned int hash;
+    // Source and order of each matched entry, in cascade order
+    unsigned int* key;
+    unsigned int key_length;
+} CssCascadeStyleEntry;
+
+struct CssInternalCascade {
+    CssArray /* CssCascadeSource */ sources;
+    // Scratch space of css_cascade_resolve()
+    const CssRuleIndexEntry** candidates;
+    size_t candidates_capacity;
+    CssCascadeMatch* matches;
+    size_t matches_capacity;
+    unsigned int* key;
+    // Open addressing over `styles`, the capacity is 0 or a power of two
+    CssCascadeStyleEntry** table;
+    unsigned int capacity;
+    CssArray /* CssCascadeStyleEntry */ styles;
+};
+
+// Walks the rules in the order css_rule_index_new() numbers the selectors.
+static unsigned int map_media_rules(CssArray* rules, const CssMediaRule* media,
+                                    const CssMediaRule** media_rules, unsigned int order, unsigned int length)
+{
+    for (size_t i = 0; i < rules->length; ++i) {
+        CssRule* rule = rules->data[i];
+        if ( CssRuleMedia == rule->type && ((CssMediaRule*)rule)->rules ) {
+            order = map_media_rules(((CssMediaRule*)rule)->rules, (CssMediaRule*)rule, media_rules, order, length);
+            continue;
+        }
+        if ( CssRuleStyle != rule->type )
+            continue;
+        for (size_t j = 0; j < ((CssStyleRule*)rule)->selectors->length && order < length; ++j)
+            media_rules[order++] = media;
+    }
+    return order;
+}
+
+CssCascade* css_cascade_new(void)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssCascade* cascade = cssprsr_parser_alloc(&parser, sizeof(CssCascade));
+    cssprsr_array_init(&parser, 0, &cascade->sources);
+    cascade->candidates = NULL;
+    cascade->candidates_capacity = 0;
+    cascade->matches = NULL;
+    cascade->matches_capacity = 0;
+    cascade->key = NULL;
+    cascade->table = NULL;
+    cascade->capacity = 0;
+    cssprsr_array_init(&parser, 0, &cascade->styles);
+    return cascade;
+}
+
+void css_cascade_clear(CssCascade* cascade)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    for (size_t i = 0; i < cascade->styles.length; ++i) {
+        CssCascadeStyleEntry* entry = cascade->styles.data[i];
+        cssprsr_parser_free(&parser, (void*)entry->style.properties);
+        cssprsr_parser_free(&parser, (void*)entry->style.custom);
+        cssprsr_parser_free(&parser, entry->key);
+        cssprsr_parser_free(&parser, entry);
+    }
+    cascade->styles.length = 0;
+    if ( cascade->table )
+        memset(cascade->table, 0, sizeof(CssCascadeStyleEntry*) * cascade->capacity);
+}
+
+void css_cascade_destroy(CssCascade* cascade)
+{
+    if ( NULL == cascade )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    css_cascade_clear(cascade);
+    for (size_t i = 0; i < cascade->sources.length; ++i) {
+        CssCascadeSource* source = cascade->sources.data[i];
+        cssprsr_parser_free(&parser, (void*)source->media_rules);
+        cssprsr_parser_free(&parser, source);
+    }
+    cssprsr_array_destroy(&parser, &cascade->sources);
+    cssprsr_array_destroy(&parser, &cascade->styles);
+    if ( cascade->candidates )
+        cssprsr_parser_free(&parser, (void*)cascade->candidates);
+    if ( cascade->matches )
+        cssprsr_parser_free(&parser, cascade->matches);
+    if ( cascade->key )
+        cssprsr_parser_free(&parser, cascade->key);
+    if ( cascade->table )
+        cssprsr_parser_free(&parser, cascade->table);
+    cssprsr_parser_free(&parser, cascade);
+}
+
+void css_cascade_add_stylesheet(CssCascade* cascade, CssStylesheet* stylesheet, const CssRuleIndex* index,
+                                CssCascadeOrigin origin, const CssMediaQueryCache* media)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssCascadeSource* source = cssprsr_parser_alloc(&parser, sizeof(CssCascadeSource));
+    source->index = index;
+    source->origin = origin;
+    source->media = media;
+    source->length = (unsigned int)css_rule_index_length(index);
+    source->media_rules = cssprsr_parser_alloc(&parser, sizeof(CssMediaRule*) * (source->length ? source->length : 1));
+    memset((void*)source->media_rules, 0, sizeof(CssMediaRule*) * source->length);
+    map_media_rules(&stylesheet->rules, NULL, source->media_rules, 0, source->length);
+    cssprsr_array_add(&parser, source, &cascade->sources);
+    // The styles cached so far lack the new rules
+    css_cascade_clear(cascade);
+}
+
+static int compare_matches(const void* a, const void* b)
+{
+    const CssCascadeMatch* first = a;
+    const CssCascadeMatch* second = b;
+    if ( first->origin != second->origin )
+        return first->origin < second->origin ? -1 : 1;
+    if ( first->entry->specificity != second->entry->specificity )
+        return first->entry->specificity < second->entry->specificity ? -1 : 1;
+    if ( first->source != second->source )
+        return first->source < second->source ? -1 : 1;
+    if ( first->entry->order != second->entry->order )
+        return first->entry->order < second->entry->order ? -1 : 1;
+    return 0;
+}
+
+static unsigned int key_hash(const unsigned int* key, unsigned int length)
+{
+    // FNV-1a over the words
+    unsigned int hash = 2166136261u;
+    for (unsigned int i = 0; i < length; ++i) {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static CssCascadeStyleEntry** find(const CssCascade* cascade, unsigned int hash, const unsigned int* key,
+                                   unsigned int length)
+{
+    unsigned int mask = cascade->capacity - 1;
+    for (unsigned int i = hash & mask; ; i = (i + 1) & mask) {
+        CssCascadeStyleEntry* entry = cascade->table[i];
+        if ( NULL == entry || (entry->hash == hash && entry->key_length == length &&
+                               (0 == length || 0 == memcmp(entry->key, key, sizeof(unsigned int) * length))) )
+            return &cascade->table[i];
+    }
+}
+
+// Makes room for one more style, keeping the load factor under 1/2.
+static void reserve(CssParser* parser, CssCascade* cascade)
+{
+    unsigned int capacity = cascade->capacity ? cascade->capacity : 64;
+    while ( (cascade->styles.length + 1) * 2 > capacity )
+        capacity *= 2;
+    if ( capacity == cascade->capacity )
+        return;
+    if ( cascade->table )
+        cssprsr_parser_free(parser, cascade->table);
+    cascade->table = cssprsr_parser_alloc(parser, sizeof(CssCascadeStyleEntry*) * capacity);
+    memset(cascade->table, 0, sizeof(CssCascadeStyleEntry*) * capacity);
+    cascade->capacity = capacity;
+    for (size_t i = 0; i < cascade->styles.length; ++i) {
+        CssCascadeStyleEntry* entry = cascade->styles.data[i];
+        *find(cascade, entry->hash, entry->key, entry->key_length) = entry;
+    }
+}
+
+// Strength of a declaration, a stronger or equal one replaces it.
+static unsigned char cascade_level(CssCascadeOrigin origin, bool important)
+{
+    return (unsigned char)(important ? 2 * CssCascadeOriginAuthor + 1 - origin : origin);
+}
+
+static int compare_customs(const void* a, const void* b)
+{
+    const CssCascadeCustom* first = a;
+    const CssCascadeCustom* second = b;
+    int order = strcmp(first->declaration->property, second->declaration->property);
+    if ( 0 != order )
+        return order;
+    return first->position < second->position ? -1 : 1;
+}
+
+// Custom properties are keyed by their names rather than by ids: the
+// declarations are sorted by name, then position, and the winner of each
+// name is the last one of the strongest level.
+static void cascade_customs(CssParser* parser, const CssCascadeMatch* matches, size_t count,
+                            CssCascadedStyle* style)
+{
+    unsigned int length = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const CssArray* declarations = matches[i].entry->rule->declarations;
+        for (size_t j = 0; declarations && j < declarations->length; ++j) {
+            if ( CssPropertyCustom == ((CssDeclaration*)declarations->data[j])->id )
+                length++;
+        }
+    }
+    style->custom = NULL;
+    style->custom_length = 0;
+    if ( 0 == length )
+        return;
+
+    CssCascadeCustom* customs = cssprsr_parser_alloc(parser, sizeof(CssCascadeCustom) * length);
+    unsigned int position = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const CssArray* declarations = matches[i].entry->rule->declarations;
+        for (size_t j = 0; declarations && j < declarations->length; ++j) {
+            const CssDeclaration* declaration = declarations->data[j];
+            if ( CssPropertyCustom != declaration->id )
+                continue;
+            customs[position].declaration = declaration;
+            customs[position].level = cascade_level(matches[i].origin, declaration->important);
+            customs[position].position = position;
+            position++;
+        }
+    }
+    qsort(customs, length, sizeof(CssCascadeCustom), compare_customs);
+
+    const CssDeclaration** custom = cssprsr_parser_alloc(parser, sizeof(CssDeclaration*) * length);
+    for (unsigned int i = 0; i < length; ) {
+        unsigned int winner = i, next = i + 1;
+        while ( next < length && 0 == strcmp(customs[next].declaration->property, customs[i].declaration->property) ) {
+            if ( customs[next].level >= customs[winner].level )
+                winner = next;
+            next++;
+        }
+        custom[style->custom_length++] = customs[winner].declaration;
+        i = next;
+    }
+    cssprsr_parser_free(parser, customs);
+    style->custom = custom;
+}
+
+static void cascade_declarations(CssParser* parser, const CssCascadeMatch* matches, size_t count,
+                                 CssCascadedStyle* style)
+{
+    unsigned char levels[CssPropertyCount];
+    memset(style->declarations, 0, sizeof(style->declarations));
+    for (size_t i = 0; i < count; ++i) {
+        const CssArray* declarations = matches[i].entry->rule->declarations;
+        for (size_t j = 0; declarations && j < declarations->length; ++j) {
+            const CssDeclaration* declaration = declarations->data[j];
+            if ( declaration->id <= CssPropertyCustom || declaration->id >= CssPropertyCount )
+                continue;
+            unsigned char level = cascade_level(matches[i].origin, declaration->important);
+            if ( NULL != style->declarations[declaration->id] && level < levels[declaration->id] )
+                continue;
+            style->declarations[declaration->id] = declaration;
+            levels[declaration->id] = level;
+        }
+    }
+    unsigned int length = 0;
+    for (unsigned int id = 0; id < CssPropertyCount; ++id) {
+        if ( style->declarations[id] )
+            length++;
+    }
+    CssPropertyID* properties = cssprsr_parser_alloc(parser, sizeof(CssPropertyID) * (length ? length : 1));
+    style->length = 0;
+    for (unsigned int id = 0; id < CssPropertyCount; ++id) {
+        if ( style->declarations[id] )
+            properties[style->length++] = (CssPropertyID)id;
+    }
+    style->properties = properties;
+    cascade_customs(parser, matches, count, style);
+}
+
+static size_t collect_matches(CssParser* parser, CssCascade* cascade, const void* element, const CssElementOps* ops,
+                              const char* const* classes, size_t class_count, const CssBloomFilter* filter)
+{
+    const char* tag = ops->tag_name(element);
+    const char* id = ops->id(element);
+    size_t count = 0;
+    for (size_t i = 0; i < cascade->sources.length; ++i) {
+        const CssCascadeSource* source = cascade->sources.data[i];
+        size_t candidates = css_rule_index_collect(source->index, tag, id, classes, class_count,
+                                                   cascade->candidates, cascade->candidates_capacity);
+        if ( candidates > cascade->candidates_capacity ) {
+            if ( cascade->candidates )
+                cssprsr_parser_free(parser, (void*)cascade->candidates);
+            cascade->candidates_capacity = candidates * 2;
+            cascade->candidates = cssprsr_parser_alloc(parser, sizeof(CssRuleIndexEntry*) * cascade->candidates_capacity);
+            candidates = css_rule_index_collect(source->index, tag, id, classes, class_count,
+                                                cascade->candidates, cascade->candidates_capacity);
+        }
+        // Equal selectors share their compiled form
+        const CssSelectorProgram* program = css_rule_index_program(source->index);
+        for (size_t j = 0; j < candidates; ++j) {
+            const CssRuleIndexEntry* entry = cascade->candidates[j];
+            if ( filter && !css_bloom_filter_may_match(filter, &entry->ancestors) )
+                continue;
+            const CssMediaRule* media = entry->order < source->length ? source->media_rules[entry->order] : NULL;
+            if ( media && source->media && !css_media_query_cache_is_active(source->media, media) )
+                continue;
+            if ( !css_selector_program_matches(program, entry->unique, element, ops) )
+                continue;
+            if ( count == cascade->matches_capacity ) {
+                size_t capacity = cascade->matches_capacity ? cascade->matches_capacity * 2 : 64;
+                CssCascadeMatch* matches = cssprsr_parser_alloc(parser, sizeof(CssCascadeMatch) * capacity);
+                if ( count )
+                    memcpy(matches, cascade->matches, sizeof(CssCascadeMatch) * count);
+                if ( cascade->matches )
+                    cssprsr_parser_free(parser, cascade->matches);
+                cascade->matches = matches;
+                cascade->matches_capacity = capacity;
+                if ( cascade->key )
+                    cssprsr_parser_free(parser, cascade->key);
+                cascade->key = cssprsr_parser_alloc(parser, sizeof(unsigned int) * 2 * capacity);
+            }
+            cascade->matches[count].entry = entry;
+            cascade->matches[count].source = (unsigned int)i;
+            cascade->matches[count].origin = source->origin;
+            count++;
+        }
+    }
+    return count;
+}
+
+const CssCascadedStyle* css_cascade_resolve(CssCascade* cascade, const void* element, const CssElementOps* ops,
+                                            const char* const* classes, size_t class_count,
+                                            const CssBloomFilter* filter)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    size_t count = collect_matches(&parser, cascade, element, ops, classes, class_count, filter);
+    if ( count > 1 )
+        qsort(cascade->matches, count, sizeof(CssCascadeMatch), compare_matches);
+
+    unsigned int length = (unsigned int)count * 2;
+    for (size_t i = 0; i < count; ++i) {
+        cascade->key[2 * i] = cascade->matches[i].source;
+        cascade->key[2 * i + 1] = cascade->matches[i].entry->order;
+    }
+    unsigned int hash = key_hash(cascade->key, length);
+    reserve(&parser, cascade);
+    CssCascadeStyleEntry** slot = find(cascade, hash, cascade->key, length);
+    if ( *slot )
+        return &(*slot)->style;
+
+    CssCascadeStyleEntry* entry = cssprsr_parser_alloc(&parser, sizeof(CssCascadeStyleEntry));
+    entry->hash = hash;
+    entry->key_length = length;
+    entry->key = cssprsr_parser_alloc(&parser, sizeof(unsigned int) * (length ? length : 1));
+    if ( length )
+        memcpy(entry->key, cascade->key, sizeof(unsigned int) * length);
+    cascade_declarations(&parser, cascade->matches, count, &entry->style);
+    entry->style.matched = (unsigned int)count;
+    *slot = entry;
+    cssprsr_array_add(&parser, entry, &cascade->styles);
+    return &entry->style;
+}
+
+size_t css_cascade_style_count(const CssCascade* cascade)
+{
+    return cascade->styles.length;
+}
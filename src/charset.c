@@ -0,0 +1,304 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "charset.h"
+#include "cssparser_i.h"
+
+// Refs:
+// https://www.w3.org/TR/css-syntax-3/#input-byte-stream
+// https://encoding.spec.whatwg.org/
+
+static const char* kCssEncodingNames[] = {
+    "UTF-8",
+    "UTF-16LE",
+    "UTF-16BE",
+    "windows-1252",
+};
+
+// Labels of https://encoding.spec.whatwg.org/#names-and-labels
+static const char* kCssWindows1252Labels[] = {
+    "ansi_x3.4-1968", "ascii", "cp1252", "cp819", "csisolatin1", "ibm819",
+    "iso-8859-1", "iso-ir-100", "iso8859-1", "iso88591", "iso_8859-1",
+    "iso_8859-1:1987", "l1", "latin1", "us-ascii", "windows-1252", "x-cp1252",
+};
+
+// windows-1252 code points of the bytes 0x80 to 0x9F, the others map to
+// themselves.
+static const unsigned short kCssWindows1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+const char* cssprsr_encoding_name(CssEncoding encoding)
+{
+    return kCssEncodingNames[encoding];
+}
+
+static CssEncoding cssprsr_encoding_for_label(const char* label, size_t length)
+{
+    for (size_t i = 0; i < sizeof(kCssWindows1252Labels) / sizeof(kCssWindows1252Labels[0]); ++i) {
+        const char* name = kCssWindows1252Labels[i];
+        if ( strlen(name) == length && 0 == strncasecmp(name, label, length) )
+            return CssEncodingWindows1252;
+    }
+    // utf-16be and utf-16le labels mean UTF-8 here, an ASCII compatible
+    // `@charset` can not have been written in UTF-16.
+    return CssEncodingUTF8;
+}
+
+CssEncoding cssprsr_detect_encoding(const char* bytes, size_t length, size_t* bom_length)
+{
+    const unsigned char* s = (const unsigned char*)bytes;
+    *bom_length = 0;
+    if ( length >= 3 && s[0] == 0xEF && s[1] == 0xBB && s[2] == 0xBF ) {
+        *bom_length = 3;
+        return CssEncodingUTF8;
+    }
+    if ( length >= 2 && s[0] == 0xFE && s[1] == 0xFF ) {
+        *bom_length = 2;
+        return CssEncodingUTF16BE;
+    }
+    if ( length >= 2 && s[0] == 0xFF && s[1] == 0xFE ) {
+        *bom_length = 2;
+        return CssEncodingUTF16LE;
+    }
+
+    // `@charset "label";` is matched byte for byte.
+    static const char prefix[] = "@charset \"";
+    size_t prefix_length = sizeof(prefix) - 1;
+    if ( length > prefix_length && 0 == memcmp(bytes, prefix, prefix_length) ) {
+        const char* label = bytes + prefix_length;
+        const char* end = memchr(label, '"', length - prefix_length);
+        if ( end && end + 1 < bytes + length && end[1] == ';' )
+            return cssprsr_encoding_for_label(label, (size_t)(end - label));
+    }
+    return CssEncodingUTF8;
+}
+
+// Length of the UTF-8 sequence at `s`. When it is invalid, the negated length
+// of its maximal subpart, which is replaced by a single U+FFFD.
+static int utf8_sequence(const unsigned char* s, size_t length)
+{
+    unsigned char c = s[0];
+    unsigned char lower = 0x80, upper = 0xBF;
+    int needed;
+    if ( c < 0x80 ) {
+        return 1;
+    } else if ( c >= 0xC2 && c <= 0xDF ) {
+        needed = 1;
+    } else if ( c >= 0xE0 && c <= 0xEF ) {
+        needed = 2;
+        if ( c == 0xE0 )
+            lower = 0xA0;
+        else if ( c == 0xED )
+            upper = 0x9F;
+    } else if ( c >= 0xF0 && c <= 0xF4 ) {
+        needed = 3;
+        if ( c == 0xF0 )
+            lower = 0x90;
+        else if ( c == 0xF4 )
+            upper = 0x8F;
+    } else {
+        return -1;
+    }
+    for (int i = 1; i <= needed; ++i) {
+        if ( (size_t)i >= length || s[i] < lower || s[i] > upper )
+            return -i;
+        lower = 0x80;
+        upper = 0xBF;
+    }
+    return needed + 1;
+}
+
+size_t cssprsr_utf8_encode(unsigned int c, char* bytes)
+{
+    unsigned char* output = (unsigned char*)bytes;
+    if ( c < 0x80 ) {
+        output[0] = (unsigned char)c;
+        return 1;
+    }
+    if ( c < 0x800 ) {
+        output[0] = (unsigned char)(0xC0 | (c >> 6));
+        output[1] = (unsigned char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if ( c < 0x10000 ) {
+        output[0] = (unsigned char)(0xE0 | (c >> 12));
+        output[1] = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+        output[2] = (unsigned char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    output[0] = (unsigned char)(0xF0 | (c >> 18));
+    output[1] = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+    output[2] = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+    output[3] = (unsigned char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+// Number of leading ASCII bytes, the common case for style sheets.
+static size_t ascii_prefix(const unsigned char* s, size_t length)
+{
+    size_t i = 0;
+#if CSSPRSR_HAVE_SSE2
+    for (; i + 32 <= length; i += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 16));
+        if ( _mm_movemask_epi8(_mm_or_si128(a, b)) )
+            break;
+    }
+    for (; i + 16 <= length; i += 16) {
+        if ( _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i))) )
+            break;
+    }
+#endif // #if CSSPRSR_HAVE_SSE2
+    while ( i < length && s[i] < 0x80 )
+        i++;
+    return i;
+}
+
+bool cssprsr_utf8_is_valid(const char* bytes, size_t length)
+{
+    const unsigned char* s = (const unsigned char*)bytes;
+    size_t i = 0;
+    while ( i < length ) {
+        i += ascii_prefix(s + i, length - i);
+        if ( i == length )
+            break;
+        int n = utf8_sequence(s + i, length - i);
+        if ( n < 0 )
+            return false;
+        i += n;
+    }
+    return true;
+}
+
+static size_t utf8_repair(const unsigned char* s, size_t length, unsigned char* output)
+{
+    size_t i = 0, o = 0;
+    while ( i < length ) {
+        size_t ascii = ascii_prefix(s + i, length - i);
+        memcpy(output + o, s + i, ascii);
+        i += ascii;
+        o += ascii;
+        if ( i == length )
+            break;
+        int n = utf8_sequence(s + i, length - i);
+        if ( n > 0 ) {
+            memcpy(output + o, s + i, n);
+            i += n;
+            o += n;
+        } else {
+            o += cssprsr_utf8_encode(CSSPRSR_REPLACEMENT_CHARACTER, (char*)output + o);
+            i += -n;
+        }
+    }
+    return o;
+}
+
+static size_t utf16_decode(const unsigned char* s, size_t length, bool big_endian, unsigned char* output)
+{
+    int hi = big_endian ? 0 : 1, lo = big_endian ? 1 : 0;
+    size_t i = 0, o = 0;
+    while ( i + 1 < length ) {
+#if CSSPRSR_HAVE_SSE2
+        // Eight ASCII code units at a time.
+        if ( i + 16 <= length ) {
+            __m128i units = _mm_loadu_si128((const __m128i*)(s + i));
+            if ( big_endian )
+                units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+            __m128i high = _mm_and_si128(units, _mm_set1_epi16((short)0xFF80));
+            if ( 0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) ) {
+                _mm_storel_epi64((__m128i*)(output + o), _mm_packus_epi16(units, units));
+                i += 16;
+                o += 8;
+                continue;
+            }
+        }
+#endif // #if CSSPRSR_HAVE_SSE2
+        unsigned int c = (s[i + hi] << 8) | s[i + lo];
+        i += 2;
+        if ( c >= 0xD800 && c <= 0xDBFF ) {
+            unsigned int next = i + 1 < length ? (unsigned int)((s[i + hi] << 8) | s[i + lo]) : 0;
+            if ( next >= 0xDC00 && next <= 0xDFFF ) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (next - 0xDC00);
+                i += 2;
+            } else {
+                c = CSSPRSR_REPLACEMENT_CHARACTER;
+            }
+        } else if ( c >= 0xDC00 && c <= 0xDFFF ) {
+            c = CSSPRSR_REPLACEMENT_CHARACTER;
+        }
+        o += cssprsr_utf8_encode(c, (char*)output + o);
+    }
+    // A dangling byte
+    if ( i < length )
+        o += cssprsr_utf8_encode(CSSPRSR_REPLACEMENT_CHARACTER, (char*)output + o);
+    return o;
+}
+
+static size_t windows1252_decode(const unsigned char* s, size_t length, unsigned char* output)
+{
+    size_t i = 0, o = 0;
+    while ( i < length ) {
+        size_t ascii = ascii_prefix(s + i, length - i);
+        memcpy(output + o, s + i, ascii);
+        i += ascii;
+        o += ascii;
+        if ( i == length )
+            break;
+        unsigned int c = s[i++];
+        if ( c < 0xA0 )
+            c = kCssWindows1252High[c - 0x80];
+        o += cssprsr_utf8_encode(c, (char*)output + o);
+    }
+    return o;
+}
+
+char* cssprsr_decode_input(struct CssInternalParser* parser, const char* bytes, size_t length,
+                           CssEncoding encoding, size_t* output_length)
+{
+    const unsigned char* s = (const unsigned char*)bytes;
+    unsigned char* output;
+    switch ( encoding ) {
+    case CssEncodingUTF8:
+        if ( cssprsr_utf8_is_valid(bytes, length) )
+            return NULL;
+        // Each invalid byte may grow into a 3 bytes U+FFFD.
+        output = cssprsr_parser_alloc(parser, length * 3 + 1);
+        *output_length = utf8_repair(s, length, output);
+        break;
+    case CssEncodingUTF16LE:
+    case CssEncodingUTF16BE:
+        // A code unit takes at most 3 bytes, a surrogate pair 4 for 2 units.
+        output = cssprsr_parser_alloc(parser, (length / 2) * 3 + 3 + 1);
+        *output_length = utf16_decode(s, length, CssEncodingUTF16BE == encoding, output);
+        break;
+    case CssEncodingWindows1252:
+    default:
+        output = cssprsr_parser_alloc(parser, length * 3 + 1);
+        *output_length = windows1252_decode(s, length, output);
+        break;
+    }
+    output[*output_length] = '\0';
+    return (char*)output;
+}
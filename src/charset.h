@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#ifndef __CSS_CHARSET_H_
+#define __CSS_CHARSET_H_
+
+#include "foundation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// U+FFFD, substituted for anything that can not be decoded
+#define CSSPRSR_REPLACEMENT_CHARACTER 0xFFFD
+
+/**
+ *  Input encodings, everything is turned into UTF-8 before scanning
+ */
+typedef enum {
+    CssEncodingUTF8,
+    CssEncodingUTF16LE,
+    CssEncodingUTF16BE,
+    // Also used for the iso-8859-1 and us-ascii labels, as browsers do
+    CssEncodingWindows1252,
+} CssEncoding;
+
+// Name reported in `CssStylesheet.encoding`.
+const char* cssprsr_encoding_name(CssEncoding encoding);
+
+// Detects the encoding from a byte order mark or a leading `@charset` rule,
+// UTF-8 otherwise. `bom_length` receives the number of bytes to skip.
+CssEncoding cssprsr_detect_encoding(const char* bytes, size_t length, size_t* bom_length);
+
+// Whether the bytes are well-formed UTF-8, ASCII runs are checked 32 bytes
+// at a time, then 16.
+bool cssprsr_utf8_is_valid(const char* bytes, size_t length);
+
+// Writes the code point as UTF-8, at most 4 bytes, and returns its length.
+size_t cssprsr_utf8_encode(unsigned int c, char* output);
+
+// Converts the input to UTF-8 in a single pass, invalid sequences become
+// U+FFFD. Returns NULL when the bytes are valid UTF-8 and can be used as is,
+// a buffer to release with cssprsr_parser_free() otherwise.
+char* cssprsr_decode_input(struct CssInternalParser* parser, const char* bytes, size_t length,
+                           CssEncoding encoding, size_t* output_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CSS_CHARSET_H_ */
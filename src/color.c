@@ -0,0 +1,525 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Colors.
+//
+// Hex colors, named colors and the rgb() and hsl() functions are resolved
+// while parsing into a CSS_VALUE_RGBCOLOR value packing the color in 32
+// bits, so consumers do not parse them again and color functions keep no
+// CssValueFunction nor argument list. The form the color was written in is
+// kept for serializing it back. Names are only colors in the value of a
+// property taking one: `animation-name: red` stays an ident.
+
+// Named colors from CssValueAliceblue to CssValueYellowgreen, 0xRRGGBBAA
+static const unsigned int kNamedColors[] = {
+    0xf0f8ffff, // aliceblue
+    0xfaebd7ff, // antiquewhite
+    0x00ffffff, // aqua
+    0x7fffd4ff, // aquamarine
+    0xf0ffffff, // azure
+    0xf5f5dcff, // beige
+    0xffe4c4ff, // bisque
+    0x000000ff, // black
+    0xffebcdff, // blanchedalmond
+    0x0000ffff, // blue
+    0x8a2be2ff, // blueviolet
+    0xa52a2aff, // brown
+    0xdeb887ff, // burlywood
+    0x5f9ea0ff, // cadetblue
+    0x7fff00ff, // chartreuse
+    0xd2691eff, // chocolate
+    0xff7f50ff, // coral
+    0x6495edff, // cornflowerblue
+    0xfff8dcff, // cornsilk
+    0xdc143cff, // crimson
+    0x00ffffff, // cyan
+    0x00008bff, // darkblue
+    0x008b8bff, // darkcyan
+    0xb8860bff, // darkgoldenrod
+    0xa9a9a9ff, // darkgray
+    0x006400ff, // darkgreen
+    0xa9a9a9ff, // darkgrey
+    0xbdb76bff, // darkkhaki
+    0x8b008bff, // darkmagenta
+    0x556b2fff, // darkolivegreen
+    0xff8c00ff, // darkorange
+    0x9932ccff, // darkorchid
+    0x8b0000ff, // darkred
+    0xe9967aff, // darksalmon
+    0x8fbc8fff, // darkseagreen
+    0x483d8bff, // darkslateblue
+    0x2f4f4fff, // darkslategray
+    0x2f4f4fff, // darkslategrey
+    0x00ced1ff, // darkturquoise
+    0x9400d3ff, // darkviolet
+    0xff1493ff, // deeppink
+    0x00bfffff, // deepskyblue
+    0x696969ff, // dimgray
+    0x696969ff, // dimgrey
+    0x1e90ffff, // dodgerblue
+    0xb22222ff, // firebrick
+    0xfffaf0ff, // floralwhite
+    0x228b22ff, // forestgreen
+    0xff00ffff, // fuchsia
+    0xdcdcdcff, // gainsboro
+    0xf8f8ffff, // ghostwhite
+    0xffd700ff, // gold
+    0xdaa520ff, // goldenrod
+    0x808080ff, // gray
+    0x008000ff, // green
+    0xadff2fff, // greenyellow
+    0x808080ff, // grey
+    0xf0fff0ff, // honeydew
+    0xff69b4ff, // hotpink
+    0xcd5c5cff, // indianred
+    0x4b0082ff, // indigo
+    0xfffff0ff, // ivory
+    0xf0e68cff, // khaki
+    0xe6e6faff, // lavender
+    0xfff0f5ff, // lavenderblush
+    0x7cfc00ff, // lawngreen
+    0xfffacdff, // lemonchiffon
+    0xadd8e6ff, // lightblue
+    0xf08080ff, // lightcoral
+    0xe0ffffff, // lightcyan
+    0xfafad2ff, // lightgoldenrodyellow
+    0xd3d3d3ff, // lightgray
+    0x90ee90ff, // lightgreen
+    0xd3d3d3ff, // lightgrey
+    0xffb6c1ff, // lightpink
+    0xffa07aff, // lightsalmon
+    0x20b2aaff, // lightseagreen
+    0x87cefaff, // lightskyblue
+    0x778899ff, // lightslategray
+    0x778899ff, // lightslategrey
+    0xb0c4deff, // lightsteelblue
+    0xffffe0ff, // lightyellow
+    0x00ff00ff, // lime
+    0x32cd32ff, // limegreen
+    0xfaf0e6ff, // linen
+    0xff00ffff, // magenta
+    0x800000ff, // maroon
+    0x66cdaaff, // mediumaquamarine
+    0x0000cdff, // mediumblue
+    0xba55d3ff, // mediumorchid
+    0x9370dbff, // mediumpurple
+    0x3cb371ff, // mediumseagreen
+    0x7b68eeff, // mediumslateblue
+    0x00fa9aff, // mediumspringgreen
+    0x48d1ccff, // mediumturquoise
+    0xc71585ff, // mediumvioletred
+    0x191970ff, // midnightblue
+    0xf5fffaff, // mintcream
+    0xffe4e1ff, // mistyrose
+    0xffe4b5ff, // moccasin
+    0xffdeadff, // navajowhite
+    0x000080ff, // navy
+    0xfdf5e6ff, // oldlace
+    0x808000ff, // olive
+    0x6b8e23ff, // olivedrab
+    0xffa500ff, // orange
+    0xff4500ff, // orangered
+    0xda70d6ff, // orchid
+    0xeee8aaff, // palegoldenrod
+    0x98fb98ff, // palegreen
+    0xafeeeeff, // paleturquoise
+    0xdb7093ff, // palevioletred
+    0xffefd5ff, // papayawhip
+    0xffdab9ff, // peachpuff
+    0xcd853fff, // peru
+    0xffc0cbff, // pink
+    0xdda0ddff, // plum
+    0xb0e0e6ff, // powderblue
+    0x800080ff, // purple
+    0x663399ff, // rebeccapurple
+    0xff0000ff, // red
+    0xbc8f8fff, // rosybrown
+    0x4169e1ff, // royalblue
+    0x8b4513ff, // saddlebrown
+    0xfa8072ff, // salmon
+    0xf4a460ff, // sandybrown
+    0x2e8b57ff, // seagreen
+    0xfff5eeff, // seashell
+    0xa0522dff, // sienna
+    0xc0c0c0ff, // silver
+    0x87ceebff, // skyblue
+    0x6a5acdff, // slateblue
+    0x708090ff, // slategray
+    0x708090ff, // slategrey
+    0xfffafaff, // snow
+    0x00ff7fff, // springgreen
+    0x4682b4ff, // steelblue
+    0xd2b48cff, // tan
+    0x008080ff, // teal
+    0xd8bfd8ff, // thistle
+    0xff6347ff, // tomato
+    0x40e0d0ff, // turquoise
+    0xee82eeff, // violet
+    0xf5deb3ff, // wheat
+    0xffffffff, // white
+    0xf5f5f5ff, // whitesmoke
+    0xffff00ff, // yellow
+    0x9acd32ff, // yellowgreen
+};
+
+static int hex_digit(char c)
+{
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    return -1;
+}
+
+// `#rgb`, `#rgba`, `#rrggbb` and `#rrggbbaa`, without the `#`.
+static bool color_from_hex(const char* digits, CssColor* color)
+{
+    size_t length = strlen(digits);
+    if ( 3 != length && 4 != length && 6 != length && 8 != length )
+        return false;
+    unsigned int rgba = 0;
+    for ( size_t i = 0; i < length; i++ ) {
+        int digit = hex_digit(digits[i]);
+        if ( digit < 0 )
+            return false;
+        // A short form digit stands for both digits of its channel
+        rgba = length <= 4 ? (rgba << 8) | (unsigned int)(digit * 0x11) : (rgba << 4) | (unsigned int)digit;
+    }
+    if ( 3 == length || 6 == length )
+        rgba = (rgba << 8) | 0xff;
+    color->rgba = rgba;
+    color->form = CssColorHex;
+    color->digits = (unsigned char)length;
+    return true;
+}
+
+static unsigned int clamp_channel(double value, double max)
+{
+    if ( value <= 0 )
+        return 0;
+    if ( value >= max )
+        return 255;
+    return (unsigned int)(value * 255 / max + 0.5);
+}
+
+static bool channel(const CssValue* value, unsigned int* channel)
+{
+    switch ( value->unit ) {
+    case CSS_VALUE_NUMBER:
+        *channel = clamp_channel(value->fValue, 255);
+        return true;
+    case CSS_VALUE_PERCENTAGE:
+        *channel = clamp_channel(value->fValue, 100);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool alpha(const CssValue* value, unsigned int* alpha)
+{
+    switch ( value->unit ) {
+    case CSS_VALUE_NUMBER:
+        *alpha = clamp_channel(value->fValue, 1);
+        return true;
+    case CSS_VALUE_PERCENTAGE:
+        *alpha = clamp_channel(value->fValue, 100);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool hue(const CssValue* value, double* degrees)
+{
+    switch ( value->unit ) {
+    case CSS_VALUE_NUMBER:
+    case CSS_VALUE_DEG:
+        *degrees = value->fValue;
+        break;
+    case CSS_VALUE_RAD:
+        *degrees = value->fValue * 180 / 3.14159265358979323846;
+        break;
+    case CSS_VALUE_GRAD:
+        *degrees = value->fValue * 0.9;
+        break;
+    case CSS_VALUE_TURN:
+        *degrees = value->fValue * 360;
+        break;
+    default:
+        return false;
+    }
+    *degrees -= 360 * (double)(long long)(*degrees / 360);
+    if ( *degrees < 0 )
+        *degrees += 360;
+    return true;
+}
+
+static double hue_to_rgb(double t1, double t2, double hue)
+{
+    if ( hue < 0 )
+        hue += 6;
+    if ( hue >= 6 )
+        hue -= 6;
+    if ( hue < 1 )
+        return t1 + (t2 - t1) * hue;
+    if ( hue < 3 )
+        return t2;
+    if ( hue < 4 )
+        return t1 + (t2 - t1) * (4 - hue);
+    return t1;
+}
+
+static bool hsl_to_rgb(const CssValue* const components[3], unsigned int rgb[3])
+{
+    double h;
+    if ( !hue(components[0], &h)
+         || CSS_VALUE_PERCENTAGE != components[1]->unit
+         || CSS_VALUE_PERCENTAGE != components[2]->unit )
+        return false;
+    double s = components[1]->fValue < 0 ? 0 : components[1]->fValue > 100 ? 1 : components[1]->fValue / 100;
+    double l = components[2]->fValue < 0 ? 0 : components[2]->fValue > 100 ? 1 : components[2]->fValue / 100;
+    double t2 = l <= 0.5 ? l * (s + 1) : l + s - l * s;
+    double t1 = l * 2 - t2;
+    h /= 60;
+    rgb[0] = clamp_channel(hue_to_rgb(t1, t2, h + 2), 1);
+    rgb[1] = clamp_channel(hue_to_rgb(t1, t2, h), 1);
+    rgb[2] = clamp_channel(hue_to_rgb(t1, t2, h - 2), 1);
+    return true;
+}
+
+// Splits the arguments of a color function into three or four components,
+// all separated by commas, or by spaces with a `/` before the alpha.
+static size_t color_components(const CssArray* args, const CssValue* components[4])
+{
+    size_t count = 0;
+    size_t commas = 0;
+    bool slash = false;
+    for ( size_t i = 0; i < args->length; i++ ) {
+        const CssValue* value = args->data[i];
+        if ( CSS_VALUE_PARSER_OPERATOR != value->unit ) {
+            if ( 4 == count || (commas && commas != count) )
+                return 0;
+            components[count++] = value;
+        } else if ( ',' == value->iValue ) {
+            if ( slash || ++commas != count )
+                return 0;
+        } else if ( '/' == value->iValue ) {
+            if ( commas || slash || 3 != count )
+                return 0;
+            slash = true;
+        } else {
+            return 0;
+        }
+    }
+    if ( count < 3 || (commas && commas != count - 1) || (slash && 4 != count) || (!commas && !slash && 4 == count) )
+        return 0;
+    return count;
+}
+
+bool cssprsr_color_from_function(const char* name, size_t length, const CssArray* args, CssColor* color)
+{
+    // `name` ends with the `(`
+    CssColorForm form;
+    if ( (4 == length && 0 == strncasecmp(name, "rgb(", 4)) || (5 == length && 0 == strncasecmp(name, "rgba(", 5)) )
+        form = CssColorRgb;
+    else if ( (4 == length && 0 == strncasecmp(name, "hsl(", 4)) || (5 == length && 0 == strncasecmp(name, "hsla(", 5)) )
+        form = CssColorHsl;
+    else
+        return false;
+
+    const CssValue* components[4];
+    size_t count = NULL == args ? 0 : color_components(args, components);
+    if ( 0 == count )
+        return false;
+    unsigned int rgb[3];
+    if ( CssColorRgb == form ) {
+        for ( size_t i = 0; i < 3; i++ ) {
+            if ( !channel(components[i], &rgb[i]) )
+                return false;
+        }
+    } else if ( !hsl_to_rgb(components, rgb) ) {
+        return false;
+    }
+    unsigned int a = 255;
+    if ( 4 == count && !alpha(components[3], &a) )
+        return false;
+    color->rgba = rgb[0] << 24 | rgb[1] << 16 | rgb[2] << 8 | a;
+    color->form = (unsigned char)form;
+    color->digits = 0;
+    return true;
+}
+
+static bool color_from_keyword(CssValueID id, CssColor* color)
+{
+    if ( CssValueTransparent == id )
+        color->rgba = 0;
+    else if ( id >= CssValueAliceblue && id <= CssValueYellowgreen )
+        color->rgba = kNamedColors[id - CssValueAliceblue];
+    else
+        return false;
+    color->form = CssColorNamed;
+    color->digits = 0;
+    return true;
+}
+
+void cssprsr_value_resolve_hex_color(CssParser* parser, CssValue* value)
+{
+    CssColor color;
+    if ( CSS_VALUE_PARSER_HEXCOLOR != value->unit || !color_from_hex(value->string, &color) )
+        return;
+    cssprsr_parser_free(parser, (void*) value->string);
+    value->unit = CSS_VALUE_RGBCOLOR;
+    value->color = color;
+}
+
+static bool property_takes_color(CssPropertyID id)
+{
+    switch ( id ) {
+    case CssPropertyBackground:
+    case CssPropertyBackgroundColor:
+    case CssPropertyBackgroundImage:
+    case CssPropertyBorder:
+    case CssPropertyBorderBottom:
+    case CssPropertyBorderBottomColor:
+    case CssPropertyBorderColor:
+    case CssPropertyBorderLeft:
+    case CssPropertyBorderLeftColor:
+    case CssPropertyBorderRight:
+    case CssPropertyBorderRightColor:
+    case CssPropertyBorderTop:
+    case CssPropertyBorderTopColor:
+    case CssPropertyBoxShadow:
+    case CssPropertyCaretColor:
+    case CssPropertyColor:
+    case CssPropertyColumnRule:
+    case CssPropertyColumnRuleColor:
+    case CssPropertyOutline:
+    case CssPropertyOutlineColor:
+    case CssPropertyTextDecoration:
+    case CssPropertyTextDecorationColor:
+    case CssPropertyTextShadow:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void resolve_named_colors(CssParser* parser, CssArray* values)
+{
+    for ( size_t i = 0; i < values->length; i++ ) {
+        CssValue* value = values->data[i];
+        CssColor color;
+        switch ( value->unit ) {
+        case CSS_VALUE_IDENT:
+            if ( !color_from_keyword(value->id, &color) )
+                break;
+            if ( value->string != css_value_name(value->id) )
+                cssprsr_parser_free(parser, (void*) value->string);
+            value->unit = CSS_VALUE_RGBCOLOR;
+            value->color = color;
+            break;
+        case CSS_VALUE_PARSER_LIST:
+            if ( value->list )
+                resolve_named_colors(parser, value->list);
+            break;
+        case CSS_VALUE_PARSER_FUNCTION:
+            // Gradients and the like
+            if ( value->function->args )
+                resolve_named_colors(parser, value->function->args);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void cssprsr_declaration_resolve_named_colors(CssParser* parser, CssDeclaration* declaration)
+{
+    if ( declaration->values && property_takes_color(declaration->id) )
+        resolve_named_colors(parser, declaration->values);
+}
+
+// Alpha as the shortest decimal, of at most three digits, giving it back.
+static void append_alpha(unsigned int alpha, char* buffer, size_t size)
+{
+    for ( int digits = 0; digits <= 3; digits++ ) {
+        int scale = 1;
+        for ( int i = 0; i < digits; i++ )
+            scale *= 10;
+        int rounded = (int)((double)alpha * scale / 255 + 0.5);
+        if ( 3 == digits || clamp_channel((double)rounded / scale, 1) == alpha ) {
+            snprintf(buffer, size, "%g", (double)rounded / scale);
+            return;
+        }
+    }
+}
+
+void cssprsr_color_to_string(const CssValue* value, char* buffer, size_t size)
+{
+    unsigned int rgba = value->color.rgba;
+    unsigned int r = rgba >> 24, g = (rgba >> 16) & 0xff, b = (rgba >> 8) & 0xff, a = rgba & 0xff;
+    switch ( value->color.form ) {
+    case CssColorHex:
+        switch ( value->color.digits ) {
+        case 3:
+            snprintf(buffer, size, "#%x%x%x", r >> 4, g >> 4, b >> 4);
+            break;
+        case 4:
+            snprintf(buffer, size, "#%x%x%x%x", r >> 4, g >> 4, b >> 4, a >> 4);
+            break;
+        case 6:
+            snprintf(buffer, size, "#%02x%02x%02x", r, g, b);
+            break;
+        default:
+            snprintf(buffer, size, "#%02x%02x%02x%02x", r, g, b, a);
+            break;
+        }
+        break;
+    case CssColorNamed:
+        snprintf(buffer, size, "%s", css_value_name(value->id));
+        break;
+    default:
+        // rgb() and hsl() serialize as rgb(), as in CSSOM
+        if ( 255 == a ) {
+            snprintf(buffer, size, "rgb(%u, %u, %u)", r, g, b);
+        } else {
+            char alpha_string[16];
+            append_alpha(a, alpha_string, sizeof(alpha_string));
+            snprintf(buffer, size, "rgba(%u, %u, %u, %s)", r, g, b, alpha_string);
+        }
+        break;
+    }
+}
+
+#if CSSPRSR_RPARSER_DEBUG
+
+void test_named_colors()
+{
+    assert(sizeof(kNamedColors) / sizeof(kNamedColors[0]) == CssValueYellowgreen - CssValueAliceblue + 1);
+    assert(CssValueCount == CssValueYellowgreen + 1);
+}
+
+#endif // #if CSSPRSR_RPARSER_DEBUG
@@ -22,10 +22,13 @@
 #include <strings.h>
 
 #include "selector.h"
+#include "charset.h"
 #include "cssparser_i.h"
 
 #define CSS_PARSER_STRING(literal) { literal, sizeof(literal) - 1 }
 
+static const CssSourceRange kCssEmptyRange = { 0, 0 };
+
 
 typedef void (*CssArrayDeallocator)(CssParser* parser, void* e);
 
@@ -61,16 +64,21 @@ extern int cssparse(void* scanner, struct CssInternalParser * parser);
 static CssOutput* cssprsr_parse_with_options(const CssOptions* options,
                                                yyconst char* bytes,
                                                size_t len,
-                                               CssParserMode mode);
+                                               CssParserMode mode,
+                                               unsigned int flags,
+                                               bool piece);
 
 static CssOutput* cssprsr_parse_fragment(const char* prefix,
                                            size_t pre_len,
                                            const char* string,
                                            size_t str_len,
-                                           CssParserMode mode);
+                                           CssParserMode mode,
+                                           unsigned int flags);
 
+static void cssprsr_parser_resolve_errors(CssParser* parser);
 static const char* cssprsr_stringify_value_list(CssParser* parser, CssArray* value_list);
 static const char* cssprsr_stringify_value(CssParser* parser, CssValue* value);
+static const char* cssprsr_declaration_value_text(CssParser* parser, bool important, CSSPARSERLTYPE* loc);
 
 static void* malloc_wrapper(void* unused, size_t size) {
     return malloc(size);
@@ -90,11 +98,27 @@ static void output_init(CssParser* parser, CssParserMode mode)
 {
     CssOutput* output = cssprsr_parser_alloc(parser, sizeof(CssOutput));
     output->stylesheet = cssprsr_new_stylesheet(parser);
+    output->rule = NULL;
     output->mode = mode;
+    output->flags = parser->flags;
+    output->source = NULL;
+    output->source_length = 0;
     cssprsr_array_init(parser, 0, &output->errors);
     parser->output = output;
 }
 
+static void output_keep_source(CssParser* parser, const char* source, size_t length)
+{
+    // Fragments are passed to the scanner NUL terminated.
+    while ( length > 0 && source[length - 1] == '\0' )
+        length--;
+    char* copy = cssprsr_parser_alloc(parser, length + 1);
+    memcpy(copy, source, length);
+    copy[length] = '\0';
+    parser->output->source = copy;
+    parser->output->source_length = length;
+}
+
 void css_destroy_output(CssOutput* output)
 {
     CssParser parser;
@@ -147,7 +171,12 @@ void css_destroy_output(CssOutput* output)
         break;
     }
     cssprsr_destroy_stylesheet(&parser, output->stylesheet);
+    for (size_t i = 0; i < output->errors.length; ++i) {
+        free(output->errors.data[i]);
+    }
     cssprsr_array_destroy(&parser, &output->errors);
+    if ( output->source )
+        cssprsr_parser_free(&parser, (void*) output->source);
     cssprsr_parser_free(&parser, output);
 }
 
@@ -164,10 +193,46 @@ static const CssParserString kCssParserModePrefixs[] = {
 };
 
 CssOutput* css_parse_string(const char* str, size_t len, CssParserMode mode)
+{
+    return css_parse_string_with_flags(str, len, mode, CssParserFlagNone);
+}
+
+CssOutput* css_parse_string_with_flags(const char* str, size_t len, CssParserMode mode, unsigned int flags)
+{
+    // Fragments are expected to be decoded by the caller already.
+    if ( CssParserModeStylesheet != mode )
+        return cssprsr_parse_string(str, len, mode, flags);
+
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    size_t bom_length = 0;
+    CssEncoding encoding = cssprsr_detect_encoding(str, len, &bom_length);
+    size_t decoded_length = 0;
+    // Ranges and error offsets count bytes of the text actually parsed,
+    // without the byte order mark and after decoding.
+    char* decoded = cssprsr_decode_input(&parser, str + bom_length, len - bom_length, encoding, &decoded_length);
+    CssOutput* output = NULL;
+    if ( NULL == decoded ) {
+        output = cssprsr_parse_string(str + bom_length, len - bom_length, mode, flags);
+    } else {
+        output = cssprsr_parse_string(decoded, decoded_length, mode, flags);
+        cssprsr_parser_free(&parser, decoded);
+    }
+    if ( NULL != output ) {
+        const char* name = cssprsr_encoding_name(encoding);
+        size_t name_length = strlen(name);
+        char* copy = cssprsr_parser_alloc(&parser, name_length + 1);
+        memcpy(copy, name, name_length + 1);
+        output->stylesheet->encoding = copy;
+    }
+    return output;
+}
+
+CssOutput* cssprsr_parse_string(const char* str, size_t len, CssParserMode mode, unsigned int flags)
 {
     switch (mode) {
     case CssParserModeStylesheet:
-        return cssprsr_parse_with_options(&kCssDefaultOptions, (yyconst char*)str, len, mode);
+        return cssprsr_parse_with_options(&kCssDefaultOptions, (yyconst char*)str, len, mode, flags, false);
     case CssParserModeRule:
     case CssParserModeKeyframeRule:
     case CssParserModeKeyframeKeyList:
@@ -176,7 +241,7 @@ CssOutput* css_parse_string(const char* str, size_t len, CssParserMode mode)
     case CssParserModeSelector:
     case CssParserModeDeclarationList: {
         CssParserString prefix = kCssParserModePrefixs[mode];
-        return cssprsr_parse_fragment(prefix.data, prefix.length, str, len, mode);
+        return cssprsr_parse_fragment(prefix.data, prefix.length, str, len, mode, flags);
     }
     default:
         cssprsr_print("Whoops, not support yet!");
@@ -184,36 +249,43 @@ CssOutput* css_parse_string(const char* str, size_t len, CssParserMode mode)
     }
 }
 
-CssOutput* css_parse_file(FILE* fp)
+// Reads the whole stream into memory, the scanner reports byte offsets into
+// a single buffer so the file is not fed to it piecewise.
+static char* cssprsr_read_file(FILE* fp, size_t* length)
 {
-    yyscan_t scanner;
-    if (cssprsr_lex_init(&scanner)) {
-        cssprsr_print("no scanning today!");
+    size_t capacity = 4096, len = 0, n;
+    char* data = malloc_wrapper(NULL, capacity);
+    if ( NULL == data )
         return NULL;
+    while ( (n = fread(data + len, 1, capacity - len, fp)) > 0 ) {
+        len += n;
+        if ( len == capacity ) {
+            char* grown = realloc(data, capacity * 2);
+            if ( NULL == grown ) {
+                free_wrapper(NULL, data);
+                return NULL;
+            }
+            data = grown;
+            capacity *= 2;
+        }
     }
-    
-    cssprsr_set_in(fp, scanner);
-    
-    CssParser parser;
-    parser.options = &kCssDefaultOptions;
-    parser.scanner = &scanner;
-    parser.default_namespace = cssAsteriskString;
-    parser.parsed_declarations = cssprsr_new_array(&parser);
-#if CSSPRSR_RPARSER_DEBUG
-    parser.parsed_selectors = cssprsr_new_array(&parser);
-#endif // #if CSSPRSR_RPARSER_DEBUG
-    parser.position = cssprsr_parser_alloc(&parser, sizeof(CssSourcePosition));
-    output_init(&parser, CssParserModeStylesheet);
-    cssparse(scanner, &parser);
-    cssprsr_lex_destroy(scanner);
-    cssprsr_parser_clear_declarations(&parser);
-    cssprsr_parser_free(&parser, parser.position);
-#if CSSPRSR_RPARSER_DEBUG
-    cssprsr_destroy_array(&parser, cssprsr_destroy_selector, parser.parsed_selectors);
-    cssprsr_parser_free(&parser, parser.parsed_selectors);
-#endif // #if CSSPRSR_RPARSER_DEBUG
-    parser.scanner = NULL;
-    CssOutput* output = parser.output;
+    *length = len;
+    return data;
+}
+
+CssOutput* css_parse_file(FILE* fp)
+{
+    return css_parse_file_with_flags(fp, CssParserFlagNone);
+}
+
+CssOutput* css_parse_file_with_flags(FILE* fp, unsigned int flags)
+{
+    size_t len = 0;
+    char* source = cssprsr_read_file(fp, &len);
+    if ( NULL == source )
+        return NULL;
+    CssOutput * output = css_parse_string_with_flags(source, len, CssParserModeStylesheet, flags);
+    free_wrapper(NULL, source);
     return output;
 }
 
@@ -222,7 +294,8 @@ static CssOutput* cssprsr_parse_fragment(const char* prefix,
                                         size_t pre_len,
                                         const char* str,
                                         size_t str_len,
-                                        CssParserMode mode) {
+                                        CssParserMode mode,
+                                        unsigned int flags) {
     size_t len = pre_len + str_len + 1;
     char * source = malloc_wrapper(NULL, len);
     if ( source == NULL )
@@ -230,7 +303,7 @@ static CssOutput* cssprsr_parse_fragment(const char* prefix,
     memcpy(source, prefix, pre_len);
     memcpy(source+pre_len, str, str_len);
     source[pre_len + str_len] = '\0';
-    CssOutput * output = cssprsr_parse_with_options(&kCssDefaultOptions, (void*)source, len, mode);
+    CssOutput * output = cssprsr_parse_with_options(&kCssDefaultOptions, (void*)source, len, mode, flags, false);
     free_wrapper(NULL, source);
     return output;
 }
@@ -238,7 +311,9 @@ static CssOutput* cssprsr_parse_fragment(const char* prefix,
 static CssOutput* cssprsr_parse_with_options(const CssOptions* options,
                                             yyconst char* bytes,
                                             size_t len,
-                                            CssParserMode mode) {
+                                            CssParserMode mode,
+                                            unsigned int flags,
+                                            bool piece) {
     if ( NULL == bytes )
         return NULL;
 
@@ -259,12 +334,35 @@ static CssOutput* cssprsr_parse_with_options(const CssOptions* options,
     parser.parsed_selectors = cssprsr_new_array(&parser);
 #endif // #if CSSPRSR_RPARSER_DEBUG
     parser.position = cssprsr_parser_alloc(&parser, sizeof(CssSourcePosition));
+    parser.source = bytes;
+    parser.source_length = len;
+    parser.source_prefix = (unsigned int)kCssParserModePrefixs[mode].length;
+    parser.lines = NULL;
+    parser.flags = flags;
+    parser.unescaped_texts = NULL;
+    parser.has_pending_token = false;
+    parser.last_token = 0;
+    parser.skip_until = 0;
+    parser.token_count = 0;
+    parser.early_error = false;
     output_init(&parser, mode);
+    if ( flags & CssParserFlagSourceRanges ) {
+        output_keep_source(&parser, bytes + parser.source_prefix, len - parser.source_prefix);
+    }
     cssparse(scanner, &parser);
     cssprsr_lex_destroy(scanner);
     if ( CssParserModeDeclarationList != mode ) {
         cssprsr_parser_clear_declarations(&parser);
     }
+    cssprsr_parser_resolve_errors(&parser);
+    cssprsr_line_index_destroy(&parser, parser.lines);
+    if ( parser.unescaped_texts ) {
+        for (size_t i = 0; i < parser.unescaped_texts->length; ++i) {
+            cssprsr_parser_free(&parser, parser.unescaped_texts->data[i]);
+        }
+        cssprsr_array_destroy(&parser, parser.unescaped_texts);
+        cssprsr_parser_free(&parser, parser.unescaped_texts);
+    }
     cssprsr_parser_free(&parser, parser.position);
 #if CSSPRSR_RPARSER_DEBUG
     cssprsr_destroy_array(&parser, cssprsr_destroy_selector, parser.parsed_selectors);
@@ -272,9 +370,19 @@ static CssOutput* cssprsr_parse_with_options(const CssOptions* options,
 #endif // #if CSSPRSR_RPARSER_DEBUG
     parser.scanner = NULL;
     CssOutput* output = parser.output;
+    if ( piece && parser.early_error ) {
+        css_destroy_output(output);
+        return NULL;
+    }
     return output;
 }
 
+CssOutput* cssprsr_parse_piece(const char* str, size_t len, unsigned int flags)
+{
+    return cssprsr_parse_with_options(&kCssDefaultOptions, (yyconst char*)str, len,
+                                      CssParserModeStylesheet, flags, true);
+}
+
 
 void cssprsr_parse_internal_rule(CssParser* parser, CssRule* e)
 {
@@ -397,6 +505,7 @@ CssRule* cssprsr_new_style_rule(CssParser* parser, CssArray* selectors)
     CssStyleRule* rule = cssprsr_parser_alloc(parser, sizeof(CssStyleRule));
     rule->base.name = "style";
     rule->base.type = CssRuleStyle;
+    rule->base.range = kCssEmptyRange;
     rule->selectors = selectors;
     // Do not check parser->parsed_declarations, when we encounter something like `selectors {}`, treat it as valid.
     rule->declarations = parser->parsed_declarations;
@@ -428,6 +537,7 @@ CssRule* cssprsr_new_font_face(CssParser* parser)
     CssFontFaceRule* rule = cssprsr_parser_alloc(parser, sizeof(CssFontFaceRule));
     rule->base.name = "font-face";
     rule->base.type = CssRuleFontFace;
+    rule->base.range = kCssEmptyRange;
     rule->declarations = parser->parsed_declarations;
     cssprsr_parser_reset_declarations(parser);
     return (CssRule*)rule;
@@ -446,6 +556,7 @@ CssRule* cssprsr_new_keyframes_rule(CssParser* parser, CssParserString* name, Cs
     CssKeyframesRule * rule = cssprsr_parser_alloc(parser, sizeof(CssKeyframesRule));
     rule->base.name = "keyframes";
     rule->base.type = CssRuleKeyframes;
+    rule->base.range = kCssEmptyRange;
     rule->name = cssprsr_string_to_characters(parser, name);
     rule->keyframes = keyframes;
     return (CssRule*)rule;
@@ -462,6 +573,7 @@ CssKeyframe* cssprsr_new_keyframe(CssParser* parser, CssArray* selectors)
 {
     CssKeyframe* keyframe = cssprsr_parser_alloc(parser, sizeof(CssKeyframe));
     keyframe->selectors = selectors;
+    keyframe->range = kCssEmptyRange;
     keyframe->declarations = parser->parsed_declarations;
     cssprsr_parser_reset_declarations(parser);
     return keyframe;
@@ -495,7 +607,7 @@ void cssprsr_parser_clear_keyframes(CssParser* parser, CssArray* keyframes)
 
 void cssprsr_set_charset(CssParser* parser, CssParserString* charset)
 {
-    // parser->output->stylesheet->encoding = cssprsr_string_to_characters(parser, charset);
+    // The encoding is detected before scanning, see cssprsr_detect_encoding().
 }
 
 
@@ -504,6 +616,7 @@ CssRule* cssprsr_new_import_rule(CssParser* parser, CssParserString* href, CssAr
     CssImportRule* rule = cssprsr_parser_alloc(parser, sizeof(CssImportRule));
     rule->base.name = "import";
     rule->base.type = CssRuleImport;
+    rule->base.range = kCssEmptyRange;
     rule->href = cssprsr_string_to_characters(parser, href);
     rule->medias = media;
     return (CssRule*)rule;
@@ -527,8 +640,12 @@ CssValue* cssprsr_new_value(CssParser* parser)
 void cssprsr_destroy_value(CssParser* parser, CssValue* e)
 {
     switch (e->unit) {
-    case CSS_VALUE_URI:
     case CSS_VALUE_IDENT:
+        // Lowercase keywords point into the name table
+        if ( e->string && e->string != css_value_name(e->id) )
+            cssprsr_parser_free(parser, (void*) e->string);
+        break;
+    case CSS_VALUE_URI:
     case CSS_VALUE_STRING:
     case CSS_VALUE_DIMENSION:
     case CSS_VALUE_UNICODE_RANGE:
@@ -548,6 +665,9 @@ void cssprsr_destroy_value(CssParser* parser, CssValue* e)
             cssprsr_destroy_function(parser, e->function);
         }
         break;
+    case CSS_VALUE_CALC:
+        cssprsr_destroy_calc(parser, e->calc);
+        break;
     case CSS_VALUE_NUMBER:
     case CSS_VALUE_PERCENTAGE:
     case CSS_VALUE_PX:
@@ -641,19 +761,39 @@ CssValue* cssprsr_new_operator_value(CssParser* parser, int value)
 CssValue* cssprsr_new_ident_value(CssParser* parser, CssParserString* value)
 {
     CssValue* v = cssprsr_new_value(parser);
-    v->id = CssValueCustom;
+    CssValueID id = cssprsr_value_id(value->data, value->length);
+    v->id = CssValueInvalid == id ? CssValueCustom : id;
     v->isInt = false;
     v->unit = CSS_VALUE_IDENT;
-    v->string = cssprsr_string_to_characters(parser, value);
+    const char* name = css_value_name(id);
+    if ( NULL != name && 0 == strncmp(name, value->data, value->length) )
+        v->string = name;
+    else
+        v->string = cssprsr_string_to_characters(parser, value);
     return v;
 }
 
 CssValue* cssprsr_new_function_value(CssParser* parser, CssParserString* name, CssArray* args)
 {
-    CssValueFunction* func = cssprsr_new_function(parser, name, args);
     CssValue* value = cssprsr_new_value(parser);
+    value->id = CssValueInvalid;
+    value->isInt = false;
+    value->raw = NULL;
+    if ( cssprsr_color_from_function(name->data, name->length, args, &value->color) ) {
+        cssprsr_destroy_array(parser, cssprsr_destroy_value, args);
+        cssprsr_parser_free(parser, (void*) args);
+        value->unit = CSS_VALUE_RGBCOLOR;
+        return value;
+    }
+    value->calc = cssprsr_calc_from_function(parser, name, args);
+    if ( NULL != value->calc ) {
+        cssprsr_destroy_array(parser, cssprsr_destroy_value, args);
+        cssprsr_parser_free(parser, (void*) args);
+        value->unit = CSS_VALUE_CALC;
+        return value;
+    }
     value->unit = CSS_VALUE_PARSER_FUNCTION;
-    value->function = func;
+    value->function = cssprsr_new_function(parser, name, args);
     return value;
 }
 
@@ -665,6 +805,59 @@ CssValue* cssprsr_new_list_value(CssParser* parser, CssArray* list)
     return value;
 }
 
+static const char* copy_characters(CssParser* parser, const char* characters)
+{
+    CssParserString string = { (char*)characters, strlen(characters), 0 };
+    return cssprsr_string_to_characters(parser, &string);
+}
+
+static CssArray* copy_value_list(CssParser* parser, const CssArray* values)
+{
+    if ( NULL == values )
+        return NULL;
+    CssArray* copy = cssprsr_new_array(parser);
+    for (size_t i = 0; i < values->length; ++i)
+        cssprsr_array_add(parser, cssprsr_copy_value(parser, values->data[i]), copy);
+    return copy;
+}
+
+// Owns what cssprsr_destroy_value() frees, so both can be destroyed.
+CssValue* cssprsr_copy_value(CssParser* parser, const CssValue* value)
+{
+    CssValue* copy = cssprsr_new_value(parser);
+    *copy = *value;
+    switch ( value->unit ) {
+    case CSS_VALUE_IDENT:
+        if ( value->string != css_value_name(value->id) )
+            copy->string = copy_characters(parser, value->string);
+        break;
+    case CSS_VALUE_URI:
+    case CSS_VALUE_STRING:
+    case CSS_VALUE_DIMENSION:
+    case CSS_VALUE_UNICODE_RANGE:
+    case CSS_VALUE_PARSER_HEXCOLOR:
+        copy->string = copy_characters(parser, value->string);
+        break;
+    case CSS_VALUE_PARSER_LIST:
+        copy->list = copy_value_list(parser, value->list);
+        break;
+    case CSS_VALUE_PARSER_FUNCTION:
+        copy->function = cssprsr_parser_alloc(parser, sizeof(CssValueFunction));
+        copy->function->name = copy_characters(parser, value->function->name);
+        copy->function->args = copy_value_list(parser, value->function->args);
+        break;
+    case CSS_VALUE_CALC:
+        copy->calc = cssprsr_copy_calc(parser, value->calc);
+        break;
+    default:
+        // Numbers own their text
+        if ( CssUnitNone != css_unit_kind(value->unit) || CSS_VALUE_FR == value->unit )
+            copy->raw = value->raw ? copy_characters(parser, value->raw) : NULL;
+        break;
+    }
+    return copy;
+}
+
 void cssprsr_value_set_string(CssParser* parser, CssValue* value, CssParserString* string)
 {
     value->string = cssprsr_string_to_characters(parser, string);
@@ -707,37 +900,70 @@ void cssprsr_value_list_add(CssParser* parser, CssValue* value, CssArray* list)
     assert(NULL != value);
     if ( value == NULL)
         return;
+    cssprsr_value_resolve_hex_color(parser, value);
     cssprsr_array_add(parser, value, list);
 }
 
 
 void cssprsr_value_list_steal_values(CssParser* parser, CssArray* values, CssArray* list)
 {
-    if ( values && values->length ) {
+    if ( values ) {
         for (size_t i = 0; i < values->length; ++i)
             cssprsr_value_list_add(parser, values->data[i], list);
+        cssprsr_array_destroy(parser, values);
         cssprsr_parser_free(parser, (void*) values);
     }
 }
 
 
-bool cssprsr_new_declaration(CssParser* parser, CssParserString* name, bool important, CssArray* values)
+bool cssprsr_new_declaration(CssParser* parser, CssParserString* name, bool important, CssArray* values, CSSPARSERLTYPE* loc)
 {
     CssDeclaration * decl = cssprsr_parser_alloc(parser, sizeof(CssDeclaration));
     decl->property = cssprsr_string_to_characters(parser, name);
+    decl->id = cssprsr_property_id(decl->property, &decl->vendor);
     decl->important = important;
     decl->values = values;
+    cssprsr_declaration_resolve_named_colors(parser, decl);
     decl->raw = cssprsr_stringify_value_list(parser, values);
+    decl->range = kCssEmptyRange;
+    cssprsr_parser_set_range(parser, &decl->range, loc);
+    decl->string = NULL;
+    if ( CssPropertyCustom == decl->id || cssprsr_values_have_var(values) )
+        decl->string = cssprsr_declaration_value_text(parser, important, loc);
+    if ( (parser->flags & CssParserFlagExpandShorthands) &&
+         cssprsr_expand_shorthand(parser, decl, parser->parsed_declarations) ) {
+        cssprsr_destroy_declaration(parser, decl);
+        return true;
+    }
     cssprsr_array_add(parser, decl, parser->parsed_declarations);
     return true;
 }
 
 
+CssDeclaration* cssprsr_new_longhand_declaration(CssParser* parser, const CssDeclaration* shorthand,
+                                                 CssPropertyID id, CssArray* values)
+{
+    CssDeclaration * decl = cssprsr_parser_alloc(parser, sizeof(CssDeclaration));
+    decl->property = copy_characters(parser, css_property_name(id));
+    decl->id = id;
+    decl->vendor = shorthand->vendor;
+    decl->important = shorthand->important;
+    decl->values = values;
+    decl->string = NULL;
+    decl->raw = cssprsr_stringify_value_list(parser, values);
+    // The longhands all come from the text of the shorthand
+    decl->range = shorthand->range;
+    return decl;
+}
+
+
 void cssprsr_destroy_declaration(CssParser* parser, CssDeclaration* e)
 {
     cssprsr_destroy_array(parser, cssprsr_destroy_value, e->values);
     cssprsr_parser_free(parser, (void*) e->values);
     cssprsr_parser_free(parser, (void*) e->raw);
+    if ( e->string )
+        cssprsr_parser_free(parser, (void*) e->string);
     cssprsr_parser_free(parser, (void*) e->property);
     cssprsr_parser_free(parser, (void*) e);
 }
@@ -763,6 +989,7 @@ CssRule* cssprsr_new_media_rule(CssParser* parser, CssArray* medias, CssArray* r
         CssMediaRule* rule = cssprsr_parser_alloc(parser, sizeof(CssMediaRule));
         rule->base.name = "media";
         rule->base.type = CssRuleMedia;
+        rule->base.range = kCssEmptyRange;
         rule->medias = medias;
         rule->rules = rules;
         return (CssRule*)rule;
@@ -805,6 +1032,7 @@ CssMediaQuery* cssprsr_new_media_query(CssParser* parser, CssMediaQueryRestricto
     media_query->restrictor = r;
     media_query->type = type == NULL ? NULL : cssprsr_string_to_characters(parser, type);
     media_query->expressions = exps;
+    media_query->ignored = false;
     return media_query;
 }
 
@@ -866,7 +1094,7 @@ CssArray* cssprsr_new_rule_list(CssParser* parser)
 CssArray* cssprsr_rule_list_add(CssParser* parser, CssRule* rule, CssArray* rule_list)
 {
     if ( rule ) {
-        if ( rule_list )
+        if ( !rule_list )
             rule_list = cssprsr_new_rule_list(parser);
         cssprsr_array_add(parser, rule, rule_list);
     }
@@ -966,6 +1194,7 @@ CssSelector* cssprsr_new_selector(CssParser* parser)
     selector->specificity = 0;
     selector->tag = NULL;
     selector->tagHistory = NULL;
+    selector->range = kCssEmptyRange;
 #if CSSPRSR_RPARSER_DEBUG
     cssprsr_array_add(parser, selector, parser->parsed_selectors);
 #endif
@@ -1116,8 +1345,11 @@ void cssprsr_selector_list_shink(CssParser* parser, int capacity, CssArray* list
 
 void cssprsr_selector_list_add(CssParser* parser, CssSelector* selector, CssArray* list)
 {
-    if ( selector )
+    if ( selector ) {
+        // The selector is complete, and so are the lists nested in it.
+        selector->specificity = cssprsr_selector_calc_specificity(selector);
         cssprsr_array_add(parser, selector, list);
+    }
 }
 
 
@@ -1143,8 +1375,34 @@ void cssprsr_selector_set_argument(CssParser* parser, CssSelector* selector, Css
 }
 
 
-bool cssprsr_parse_attribute_match_type(CssParser* parser, CssAttributeMatchType type, CssParserString* attr)
+void cssprsr_selector_set_nth_argument(CssParser* parser, CssSelector* selector, CssParserString* argument)
+{
+    selector->data->argument = cssprsr_string_to_characters(parser, argument);
+    CssPseudoType type = cssprsr_parse_pseudo_type(selector->data->value, true);
+    int a, b;
+    const char* of = NULL;
+    if ( (CssPseudoNthChild != type && CssPseudoNthLastChild != type)
+         || !cssprsr_parse_nth(selector->data->argument, &a, &b, &of) || NULL == of )
+        return;
+    // S of `An+B of S` is a selector list of its own, one that does not
+    // parse leaves the selectors unset and the pseudo-class unknown
+    CssOutput* output = cssprsr_parse_string(of, strlen(of), CssParserModeSelector, CssParserFlagNone);
+    if ( NULL == output )
+        return;
+    if ( 0 == output->errors.length && NULL != output->selectors && output->selectors->length ) {
+        cssprsr_adopt_selector_list(parser, output->selectors, selector);
+        output->selectors = NULL;
+    }
+    css_destroy_output(output);
+}
+
+
+bool cssprsr_parse_attribute_match_type(CssParser* parser, CssAttributeMatchType* type, CssParserString* attr)
 {
+    // Only the `i` flag is known, as in `[type="a" i]`
+    if ( 1 != attr->length || 'i' != tolower(attr->data[0]) )
+        return false;
+    *type = CssAMTCaseInsensitive;
     return true;
 }
 
@@ -1230,25 +1488,28 @@ void cssprsr_error(YYLTYPE* yyloc, void* scanner, struct CssInternalParser * par
 {
 #ifdef CSSPRSR_RPARSER_DEBUG
 #   if CSSPRSR_RPARSER_DEBUG
-    cssprsr_print("[Error] %d.%d - %d.%d: %s at %s\n",
-           yyloc->first_line,
-           yyloc->first_column,
-           yyloc->last_line,
-           yyloc->last_column,
+    cssprsr_print("[Error] %u - %u: %s at %s\n",
+           cssprsr_parser_offset(parser, yyloc->first_offset),
+           cssprsr_parser_offset(parser, yyloc->last_offset),
            error,
-           cssprsr_get_text(parser->scanner));
+           cssprsr_get_text(scanner));
 
-    YYSTYPE * s = cssprsr_get_lval(parser->scanner);
+    YYSTYPE * s = cssprsr_get_lval(scanner);
 #   endif
 #endif
 
+    if ( parser->token_count <= 3 )
+        parser->early_error = true;
+
     CssError *e = (CssError *)malloc(sizeof(CssError));
     e->type = CssParseError;
-    e->first_line = yyloc->first_line;
-    e->first_column = yyloc->first_column;
-    e->last_line = yyloc->last_line;
-    e->last_column = yyloc->last_column;
-    snprintf(e->message, CSS_ERROR_MSG_SIZE, "%s at %s", error, cssprsr_get_text(parser->scanner));
+    // Lines and columns are filled in once parsing is done, see
+    // cssprsr_parser_resolve_errors().
+    e->first_line = e->last_line = 0;
+    e->first_column = e->last_column = 0;
+    e->first_offset = cssprsr_parser_offset(parser, yyloc->first_offset);
+    e->last_offset = cssprsr_parser_offset(parser, yyloc->last_offset);
+    snprintf(e->message, CSS_ERROR_MSG_SIZE, "%s at %s", error, cssprsr_get_text(scanner));
     cssprsr_array_add(parser, e, &(parser->output->errors));
 }
 
@@ -1279,7 +1540,8 @@ void cssprsr_parser_report_error(CssParser* parser, CssSourcePosition* pos, cons
 {
 #ifdef CSSPRSR_RPARSER_DEBUG
 #   if CSSPRSR_RPARSER_DEBUG
-    printf("[ERROR] %d.%d - %d.%d : ", pos->line, pos->column, cssprsr_get_lineno(*parser->scanner), cssprsr_get_column(*parser->scanner) );
+    cssprsr_parser_resolve_position(parser, pos);
+    printf("[ERROR] %u.%u : ", pos->line, pos->column);
     va_list args;
     va_start(args, format);
     vprintf(format, args);
@@ -1293,24 +1555,145 @@ void cssprsr_parser_report_error(CssParser* parser, CssSourcePosition* pos, cons
 
 void cssprsr_print_position(YYLTYPE* yyloc)
 {
-    cssprsr_print(NULL,
-        "Loaction %d.%d - %d.%d",
-        yyloc->first_line,
-        yyloc->first_column,
-        yyloc->last_line,
-        yyloc->last_column
+    cssprsr_print("Loaction %u - %u",
+        yyloc->first_offset,
+        yyloc->last_offset
         );
 }
 
 
 CssSourcePosition* cssprsr_parser_current_location(CssParser* parser, CSSPARSERLTYPE* yylloc)
 {
-    parser->position->line = cssprsr_get_lineno(*parser->scanner);
-    parser->position->column = cssprsr_get_column(*parser->scanner);
+    // Only the offset is recorded here, see cssprsr_parser_resolve_position().
+    parser->position->line = 0;
+    parser->position->column = 0;
+    parser->position->offset = cssprsr_parser_offset(parser, yylloc->first_offset);
     return parser->position;
 }
 
 
+unsigned int cssprsr_parser_offset(CssParser* parser, unsigned int offset)
+{
+    return offset > parser->source_prefix ? offset - parser->source_prefix : 0;
+}
+
+
+CssLineIndex* cssprsr_parser_line_index(CssParser* parser)
+{
+    if ( NULL == parser->lines ) {
+        size_t prefix = parser->source_prefix;
+        size_t length = parser->source_length > prefix ? parser->source_length - prefix : 0;
+        parser->lines = cssprsr_line_index_new(parser, parser->source + prefix, length);
+    }
+    return parser->lines;
+}
+
+
+void cssprsr_parser_resolve_position(CssParser* parser, CssSourcePosition* pos)
+{
+    cssprsr_line_index_lookup(cssprsr_parser_line_index(parser), pos->offset, &pos->line, &pos->column);
+}
+
+
+static void cssprsr_parser_trim_location(CssParser* parser, CSSPARSERLTYPE* loc, size_t* out_start, size_t* out_end)
+{
+    // Locations of nonterminals may start with whitespace or comments left
+    // over from the previous token and end with trailing whitespace.
+    const char* s = parser->source;
+    size_t start = loc->first_offset;
+    size_t end = loc->last_offset < parser->source_length ? loc->last_offset : parser->source_length;
+    while ( start < end ) {
+        if ( isspace((unsigned char)s[start]) ) {
+            start++;
+        } else if ( start + 1 < end && s[start] == '/' && s[start + 1] == '*' ) {
+            const char* close = NULL;
+            for (size_t i = start + 2; i + 1 < end; ++i) {
+                if ( s[i] == '*' && s[i + 1] == '/' ) {
+                    close = s + i;
+                    break;
+                }
+            }
+            start = close ? (size_t)(close - s) + 2 : end;
+        } else {
+            break;
+        }
+    }
+    while ( end > start ) {
+        if ( isspace((unsigned char)s[end - 1]) || s[end - 1] == '\0' ) {
+            end--;
+        } else if ( end - start >= 4 && s[end - 1] == '/' && s[end - 2] == '*' ) {
+            size_t i = end - 2;
+            while ( i > start && !(s[i - 1] == '/' && s[i] == '*') )
+                i--;
+            if ( i == start )
+                break;
+            end = i - 1;
+        } else {
+            break;
+        }
+    }
+    *out_start = start;
+    *out_end = end;
+}
+
+
+void cssprsr_parser_set_range(CssParser* parser, CssSourceRange* range, CSSPARSERLTYPE* loc)
+{
+    if ( !(parser->flags & CssParserFlagSourceRanges) )
+        return;
+
+    size_t start, end;
+    cssprsr_parser_trim_location(parser, loc, &start, &end);
+    range->start = cssprsr_parser_offset(parser, (unsigned int)start);
+    range->end = cssprsr_parser_offset(parser, (unsigned int)end);
+}
+
+
+// The value of a declaration as written: after the colon, without the
+// `!important` and the surrounding whitespace. Custom properties keep it
+// since their values are only known once var() is substituted.
+static const char* cssprsr_declaration_value_text(CssParser* parser, bool important, CSSPARSERLTYPE* loc)
+{
+    const char* s = parser->source;
+    size_t start, end;
+    cssprsr_parser_trim_location(parser, loc, &start, &end);
+    while ( start < end && s[start] != ':' )
+        start++;
+    if ( start < end )
+        start++;
+    if ( important ) {
+        while ( end > start && s[end - 1] != '!' )
+            end--;
+        if ( end > start )
+            end--;
+    }
+    while ( start < end && isspace((unsigned char)s[start]) )
+        start++;
+    while ( end > start && isspace((unsigned char)s[end - 1]) )
+        end--;
+    char* text = cssprsr_parser_alloc(parser, end - start + 1);
+    memcpy(text, s + start, end - start);
+    text[end - start] = '\0';
+    return text;
+}
+
+
+static void cssprsr_parser_resolve_errors(CssParser* parser)
+{
+    CssArray* errors = &parser->output->errors;
+    for (size_t i = 0; i < errors->length; ++i) {
+        CssError* e = errors->data[i];
+        unsigned int line, column;
+        cssprsr_line_index_lookup(cssprsr_parser_line_index(parser), e->first_offset, &line, &column);
+        e->first_line = line;
+        e->first_column = column;
+        cssprsr_line_index_lookup(cssprsr_parser_line_index(parser), e->last_offset, &line, &column);
+        e->last_line = line;
+        e->last_column = column;
+    }
+}
+
+
 void cssprsr_print(const char * format, ...)
 {
     va_list args;
@@ -1491,12 +1874,11 @@ void cssprsr_print_media_rule(CssParser* parser, CssMediaRule* rule)
 
 void cssprsr_print_selector(CssParser* parser, CssSelector* selector)
 {
-    CssParserString * string = cssprsr_selector_to_string(parser, selector, NULL);
-    const char* text = cssprsr_string_to_characters(parser, string);
-    cssprsr_parser_free(parser, (void*) string->data);
-    cssprsr_parser_free(parser, (void*) string);
-    cssprsr_print("%s", text);
-    cssprsr_parser_free(parser, (void*) text);
+    CssParserString string;
+    cssprsr_string_init(parser, &string);
+    cssprsr_selector_append_string(parser, selector, &string);
+    cssprsr_print("%.*s", (int)string.length, string.data);
+    cssprsr_parser_free(parser, (void*) string.data);
 }
 
 
@@ -1608,6 +1990,57 @@ CssOutput* css_dump_output(CssOutput* output)
 }
 
 
+typedef const CssSourceRange* (*CssRangeGetter)(void* node);
+
+static const CssSourceRange* cssprsr_rule_range(void* node) { return &((CssRule*)node)->range; }
+static const CssSourceRange* cssprsr_selector_range(void* node) { return &((CssSelector*)node)->range; }
+static const CssSourceRange* cssprsr_declaration_range(void* node) { return &((CssDeclaration*)node)->range; }
+
+// Nodes of an array are in source order and do not overlap, so the candidate
+// is the last one starting at or before the offset.
+static void* cssprsr_node_at_offset(CssArray* nodes, unsigned int offset, CssRangeGetter range_of)
+{
+    if ( NULL == nodes || 0 == nodes->length )
+        return NULL;
+    size_t first = 0, count = nodes->length;
+    while ( count > 0 ) {
+        size_t step = count / 2;
+        if ( range_of(nodes->data[first + step])->start <= offset ) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    if ( 0 == first )
+        return NULL;
+    void* node = nodes->data[first - 1];
+    const CssSourceRange* range = range_of(node);
+    return offset < range->end ? node : NULL;
+}
+
+CssRule* css_rule_at_offset(CssArray* rules, unsigned int offset)
+{
+    CssRule* rule = cssprsr_node_at_offset(rules, offset, cssprsr_rule_range);
+    if ( rule && CssRuleMedia == rule->type ) {
+        CssRule* inner = css_rule_at_offset(((CssMediaRule*)rule)->rules, offset);
+        if ( inner )
+            return inner;
+    }
+    return rule;
+}
+
+CssSelector* css_selector_at_offset(CssArray* selectors, unsigned int offset)
+{
+    return cssprsr_node_at_offset(selectors, offset, cssprsr_selector_range);
+}
+
+CssDeclaration* css_declaration_at_offset(CssArray* declarations, unsigned int offset)
+{
+    return cssprsr_node_at_offset(declarations, offset, cssprsr_declaration_range);
+}
+
+
 static const char* cssprsr_stringify_value_list(CssParser* parser, CssArray* values)
 {
     if (values) {
@@ -1670,6 +2103,11 @@ static const char* cssprsr_stringify_value(CssParser* parser, CssValue* value)
     case CSS_VALUE_HZ:
     case CSS_VALUE_KHZ:
     case CSS_VALUE_TURN:
+    case CSS_VALUE_VW:
+    case CSS_VALUE_VH:
+    case CSS_VALUE_VMIN:
+    case CSS_VALUE_VMAX:
+    case CSS_VALUE_FR:
         snprintf(str, sizeof(str), "%s", value->raw);
         break;
     case CSS_VALUE_IDENT:
@@ -1697,6 +2135,12 @@ static const char* cssprsr_stringify_value(CssParser* parser, CssValue* value)
     case CSS_VALUE_PARSER_HEXCOLOR:
         snprintf(str, sizeof(str), "#%s", value->string);
         break;
+    case CSS_VALUE_RGBCOLOR:
+        cssprsr_color_to_string(value, str, sizeof(str));
+        break;
+    case CSS_VALUE_CALC:
+        cssprsr_calc_to_string(value->calc, str, sizeof(str));
+        break;
     case CSS_VALUE_URI:
         snprintf(str, sizeof(str), "url(%s)", value->string);
         break;
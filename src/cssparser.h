@@ -261,10 +261,665 @@ typedef enum {
     CssValueInherit = 1,
     CssValueInitial = 2,
     CssValueNone = 3,
+    CssValueAbsolute,
+    CssValueAlias,
+    CssValueAll,
+    CssValueAllScroll,
+    CssValueAllSmallCaps,
+    CssValueAlternate,
+    CssValueAlternateReverse,
+    CssValueAlways,
+    CssValueAntialiased,
+    CssValueAttr,
+    CssValueAuto,
+    CssValueAvoid,
+    CssValueBackwards,
+    CssValueBaseline,
+    CssValueBidiOverride,
+    CssValueBlink,
+    CssValueBlock,
+    CssValueBold,
+    CssValueBolder,
+    CssValueBorderBox,
+    CssValueBoth,
+    CssValueBottom,
+    CssValueBreakAll,
+    CssValueBreakWord,
+    CssValueCapitalize,
+    CssValueCaption,
+    CssValueCell,
+    CssValueCenter,
+    CssValueCircle,
+    CssValueClip,
+    CssValueCloseQuote,
+    CssValueColResize,
+    CssValueCollapse,
+    CssValueColor,
+    CssValueColorBurn,
+    CssValueColorDodge,
+    CssValueColumn,
+    CssValueColumnReverse,
+    CssValueContain,
+    CssValueContentBox,
+    CssValueContents,
+    CssValueContextMenu,
+    CssValueCopy,
+    CssValueCover,
+    CssValueCrosshair,
+    CssValueCurrentcolor,
+    CssValueCursive,
+    CssValueDarken,
+    CssValueDashed,
+    CssValueDecimal,
+    CssValueDecimalLeadingZero,
+    CssValueDefault,
+    CssValueDense,
+    CssValueDifference,
+    CssValueDisc,
+    CssValueDotted,
+    CssValueDouble,
+    CssValueEResize,
+    CssValueEase,
+    CssValueEaseIn,
+    CssValueEaseInOut,
+    CssValueEaseOut,
+    CssValueEllipsis,
+    CssValueEmbed,
+    CssValueEnd,
+    CssValueEwResize,
+    CssValueExclusion,
+    CssValueFantasy,
+    CssValueFill,
+    CssValueFitContent,
+    CssValueFixed,
+    CssValueFlat,
+    CssValueFlex,
+    CssValueFlexEnd,
+    CssValueFlexStart,
+    CssValueFlowRoot,
+    CssValueForwards,
+    CssValueGeometricprecision,
+    CssValueGrab,
+    CssValueGrabbing,
+    CssValueGrid,
+    CssValueGroove,
+    CssValueHardLight,
+    CssValueHelp,
+    CssValueHidden,
+    CssValueHide,
+    CssValueHorizontalTb,
+    CssValueHue,
+    CssValueIcon,
+    CssValueInfinite,
+    CssValueInline,
+    CssValueInlineBlock,
+    CssValueInlineFlex,
+    CssValueInlineGrid,
+    CssValueInlineTable,
+    CssValueInset,
+    CssValueInside,
+    CssValueIsolate,
+    CssValueItalic,
+    CssValueJustify,
+    CssValueKeepAll,
+    CssValueLandscape,
+    CssValueLarge,
+    CssValueLarger,
+    CssValueLeft,
+    CssValueLighten,
+    CssValueLighter,
+    CssValueLineThrough,
+    CssValueLinear,
+    CssValueListItem,
+    CssValueLocal,
+    CssValueLowerAlpha,
+    CssValueLowerGreek,
+    CssValueLowerLatin,
+    CssValueLowerRoman,
+    CssValueLowercase,
+    CssValueLtr,
+    CssValueLuminosity,
+    CssValueManipulation,
+    CssValueManual,
+    CssValueMaxContent,
+    CssValueMedium,
+    CssValueMenu,
+    CssValueMessageBox,
+    CssValueMiddle,
+    CssValueMinContent,
+    CssValueMonospace,
+    CssValueMove,
+    CssValueMultiply,
+    CssValueNResize,
+    CssValueNeResize,
+    CssValueNoCloseQuote,
+    CssValueNoDrop,
+    CssValueNoOpenQuote,
+    CssValueNoRepeat,
+    CssValueNormal,
+    CssValueNotAllowed,
+    CssValueNowrap,
+    CssValueNsResize,
+    CssValueNwResize,
+    CssValueObject,
+    CssValueOblique,
+    CssValueOpenQuote,
+    CssValueOptimizelegibility,
+    CssValueOptimizespeed,
+    CssValueOutset,
+    CssValueOutside,
+    CssValueOverlay,
+    CssValueOverline,
+    CssValuePaddingBox,
+    CssValuePage,
+    CssValuePanX,
+    CssValuePanY,
+    CssValuePaused,
+    CssValuePointer,
+    CssValuePortrait,
+    CssValuePre,
+    CssValuePreLine,
+    CssValuePreWrap,
+    CssValuePreserve3d,
+    CssValuePrint,
+    CssValueProgress,
+    CssValueProportionalNums,
+    CssValueRelative,
+    CssValueRepeat,
+    CssValueRepeatX,
+    CssValueRepeatY,
+    CssValueReverse,
+    CssValueRevert,
+    CssValueRidge,
+    CssValueRight,
+    CssValueRound,
+    CssValueRow,
+    CssValueRowResize,
+    CssValueRowReverse,
+    CssValueRtl,
+    CssValueRunIn,
+    CssValueRunning,
+    CssValueSResize,
+    CssValueSansSerif,
+    CssValueSaturation,
+    CssValueScreen,
+    CssValueScroll,
+    CssValueSeResize,
+    CssValueSeparate,
+    CssValueSerif,
+    CssValueShow,
+    CssValueSmall,
+    CssValueSmallCaps,
+    CssValueSmallCaption,
+    CssValueSmaller,
+    CssValueSmooth,
+    CssValueSoftLight,
+    CssValueSolid,
+    CssValueSpace,
+    CssValueSpaceAround,
+    CssValueSpaceBetween,
+    CssValueSpaceEvenly,
+    CssValueSquare,
+    CssValueStart,
+    CssValueStatic,
+    CssValueStatusBar,
+    CssValueStepEnd,
+    CssValueStepStart,
+    CssValueSticky,
+    CssValueStretch,
+    CssValueSub,
+    CssValueSubpixelAntialiased,
+    CssValueSuper,
+    CssValueSwResize,
+    CssValueSystemUi,
+    CssValueTable,
+    CssValueTableCaption,
+    CssValueTableCell,
+    CssValueTableColumn,
+    CssValueTableColumnGroup,
+    CssValueTableFooterGroup,
+    CssValueTableHeaderGroup,
+    CssValueTableRow,
+    CssValueTableRowGroup,
+    CssValueTabularNums,
+    CssValueText,
+    CssValueTextBottom,
+    CssValueTextTop,
+    CssValueThick,
+    CssValueThin,
+    CssValueTop,
+    CssValueTouch,
+    CssValueTransparent,
+    CssValueUnderline,
+    CssValueUnset,
+    CssValueUpperAlpha,
+    CssValueUpperLatin,
+    CssValueUpperRoman,
+    CssValueUppercase,
+    CssValueVerticalLr,
+    CssValueVerticalRl,
+    CssValueVerticalText,
+    CssValueVisible,
+    CssValueWResize,
+    CssValueWait,
+    CssValueWrap,
+    CssValueWrapReverse,
+    CssValueXLarge,
+    CssValueXSmall,
+    CssValueXxLarge,
+    CssValueXxSmall,
+    CssValueZoomIn,
+    CssValueZoomOut,
+    // Named colors, in CssValue.color once resolved
+    CssValueAliceblue,
+    CssValueAntiquewhite,
+    CssValueAqua,
+    CssValueAquamarine,
+    CssValueAzure,
+    CssValueBeige,
+    CssValueBisque,
+    CssValueBlack,
+    CssValueBlanchedalmond,
+    CssValueBlue,
+    CssValueBlueviolet,
+    CssValueBrown,
+    CssValueBurlywood,
+    CssValueCadetblue,
+    CssValueChartreuse,
+    CssValueChocolate,
+    CssValueCoral,
+    CssValueCornflowerblue,
+    CssValueCornsilk,
+    CssValueCrimson,
+    CssValueCyan,
+    CssValueDarkblue,
+    CssValueDarkcyan,
+    CssValueDarkgoldenrod,
+    CssValueDarkgray,
+    CssValueDarkgreen,
+    CssValueDarkgrey,
+    CssValueDarkkhaki,
+    CssValueDarkmagenta,
+    CssValueDarkolivegreen,
+    CssValueDarkorange,
+    CssValueDarkorchid,
+    CssValueDarkred,
+    CssValueDarksalmon,
+    CssValueDarkseagreen,
+    CssValueDarkslateblue,
+    CssValueDarkslategray,
+    CssValueDarkslategrey,
+    CssValueDarkturquoise,
+    CssValueDarkviolet,
+    CssValueDeeppink,
+    CssValueDeepskyblue,
+    CssValueDimgray,
+    CssValueDimgrey,
+    CssValueDodgerblue,
+    CssValueFirebrick,
+    CssValueFloralwhite,
+    CssValueForestgreen,
+    CssValueFuchsia,
+    CssValueGainsboro,
+    CssValueGhostwhite,
+    CssValueGold,
+    CssValueGoldenrod,
+    CssValueGray,
+    CssValueGreen,
+    CssValueGreenyellow,
+    CssValueGrey,
+    CssValueHoneydew,
+    CssValueHotpink,
+    CssValueIndianred,
+    CssValueIndigo,
+    CssValueIvory,
+    CssValueKhaki,
+    CssValueLavender,
+    CssValueLavenderblush,
+    CssValueLawngreen,
+    CssValueLemonchiffon,
+    CssValueLightblue,
+    CssValueLightcoral,
+    CssValueLightcyan,
+    CssValueLightgoldenrodyellow,
+    CssValueLightgray,
+    CssValueLightgreen,
+    CssValueLightgrey,
+    CssValueLightpink,
+    CssValueLightsalmon,
+    CssValueLightseagreen,
+    CssValueLightskyblue,
+    CssValueLightslategray,
+    CssValueLightslategrey,
+    CssValueLightsteelblue,
+    CssValueLightyellow,
+    CssValueLime,
+    CssValueLimegreen,
+    CssValueLinen,
+    CssValueMagenta,
+    CssValueMaroon,
+    CssValueMediumaquamarine,
+    CssValueMediumblue,
+    CssValueMediumorchid,
+    CssValueMediumpurple,
+    CssValueMediumseagreen,
+    CssValueMediumslateblue,
+    CssValueMediumspringgreen,
+    CssValueMediumturquoise,
+    CssValueMediumvioletred,
+    CssValueMidnightblue,
+    CssValueMintcream,
+    CssValueMistyrose,
+    CssValueMoccasin,
+    CssValueNavajowhite,
+    CssValueNavy,
+    CssValueOldlace,
+    CssValueOlive,
+    CssValueOlivedrab,
+    CssValueOrange,
+    CssValueOrangered,
+    CssValueOrchid,
+    CssValuePalegoldenrod,
+    CssValuePalegreen,
+    CssValuePaleturquoise,
+    CssValuePalevioletred,
+    CssValuePapayawhip,
+    CssValuePeachpuff,
+    CssValuePeru,
+    CssValuePink,
+    CssValuePlum,
+    CssValuePowderblue,
+    CssValuePurple,
+    CssValueRebeccapurple,
+    CssValueRed,
+    CssValueRosybrown,
+    CssValueRoyalblue,
+    CssValueSaddlebrown,
+    CssValueSalmon,
+    CssValueSandybrown,
+    CssValueSeagreen,
+    CssValueSeashell,
+    CssValueSienna,
+    CssValueSilver,
+    CssValueSkyblue,
+    CssValueSlateblue,
+    CssValueSlategray,
+    CssValueSlategrey,
+    CssValueSnow,
+    CssValueSpringgreen,
+    CssValueSteelblue,
+    CssValueTan,
+    CssValueTeal,
+    CssValueThistle,
+    CssValueTomato,
+    CssValueTurquoise,
+    CssValueViolet,
+    CssValueWheat,
+    CssValueWhite,
+    CssValueWhitesmoke,
+    CssValueYellow,
+    CssValueYellowgreen,
+    CssValueCount,
+    // An ident that is not a known keyword
     CssValueCustom = 0x100010,
 } CssValueID;
 
 
+/**
+ * Known properties, see css_property_id(). Vendor prefixes are not part of
+ * the id, `-webkit-transform` is CssPropertyTransform.
+ */
+typedef enum {
+    CssPropertyUnknown = 0,
+    // `--*`, see CssDeclaration.property for the name
+    CssPropertyCustom = 1,
+    CssPropertyAlignContent = 2,
+    CssPropertyAlignItems,
+    CssPropertyAlignSelf,
+    CssPropertyAll,
+    CssPropertyAnimation,
+    CssPropertyAnimationDelay,
+    CssPropertyAnimationDirection,
+    CssPropertyAnimationDuration,
+    CssPropertyAnimationFillMode,
+    CssPropertyAnimationIterationCount,
+    CssPropertyAnimationName,
+    CssPropertyAnimationPlayState,
+    CssPropertyAnimationTimingFunction,
+    CssPropertyAppearance,
+    CssPropertyBackfaceVisibility,
+    CssPropertyBackground,
+    CssPropertyBackgroundAttachment,
+    CssPropertyBackgroundBlendMode,
+    CssPropertyBackgroundClip,
+    CssPropertyBackgroundColor,
+    CssPropertyBackgroundImage,
+    CssPropertyBackgroundOrigin,
+    CssPropertyBackgroundPosition,
+    CssPropertyBackgroundPositionX,
+    CssPropertyBackgroundPositionY,
+    CssPropertyBackgroundRepeat,
+    CssPropertyBackgroundSize,
+    CssPropertyBorder,
+    CssPropertyBorderBottom,
+    CssPropertyBorderBottomColor,
+    CssPropertyBorderBottomLeftRadius,
+    CssPropertyBorderBottomRightRadius,
+    CssPropertyBorderBottomStyle,
+    CssPropertyBorderBottomWidth,
+    CssPropertyBorderCollapse,
+    CssPropertyBorderColor,
+    CssPropertyBorderImage,
+    CssPropertyBorderImageOutset,
+    CssPropertyBorderImageRepeat,
+    CssPropertyBorderImageSlice,
+    CssPropertyBorderImageSource,
+    CssPropertyBorderImageWidth,
+    CssPropertyBorderLeft,
+    CssPropertyBorderLeftColor,
+    CssPropertyBorderLeftStyle,
+    CssPropertyBorderLeftWidth,
+    CssPropertyBorderRadius,
+    CssPropertyBorderRight,
+    CssPropertyBorderRightColor,
+    CssPropertyBorderRightStyle,
+    CssPropertyBorderRightWidth,
+    CssPropertyBorderSpacing,
+    CssPropertyBorderStyle,
+    CssPropertyBorderTop,
+    CssPropertyBorderTopColor,
+    CssPropertyBorderTopLeftRadius,
+    CssPropertyBorderTopRightRadius,
+    CssPropertyBorderTopStyle,
+    CssPropertyBorderTopWidth,
+    CssPropertyBorderWidth,
+    CssPropertyBottom,
+    CssPropertyBoxDecorationBreak,
+    CssPropertyBoxShadow,
+    CssPropertyBoxSizing,
+    CssPropertyBreakAfter,
+    CssPropertyBreakBefore,
+    CssPropertyBreakInside,
+    CssPropertyCaptionSide,
+    CssPropertyCaretColor,
+    CssPropertyClear,
+    CssPropertyClip,
+    CssPropertyClipPath,
+    CssPropertyColor,
+    CssPropertyColumnCount,
+    CssPropertyColumnFill,
+    CssPropertyColumnGap,
+    CssPropertyColumnRule,
+    CssPropertyColumnRuleColor,
+    CssPropertyColumnRuleStyle,
+    CssPropertyColumnRuleWidth,
+    CssPropertyColumnSpan,
+    CssPropertyColumnWidth,
+    CssPropertyColumns,
+    CssPropertyContent,
+    CssPropertyCounterIncrement,
+    CssPropertyCounterReset,
+    CssPropertyCursor,
+    CssPropertyDirection,
+    CssPropertyDisplay,
+    CssPropertyEmptyCells,
+    CssPropertyFilter,
+    CssPropertyFlex,
+    CssPropertyFlexBasis,
+    CssPropertyFlexDirection,
+    CssPropertyFlexFlow,
+    CssPropertyFlexGrow,
+    CssPropertyFlexShrink,
+    CssPropertyFlexWrap,
+    CssPropertyFloat,
+    CssPropertyFont,
+    CssPropertyFontFamily,
+    CssPropertyFontFeatureSettings,
+    CssPropertyFontKerning,
+    CssPropertyFontSize,
+    CssPropertyFontSizeAdjust,
+    CssPropertyFontStretch,
+    CssPropertyFontStyle,
+    CssPropertyFontVariant,
+    CssPropertyFontVariantCaps,
+    CssPropertyFontVariantLigatures,
+    CssPropertyFontVariantNumeric,
+    CssPropertyFontWeight,
+    CssPropertyGap,
+    CssPropertyGrid,
+    CssPropertyGridArea,
+    CssPropertyGridAutoColumns,
+    CssPropertyGridAutoFlow,
+    CssPropertyGridAutoRows,
+    CssPropertyGridColumn,
+    CssPropertyGridColumnEnd,
+    CssPropertyGridColumnGap,
+    CssPropertyGridColumnStart,
+    CssPropertyGridGap,
+    CssPropertyGridRow,
+    CssPropertyGridRowEnd,
+    CssPropertyGridRowGap,
+    CssPropertyGridRowStart,
+    CssPropertyGridTemplate,
+    CssPropertyGridTemplateAreas,
+    CssPropertyGridTemplateColumns,
+    CssPropertyGridTemplateRows,
+    CssPropertyHeight,
+    CssPropertyHyphens,
+    CssPropertyImageRendering,
+    CssPropertyIsolation,
+    CssPropertyJustifyContent,
+    CssPropertyJustifyItems,
+    CssPropertyJustifySelf,
+    CssPropertyLeft,
+    CssPropertyLetterSpacing,
+    CssPropertyLineHeight,
+    CssPropertyListStyle,
+    CssPropertyListStyleImage,
+    CssPropertyListStylePosition,
+    CssPropertyListStyleType,
+    CssPropertyMargin,
+    CssPropertyMarginBottom,
+    CssPropertyMarginLeft,
+    CssPropertyMarginRight,
+    CssPropertyMarginTop,
+    CssPropertyMask,
+    CssPropertyMaskImage,
+    CssPropertyMaxHeight,
+    CssPropertyMaxWidth,
+    CssPropertyMinHeight,
+    CssPropertyMinWidth,
+    CssPropertyMixBlendMode,
+    CssPropertyObjectFit,
+    CssPropertyObjectPosition,
+    CssPropertyOpacity,
+    CssPropertyOrder,
+    CssPropertyOrphans,
+    CssPropertyOutline,
+    CssPropertyOutlineColor,
+    CssPropertyOutlineOffset,
+    CssPropertyOutlineStyle,
+    CssPropertyOutlineWidth,
+    CssPropertyOverflow,
+    CssPropertyOverflowWrap,
+    CssPropertyOverflowX,
+    CssPropertyOverflowY,
+    CssPropertyPadding,
+    CssPropertyPaddingBottom,
+    CssPropertyPaddingLeft,
+    CssPropertyPaddingRight,
+    CssPropertyPaddingTop,
+    CssPropertyPageBreakAfter,
+    CssPropertyPageBreakBefore,
+    CssPropertyPageBreakInside,
+    CssPropertyPerspective,
+    CssPropertyPerspectiveOrigin,
+    CssPropertyPlaceContent,
+    CssPropertyPlaceItems,
+    CssPropertyPlaceSelf,
+    CssPropertyPointerEvents,
+    CssPropertyPosition,
+    CssPropertyQuotes,
+    CssPropertyResize,
+    CssPropertyRight,
+    CssPropertyRowGap,
+    CssPropertyScrollBehavior,
+    CssPropertySpeak,
+    CssPropertySrc,
+    CssPropertyTabSize,
+    CssPropertyTableLayout,
+    CssPropertyTextAlign,
+    CssPropertyTextAlignLast,
+    CssPropertyTextDecoration,
+    CssPropertyTextDecorationColor,
+    CssPropertyTextDecorationLine,
+    CssPropertyTextDecorationStyle,
+    CssPropertyTextIndent,
+    CssPropertyTextJustify,
+    CssPropertyTextOverflow,
+    CssPropertyTextRendering,
+    CssPropertyTextShadow,
+    CssPropertyTextSizeAdjust,
+    CssPropertyTextTransform,
+    CssPropertyTextUnderlinePosition,
+    CssPropertyTop,
+    CssPropertyTouchAction,
+    CssPropertyTransform,
+    CssPropertyTransformOrigin,
+    CssPropertyTransformStyle,
+    CssPropertyTransition,
+    CssPropertyTransitionDelay,
+    CssPropertyTransitionDuration,
+    CssPropertyTransitionProperty,
+    CssPropertyTransitionTimingFunction,
+    CssPropertyUnicodeBidi,
+    CssPropertyUnicodeRange,
+    CssPropertyUserSelect,
+    CssPropertyVerticalAlign,
+    CssPropertyVisibility,
+    CssPropertyWhiteSpace,
+    CssPropertyWidows,
+    CssPropertyWidth,
+    CssPropertyWillChange,
+    CssPropertyWordBreak,
+    CssPropertyWordSpacing,
+    CssPropertyWordWrap,
+    CssPropertyWritingMode,
+    CssPropertyZIndex,
+    CssPropertyZoom,
+    CssPropertyCount
+} CssPropertyID;
+
+
+typedef enum {
+    CssVendorNone,
+    CssVendorWebKit,
+    CssVendorMoz,
+    CssVendorMs,
+    CssVendorO,
+} CssVendorPrefix;
+
+
 typedef enum { CssParseError } CssErrorType;
 
 
@@ -289,6 +944,18 @@ typedef struct {
 } CssArray;
 
 
+/**
+ *  Byte range of a node in the input, `end` is exclusive.
+ *  Only recorded when parsing with `CssParserFlagSourceRanges`, zero otherwise.
+ *  A stylesheet is parsed once decoded to UTF-8 without its byte order mark,
+ *  offsets count bytes of that text, as kept in `CssOutput.source`.
+ */
+typedef struct {
+    unsigned int start;
+    unsigned int end;
+} CssSourceRange;
+
+
 typedef struct {
     const char* encoding;
     CssArray /* CssRule */ rules;
@@ -299,6 +966,7 @@ typedef struct {
 typedef struct {
     const char* name;
     CssRuleType type;
+    CssSourceRange range;
 } CssRule;
 
 
@@ -365,6 +1033,7 @@ typedef struct {
 typedef struct {
     CssArray* /* CssValue: `percentage`, `from`, `to` */ selectors;
     CssArray* /* CssDeclaration */ declarations;
+    CssSourceRange range;
 } CssKeyframe;
 
 
@@ -408,18 +1077,20 @@ typedef struct {
     const char* value;
     union {
         struct {
-            int a; // Used for :nth-*
+            int a; // Used for :nth-*, An+B parsed from the argument
             int b; // Used for :nth-*
         } nth;
         CssAttributeMatchType attrMatchType; // used for attribute selector (with value)
     } bits;
     CssQualifiedName* attribute;
     const char* argument; // Used for :contains, :lang, :nth-*
-    CssArray* selectors; // Used for :any and :not
+    CssArray* selectors; // Used for :any, :not and the S of :nth-child(An+B of S)
 } CssSelectorRareData;
 
 
 typedef struct CssSelector {
+    // Set on the selectors of a selector list, 0x10000 per id, 0x100 per
+    // class, attribute or pseudo-class and 1 per type or pseudo-element
     size_t specificity;
     CssSelectorMatch match;
     CssPseudoType pseudo;
@@ -427,18 +1098,60 @@ typedef struct CssSelector {
     CssQualifiedName* tag;
     CssSelectorRareData* data;
     struct CssSelector* tagHistory;
+    // Set on the selectors of a selector list, covers the whole complex selector
+    CssSourceRange range;
 } CssSelector;
 
 
+/**
+ *  Specificity of a complex selector. `:not()` counts as its most specific
+ *  argument.
+ *
+ *  @param selector The selector
+ *
+ *  @return `selector->specificity` when the parser computed it
+ */
 unsigned css_calc_specificity_for_selector(CssSelector* selector);
 
 
+/**
+ *  Structural hash of a complex selector, equal for selectors that
+ *  css_selector_equals() finds equal.
+ *
+ *  @param selector The selector
+ *
+ *  @return The hash
+ */
+CSSPARSER_API unsigned css_selector_hash(const CssSelector* selector);
+
+
+/**
+ *  Whether two complex selectors are the same selector. Tag and attribute
+ *  names ignore case, `*` alone is the same as no tag, nth arguments
+ *  compare by value and the order of the simple selectors of a compound
+ *  does not matter.
+ *
+ *  @param a A selector
+ *  @param b Another selector
+ *
+ *  @return true if they match the same elements the same way
+ */
+CSSPARSER_API bool css_selector_equals(const CssSelector* a, const CssSelector* b);
+
+
 typedef struct {
     // property name
     const char* property;
+
+    // resolved property name, and its vendor prefix if any
+    CssPropertyID id;
+    CssVendorPrefix vendor;
     
     // property value
     CssArray* /* CssValue */ values;
+
+    // the value as written, kept for custom properties and values with
+    // var() until they are substituted, NULL otherwise
     const char* string;
 
     // is this property marked important
@@ -446,6 +1159,9 @@ typedef struct {
 
     // origin css text of the property
     const char* raw;
+
+    // from the property name to the end of the value or `!important`
+    CssSourceRange range;
 } CssDeclaration;
 
 
@@ -455,6 +1171,109 @@ typedef struct {
 } CssValueFunction;
 
 
+typedef enum {
+    CssColorHex,    // `#rgb`, `#rgba`, `#rrggbb` or `#rrggbbaa`
+    CssColorNamed,  // `red` or `transparent`, the name is in CssValue.id
+    CssColorRgb,    // `rgb()` or `rgba()`
+    CssColorHsl,    // `hsl()` or `hsla()`
+} CssColorForm;
+
+
+/**
+ * A color resolved while parsing, the value of CSS_VALUE_RGBCOLOR values.
+ * Names are only resolved in the value of properties taking a color.
+ */
+typedef struct {
+    unsigned int rgba;    // 0xRRGGBBAA
+    unsigned char form;   // CssColorForm
+    unsigned char digits; // Number of hex digits of CssColorHex colors
+} CssColor;
+
+
+typedef enum {
+    CssCalcNumber,
+    CssCalcLength,
+    CssCalcPercent,
+    CssCalcPercentNumber,   // percentages added to numbers
+    CssCalcPercentLength,   // percentages added to lengths
+    CssCalcAngle,
+    CssCalcTime,
+    CssCalcFrequency,
+} CssCalcCategory;
+
+
+typedef enum {
+    CssCalcLeaf = 0,
+    CssCalcAdd = '+',
+    CssCalcSubtract = '-',
+    CssCalcMultiply = '*',
+    CssCalcDivide = '/',
+} CssCalcOperator;
+
+
+typedef struct CssCalcNode {
+    CssCalcOperator op;
+    CssCalcCategory category;
+
+    // CssCalcLeaf
+    double value;
+    CssValueUnit unit;
+
+    // operators
+    struct CssCalcNode* left;
+    struct CssCalcNode* right;
+} CssCalcNode;
+
+
+/**
+ * A calc() expression, the value of CSS_VALUE_CALC values. Parsed once
+ * into a tree with its constant subexpressions folded, `calc(10px + 5px)`
+ * is a single 15px leaf.
+ */
+typedef struct {
+    // `calc(` or `-webkit-calc(`
+    const char* name;
+    CssCalcNode* root;
+} CssCalcExpression;
+
+
+/**
+ * What relative units and percentages resolve against, in px.
+ */
+typedef struct {
+    double font_size;         // `em`, while `ex` and `ch` are taken as half of it
+    double root_font_size;    // `rem`
+    double viewport_width;    // `vw`, `vmin` and `vmax`
+    double viewport_height;   // `vh`, `vmin` and `vmax`
+    double percentage_basis;  // what `100%` resolves to
+} CssUnitContext;
+
+
+typedef enum {
+    CssUnitNone,        // not a numeric unit
+    CssUnitNumber,
+    CssUnitPercent,     // converts to px
+    CssUnitLength,      // converts to px
+    CssUnitAngle,       // converts to deg
+    CssUnitTime,        // converts to ms
+    CssUnitFrequency,   // converts to Hz
+    CssUnitResolution,  // converts to dppx
+} CssUnitKind;
+
+
+#define CSS_UNIT_SCALES_SIZE (CSS_VALUE_VALUE_ID + 1)
+
+/**
+ * Factors from every unit to its canonical unit under a context, built by
+ * css_unit_scales_init() and indexed by CssValueUnit. Units that are not
+ * numeric have a factor of 0.
+ */
+typedef struct {
+    CssUnitContext context;
+    double factors[CSS_UNIT_SCALES_SIZE];
+} CssUnitScales;
+
+
 typedef struct CssValue {
     CssValueID id;
     bool isInt;
@@ -464,6 +1283,8 @@ typedef struct CssValue {
         const char* string;
         CssValueFunction* function;
         CssArray* list;
+        CssColor color;
+        CssCalcExpression* calc;
     };
     CssValueUnit unit;
     const char* raw;
@@ -480,10 +1301,17 @@ typedef struct {
     
 typedef struct {
     CssErrorType type;
+    // Position of the token in error: lines count from 1, columns are byte
+    // columns counted from 0, and the end is exclusive, so `a{b:c}}` gives
+    // 1.6 - 1.7. Up to 0.8.0 lines counted from 0 and the end was inclusive.
     int first_line;
     int first_column;
     int last_line;
     int last_column;
+    // byte offsets into the decoded input, see CssSourceRange, lines and
+    // columns are derived from them
+    unsigned int first_offset;
+    unsigned int last_offset;
     char message[CSS_ERROR_MSG_SIZE];
 } CssError;
 
@@ -512,6 +1340,24 @@ typedef enum CssParserMode {
     // Inline stylesheet like "width: 20px; height: 20px;"
     CssParserModeDeclarationList,
 } CssParserMode;
+
+
+/**
+ * Parser flags
+ */
+typedef enum CssParserFlags {
+    CssParserFlagNone = 0,
+
+    // Record the source range of rules, selectors and declarations
+    CssParserFlagSourceRanges = 1 << 0,
+
+    // Replace shorthand declarations like `margin` or `font` by their
+    // longhands, which keep the range of the shorthand. Longhands the
+    // shorthand leaves out are set to `initial`. Shorthands that can not be
+    // split safely, like those with `var()` or several background layers,
+    // are kept as they are.
+    CssParserFlagExpandShorthands = 1 << 1,
+} CssParserFlags;
     
 typedef struct CssInternalOutput {
     // Complete CSS string
@@ -528,6 +1374,12 @@ typedef struct CssInternalOutput {
     };
     CssParserMode mode;
     CssArray /* CssError */ errors;
+    unsigned int flags;
+
+    // Copy of the input decoded to UTF-8, kept with `CssParserFlagSourceRanges`
+    // for css_reparse_range()
+    const char* source;
+    size_t source_length;
 } CssOutput;
 
 
@@ -543,6 +1395,19 @@ typedef struct CssInternalOutput {
 CSSPARSER_API CssOutput* css_parse_string(const char* str, size_t len, CssParserMode mode);
 
 
+/**
+ *  Parse a complete or fragmental CSS string
+ *
+ *  @param str   Input CSS string
+ *  @param len   Length of the input CSS string
+ *  @param mode  Parser mode, depends on the input
+ *  @param flags Combination of `CssParserFlags`
+ *
+ *  @return The result of parsing
+ */
+CSSPARSER_API CssOutput* css_parse_string_with_flags(const char* str, size_t len, CssParserMode mode, unsigned int flags);
+
+
 /**
  *  Parse a complete CSS file
  *
@@ -553,6 +1418,17 @@ CSSPARSER_API CssOutput* css_parse_string(const char* str, size_t len, CssParser
 CSSPARSER_API CssOutput* css_parse_file(FILE* fp);
 
 
+/**
+ *  Parse a complete CSS file
+ *
+ *  @param fp    `FILE` point to the CSS file
+ *  @param flags Combination of `CssParserFlags`
+ *
+ *  @return The result of parsing
+ */
+CSSPARSER_API CssOutput* css_parse_file_with_flags(FILE* fp, unsigned int flags);
+
+
 /**
  *  Free the output
  *
@@ -570,6 +1446,925 @@ CSSPARSER_API void css_destroy_output(CssOutput* output);
  */
 CSSPARSER_API CssOutput* css_dump_output(CssOutput* output);
 
+
+/**
+ *  Find the innermost rule containing an offset, descending into `@media`
+ *  rules. Needs an output parsed with `CssParserFlagSourceRanges`.
+ *
+ *  @param rules  Rules in source order, like `stylesheet->rules`
+ *  @param offset Byte offset into the decoded input, see CssSourceRange
+ *
+ *  @return The rule, or NULL when the offset is outside of every rule
+ */
+CSSPARSER_API CssRule* css_rule_at_offset(CssArray* rules, unsigned int offset);
+
+
+/**
+ *  Find the selector of a selector list containing an offset
+ *
+ *  @param selectors Selector list, like `CssStyleRule.selectors`
+ *  @param offset    Byte offset into the decoded input
+ *
+ *  @return The selector, or NULL
+ */
+CSSPARSER_API CssSelector* css_selector_at_offset(CssArray* selectors, unsigned int offset);
+
+
+/**
+ *  Find the declaration containing an offset
+ *
+ *  @param declarations Declarations of a rule
+ *  @param offset       Byte offset into the decoded input
+ *
+ *  @return The declaration, or NULL
+ */
+CSSPARSER_API CssDeclaration* css_declaration_at_offset(CssArray* declarations, unsigned int offset);
+
+
+/**
+ *  Resolve a property name, ignoring case and any vendor prefix.
+ *
+ *  @param name The property name, like `CssDeclaration.property`
+ *
+ *  @return its id, CssPropertyCustom for `--*` or CssPropertyUnknown
+ */
+CSSPARSER_API CssPropertyID css_property_id(const char* name);
+
+
+/**
+ *  The lowercase, unprefixed name of a known property.
+ *
+ *  @param id A property id
+ *
+ *  @return the name, or NULL for CssPropertyUnknown and CssPropertyCustom
+ */
+CSSPARSER_API const char* css_property_name(CssPropertyID id);
+
+
+/**
+ *  Resolve a keyword, ignoring case.
+ *
+ *  @param name The keyword, like the string of a CSS_VALUE_IDENT value
+ *
+ *  @return its id, or CssValueInvalid
+ */
+CSSPARSER_API CssValueID css_value_id(const char* name);
+
+
+/**
+ *  The lowercase name of a keyword.
+ *
+ *  @param id A keyword id
+ *
+ *  @return the name, or NULL for CssValueInvalid and CssValueCustom
+ */
+CSSPARSER_API const char* css_value_name(CssValueID id);
+
+
+/**
+ *  Evaluate a calc() expression. Lengths come out in px, angles in deg,
+ *  times in ms and frequencies in Hz.
+ *
+ *  @param calc    The `calc` of a CSS_VALUE_CALC value
+ *  @param context Font sizes, viewport and percentage basis
+ *
+ *  @return the value in the canonical unit of its category
+ */
+CSSPARSER_API double css_calc_evaluate(const CssCalcExpression* calc, const CssUnitContext* context);
+
+
+/**
+ *  The type of a calc() expression, telling which canonical unit
+ *  css_calc_evaluate() gives it in.
+ *
+ *  @param calc The `calc` of a CSS_VALUE_CALC value
+ *
+ *  @return its category
+ */
+CSSPARSER_API CssCalcCategory css_calc_category(const CssCalcExpression* calc);
+
+
+/**
+ *  The kind of a unit, telling which canonical unit it converts to.
+ *
+ *  @param unit A value unit
+ *
+ *  @return its kind, CssUnitNone if it is not numeric
+ */
+CSSPARSER_API CssUnitKind css_unit_kind(CssValueUnit unit);
+
+
+/**
+ *  Compute the conversion factors of every unit under a context. Needs
+ *  doing again when the context changes.
+ *
+ *  @param scales  The table to fill
+ *  @param context Font sizes, viewport and percentage basis
+ */
+CSSPARSER_API void css_unit_scales_init(CssUnitScales* scales, const CssUnitContext* context);
+
+
+/**
+ *  Convert numbers to their canonical unit, `out[i] = numbers[i] * factor`.
+ *  `out` may be `numbers`.
+ *
+ *  @param numbers The numbers
+ *  @param units   The unit of each number
+ *  @param count   How many numbers there are
+ *  @param scales  Factors from css_unit_scales_init()
+ *  @param out     Room for `count` results
+ */
+CSSPARSER_API void css_numbers_to_canonical(const double* numbers, const CssValueUnit* units, size_t count,
+                                            const CssUnitScales* scales, double* out);
+
+
+/**
+ *  Convert values to their canonical unit. calc() values are evaluated,
+ *  values that are not numeric come out as 0.
+ *
+ *  @param values A CssValue array, like `CssDeclaration.values`
+ *  @param scales Factors from css_unit_scales_init()
+ *  @param out    Room for one result per value
+ *
+ *  @return how many values were numeric
+ */
+CSSPARSER_API size_t css_values_to_canonical(const CssArray* values, const CssUnitScales* scales, double* out);
+
+
+/**
+ *  Convert the values of a whole declaration block, as
+ *  css_values_to_canonical() does, one declaration after the other.
+ *
+ *  @param declarations A CssDeclaration array, like `CssStyleRule.declarations`
+ *  @param scales       Factors from css_unit_scales_init()
+ *  @param out          Room for one result per value of every declaration
+ *
+ *  @return how many results were written
+ */
+CSSPARSER_API size_t css_declarations_to_canonical(const CssArray* declarations, const CssUnitScales* scales,
+                                                   double* out);
+
+
+/**
+ *  Apply an edit to the input of a stylesheet and reparse only what it
+ *  touches: the declaration block around the edit when it stays inside one,
+ *  otherwise the affected top-level rules. New nodes are spliced into the
+ *  existing stylesheet, untouched rules are kept as they are and only have
+ *  their ranges shifted. Falls back to a full reparse when the edit may
+ *  change how the rest of the input is tokenized.
+ *
+ *  Needs an output of `CssParserModeStylesheet` parsed with
+ *  `CssParserFlagSourceRanges`.
+ *
+ *  @param output     The result of a previous parse, updated in place
+ *  @param edit_start Byte offset of the edit in `output->source`
+ *  @param old_len    Number of bytes replaced
+ *  @param new_text   Replacement text
+ *
+ *  @return false if the output can not be reparsed incrementally or the edit
+ *          is out of range, the output is left untouched in that case
+ */
+CSSPARSER_API bool css_reparse_range(CssOutput* output, unsigned int edit_start, unsigned int old_len, const char* new_text);
+
+
+#define CSS_ANCESTOR_HASHES_MAX 4
+
+/**
+ *  Hashes of names a selector requires on ancestors of the element, ended
+ *  by a zero when there are fewer than `CSS_ANCESTOR_HASHES_MAX`
+ */
+typedef struct {
+    unsigned int hashes[CSS_ANCESTOR_HASHES_MAX];
+} CssAncestorHashes;
+
+
+#define CSS_BLOOM_FILTER_KEY_BITS 12
+
+/**
+ *  Counting bloom filter of the tag names, ids and classes of the ancestors
+ *  of the element being matched. Maintained by the host during traversal.
+ */
+typedef struct {
+    unsigned char counters[1 << CSS_BLOOM_FILTER_KEY_BITS];
+} CssBloomFilter;
+
+
+/**
+ *  Compute the hashes of the tag names, ids and classes of the compounds a
+ *  selector requires to be ancestors of the element, those on the left of a
+ *  descendant or child combinator.
+ *
+ *  @param selector  A selector of a selector list
+ *  @param ancestors Receives the hashes
+ */
+CSSPARSER_API void css_selector_ancestor_hashes(const CssSelector* selector, CssAncestorHashes* ancestors);
+
+
+/**
+ *  Empty the filter, before walking a document from its root
+ *
+ *  @param filter The filter
+ */
+CSSPARSER_API void css_bloom_filter_clear(CssBloomFilter* filter);
+
+
+/**
+ *  Add an element to the filter, before matching its descendants
+ *
+ *  @param filter      The filter
+ *  @param tag         Tag name of the element
+ *  @param id          Id of the element, or NULL
+ *  @param classes     Distinct class names of the element
+ *  @param class_count Number of class names
+ */
+CSSPARSER_API void css_bloom_filter_push(CssBloomFilter* filter, const char* tag, const char* id,
+                                         const char* const* classes, size_t class_count);
+
+
+/**
+ *  Remove an element added by css_bloom_filter_push(), with the same names,
+ *  once its descendants are done
+ *
+ *  @param filter      The filter
+ *  @param tag         Tag name of the element
+ *  @param id          Id of the element, or NULL
+ *  @param classes     Distinct class names of the element
+ *  @param class_count Number of class names
+ */
+CSSPARSER_API void css_bloom_filter_pop(CssBloomFilter* filter, const char* tag, const char* id,
+                                        const char* const* classes, size_t class_count);
+
+
+/**
+ *  Check whether the ancestors required by a selector may be present
+ *
+ *  @param filter    Filter holding the ancestors of the element
+ *  @param ancestors Hashes from css_selector_ancestor_hashes()
+ *
+ *  @return false if the selector can not match the element, true if it may
+ */
+CSSPARSER_API bool css_bloom_filter_may_match(const CssBloomFilter* filter, const CssAncestorHashes* ancestors);
+
+
+/**
+ *  Style rules bucketed by the key selector of their rightmost compound
+ */
+typedef struct CssInternalRuleIndex CssRuleIndex;
+
+typedef struct {
+    CssStyleRule* rule;
+    // One selector of the rule's selector list
+    CssSelector* selector;
+    // Position of the selector in the stylesheet, for the cascade order
+    unsigned int order;
+    // Copy of `selector->specificity`
+    unsigned int specificity;
+    // Shared by the entries with equal selectors, below
+    // css_rule_index_unique_count(), and their entry in css_rule_index_program()
+    unsigned int unique;
+    // For css_bloom_filter_may_match()
+    CssAncestorHashes ancestors;
+} CssRuleIndexEntry;
+
+
+/**
+ *  Build the index of the style rules of a stylesheet, including those in
+ *  `@media` rules whatever their media. Each selector of a rule is filed
+ *  under the id, else the first class, else the tag name of its rightmost
+ *  compound. The stylesheet must outlive the index.
+ *
+ *  @param stylesheet The stylesheet to index
+ *
+ *  @return The index, release it with css_rule_index_destroy()
+ */
+CSSPARSER_API CssRuleIndex* css_rule_index_new(CssStylesheet* stylesheet);
+
+
+/**
+ *  Free the index
+ *
+ *  @param index The index
+ */
+CSSPARSER_API void css_rule_index_destroy(CssRuleIndex* index);
+
+
+/**
+ *  Number of selectors in the index
+ *
+ *  @param index The index
+ *
+ *  @return The number of entries
+ */
+CSSPARSER_API size_t css_rule_index_length(const CssRuleIndex* index);
+
+
+/**
+ *  Number of distinct selectors in the index, by css_selector_equals().
+ *  Results of matching an element can be cached per `unique` of the entries,
+ *  which also selects their shared compiled form, see css_rule_index_program().
+ *
+ *  @param index The index
+ *
+ *  @return The number of distinct selectors
+ */
+CSSPARSER_API size_t css_rule_index_unique_count(const CssRuleIndex* index);
+
+
+/**
+ *  All the entries of the index in cascade order: by specificity, then by
+ *  position in the stylesheet. Later entries win.
+ *
+ *  @param index The index
+ *
+ *  @return css_rule_index_length() entries, owned by the index
+ */
+CSSPARSER_API const CssRuleIndexEntry* const* css_rule_index_by_specificity(const CssRuleIndex* index);
+
+
+/**
+ *  Sort entries, like the candidates matching an element, in the cascade
+ *  order of css_rule_index_by_specificity().
+ *
+ *  @param entries The entries
+ *  @param count   Number of entries
+ */
+CSSPARSER_API void css_rule_index_sort(const CssRuleIndexEntry** entries, size_t count);
+
+
+/**
+ *  Elements to restyle when a class, id or attribute of an element changes
+ */
+typedef enum {
+    // The element itself, the name is in the rightmost compound
+    CssInvalidateSelf        = 1 << 0,
+    // Its descendants, the name is left of a descendant or child combinator
+    CssInvalidateDescendants = 1 << 1,
+    // Its following siblings, the name is left of a sibling combinator.
+    // Along with CssInvalidateDescendants, the descendants of those siblings.
+    CssInvalidateSiblings    = 1 << 2,
+} CssInvalidationScope;
+
+typedef enum {
+    CssInvalidationClass,
+    CssInvalidationId,
+    // Attribute names are compared case-insensitively
+    CssInvalidationAttribute,
+} CssInvalidationFeature;
+
+typedef struct {
+    CssStyleRule* rule;
+    // One selector of the rule's selector list
+    CssSelector* selector;
+    // CssInvalidationScope flags, for all the places of the name in the selector
+    unsigned int scope;
+} CssInvalidationDependency;
+
+typedef struct {
+    // Union of the scopes of the dependencies
+    unsigned int scope;
+    // CssInvalidationDependency, in stylesheet order
+    CssArray dependencies;
+} CssInvalidationSet;
+
+/**
+ *  Invalidation sets of the class, id and attribute names of a stylesheet
+ */
+typedef struct CssInternalInvalidationMap CssInvalidationMap;
+
+
+/**
+ *  Collect the names tested by the style rules of a stylesheet, media rules
+ *  included. The map references the stylesheet, which must outlive it.
+ *
+ *  @param stylesheet The stylesheet
+ *
+ *  @return A map, to be released by css_invalidation_map_destroy()
+ */
+CSSPARSER_API CssInvalidationMap* css_invalidation_map_new(CssStylesheet* stylesheet);
+
+
+/**
+ *  Release a map created by css_invalidation_map_new()
+ *
+ *  @param map The map
+ */
+CSSPARSER_API void css_invalidation_map_destroy(CssInvalidationMap* map);
+
+
+/**
+ *  Rules depending on a name. When a name is added to or removed from an
+ *  element, only the elements in the scope of its set need a restyle.
+ *
+ *  @param map     The map
+ *  @param feature Kind of the name
+ *  @param name    The class, id or attribute name
+ *
+ *  @return The set of the name, or NULL when no selector tests it
+ */
+CSSPARSER_API const CssInvalidationSet* css_invalidation_map_lookup(const CssInvalidationMap* map,
+                                                                    CssInvalidationFeature feature,
+                                                                    const char* name);
+
+
+/**
+ *  Collect the entries whose selector may match an element: those filed
+ *  under its id, one of its classes or its tag name, and the universal ones.
+ *  Entries come bucket by bucket, sort them on `order` for the cascade.
+ *
+ *  @param index       The index
+ *  @param tag         Tag name of the element, compared case-insensitively
+ *  @param id          Id of the element, or NULL
+ *  @param classes     Distinct class names of the element
+ *  @param class_count Number of class names
+ *  @param candidates  Receives at most `capacity` entries
+ *  @param capacity    Size of `candidates`
+ *
+ *  @return The number of candidates, which may exceed `capacity`
+ */
+CSSPARSER_API size_t css_rule_index_collect(const CssRuleIndex* index, const char* tag, const char* id,
+                                            const char* const* classes, size_t class_count,
+                                            const CssRuleIndexEntry** candidates, size_t capacity);
+
+
+/**
+ *  Access to the elements of the host document. Elements are opaque, the
+ *  sibling functions only walk element siblings.
+ */
+typedef struct {
+    // Tag name, compared case-insensitively
+    const char* (*tag_name)(const void* element);
+    // Id, or NULL
+    const char* (*id)(const void* element);
+    bool (*has_class)(const void* element, const char* name);
+    // Value of an attribute, or NULL if the element does not have it
+    const char* (*attribute)(const void* element, const char* name);
+    // NULL for the root element
+    const void* (*parent)(const void* element);
+    const void* (*previous_sibling)(const void* element);
+    const void* (*next_sibling)(const void* element);
+    // Dynamic states like `:hover` or `:checked`, and `:empty`. Optional,
+    // such pseudo-classes never match without it.
+    bool (*has_state)(const void* element, CssPseudoType pseudo);
+} CssElementOps;
+
+
+/**
+ *  Match a complex selector against an element, right to left: the rightmost
+ *  compound is checked on the element before any combinator walks the tree.
+ *  Namespace prefixes are ignored, and a selector with a pseudo-element
+ *  never matches an element.
+ *
+ *  @param selector A selector of a selector list, like `CssStyleRule.selectors`
+ *  @param element  The element
+ *  @param ops      Access to the element and the tree around it
+ *
+ *  @return true if the selector matches the element
+ */
+CSSPARSER_API bool css_selector_matches(const CssSelector* selector, const void* element, const CssElementOps* ops);
+
+/**
+ *  Whether a 1-based position is `An+B` for some n >= 0, the a and b of a
+ *  `:nth-*` pseudo class being in `CssSelectorRareData.bits.nth`.
+ *
+ *  @param a     The step, may be 0 or negative
+ *  @param b     The offset
+ *  @param index The 1-based position of the element among its siblings
+ *
+ *  @return true if the position is in the sequence
+ */
+CSSPARSER_API bool css_nth_matches(int a, int b, int index);
+
+/**
+ *  Positions of elements among their siblings. The siblings of an element
+ *  are all numbered the first time one of them is looked up, which makes
+ *  `:nth-*` and `:*-of-type` pseudo classes constant time per element
+ *  instead of a walk over the siblings. The cache keeps element pointers:
+ *  clear it whenever the tree changes.
+ */
+typedef struct CssInternalNthIndexCache CssNthIndexCache;
+
+/**
+ *  Create an empty sibling position cache.
+ *
+ *  @return a cache, to be released by css_nth_index_cache_destroy()
+ */
+CSSPARSER_API CssNthIndexCache* css_nth_index_cache_new(void);
+
+/**
+ *  Forget every position, after the tree changed.
+ *
+ *  @param cache The cache
+ */
+CSSPARSER_API void css_nth_index_cache_clear(CssNthIndexCache* cache);
+
+/**
+ *  Release a cache created by css_nth_index_cache_new().
+ *
+ *  @param cache The cache
+ */
+CSSPARSER_API void css_nth_index_cache_destroy(CssNthIndexCache* cache);
+
+/**
+ *  css_selector_matches() reading sibling positions from a cache.
+ *
+ *  @param selector A selector of a selector list, like `CssStyleRule.selectors`
+ *  @param element  The element
+ *  @param ops      Access to the element and the tree around it
+ *  @param cache    Sibling positions of the tree, or NULL
+ *
+ *  @return true if the selector matches the element
+ */
+CSSPARSER_API bool css_selector_matches_with_cache(const CssSelector* selector, const void* element,
+                                                   const CssElementOps* ops, CssNthIndexCache* cache);
+
+/**
+ *  A selector list compiled into contiguous bytecode, matched like
+ *  css_selector_matches() without walking the CssSelector chains.
+ */
+typedef struct CssInternalSelectorProgram CssSelectorProgram;
+
+/**
+ *  Compile a selector list. The program does not reference the selectors,
+ *  it outlives the stylesheet.
+ *
+ *  @param selectors A selector list, like `CssStyleRule.selectors`
+ *
+ *  @return a program, to be released by css_selector_program_destroy()
+ */
+CSSPARSER_API CssSelectorProgram* css_selector_program_new(const CssArray* selectors);
+
+/**
+ *  Release a program created by css_selector_program_new().
+ *
+ *  @param program The program
+ */
+CSSPARSER_API void css_selector_program_destroy(CssSelectorProgram* program);
+
+/**
+ *  Match one selector of the compiled list against an element.
+ *
+ *  @param program        The program
+ *  @param selector_index Index of the selector in the compiled list
+ *  @param element        The element
+ *  @param ops            Access to the element and the tree around it
+ *
+ *  @return true if the selector matches the element
+ */
+CSSPARSER_API bool css_selector_program_matches(const CssSelectorProgram* program, size_t selector_index,
+                                                const void* element, const CssElementOps* ops);
+
+/**
+ *  css_selector_program_matches() reading sibling positions from a cache.
+ *
+ *  @param program        The program
+ *  @param selector_index Index of the selector in the compiled list
+ *  @param element        The element
+ *  @param ops            Access to the element and the tree around it
+ *  @param cache          Sibling positions of the tree, or NULL
+ *
+ *  @return true if the selector matches the element
+ */
+CSSPARSER_API bool css_selector_program_matches_with_cache(const CssSelectorProgram* program, size_t selector_index,
+                                                           const void* element, const CssElementOps* ops,
+                                                           CssNthIndexCache* cache);
+
+/**
+ *  Size of the code, entry table and name pool of a program.
+ *
+ *  @param program The program
+ *
+ *  @return the size in bytes
+ */
+CSSPARSER_API size_t css_selector_program_size(const CssSelectorProgram* program);
+
+/**
+ *  The distinct selectors of an index compiled once, when the index is
+ *  built. Equal selectors share their entry, match an entry with
+ *  css_selector_program_matches(program, entry->unique, ...).
+ *
+ *  @param index The index
+ *
+ *  @return css_rule_index_unique_count() entries, owned by the index
+ */
+CSSPARSER_API const CssSelectorProgram* css_rule_index_program(const CssRuleIndex* index);
+
+/**
+ *  What media queries are evaluated against. Lengths are in px.
+ */
+typedef struct {
+    // Lowercase media type, NULL for `screen`
+    const char* media_type;
+    // Viewport
+    double width;
+    double height;
+    // Screen
+    double device_width;
+    double device_height;
+    // Device pixels per px, `resolution` in dppx
+    double resolution;
+    // Initial font size, what `em` are in media queries
+    double font_size;
+    // Bits per color component, 0 on monochrome devices
+    int color;
+    // Bits per pixel on monochrome devices, else 0
+    int monochrome;
+} CssMediaEnv;
+
+/**
+ *  Evaluate a media query. Knows `width`, `height`, `device-width`,
+ *  `device-height`, `orientation`, `aspect-ratio`, `device-aspect-ratio`,
+ *  `resolution`, `-webkit-device-pixel-ratio`, `color` and `monochrome`,
+ *  with their `min-` and `max-` forms. A query using any other feature,
+ *  or a value not suiting its feature like `(min-width: red)`, never
+ *  holds, even with `not`.
+ *
+ *  @param query A query of a media list, like `CssMediaRule.medias`
+ *  @param env   The environment
+ *
+ *  @return true if the query holds
+ */
+CSSPARSER_API bool css_media_query_evaluate(const CssMediaQuery* query, const CssMediaEnv* env);
+
+/**
+ *  Evaluate a media list, which holds when any of its queries does.
+ *
+ *  @param medias A CssMediaQuery array, like `CssMediaRule.medias`, may be NULL
+ *  @param env    The environment
+ *
+ *  @return true if the list is empty or one of its queries holds
+ */
+CSSPARSER_API bool css_media_list_evaluate(const CssArray* medias, const CssMediaEnv* env);
+
+/**
+ *  The state of every `@media` rule of a stylesheet under an environment.
+ *  Queries written the same way in several rules are evaluated once, and
+ *  on an update only those reading what changed in the environment are
+ *  evaluated again.
+ */
+typedef struct CssInternalMediaQueryCache CssMediaQueryCache;
+
+/**
+ *  Collect the `@media` rules of a stylesheet, nested ones included. All
+ *  are inactive until the first update. The stylesheet must outlive the
+ *  cache.
+ *
+ *  @param stylesheet The stylesheet
+ *
+ *  @return a cache, to be released by css_media_query_cache_destroy()
+ */
+CSSPARSER_API CssMediaQueryCache* css_media_query_cache_new(const CssStylesheet* stylesheet);
+
+/**
+ *  Release a cache created by css_media_query_cache_new().
+ *
+ *  @param cache The cache
+ */
+CSSPARSER_API void css_media_query_cache_destroy(CssMediaQueryCache* cache);
+
+/**
+ *  Evaluate the rules under a new environment, like after a resize.
+ *  On a resize, only the queries with a `width` or `height` bound
+ *  between the old and the new size are evaluated again.
+ *
+ *  @param cache The cache
+ *  @param env   The environment, copied
+ *
+ *  @return how many rules became active or inactive, see
+ *          css_media_query_cache_changed()
+ */
+CSSPARSER_API size_t css_media_query_cache_update(CssMediaQueryCache* cache, const CssMediaEnv* env);
+
+/**
+ *  The rules that became active or inactive in the last update, in
+ *  document order.
+ *
+ *  @param cache The cache
+ *
+ *  @return as many rules as the last update returned, owned by the cache
+ */
+CSSPARSER_API const CssMediaRule* const* css_media_query_cache_changed(const CssMediaQueryCache* cache);
+
+/**
+ *  Whether the media list of a rule and of the `@media` rules around it
+ *  all hold.
+ *
+ *  @param cache The cache
+ *  @param rule  An `@media` rule of the stylesheet
+ *
+ *  @return true if the rule is active, false for unknown rules
+ */
+CSSPARSER_API bool css_media_query_cache_is_active(const CssMediaQueryCache* cache, const CssMediaRule* rule);
+
+/**
+ *  Number of distinct queries in the cache, each evaluated once per update.
+ *
+ *  @param cache The cache
+ *
+ *  @return the number of distinct queries
+ */
+CSSPARSER_API size_t css_media_query_cache_distinct_count(const CssMediaQueryCache* cache);
+
+
+/**
+ *  Origin of a stylesheet, in increasing precedence for normal declarations.
+ *  `!important` declarations reverse it.
+ */
+typedef enum {
+    CssCascadeOriginUserAgent,
+    CssCascadeOriginUser,
+    CssCascadeOriginAuthor,
+} CssCascadeOrigin;
+
+/**
+ *  Winning declarations of an element, owned by the CssCascade
+ */
+typedef struct {
+    // By property id, NULL for the properties without any declaration.
+    // Custom properties are in `custom` instead, and vendor prefixed names
+    // share the slot of their property.
+    const CssDeclaration* declarations[CssPropertyCount];
+    // Ids of the properties with a declaration, increasing
+    const CssPropertyID* properties;
+    unsigned int length;
+    // Number of selectors matching the element
+    unsigned int matched;
+    // Winning declaration of each custom property, by name
+    const CssDeclaration* const* custom;
+    unsigned int custom_length;
+} CssCascadedStyle;
+
+/**
+ *  Stylesheets to cascade, and the styles resolved so far
+ */
+typedef struct CssInternalCascade CssCascade;
+
+
+/**
+ *  @return An empty cascade, release it with css_cascade_destroy()
+ */
+CSSPARSER_API CssCascade* css_cascade_new(void);
+
+
+/**
+ *  Free the cascade and its styles
+ *
+ *  @param cascade The cascade
+ */
+CSSPARSER_API void css_cascade_destroy(CssCascade* cascade);
+
+
+/**
+ *  Add a stylesheet, after those added before in the cascade order. The
+ *  styles resolved so far are dropped.
+ *
+ *  @param cascade    The cascade
+ *  @param stylesheet The stylesheet, which must outlive the cascade
+ *  @param index      Its index from css_rule_index_new(), same lifetime
+ *  @param origin     Its origin
+ *  @param media      Cache of its `@media` rules, updated by the caller, or
+ *                    NULL to apply the rules in `@media` rules whatever
+ *                    their media
+ */
+CSSPARSER_API void css_cascade_add_stylesheet(CssCascade* cascade, CssStylesheet* stylesheet,
+                                              const CssRuleIndex* index, CssCascadeOrigin origin,
+                                              const CssMediaQueryCache* media);
+
+
+/**
+ *  Find the winning declaration of each property for an element: by origin
+ *  and importance, then specificity, then position. Elements matching the
+ *  same selectors share the same style.
+ *
+ *  @param cascade     The cascade
+ *  @param element     The element
+ *  @param ops         Access to the element and the tree around it
+ *  @param classes     Distinct class names of the element
+ *  @param class_count Number of class names
+ *  @param filter      Ancestors of the element, see css_bloom_filter_push(),
+ *                     or NULL
+ *
+ *  @return The style, valid until css_cascade_clear() or
+ *          css_cascade_add_stylesheet()
+ */
+CSSPARSER_API const CssCascadedStyle* css_cascade_resolve(CssCascade* cascade, const void* element,
+                                                          const CssElementOps* ops,
+                                                          const char* const* classes, size_t class_count,
+                                                          const CssBloomFilter* filter);
+
+
+/**
+ *  Drop the resolved styles, after the document or the media changed.
+ *
+ *  @param cascade The cascade
+ */
+CSSPARSER_API void css_cascade_clear(CssCascade* cascade);
+
+
+/**
+ *  Number of distinct styles resolved since the last clear.
+ *
+ *  @param cascade The cascade
+ *
+ *  @return the number of styles
+ */
+CSSPARSER_API size_t css_cascade_style_count(const CssCascade* cascade);
+
+
+/**
+ *  Custom properties of an element, their `var()` references substituted
+ */
+typedef struct CssInternalCustomProperties CssCustomProperties;
+
+/**
+ *  Computes custom properties down the tree and substitutes `var()`,
+ *  remembering both
+ */
+typedef struct CssInternalVariableResolver CssVariableResolver;
+
+
+/**
+ *  @return An empty resolver, release it with css_variable_resolver_destroy()
+ */
+CSSPARSER_API CssVariableResolver* css_variable_resolver_new(void);
+
+
+/**
+ *  Free the resolver and everything it computed
+ *
+ *  @param resolver The resolver
+ */
+CSSPARSER_API void css_variable_resolver_destroy(CssVariableResolver* resolver);
+
+
+/**
+ *  Drop the computed custom properties and substitutions, needed whenever
+ *  the cascade drops the styles they were computed from.
+ *
+ *  @param resolver The resolver
+ */
+CSSPARSER_API void css_variable_resolver_clear(CssVariableResolver* resolver);
+
+
+/**
+ *  Compute the custom properties of an element. Elements with the same
+ *  parent properties and the same cascaded style share the result.
+ *
+ *  @param resolver The resolver
+ *  @param parent   Custom properties of the parent element, NULL for the root
+ *  @param style    Cascaded style of the element, see css_cascade_resolve()
+ *
+ *  @return The custom properties, NULL while no element up the tree
+ *          declares any, valid until css_variable_resolver_clear()
+ */
+CSSPARSER_API const CssCustomProperties* css_variable_resolver_compute(CssVariableResolver* resolver,
+                                                                       const CssCustomProperties* parent,
+                                                                       const CssCascadedStyle* style);
+
+
+/**
+ *  Value of a custom property, declared on the element or inherited.
+ *
+ *  @param properties The custom properties, may be NULL
+ *  @param name       The property name, with its leading `--`
+ *
+ *  @return The value with its references substituted, or NULL when the
+ *          property is not declared or is invalid, like in a cycle of
+ *          references
+ */
+CSSPARSER_API const char* css_custom_properties_get(const CssCustomProperties* properties, const char* name);
+
+
+/**
+ *  Substitute the `var()` references in the value of a declaration.
+ *
+ *  @param resolver    The resolver
+ *  @param properties  Custom properties of the element, may be NULL
+ *  @param declaration The declaration, from the cascaded style
+ *
+ *  @return The value as text, `raw` for declarations without references,
+ *          or NULL when a reference is invalid and has no fallback
+ */
+CSSPARSER_API const char* css_variable_resolver_substitute(CssVariableResolver* resolver,
+                                                           const CssCustomProperties* properties,
+                                                           const CssDeclaration* declaration);
+
+
+/**
+ *  Names of the custom properties the value of a declaration refers to,
+ *  fallbacks included.
+ *
+ *  @param resolver    The resolver
+ *  @param declaration The declaration
+ *  @param names       Receives up to `capacity` names, owned by the resolver
+ *  @param capacity    Size of `names`
+ *
+ *  @return the number of references, more than `capacity` when they did not
+ *          all fit
+ */
+CSSPARSER_API size_t css_variable_resolver_references(CssVariableResolver* resolver,
+                                                      const CssDeclaration* declaration,
+                                                      const char** names, size_t capacity);
+
 #ifdef __cplusplus
 }
 #endif
@@ -79,6 +79,36 @@ typedef struct CssInternalParser {
 
     CssSourcePosition* position;
     CssParserString default_namespace;
+
+    // The scanned buffer, offsets reported by the scanner are relative to it.
+    const char* source;
+    size_t source_length;
+    // Length of the internal mode prefix, hidden from reported offsets.
+    unsigned int source_prefix;
+    // Built on first use, see cssprsr_parser_line_index().
+    CssLineIndex* lines;
+
+    // CssParserFlags for this parse run.
+    unsigned int flags;
+
+    // Token texts which grew while their escapes were decoded, see
+    // cssprsr_tokenize(). Created on first use.
+    CssArray* unescaped_texts;
+
+    // A token read ahead by cssprsr_next_token() and handed out next.
+    bool has_pending_token;
+    int pending_token;
+    CSSPARSERSTYPE pending_lval;
+    CSSPARSERLTYPE pending_loc;
+    // Type of the token handed out last, and the offset up to which the
+    // scanner tokens are dropped, the pending token standing for them.
+    int last_token;
+    unsigned int skip_until;
+
+    // Tokens handed to bison so far, and whether a syntax error was reported
+    // while it held at most three, see cssprsr_parse_piece().
+    unsigned int token_count;
+    bool early_error;
     
 } CssParser;
 
@@ -99,8 +129,20 @@ CssValue* cssprsr_new_dimension_value(CssParser* parser, CssParserNumber* value,
 CssValue* cssprsr_new_number_value(CssParser* parser, int sign, CssParserNumber* value, CssValueUnit unit);
 CssValue* cssprsr_new_operator_value(CssParser* parser, int value);
 CssValue* cssprsr_new_ident_value(CssParser* parser, CssParserString* value);
+CssValueID cssprsr_value_id(const char* name, size_t length);
+bool cssprsr_color_from_function(const char* name, size_t length, const CssArray* args, CssColor* color);
+void cssprsr_value_resolve_hex_color(CssParser* parser, CssValue* value);
+void cssprsr_declaration_resolve_named_colors(CssParser* parser, CssDeclaration* declaration);
+void cssprsr_color_to_string(const CssValue* value, char* buffer, size_t size);
+CssCalcExpression* cssprsr_calc_from_function(CssParser* parser, CssParserString* name, const CssArray* args);
+void cssprsr_destroy_calc(CssParser* parser, CssCalcExpression* calc);
+CssCalcExpression* cssprsr_copy_calc(CssParser* parser, const CssCalcExpression* calc);
+void cssprsr_calc_to_string(const CssCalcExpression* calc, char* buffer, size_t size);
+double cssprsr_unit_absolute_scale(CssValueUnit unit);
+double cssprsr_unit_scale(CssValueUnit unit, const CssUnitContext* context);
 CssValue* cssprsr_new_function_value(CssParser* parser, CssParserString* name, CssArray* args);
 CssValue* cssprsr_new_list_value(CssParser* parser, CssArray* list);
+CssValue* cssprsr_copy_value(CssParser* parser, const CssValue* value);
 void cssprsr_value_set_string(CssParser* parser, CssValue* value, CssParserString* string);
 void cssprsr_value_set_sign(CssParser* parser, CssValue* value, int sign);
 CssArray* cssprsr_new_value_list(CssParser* parser);
@@ -120,8 +162,13 @@ CssRule* cssprsr_new_style_rule(CssParser* parser, CssArray* selectors);
 void cssprsr_start_declaration(CssParser* parser);
 void cssprsr_end_declaration(CssParser* parser, bool flag, bool ended);
 void cssprsr_set_current_declaration(CssParser* parser, CssParserString* tag);
-bool cssprsr_new_declaration(CssParser* parser, CssParserString* name, bool important, CssArray* values);
+bool cssprsr_new_declaration(CssParser* parser, CssParserString* name, bool important, CssArray* values, CSSPARSERLTYPE* loc);
 void cssprsr_parser_clear_declarations(CssParser* parser);
+CssPropertyID cssprsr_property_id(const char* name, CssVendorPrefix* vendor);
+CssDeclaration* cssprsr_new_longhand_declaration(CssParser* parser, const CssDeclaration* shorthand,
+                                                 CssPropertyID id, CssArray* values);
+bool cssprsr_expand_shorthand(CssParser* parser, const CssDeclaration* declaration, CssArray* declarations);
+bool cssprsr_values_have_var(const CssArray* values);
 void cssprsr_start_selector(CssParser* parser);
 void cssprsr_end_selector(CssParser* parser);
 CssQualifiedName * cssprsr_new_qualified_name(CssParser* parser, CssParserString* prefix, CssParserString* localName, CssParserString* uri);
@@ -140,8 +187,9 @@ void cssprsr_selector_list_shink(CssParser* parser, int capacity, CssArray* list
 void cssprsr_selector_list_add(CssParser* parser, CssSelector* selector, CssArray* list);
 void cssprsr_selector_set_value(CssParser* parser, CssSelector* selector, CssParserString* value);
 void cssprsr_selector_set_argument(CssParser* parser, CssSelector* selector, CssParserString* argument);
+void cssprsr_selector_set_nth_argument(CssParser* parser, CssSelector* selector, CssParserString* argument);
 void cssprsr_selector_set_argument_with_number(CssParser* parser, CssSelector* selector, int sign, CssParserNumber* value);
-bool cssprsr_parse_attribute_match_type(CssParser* parser, CssAttributeMatchType, CssParserString* attr);
+bool cssprsr_parse_attribute_match_type(CssParser* parser, CssAttributeMatchType* type, CssParserString* attr);
 bool cssprsr_selector_is_simple(CssParser* parser, CssSelector* selector);
 void cssprsr_selector_extract_pseudo_type(CssSelector* selector);
 void cssprsr_add_rule(CssParser* parser, CssRule* rule);
@@ -161,11 +209,30 @@ void cssprsr_parse_internal_media_list(CssParser* parser, CssArray* e);
 void cssprsr_parse_internal_declaration_list(CssParser* parser, bool e);
 void cssprsr_parse_internal_selector(CssParser* parser, CssArray* e);
 
+// Destroy
+void cssprsr_destroy_rule(CssParser* parser, CssRule* e);
+void cssprsr_destroy_declaration(CssParser* parser, CssDeclaration* e);
+void cssprsr_destroy_value(CssParser* parser, CssValue* e);
+
+// Parses UTF-8 input as is, css_parse_string_with_flags() decodes it first.
+CssOutput* cssprsr_parse_string(const char* str, size_t len, CssParserMode mode, unsigned int flags);
+
+// Parses a piece of a stylesheet on its own, for css_reparse_range(). After a
+// syntax error bison keeps quiet until three tokens were shifted, even when
+// the error was recovered by an action without a report, so the whole input
+// may not report an error the piece reports among its first three tokens.
+// Returns NULL then.
+CssOutput* cssprsr_parse_piece(const char* str, size_t len, unsigned int flags);
+
 // Bison error
 void cssprsr_error(CSSPARSERLTYPE* yyloc, void* scanner, CssParser * parser, char*);
 
 // Bison parser location
 CssSourcePosition* cssprsr_parser_current_location(CssParser* parser, CSSPARSERLTYPE* yylloc);
+unsigned int cssprsr_parser_offset(CssParser* parser, unsigned int offset);
+CssLineIndex* cssprsr_parser_line_index(CssParser* parser);
+void cssprsr_parser_set_range(CssParser* parser, CssSourceRange* range, CSSPARSERLTYPE* loc);
+void cssprsr_parser_resolve_position(CssParser* parser, CssSourcePosition* pos);
 
 // Log
 void cssprsr_parser_log(CssParser* parser, const char * format, ...);
@@ -198,6 +265,7 @@ void cssprsr_print_declaration_list(CssParser* parser, CssArray* declarations);
 void cssprsr_print_value_list(CssParser* parser, CssArray* values);
 
 int cssprsr_tokenize(CSSPARSERSTYPE* lval , CSSPARSERLTYPE* loc, yyscan_t scanner, CssParser* parser, int tok);
+int cssprsr_next_token(CSSPARSERSTYPE* lval, CSSPARSERLTYPE* loc, yyscan_t scanner, CssParser* parser);
 
 #ifdef __cplusplus
 }
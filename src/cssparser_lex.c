@@ -197,20 +197,7 @@ typedef size_t yy_size_t;
 #define EOB_ACT_END_OF_FILE 1
 #define EOB_ACT_LAST_MATCH 2
 
-    /* Note: We specifically omit the test for yy_rule_can_match_eol because it requires
-     *       access to the local variable yy_act. Since yyless() is a macro, it would break
-     *       existing scanners that call yyless() from OUTSIDE cssprsr_lex. 
-     *       One obvious solution it to make yy_act a global. I tried that, and saw
-     *       a 5% performance hit in a non-yylineno scanner, because yy_act is
-     *       normally declared as a register variable-- so it is not worth it.
-     */
-    #define  YY_LESS_LINENO(n) \
-            do { \
-                int yyl;\
-                for ( yyl = n; yyl < yyleng; ++yyl )\
-                    if ( yytext[yyl] == '\n' )\
-                        --yylineno;\
-            }while(0)
+    #define YY_LESS_LINENO(n)
     
 /* Return all but the first "n" matched characters back to the input stream. */
 #define yyless(n) \
@@ -1868,15 +1855,6 @@ static yyconst flex_int16_t yy_chk[5551] =
       550,  550,  550,  550,  550,  550,  550,  550,  550,  550
     } ;
 
-/* Table of booleans, true if rule could match eol. */
-static yyconst flex_int32_t yy_rule_can_match_eol[91] =
-    {   0,
-1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 
-    0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 
-    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
-    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 
-    0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,     };
-
 /* The intent behind this definition is that it'll catch
  * any uses of REJECT which flex missed.
  */
@@ -1931,10 +1909,11 @@ extern int cssprsr_lex \
 #define CSSPRSR_RTOKEN(x) cssprsr_tokenize(yylval, yylloc, yyscanner, parser, x); return (x);
 #define YY_NO_INPUT
 
-#define YY_USER_ACTION /*yylloc->filename = filename;*/ \
-        yylloc->first_line = yylloc->last_line = yylineno; \
-        yylloc->first_column = yycolumn; yylloc->last_column = yycolumn+(int)yyleng-1; \
-        yycolumn += (int)yyleng;
+/* Only byte offsets are tracked per token, lines and columns are resolved
+ * on demand from the offsets, see cssprsr_line_index_lookup(). */
+#define YY_USER_ACTION \
+        yylloc->first_offset = (unsigned int)(yytext - YY_CURRENT_BUFFER_LVALUE->yy_ch_buf); \
+        yylloc->last_offset = yylloc->first_offset + (unsigned int)yyleng;
 
 #define INITIAL 0
 #define mediaquery 1
@@ -2243,18 +2222,6 @@ yy_find_action:
 
 		YY_DO_BEFORE_ACTION;
 
-		if ( yy_act != YY_END_OF_BUFFER && yy_rule_can_match_eol[yy_act] )
-			{
-			int yyl;
-			for ( yyl = 0; yyl < yyleng; ++yyl )
-				if ( yytext[yyl] == '\n' )
-					   
-    do{ yylineno++;
-        yycolumn=0;
-    }while(0)
-;
-			}
-
 do_action:	/* This label is used only to access EOF actions. */
 
 		switch ( yy_act )
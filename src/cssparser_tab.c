@@ -68,7 +68,7 @@
 
 /* Substitute the variable and function names.  */
 #define yyparse         cssparse
-#define yylex           cssprsr_lex
+#define yylex           cssprsr_next_token
 #define yyerror         cssprsr_error
 #define yydebug         cssprsr_debug
 #define yynerrs         cssprsr_nerrs
@@ -78,6 +78,24 @@
 #define YYENABLE_NLS 0
 #define YYLTYPE_IS_TRIVIAL 1
 #define YYMAXDEPTH 10000
+
+/* Locations are byte offsets into the scanned buffer. */
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                 \
+    do                                                                  \
+      if (N)                                                            \
+        {                                                               \
+          (Current).first_offset = YYRHSLOC (Rhs, 1).first_offset;      \
+          (Current).last_offset  = YYRHSLOC (Rhs, N).last_offset;       \
+        }                                                               \
+      else                                                              \
+        {                                                               \
+          (Current).first_offset = (Current).last_offset =              \
+            YYRHSLOC (Rhs, 0).last_offset;                              \
+        }                                                               \
+    while (0)
+
+#define YY_LOCATION_PRINT(File, Loc) \
+    YYFPRINTF (File, "%u-%u", (Loc).first_offset, (Loc).last_offset)
     
 #ifdef CSSPRSR_RBISON_DEBUG
 #if CSSPRSR_RBISON_DEBUG
@@ -298,10 +316,8 @@ typedef union CSSPARSERSTYPE CSSPARSERSTYPE;
 typedef struct CSSPARSERLTYPE CSSPARSERLTYPE;
 struct CSSPARSERLTYPE
 {
-  int first_line;
-  int first_column;
-  int last_line;
-  int last_column;
+  unsigned int first_offset;
+  unsigned int last_offset;
 };
 # define CSSPARSERLTYPE_IS_DECLARED 1
 # define CSSPARSERLTYPE_IS_TRIVIAL 1
@@ -1920,7 +1936,7 @@ YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
 /* Location data for the lookahead symbol.  */
 static YYLTYPE yyloc_default
 # if defined CSSPARSERLTYPE_IS_TRIVIAL && CSSPARSERLTYPE_IS_TRIVIAL
-  = { 1, 1, 1, 1 }
+  = { 0, 0 }
 # endif
 ;
 YYLTYPE yylloc = yyloc_default;
@@ -2181,6 +2197,8 @@ yyreduce:
         case 10:
 
     {
+        if ((yyvsp[-2].rule))
+            cssprsr_parser_set_range(parser, &(yyvsp[-2].rule)->range, &(yylsp[-2]));
         cssprsr_parse_internal_rule(parser, (yyvsp[-2].rule));
     }
 
@@ -2265,6 +2283,8 @@ yyreduce:
 
     {
         (yyval.rule) = (yyvsp[0].rule);
+        if ((yyval.rule))
+            cssprsr_parser_set_range(parser, &(yyval.rule)->range, &(yyloc));
         // parser->m_hadSyntacticallyValidCSSRule = true;
         cssprsr_end_rule(parser, !!(yyval.rule));
     }
@@ -2306,6 +2326,8 @@ yyreduce:
 
     {
         (yyval.rule) = (yyvsp[0].rule);
+        if ((yyval.rule))
+            cssprsr_parser_set_range(parser, &(yyval.rule)->range, &(yyloc));
         cssprsr_end_rule(parser, !!(yyval.rule));
     }
 
@@ -2758,6 +2780,7 @@ yyreduce:
 
     {
         (yyval.keyframe) = cssprsr_new_keyframe(parser, (yyvsp[-4].valueList));
+        cssprsr_parser_set_range(parser, &(yyval.keyframe)->range, &(yyloc));
     }
 
     break;
@@ -2800,7 +2823,7 @@ yyreduce:
         else if (!strcasecmp((yyvsp[0].string).data, "to")) {
             CssParserNumber number;
             number.val = 100;
-            number.raw = (CssParserString){"to", 4};
+            number.raw = (CssParserString){"to", 2};
             (yyval.value) = cssprsr_new_number_value(parser, 1, &number, CSS_VALUE_NUMBER);
         }
         else {
@@ -2938,6 +2961,7 @@ yyreduce:
     {
         (yyval.selectorList) = cssprsr_reusable_selector_list(parser);
         cssprsr_selector_list_shink(parser, 0, (yyval.selectorList));
+        cssprsr_parser_set_range(parser, &(yyvsp[0].selector)->range, &(yylsp[0]));
         cssprsr_selector_list_add(parser, cssprsr_sink_floating_selector(parser, (yyvsp[0].selector)), (yyval.selectorList));
     }
 
@@ -2947,6 +2971,7 @@ yyreduce:
 
     {
         (yyval.selectorList) = (yyvsp[-5].selectorList);
+        cssprsr_parser_set_range(parser, &(yyvsp[0].selector)->range, &(yylsp[0]));
         cssprsr_selector_list_add(parser, cssprsr_sink_floating_selector(parser, (yyvsp[0].selector)), (yyval.selectorList));
     }
 
@@ -3146,7 +3171,7 @@ yyreduce:
 
     {
         CssAttributeMatchType attrMatchType = CssAMTCaseSensitive;
-        if (!cssprsr_parse_attribute_match_type(parser, attrMatchType, &(yyvsp[-1].string)))
+        if (!cssprsr_parse_attribute_match_type(parser, &attrMatchType, &(yyvsp[-1].string)))
             YYERROR;
         (yyval.attrMatchType) = attrMatchType;
     }
@@ -3308,8 +3333,8 @@ yyreduce:
     {
         (yyval.selector) = cssprsr_new_selector(parser);
         (yyval.selector)->match = CssSelMatchPseudoClass;
-        cssprsr_selector_set_argument(parser, (yyval.selector), &(yyvsp[-2].string));
         cssprsr_selector_set_value(parser, (yyval.selector), &(yyvsp[-4].string));
+        cssprsr_selector_set_nth_argument(parser, (yyval.selector), &(yyvsp[-2].string));
         cssprsr_selector_extract_pseudo_type((yyval.selector));
         // CSSSelector::PseudoType type = $$->pseudoType();
         // if (type == CSSSelector::PseudoUnknown)
@@ -3452,7 +3477,7 @@ yyreduce:
         (yyval.boolean) = false;
         bool isPropertyParsed = false;
         // unsigned int oldParsedProperties = parser->parsedProperties->length;
-        (yyval.boolean) = cssprsr_new_declaration(parser, &(yyvsp[-5].string), (yyvsp[0].boolean), (yyvsp[-1].valueList));
+        (yyval.boolean) = cssprsr_new_declaration(parser, &(yyvsp[-5].string), (yyvsp[0].boolean), (yyvsp[-1].valueList), &(yyloc));
         if (!(yyval.boolean)) {
             // parser->rollbackLastProperties(parser->m_parsedProperties.size() - oldParsedProperties);
             cssprsr_parser_report_error(parser, (yyvsp[-2].location), "InvalidPropertyValueCSSError");
@@ -3947,7 +3972,6 @@ yyreduce:
     {
         (yyval.valueList) = (yyvsp[-2].valueList);
         cssprsr_value_list_insert(parser, cssprsr_new_operator_value(parser, '('), 0, (yyval.valueList));
-        cssprsr_new_operator_value(parser, ')');
         cssprsr_value_list_add(parser, cssprsr_new_operator_value(parser, ')'), (yyval.valueList));
     }
 
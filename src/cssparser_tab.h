@@ -209,10 +209,8 @@ typedef union CSSPARSERSTYPE CSSPARSERSTYPE;
 typedef struct CSSPARSERLTYPE CSSPARSERLTYPE;
 struct CSSPARSERLTYPE
 {
-    int first_line;
-    int first_column;
-    int last_line;
-    int last_column;
+    unsigned int first_offset;
+    unsigned int last_offset;
 };
 # define CSSPARSERLTYPE_IS_DECLARED 1
 # define CSSPARSERLTYPE_IS_TRIVIAL 1
@@ -22,6 +22,10 @@
 #include "foundation.h"
 #include "cssparser_i.h"
 
+#if CSSPRSR_HAVE_SSE2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 struct CssInternalParser;
 
 const CssParserString cssAsteriskString = {"*", 1};
@@ -86,11 +90,92 @@ void cssprsr_string_append_string(struct CssInternalParser* parser,
     output->length += str->length;
 }
 
+static void append_escaped_code_point(struct CssInternalParser* parser, unsigned char c, CssParserString* output)
+{
+    static const char hex[] = "0123456789abcdef";
+    char buffer[5] = { '\\', 0, 0, 0, 0 };
+    if ( c >= 0x10 ) {
+        buffer[1] = hex[c >> 4];
+        buffer[2] = hex[c & 0xF];
+        buffer[3] = ' ';
+    } else {
+        buffer[1] = hex[c];
+        buffer[2] = ' ';
+    }
+    cssprsr_string_append_characters(parser, buffer, output);
+}
+
+// Refs: https://drafts.csswg.org/cssom/#serialize-an-identifier
+void cssprsr_string_append_identifier(struct CssInternalParser* parser, const char* str, CssParserString* output)
+{
+    size_t len = strlen(str);
+    maybe_resize_string(parser, len, output);
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)str[i];
+        if ( (c >= 0x01 && c <= 0x1F) || c == 0x7F
+             || (isdigit(c) && (i == 0 || (i == 1 && str[0] == '-'))) ) {
+            append_escaped_code_point(parser, c, output);
+            continue;
+        }
+        if ( i == 0 && c == '-' && len == 1 ) {
+            cssprsr_string_append_characters(parser, "\\-", output);
+            continue;
+        }
+        if ( !(c >= 0x80 || c == '-' || c == '_' || isalnum(c)) ) {
+            maybe_resize_string(parser, 1, output);
+            output->data[output->length++] = '\\';
+        }
+        maybe_resize_string(parser, 1, output);
+        output->data[output->length++] = (char)c;
+    }
+}
+
+// Refs: https://drafts.csswg.org/cssom/#serialize-a-string
+void cssprsr_string_append_quoted(struct CssInternalParser* parser, const char* str, CssParserString* output)
+{
+    size_t len = strlen(str);
+    maybe_resize_string(parser, len + 2, output);
+    output->data[output->length++] = '"';
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)str[i];
+        if ( (c >= 0x01 && c <= 0x1F) || c == 0x7F ) {
+            append_escaped_code_point(parser, c, output);
+            continue;
+        }
+        maybe_resize_string(parser, 2, output);
+        if ( c == '"' || c == '\\' )
+            output->data[output->length++] = '\\';
+        output->data[output->length++] = (char)c;
+    }
+    maybe_resize_string(parser, 1, output);
+    output->data[output->length++] = '"';
+}
+
+unsigned int cssprsr_string_hash(const char* str, bool ignore_case)
+{
+    unsigned int hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)str; *c; ++c) {
+        hash ^= ignore_case ? (unsigned int)tolower(*c) : *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned int cssprsr_string_hash_with_length(const char* str, size_t length, bool ignore_case)
+{
+    unsigned int hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)str; length--; ++c) {
+        hash ^= ignore_case ? (unsigned int)tolower(*c) : *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 bool cssprsr_string_has_prefix(const char* str, const char* prefix)
 {
     size_t pre_len = strlen(prefix);
     size_t str_len = strlen(str);
-    return pre_len <= str_len && strncasecmp(prefix, str, pre_len);
+    return pre_len <= str_len && 0 == strncasecmp(prefix, str, pre_len);
 }
 
 void cssprsr_string_to_lowercase(struct CssInternalParser* parser,
@@ -129,10 +214,172 @@ const char* cssprsr_string_to_characters_with_prefix_char(struct CssInternalPars
     char* buffer = cssprsr_parser_alloc(parser, sizeof(char) * (str->length + 2));
     memcpy((buffer + 1), str->data, str->length);
     buffer[0] = prefix;
-    buffer[str->length] = '\0';
+    buffer[str->length + 1] = '\0';
     return buffer;
 }
 
+/**
+ * Line index
+ */
+#if CSSPRSR_HAVE_SSE2
+static inline unsigned int cssprsr_count_bits(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    return __popcnt(mask);
+#else
+    return (unsigned int)__builtin_popcount(mask);
+#endif
+}
+
+static inline unsigned int cssprsr_lowest_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+#endif // #if CSSPRSR_HAVE_SSE2
+
+// Walks the source 16 bytes at a time, counting newlines when `lines` is NULL
+// and recording the offset following each of them otherwise.
+static size_t scan_newlines(const char* source, size_t length, unsigned int* lines)
+{
+    size_t count = 0;
+    size_t i = 0;
+#if CSSPRSR_HAVE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(source + i));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if ( 0 == mask )
+            continue;
+        if ( NULL == lines ) {
+            count += cssprsr_count_bits(mask);
+            continue;
+        }
+        while ( mask ) {
+            lines[count++] = (unsigned int)(i + cssprsr_lowest_bit(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif // #if CSSPRSR_HAVE_SSE2
+    for (; i < length; ++i) {
+        if ( source[i] == '\n' ) {
+            if ( NULL != lines )
+                lines[count] = (unsigned int)(i + 1);
+            count++;
+        }
+    }
+    return count;
+}
+
+CssLineIndex* cssprsr_line_index_new(struct CssInternalParser* parser, const char* source, size_t length)
+{
+    CssLineIndex* index = cssprsr_parser_alloc(parser, sizeof(CssLineIndex));
+    index->length = scan_newlines(source, length, NULL) + 1;
+    index->lines = cssprsr_parser_alloc(parser, sizeof(unsigned int) * index->length);
+    index->lines[0] = 0;
+    scan_newlines(source, length, index->lines + 1);
+    return index;
+}
+
+void cssprsr_line_index_destroy(struct CssInternalParser* parser, CssLineIndex* index)
+{
+    if ( index ) {
+        cssprsr_parser_free(parser, index->lines);
+        cssprsr_parser_free(parser, index);
+    }
+}
+
+void cssprsr_line_index_lookup(const CssLineIndex* index, unsigned int offset, unsigned int* line, unsigned int* column)
+{
+    // Find the last line starting at or before the offset.
+    size_t first = 0, count = index->length;
+    while (count > 1) {
+        size_t step = count / 2;
+        if (index->lines[first + step] <= offset) {
+            first += step;
+            count -= step;
+        } else {
+            count = step;
+        }
+    }
+    *line = (unsigned int)first + 1;
+    *column = offset - index->lines[first];
+}
+
+/**
+ * String map
+ */
+void cssprsr_string_map_init(struct CssInternalParser* parser, bool ignore_case, CssStringMap* map)
+{
+    map->capacity = 16;
+    map->length = 0;
+    map->ignore_case = ignore_case;
+    map->entries = cssprsr_parser_alloc(parser, sizeof(CssStringMapEntry) * map->capacity);
+    memset(map->entries, 0, sizeof(CssStringMapEntry) * map->capacity);
+}
+
+void cssprsr_string_map_destroy(struct CssInternalParser* parser, CssStringMap* map)
+{
+    cssprsr_parser_free(parser, map->entries);
+}
+
+static CssStringMapEntry* string_map_find(const CssStringMap* map, const char* key, unsigned int hash)
+{
+    unsigned int mask = map->capacity - 1;
+    for (unsigned int i = hash & mask; ; i = (i + 1) & mask) {
+        CssStringMapEntry* entry = &map->entries[i];
+        if ( NULL == entry->key )
+            return entry;
+        if ( entry->hash == hash
+             && 0 == (map->ignore_case ? strcasecmp(entry->key, key) : strcmp(entry->key, key)) )
+            return entry;
+    }
+}
+
+static void string_map_grow(struct CssInternalParser* parser, CssStringMap* map)
+{
+    CssStringMapEntry* old = map->entries;
+    unsigned int old_capacity = map->capacity;
+    map->capacity *= 2;
+    map->entries = cssprsr_parser_alloc(parser, sizeof(CssStringMapEntry) * map->capacity);
+    memset(map->entries, 0, sizeof(CssStringMapEntry) * map->capacity);
+    for (unsigned int i = 0; i < old_capacity; ++i) {
+        if ( old[i].key )
+            *string_map_find(map, old[i].key, old[i].hash) = old[i];
+    }
+    cssprsr_parser_free(parser, old);
+}
+
+void** cssprsr_string_map_insert(struct CssInternalParser* parser, const char* key, CssStringMap* map)
+{
+    unsigned int hash = cssprsr_string_hash(key, map->ignore_case);
+    CssStringMapEntry* entry = string_map_find(map, key, hash);
+    if ( NULL == entry->key ) {
+        // Keep the load factor under 3/4.
+        if ( (map->length + 1) * 4 > map->capacity * 3 ) {
+            string_map_grow(parser, map);
+            entry = string_map_find(map, key, hash);
+        }
+        entry->key = key;
+        entry->hash = hash;
+        entry->value = NULL;
+        map->length++;
+    }
+    return &entry->value;
+}
+
+void* cssprsr_string_map_get(const CssStringMap* map, const char* key)
+{
+    if ( NULL == key )
+        return NULL;
+    return string_map_find(map, key, cssprsr_string_hash(key, map->ignore_case))->value;
+}
+
 /**
  * Array
  */
@@ -24,6 +24,11 @@
 
 #include "cssparser.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CSSPRSR_HAVE_SSE2 1
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +44,24 @@ typedef struct {
     unsigned int offset;
 } CssSourcePosition;
 
+/**
+ *  Line index, built lazily to resolve byte offsets into lines and columns
+ */
+typedef struct {
+    // Offset of the first byte of each line, lines[0] is always 0.
+    unsigned int* lines;
+    size_t length;
+} CssLineIndex;
+
+// Scans the source once for newlines and records where each line starts.
+CssLineIndex* cssprsr_line_index_new(struct CssInternalParser* parser, const char* source, size_t length);
+
+// Frees the memory used by a CssLineIndex.
+void cssprsr_line_index_destroy(struct CssInternalParser* parser, CssLineIndex* index);
+
+// Resolves an offset to a 1-based line and a 0-based column.
+void cssprsr_line_index_lookup(const CssLineIndex* index, unsigned int offset, unsigned int* line, unsigned int* column);
+
 /**
  *  String
  */
@@ -70,6 +93,18 @@ const char* cssprsr_string_to_characters_with_prefix_char(struct CssInternalPars
 // Appends a string onto the end of the CssParserString.
 void cssprsr_string_append_string(struct CssInternalParser* parser, CssParserString* str, CssParserString* output);
 
+// Appends a decoded identifier, escaping what would not scan back as the same identifier.
+void cssprsr_string_append_identifier(struct CssInternalParser* parser, const char* str, CssParserString* output);
+
+// Appends a decoded string double quoted, escaping quotes, backslashes and control characters.
+void cssprsr_string_append_quoted(struct CssInternalParser* parser, const char* str, CssParserString* output);
+
+// FNV-1a hash of a NUL terminated string, ASCII letters folded to lowercase when `ignore_case`.
+unsigned int cssprsr_string_hash(const char* str, bool ignore_case);
+
+// Same hash over the first `length` bytes of `str`.
+unsigned int cssprsr_string_hash_with_length(const char* str, size_t length, bool ignore_case);
+
 // Returns a bool value that indicates whether a given string matches the beginning characters of the receiver.
 bool cssprsr_string_has_prefix(const char* str, const char* prefix);
 
@@ -111,6 +146,37 @@ void cssprsr_array_remove(struct CssInternalParser* parser, void* element, CssAr
 // potentially O(N) time and should be used sparingly.
 void* cssprsr_array_remove_at(struct CssInternalParser* parser, int index, CssArray* array);
 
+/**
+ *  String map
+ */
+// Open addressing, linear probing, `capacity` is a power of two. Keys are
+// not copied, they must outlive the map.
+typedef struct {
+    const char* key;
+    unsigned int hash;
+    void* value;
+} CssStringMapEntry;
+
+typedef struct {
+    CssStringMapEntry* entries;
+    unsigned int capacity;
+    unsigned int length;
+    bool ignore_case;
+} CssStringMap;
+
+// Initializes an empty map, keys compare case-insensitively when `ignore_case`.
+void cssprsr_string_map_init(struct CssInternalParser* parser, bool ignore_case, CssStringMap* map);
+
+// Frees the memory used by a map. Does not free the values.
+void cssprsr_string_map_destroy(struct CssInternalParser* parser, CssStringMap* map);
+
+// Returns where the value of `key` is stored, adding the key with a NULL
+// value if the map does not hold it.
+void** cssprsr_string_map_insert(struct CssInternalParser* parser, const char* key, CssStringMap* map);
+
+// Returns the value of `key`, or NULL.
+void* cssprsr_string_map_get(const CssStringMap* map, const char* key);
+
 /**
  *  An alloc / free method wrapper
  */
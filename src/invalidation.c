@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "selector.h"
+#include "cssparser_i.h"
+
+// Invalidation sets.
+//
+// Every class, id and attribute name a selector tests is recorded with the
+// selector and with where the element holding it sits relative to the
+// subject of the selector. Walking a selector from its subject leftwards,
+// a descendant or child combinator makes the next compounds ancestors of
+// the subject, whatever came before; a sibling combinator makes them
+// preceding siblings of the subject or of the ancestor reached so far.
+// Names inside `:not()` and `:any()` count at the compound holding them.
+
+struct CssInternalInvalidationMap {
+    // Name to CssInvalidationSet, attribute names ignore case
+    CssStringMap classes;
+    CssStringMap ids;
+    CssStringMap attributes;
+};
+
+static void add_dependency(CssParser* parser, CssStringMap* map, const char* name,
+                           CssStyleRule* rule, CssSelector* selector, unsigned int scope)
+{
+    CssInvalidationSet** slot = (CssInvalidationSet**)cssprsr_string_map_insert(parser, name, map);
+    if ( NULL == *slot ) {
+        *slot = cssprsr_parser_alloc(parser, sizeof(CssInvalidationSet));
+        (*slot)->scope = 0;
+        cssprsr_array_init(parser, 0, &(*slot)->dependencies);
+    }
+    CssInvalidationSet* set = *slot;
+    set->scope |= scope;
+    // Selectors are added one at a time, a name seen twice in the same one
+    // only widens its dependency.
+    if ( set->dependencies.length ) {
+        CssInvalidationDependency* last = set->dependencies.data[set->dependencies.length - 1];
+        if ( last->selector == selector ) {
+            last->scope |= scope;
+            return;
+        }
+    }
+    CssInvalidationDependency* dependency = cssprsr_parser_alloc(parser, sizeof(CssInvalidationDependency));
+    dependency->rule = rule;
+    dependency->selector = selector;
+    dependency->scope = scope;
+    cssprsr_array_add(parser, dependency, &set->dependencies);
+}
+
+static void add_selector_list(CssParser* parser, CssInvalidationMap* map, CssArray* selectors,
+                              CssStyleRule* rule, CssSelector* subject, unsigned int scope);
+
+// Records the names of the compound starting at `selector`, returns its last
+// simple selector.
+static CssSelector* add_compound(CssParser* parser, CssInvalidationMap* map, CssSelector* selector,
+                                 CssStyleRule* rule, CssSelector* subject, unsigned int scope)
+{
+    for (CssSelector* cs = selector; ; cs = cs->tagHistory) {
+        switch ( cs->match ) {
+        case CssSelMatchClass:
+            add_dependency(parser, &map->classes, cs->data->value, rule, subject, scope);
+            break;
+        case CssSelMatchId:
+            add_dependency(parser, &map->ids, cs->data->value, rule, subject, scope);
+            break;
+        case CssSelMatchPseudoClass:
+            if ( (CssPseudoNot == cs->pseudo || CssPseudoAny == cs->pseudo) && cs->data->selectors )
+                add_selector_list(parser, map, cs->data->selectors, rule, subject, scope);
+            // Whether an element matches S moves its siblings in :nth-child(An+B of S)
+            else if ( (CssPseudoNthChild == cs->pseudo || CssPseudoNthLastChild == cs->pseudo) && cs->data->selectors )
+                add_selector_list(parser, map, cs->data->selectors, rule, subject, scope | CssInvalidateSiblings);
+            break;
+        default:
+            if ( cssprsr_selector_is_attribute(cs) )
+                add_dependency(parser, &map->attributes, cs->data->attribute->local, rule, subject, scope);
+            break;
+        }
+        if ( CssSelRelSubSelector != cs->relation || NULL == cs->tagHistory )
+            return cs;
+    }
+}
+
+static void add_selector(CssParser* parser, CssInvalidationMap* map, CssSelector* selector,
+                         CssStyleRule* rule, CssSelector* subject, unsigned int scope)
+{
+    for (CssSelector* compound = selector; compound; ) {
+        CssSelector* last = add_compound(parser, map, compound, rule, subject, scope);
+        switch ( last->relation ) {
+        case CssSelRelDirectAdjacent:
+        case CssSelRelIndirectAdjacent:
+            scope = (scope & ~CssInvalidateSelf) | CssInvalidateSiblings;
+            break;
+        default:
+            scope = CssInvalidateDescendants;
+            break;
+        }
+        compound = last->tagHistory;
+    }
+}
+
+static void add_selector_list(CssParser* parser, CssInvalidationMap* map, CssArray* selectors,
+                              CssStyleRule* rule, CssSelector* subject, unsigned int scope)
+{
+    for (size_t i = 0; i < selectors->length; ++i) {
+        add_selector(parser, map, selectors->data[i], rule, subject, scope);
+    }
+}
+
+static void add_rules(CssParser* parser, CssInvalidationMap* map, CssArray* rules)
+{
+    for (size_t i = 0; i < rules->length; ++i) {
+        CssRule* rule = rules->data[i];
+        if ( CssRuleMedia == rule->type && ((CssMediaRule*)rule)->rules ) {
+            add_rules(parser, map, ((CssMediaRule*)rule)->rules);
+            continue;
+        }
+        if ( CssRuleStyle != rule->type )
+            continue;
+        CssStyleRule* style = (CssStyleRule*)rule;
+        for (size_t j = 0; j < style->selectors->length; ++j) {
+            CssSelector* selector = style->selectors->data[j];
+            add_selector(parser, map, selector, style, selector, CssInvalidateSelf);
+        }
+    }
+}
+
+CssInvalidationMap* css_invalidation_map_new(CssStylesheet* stylesheet)
+{
+    if ( NULL == stylesheet )
+        return NULL;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssInvalidationMap* map = cssprsr_parser_alloc(&parser, sizeof(CssInvalidationMap));
+    cssprsr_string_map_init(&parser, false, &map->classes);
+    cssprsr_string_map_init(&parser, false, &map->ids);
+    cssprsr_string_map_init(&parser, true, &map->attributes);
+    add_rules(&parser, map, &stylesheet->rules);
+    return map;
+}
+
+static void destroy_sets(CssParser* parser, CssStringMap* map)
+{
+    for (unsigned int i = 0; i < map->capacity; ++i) {
+        CssInvalidationSet* set = map->entries[i].value;
+        if ( NULL == set )
+            continue;
+        for (size_t j = 0; j < set->dependencies.length; ++j) {
+            cssprsr_parser_free(parser, set->dependencies.data[j]);
+        }
+        cssprsr_array_destroy(parser, &set->dependencies);
+        cssprsr_parser_free(parser, set);
+    }
+    cssprsr_string_map_destroy(parser, map);
+}
+
+void css_invalidation_map_destroy(CssInvalidationMap* map)
+{
+    if ( NULL == map )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    destroy_sets(&parser, &map->classes);
+    destroy_sets(&parser, &map->ids);
+    destroy_sets(&parser, &map->attributes);
+    cssprsr_parser_free(&parser, map);
+}
+
+const CssInvalidationSet* css_invalidation_map_lookup(const CssInvalidationMap* map,
+                                                      CssInvalidationFeature feature, const char* name)
+{
+    switch ( feature ) {
+    case CssInvalidationClass:
+        return cssprsr_string_map_get(&map->classes, name);
+    case CssInvalidationId:
+        return cssprsr_string_map_get(&map->ids, name);
+    case CssInvalidationAttribute:
+        return cssprsr_string_map_get(&map->attributes, name);
+    }
+    return NULL;
+}
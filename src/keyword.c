@@ -0,0 +1,537 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Keywords.
+//
+// An ident value gets the CssValueID of its keyword, or CssValueCustom, so
+// consumers compare integers. The perfect hash table is laid out like the
+// property one in property.c, except that seeds are spread over the whole
+// hash before mixing: with 400 names some buckets hold names whose hashes
+// only differ in their high bits, which a byte seed alone cannot separate.
+// `tools/perfect_hash.py value` regenerates the seeds and slots after a
+// keyword is added, test_value_map() checks them. A keyword written in
+// lowercase, as nearly all are, points its value at the name table instead
+// of a copy.
+
+#define CSSPRSR_VALUE_BUCKETS    128
+#define CSSPRSR_VALUE_SLOTS      512
+#define CSSPRSR_VALUE_SLOT_SHIFT 23
+
+static const char* const kValueNames[CssValueCount] = {
+    [CssValueInherit]              = "inherit",
+    [CssValueInitial]              = "initial",
+    [CssValueNone]                 = "none",
+    [CssValueAbsolute]             = "absolute",
+    [CssValueAlias]                = "alias",
+    [CssValueAll]                  = "all",
+    [CssValueAllScroll]            = "all-scroll",
+    [CssValueAllSmallCaps]         = "all-small-caps",
+    [CssValueAlternate]            = "alternate",
+    [CssValueAlternateReverse]     = "alternate-reverse",
+    [CssValueAlways]               = "always",
+    [CssValueAntialiased]          = "antialiased",
+    [CssValueAttr]                 = "attr",
+    [CssValueAuto]                 = "auto",
+    [CssValueAvoid]                = "avoid",
+    [CssValueBackwards]            = "backwards",
+    [CssValueBaseline]             = "baseline",
+    [CssValueBidiOverride]         = "bidi-override",
+    [CssValueBlink]                = "blink",
+    [CssValueBlock]                = "block",
+    [CssValueBold]                 = "bold",
+    [CssValueBolder]               = "bolder",
+    [CssValueBorderBox]            = "border-box",
+    [CssValueBoth]                 = "both",
+    [CssValueBottom]               = "bottom",
+    [CssValueBreakAll]             = "break-all",
+    [CssValueBreakWord]            = "break-word",
+    [CssValueCapitalize]           = "capitalize",
+    [CssValueCaption]              = "caption",
+    [CssValueCell]                 = "cell",
+    [CssValueCenter]               = "center",
+    [CssValueCircle]               = "circle",
+    [CssValueClip]                 = "clip",
+    [CssValueCloseQuote]           = "close-quote",
+    [CssValueColResize]            = "col-resize",
+    [CssValueCollapse]             = "collapse",
+    [CssValueColor]                = "color",
+    [CssValueColorBurn]            = "color-burn",
+    [CssValueColorDodge]           = "color-dodge",
+    [CssValueColumn]               = "column",
+    [CssValueColumnReverse]        = "column-reverse",
+    [CssValueContain]              = "contain",
+    [CssValueContentBox]           = "content-box",
+    [CssValueContents]             = "contents",
+    [CssValueContextMenu]          = "context-menu",
+    [CssValueCopy]                 = "copy",
+    [CssValueCover]                = "cover",
+    [CssValueCrosshair]            = "crosshair",
+    [CssValueCurrentcolor]         = "currentcolor",
+    [CssValueCursive]              = "cursive",
+    [CssValueDarken]               = "darken",
+    [CssValueDashed]               = "dashed",
+    [CssValueDecimal]              = "decimal",
+    [CssValueDecimalLeadingZero]   = "decimal-leading-zero",
+    [CssValueDefault]              = "default",
+    [CssValueDense]                = "dense",
+    [CssValueDifference]           = "difference",
+    [CssValueDisc]                 = "disc",
+    [CssValueDotted]               = "dotted",
+    [CssValueDouble]               = "double",
+    [CssValueEResize]              = "e-resize",
+    [CssValueEase]                 = "ease",
+    [CssValueEaseIn]               = "ease-in",
+    [CssValueEaseInOut]            = "ease-in-out",
+    [CssValueEaseOut]              = "ease-out",
+    [CssValueEllipsis]             = "ellipsis",
+    [CssValueEmbed]                = "embed",
+    [CssValueEnd]                  = "end",
+    [CssValueEwResize]             = "ew-resize",
+    [CssValueExclusion]            = "exclusion",
+    [CssValueFantasy]              = "fantasy",
+    [CssValueFill]                 = "fill",
+    [CssValueFitContent]           = "fit-content",
+    [CssValueFixed]                = "fixed",
+    [CssValueFlat]                 = "flat",
+    [CssValueFlex]                 = "flex",
+    [CssValueFlexEnd]              = "flex-end",
+    [CssValueFlexStart]            = "flex-start",
+    [CssValueFlowRoot]             = "flow-root",
+    [CssValueForwards]             = "forwards",
+    [CssValueGeometricprecision]   = "geometricprecision",
+    [CssValueGrab]                 = "grab",
+    [CssValueGrabbing]             = "grabbing",
+    [CssValueGrid]                 = "grid",
+    [CssValueGroove]               = "groove",
+    [CssValueHardLight]            = "hard-light",
+    [CssValueHelp]                 = "help",
+    [CssValueHidden]               = "hidden",
+    [CssValueHide]                 = "hide",
+    [CssValueHorizontalTb]         = "horizontal-tb",
+    [CssValueHue]                  = "hue",
+    [CssValueIcon]                 = "icon",
+    [CssValueInfinite]             = "infinite",
+    [CssValueInline]               = "inline",
+    [CssValueInlineBlock]          = "inline-block",
+    [CssValueInlineFlex]           = "inline-flex",
+    [CssValueInlineGrid]           = "inline-grid",
+    [CssValueInlineTable]          = "inline-table",
+    [CssValueInset]                = "inset",
+    [CssValueInside]               = "inside",
+    [CssValueIsolate]              = "isolate",
+    [CssValueItalic]               = "italic",
+    [CssValueJustify]              = "justify",
+    [CssValueKeepAll]              = "keep-all",
+    [CssValueLandscape]            = "landscape",
+    [CssValueLarge]                = "large",
+    [CssValueLarger]               = "larger",
+    [CssValueLeft]                 = "left",
+    [CssValueLighten]              = "lighten",
+    [CssValueLighter]              = "lighter",
+    [CssValueLineThrough]          = "line-through",
+    [CssValueLinear]               = "linear",
+    [CssValueListItem]             = "list-item",
+    [CssValueLocal]                = "local",
+    [CssValueLowerAlpha]           = "lower-alpha",
+    [CssValueLowerGreek]           = "lower-greek",
+    [CssValueLowerLatin]           = "lower-latin",
+    [CssValueLowerRoman]           = "lower-roman",
+    [CssValueLowercase]            = "lowercase",
+    [CssValueLtr]                  = "ltr",
+    [CssValueLuminosity]           = "luminosity",
+    [CssValueManipulation]         = "manipulation",
+    [CssValueManual]               = "manual",
+    [CssValueMaxContent]           = "max-content",
+    [CssValueMedium]               = "medium",
+    [CssValueMenu]                 = "menu",
+    [CssValueMessageBox]           = "message-box",
+    [CssValueMiddle]               = "middle",
+    [CssValueMinContent]           = "min-content",
+    [CssValueMonospace]            = "monospace",
+    [CssValueMove]                 = "move",
+    [CssValueMultiply]             = "multiply",
+    [CssValueNResize]              = "n-resize",
+    [CssValueNeResize]             = "ne-resize",
+    [CssValueNoCloseQuote]         = "no-close-quote",
+    [CssValueNoDrop]               = "no-drop",
+    [CssValueNoOpenQuote]          = "no-open-quote",
+    [CssValueNoRepeat]             = "no-repeat",
+    [CssValueNormal]               = "normal",
+    [CssValueNotAllowed]           = "not-allowed",
+    [CssValueNowrap]               = "nowrap",
+    [CssValueNsResize]             = "ns-resize",
+    [CssValueNwResize]             = "nw-resize",
+    [CssValueObject]               = "object",
+    [CssValueOblique]              = "oblique",
+    [CssValueOpenQuote]            = "open-quote",
+    [CssValueOptimizelegibility]   = "optimizelegibility",
+    [CssValueOptimizespeed]        = "optimizespeed",
+    [CssValueOutset]               = "outset",
+    [CssValueOutside]              = "outside",
+    [CssValueOverlay]              = "overlay",
+    [CssValueOverline]             = "overline",
+    [CssValuePaddingBox]           = "padding-box",
+    [CssValuePage]                 = "page",
+    [CssValuePanX]                 = "pan-x",
+    [CssValuePanY]                 = "pan-y",
+    [CssValuePaused]               = "paused",
+    [CssValuePointer]              = "pointer",
+    [CssValuePortrait]             = "portrait",
+    [CssValuePre]                  = "pre",
+    [CssValuePreLine]              = "pre-line",
+    [CssValuePreWrap]              = "pre-wrap",
+    [CssValuePreserve3d]           = "preserve-3d",
+    [CssValuePrint]                = "print",
+    [CssValueProgress]             = "progress",
+    [CssValueProportionalNums]     = "proportional-nums",
+    [CssValueRelative]             = "relative",
+    [CssValueRepeat]               = "repeat",
+    [CssValueRepeatX]              = "repeat-x",
+    [CssValueRepeatY]              = "repeat-y",
+    [CssValueReverse]              = "reverse",
+    [CssValueRevert]               = "revert",
+    [CssValueRidge]                = "ridge",
+    [CssValueRight]                = "right",
+    [CssValueRound]                = "round",
+    [CssValueRow]                  = "row",
+    [CssValueRowResize]            = "row-resize",
+    [CssValueRowReverse]           = "row-reverse",
+    [CssValueRtl]                  = "rtl",
+    [CssValueRunIn]                = "run-in",
+    [CssValueRunning]              = "running",
+    [CssValueSResize]              = "s-resize",
+    [CssValueSansSerif]            = "sans-serif",
+    [CssValueSaturation]           = "saturation",
+    [CssValueScreen]               = "screen",
+    [CssValueScroll]               = "scroll",
+    [CssValueSeResize]             = "se-resize",
+    [CssValueSeparate]             = "separate",
+    [CssValueSerif]                = "serif",
+    [CssValueShow]                 = "show",
+    [CssValueSmall]                = "small",
+    [CssValueSmallCaps]            = "small-caps",
+    [CssValueSmallCaption]         = "small-caption",
+    [CssValueSmaller]              = "smaller",
+    [CssValueSmooth]               = "smooth",
+    [CssValueSoftLight]            = "soft-light",
+    [CssValueSolid]                = "solid",
+    [CssValueSpace]                = "space",
+    [CssValueSpaceAround]          = "space-around",
+    [CssValueSpaceBetween]         = "space-between",
+    [CssValueSpaceEvenly]          = "space-evenly",
+    [CssValueSquare]               = "square",
+    [CssValueStart]                = "start",
+    [CssValueStatic]               = "static",
+    [CssValueStatusBar]            = "status-bar",
+    [CssValueStepEnd]              = "step-end",
+    [CssValueStepStart]            = "step-start",
+    [CssValueSticky]               = "sticky",
+    [CssValueStretch]              = "stretch",
+    [CssValueSub]                  = "sub",
+    [CssValueSubpixelAntialiased]  = "subpixel-antialiased",
+    [CssValueSuper]                = "super",
+    [CssValueSwResize]             = "sw-resize",
+    [CssValueSystemUi]             = "system-ui",
+    [CssValueTable]                = "table",
+    [CssValueTableCaption]         = "table-caption",
+    [CssValueTableCell]            = "table-cell",
+    [CssValueTableColumn]          = "table-column",
+    [CssValueTableColumnGroup]     = "table-column-group",
+    [CssValueTableFooterGroup]     = "table-footer-group",
+    [CssValueTableHeaderGroup]     = "table-header-group",
+    [CssValueTableRow]             = "table-row",
+    [CssValueTableRowGroup]        = "table-row-group",
+    [CssValueTabularNums]          = "tabular-nums",
+    [CssValueText]                 = "text",
+    [CssValueTextBottom]           = "text-bottom",
+    [CssValueTextTop]              = "text-top",
+    [CssValueThick]                = "thick",
+    [CssValueThin]                 = "thin",
+    [CssValueTop]                  = "top",
+    [CssValueTouch]                = "touch",
+    [CssValueTransparent]          = "transparent",
+    [CssValueUnderline]            = "underline",
+    [CssValueUnset]                = "unset",
+    [CssValueUpperAlpha]           = "upper-alpha",
+    [CssValueUpperLatin]           = "upper-latin",
+    [CssValueUpperRoman]           = "upper-roman",
+    [CssValueUppercase]            = "uppercase",
+    [CssValueVerticalLr]           = "vertical-lr",
+    [CssValueVerticalRl]           = "vertical-rl",
+    [CssValueVerticalText]         = "vertical-text",
+    [CssValueVisible]              = "visible",
+    [CssValueWResize]              = "w-resize",
+    [CssValueWait]                 = "wait",
+    [CssValueWrap]                 = "wrap",
+    [CssValueWrapReverse]          = "wrap-reverse",
+    [CssValueXLarge]               = "x-large",
+    [CssValueXSmall]               = "x-small",
+    [CssValueXxLarge]              = "xx-large",
+    [CssValueXxSmall]              = "xx-small",
+    [CssValueZoomIn]               = "zoom-in",
+    [CssValueZoomOut]              = "zoom-out",
+    [CssValueAliceblue]            = "aliceblue",
+    [CssValueAntiquewhite]         = "antiquewhite",
+    [CssValueAqua]                 = "aqua",
+    [CssValueAquamarine]           = "aquamarine",
+    [CssValueAzure]                = "azure",
+    [CssValueBeige]                = "beige",
+    [CssValueBisque]               = "bisque",
+    [CssValueBlack]                = "black",
+    [CssValueBlanchedalmond]       = "blanchedalmond",
+    [CssValueBlue]                 = "blue",
+    [CssValueBlueviolet]           = "blueviolet",
+    [CssValueBrown]                = "brown",
+    [CssValueBurlywood]            = "burlywood",
+    [CssValueCadetblue]            = "cadetblue",
+    [CssValueChartreuse]           = "chartreuse",
+    [CssValueChocolate]            = "chocolate",
+    [CssValueCoral]                = "coral",
+    [CssValueCornflowerblue]       = "cornflowerblue",
+    [CssValueCornsilk]             = "cornsilk",
+    [CssValueCrimson]              = "crimson",
+    [CssValueCyan]                 = "cyan",
+    [CssValueDarkblue]             = "darkblue",
+    [CssValueDarkcyan]             = "darkcyan",
+    [CssValueDarkgoldenrod]        = "darkgoldenrod",
+    [CssValueDarkgray]             = "darkgray",
+    [CssValueDarkgreen]            = "darkgreen",
+    [CssValueDarkgrey]             = "darkgrey",
+    [CssValueDarkkhaki]            = "darkkhaki",
+    [CssValueDarkmagenta]          = "darkmagenta",
+    [CssValueDarkolivegreen]       = "darkolivegreen",
+    [CssValueDarkorange]           = "darkorange",
+    [CssValueDarkorchid]           = "darkorchid",
+    [CssValueDarkred]              = "darkred",
+    [CssValueDarksalmon]           = "darksalmon",
+    [CssValueDarkseagreen]         = "darkseagreen",
+    [CssValueDarkslateblue]        = "darkslateblue",
+    [CssValueDarkslategray]        = "darkslategray",
+    [CssValueDarkslategrey]        = "darkslategrey",
+    [CssValueDarkturquoise]        = "darkturquoise",
+    [CssValueDarkviolet]           = "darkviolet",
+    [CssValueDeeppink]             = "deeppink",
+    [CssValueDeepskyblue]          = "deepskyblue",
+    [CssValueDimgray]              = "dimgray",
+    [CssValueDimgrey]              = "dimgrey",
+    [CssValueDodgerblue]           = "dodgerblue",
+    [CssValueFirebrick]            = "firebrick",
+    [CssValueFloralwhite]          = "floralwhite",
+    [CssValueForestgreen]          = "forestgreen",
+    [CssValueFuchsia]              = "fuchsia",
+    [CssValueGainsboro]            = "gainsboro",
+    [CssValueGhostwhite]           = "ghostwhite",
+    [CssValueGold]                 = "gold",
+    [CssValueGoldenrod]            = "goldenrod",
+    [CssValueGray]                 = "gray",
+    [CssValueGreen]                = "green",
+    [CssValueGreenyellow]          = "greenyellow",
+    [CssValueGrey]                 = "grey",
+    [CssValueHoneydew]             = "honeydew",
+    [CssValueHotpink]              = "hotpink",
+    [CssValueIndianred]            = "indianred",
+    [CssValueIndigo]               = "indigo",
+    [CssValueIvory]                = "ivory",
+    [CssValueKhaki]                = "khaki",
+    [CssValueLavender]             = "lavender",
+    [CssValueLavenderblush]        = "lavenderblush",
+    [CssValueLawngreen]            = "lawngreen",
+    [CssValueLemonchiffon]         = "lemonchiffon",
+    [CssValueLightblue]            = "lightblue",
+    [CssValueLightcoral]           = "lightcoral",
+    [CssValueLightcyan]            = "lightcyan",
+    [CssValueLightgoldenrodyellow] = "lightgoldenrodyellow",
+    [CssValueLightgray]            = "lightgray",
+    [CssValueLightgreen]           = "lightgreen",
+    [CssValueLightgrey]            = "lightgrey",
+    [CssValueLightpink]            = "lightpink",
+    [CssValueLightsalmon]          = "lightsalmon",
+    [CssValueLightseagreen]        = "lightseagreen",
+    [CssValueLightskyblue]         = "lightskyblue",
+    [CssValueLightslategray]       = "lightslategray",
+    [CssValueLightslategrey]       = "lightslategrey",
+    [CssValueLightsteelblue]       = "lightsteelblue",
+    [CssValueLightyellow]          = "lightyellow",
+    [CssValueLime]                 = "lime",
+    [CssValueLimegreen]            = "limegreen",
+    [CssValueLinen]                = "linen",
+    [CssValueMagenta]              = "magenta",
+    [CssValueMaroon]               = "maroon",
+    [CssValueMediumaquamarine]     = "mediumaquamarine",
+    [CssValueMediumblue]           = "mediumblue",
+    [CssValueMediumorchid]         = "mediumorchid",
+    [CssValueMediumpurple]         = "mediumpurple",
+    [CssValueMediumseagreen]       = "mediumseagreen",
+    [CssValueMediumslateblue]      = "mediumslateblue",
+    [CssValueMediumspringgreen]    = "mediumspringgreen",
+    [CssValueMediumturquoise]      = "mediumturquoise",
+    [CssValueMediumvioletred]      = "mediumvioletred",
+    [CssValueMidnightblue]         = "midnightblue",
+    [CssValueMintcream]            = "mintcream",
+    [CssValueMistyrose]            = "mistyrose",
+    [CssValueMoccasin]             = "moccasin",
+    [CssValueNavajowhite]          = "navajowhite",
+    [CssValueNavy]                 = "navy",
+    [CssValueOldlace]              = "oldlace",
+    [CssValueOlive]                = "olive",
+    [CssValueOlivedrab]            = "olivedrab",
+    [CssValueOrange]               = "orange",
+    [CssValueOrangered]            = "orangered",
+    [CssValueOrchid]               = "orchid",
+    [CssValuePalegoldenrod]        = "palegoldenrod",
+    [CssValuePalegreen]            = "palegreen",
+    [CssValuePaleturquoise]        = "paleturquoise",
+    [CssValuePalevioletred]        = "palevioletred",
+    [CssValuePapayawhip]           = "papayawhip",
+    [CssValuePeachpuff]            = "peachpuff",
+    [CssValuePeru]                 = "peru",
+    [CssValuePink]                 = "pink",
+    [CssValuePlum]                 = "plum",
+    [CssValuePowderblue]           = "powderblue",
+    [CssValuePurple]               = "purple",
+    [CssValueRebeccapurple]        = "rebeccapurple",
+    [CssValueRed]                  = "red",
+    [CssValueRosybrown]            = "rosybrown",
+    [CssValueRoyalblue]            = "royalblue",
+    [CssValueSaddlebrown]          = "saddlebrown",
+    [CssValueSalmon]               = "salmon",
+    [CssValueSandybrown]           = "sandybrown",
+    [CssValueSeagreen]             = "seagreen",
+    [CssValueSeashell]             = "seashell",
+    [CssValueSienna]               = "sienna",
+    [CssValueSilver]               = "silver",
+    [CssValueSkyblue]              = "skyblue",
+    [CssValueSlateblue]            = "slateblue",
+    [CssValueSlategray]            = "slategray",
+    [CssValueSlategrey]            = "slategrey",
+    [CssValueSnow]                 = "snow",
+    [CssValueSpringgreen]          = "springgreen",
+    [CssValueSteelblue]            = "steelblue",
+    [CssValueTan]                  = "tan",
+    [CssValueTeal]                 = "teal",
+    [CssValueThistle]              = "thistle",
+    [CssValueTomato]               = "tomato",
+    [CssValueTurquoise]            = "turquoise",
+    [CssValueViolet]               = "violet",
+    [CssValueWheat]                = "wheat",
+    [CssValueWhite]                = "white",
+    [CssValueWhitesmoke]           = "whitesmoke",
+    [CssValueYellow]               = "yellow",
+    [CssValueYellowgreen]          = "yellowgreen",
+};
+
+static const unsigned char kValueSeeds[CSSPRSR_VALUE_BUCKETS] = {
+      1,   2,   0,  28,   4,   0,   7,   0,   5,  17,   9,   5,  11,  14,   7,  30,
+      3,   7,   0,  22,   5,   4,   6,   0,   0,   0,   2,   6,   1,   1,   8,   0,
+     16,   1,   5,   5,   4,   4,   1,   4,   0,   6,   1,  60,   4,   1,   4,  18,
+      0,   7,   2,   0,   2,  10,  15,  17,   0,   1,   0,   9,   2,  21,  18,   5,
+      9,   3,  18,   8,  10,   7,   0,   0,   2,   9,  34,  15,   0,   1,   2,  15,
+      0,   6,   4,   7,   3,   4,   4,  14,   0,   6,   4,   0,  66,   2,   0,   5,
+      6,   0,  13,   0,   4,   6,  44,  15,   6,   0,   0,   0,   0,   1,  13,   2,
+      8,   3,   1,   2,  11,   2,   3,   4,   5,   5,   0,   3,  27,   1,   2,   9,
+};
+
+// CssValueID of the keyword in each slot, 0 for none
+static const unsigned short kValueSlots[CSSPRSR_VALUE_SLOTS] = {
+     12, 263,   0,  72,   0,   0, 297, 197, 261,   0, 288, 210, 157,  82, 400, 220,
+    167,  56, 352, 223, 361,   0,   9,   0, 102,   0,  27, 109,   0,  49, 341,   0,
+      0, 169, 304,   0, 340,  95, 176,  22, 308,   1,   0, 230, 328, 189, 150, 179,
+    334,   0,  41,   4, 203, 293, 182, 374, 290, 380,   6, 190, 276, 398, 235, 218,
+    151, 188, 228,  18, 166, 383, 366, 284,   0,  94, 147,  37,  53,  61,  80, 132,
+    294, 396, 292,   0, 154, 212,  97,   0, 260,   0, 249, 320, 339,   0, 199, 347,
+    255, 336, 140, 156, 377, 187, 216, 269, 337,  23,  96, 302, 343,  50,   0, 192,
+     77,   0, 229,   3, 342,  60, 280,  44,   0,  13, 149, 158,   0, 298,  11, 315,
+      0,  89, 241,   0,  45, 254, 225,   0, 375,  30, 110, 105,   0,   0, 106,  15,
+     64, 160, 274, 382, 250,   0, 172,   0, 196, 141,  16,   0,  38,  73,   0, 245,
+      0, 128, 104, 376,  68, 112,   0, 180,  78,   0, 387, 301,   0, 214,  84, 395,
+      0, 312, 119, 238, 242, 306, 351, 359, 270,  52, 353, 138, 246, 381, 194,   0,
+     39, 283,   0,   0,  79, 133, 332,   0,   0,   0,  58, 101,   0, 183, 103, 322,
+    168,   0, 360,   0, 309,   0, 278,   0,  81,  71, 326,   0, 368, 186,  47,  24,
+      0,  67,   0, 184,   0, 206, 386, 121, 268, 314, 277, 226,   0, 171, 271,  29,
+    198, 136,   0, 253,   0,  98, 300, 257, 363,   0, 126, 399, 372, 173, 174, 379,
+    317,  46, 175, 227, 215,  88,  26,  85, 256, 371,  62,   0,   0,   0,   0, 327,
+    362,   0, 348, 247, 307, 345, 135,   7,  83, 108,  54, 142, 335, 233, 181, 252,
+    155,  70, 162, 370,  99, 161,   0,  69, 232,   0, 321,  57, 237,   0, 356,   0,
+    107,   0,  42, 144, 355,   0, 244, 221,  33,  63, 177, 287, 394, 279, 281, 364,
+      0,  43, 118,  91,   0, 153, 117,   0,  55,  34,   0, 222, 358, 129,   0,  31,
+      0, 267, 125, 258, 148, 201,  32,   0, 124,   0, 338,   0,  75, 145, 330, 191,
+    354,  86, 390, 331,   0,   0,   0, 248, 282, 349,  10, 264,  28, 316, 344,  35,
+    240, 152, 207,   0, 123, 131, 389, 313, 200,  20, 325, 204, 273, 393, 299,   5,
+    319, 202,  51, 397, 296,   0, 384, 378,  90, 113, 323,   0, 265, 286, 391, 303,
+    251,   0, 275,   0, 262, 127,   0,  17,   0, 159, 285, 195,   2, 266, 219, 310,
+    385, 373,   0,   0,   0,   0,   0, 178, 122,  87,   0, 259, 305,   8, 357,   0,
+    205,   0,   0,  76,  65,  14, 213, 234,   0, 224,   0, 208, 289, 164,   0,   0,
+    146, 388,   0, 163,  48, 291, 367,   0, 165,  59, 211,  25, 100, 333, 243, 295,
+    239, 130,   0,   0,  36, 318, 329, 134, 116, 170, 114, 115, 324, 392, 350,   0,
+     66,  74,   0,   0,   0, 120, 111, 143, 272,  40,   0,  21, 185,  19,   0,   0,
+    139, 209,  92, 193, 236, 137, 365, 231,   0,   0, 346, 311, 369, 217,  93,   0,
+};
+
+static CssValueID value_slot(const char* name, size_t length)
+{
+    unsigned int hash = cssprsr_string_hash_with_length(name, length, true);
+    unsigned int seed = kValueSeeds[hash & (CSSPRSR_VALUE_BUCKETS - 1)];
+    return (CssValueID)kValueSlots[((hash ^ (seed * 0x9E3779B9u)) * 16777619u) >> CSSPRSR_VALUE_SLOT_SHIFT];
+}
+
+CssValueID cssprsr_value_id(const char* name, size_t length)
+{
+    CssValueID id = value_slot(name, length);
+    if ( CssValueInvalid == id
+         || 0 != strncasecmp(kValueNames[id], name, length)
+         || '\0' != kValueNames[id][length] )
+        return CssValueInvalid;
+    return id;
+}
+
+CssValueID css_value_id(const char* name)
+{
+    if ( NULL == name )
+        return CssValueInvalid;
+    return cssprsr_value_id(name, strlen(name));
+}
+
+const char* css_value_name(CssValueID id)
+{
+    if ( id <= CssValueInvalid || id >= CssValueCount )
+        return NULL;
+    return kValueNames[id];
+}
+
+#if CSSPRSR_RPARSER_DEBUG
+
+void test_value_map()
+{
+    size_t found = 0;
+    for ( size_t i = 0; i < CSSPRSR_VALUE_SLOTS; i++ ) {
+        CssValueID id = (CssValueID)kValueSlots[i];
+        if ( CssValueInvalid == id )
+            continue;
+        assert(value_slot(kValueNames[id], strlen(kValueNames[id])) == id);
+        assert(css_value_id(kValueNames[id]) == id);
+        found++;
+    }
+    assert(found == CssValueCount - 1);
+}
+
+#endif // #if CSSPRSR_RPARSER_DEBUG
@@ -0,0 +1,339 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "selector.h"
+#include "cssparser_i.h"
+
+// Selector matching.
+//
+// A selector is stored right to left: the head is the rightmost compound and
+// `tagHistory` leads to the compounds on its left. The relation of the last
+// simple selector of a compound is the combinator to the next compound. So
+// matching starts at the element, checks its compound and only then walks
+// the tree towards the left, cheap rejections coming first.
+
+static CssMatchResult match_complex(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                                    CssNthIndexCache* cache);
+static bool match_compound(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                           CssNthIndexCache* cache);
+
+static bool has_value(const char* value)
+{
+    return NULL != value && '\0' != *value;
+}
+
+static bool equals(const char* a, const char* b, bool ignore_case)
+{
+    return ignore_case ? 0 == strcasecmp(a, b) : 0 == strcmp(a, b);
+}
+
+static bool has_prefix(const char* str, const char* prefix, size_t length, bool ignore_case)
+{
+    return ignore_case ? 0 == strncasecmp(str, prefix, length) : 0 == strncmp(str, prefix, length);
+}
+
+// Whether `value` is one of the whitespace separated words of `list`.
+static bool list_contains(const char* list, const char* value, bool ignore_case)
+{
+    size_t length = strlen(value);
+    if ( 0 == length || strpbrk(value, " \t\n\r\f") )
+        return false;
+    const char* word = list;
+    while ( *word ) {
+        while ( *word && strchr(" \t\n\r\f", *word) )
+            word++;
+        const char* end = word;
+        while ( *end && !strchr(" \t\n\r\f", *end) )
+            end++;
+        if ( (size_t)(end - word) == length && has_prefix(word, value, length, ignore_case) )
+            return true;
+        word = end;
+    }
+    return false;
+}
+
+bool cssprsr_match_attribute_value(CssSelectorMatch match, const char* actual, const char* value, bool ignore_case)
+{
+    if ( NULL == actual )
+        return false;
+    if ( CssSelMatchAttrSet == match )
+        return true;
+
+    size_t length = strlen(value);
+    size_t actual_length = strlen(actual);
+    switch ( match ) {
+    case CssSelMatchAttrExact:
+        return equals(actual, value, ignore_case);
+    case CssSelMatchAttrList:
+        return list_contains(actual, value, ignore_case);
+    case CssSelMatchAttrHyphen:
+        return has_prefix(actual, value, length, ignore_case)
+            && (actual[length] == '\0' || actual[length] == '-');
+    case CssSelMatchAttrBegin:
+        return length && has_prefix(actual, value, length, ignore_case);
+    case CssSelMatchAttrEnd:
+        return length && actual_length >= length
+            && has_prefix(actual + actual_length - length, value, length, ignore_case);
+    case CssSelMatchAttrContain: {
+        if ( 0 == length )
+            return false;
+        for (size_t i = 0; i + length <= actual_length; ++i) {
+            if ( has_prefix(actual + i, value, length, ignore_case) )
+                return true;
+        }
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+static bool match_attribute(const CssSelector* selector, const void* element, const CssElementOps* ops)
+{
+    return cssprsr_match_attribute_value(selector->match,
+                                         ops->attribute(element, selector->data->attribute->local),
+                                         selector->data->value,
+                                         CssAMTCaseInsensitive == selector->data->bits.attrMatchType);
+}
+
+// 1-based position among the element siblings, only counting those of the
+// same type when `of_type`.
+int cssprsr_sibling_position(const void* element, const CssElementOps* ops, CssNthIndexCache* cache,
+                             bool forward, bool of_type)
+{
+    if ( cache ) {
+        int position = cssprsr_nth_index_position(cache, element, ops, forward, of_type);
+        if ( position )
+            return position;
+    }
+    const char* tag = of_type ? ops->tag_name(element) : NULL;
+    int position = 1;
+    for (const void* e = forward ? ops->previous_sibling(element) : ops->next_sibling(element);
+         e; e = forward ? ops->previous_sibling(e) : ops->next_sibling(e)) {
+        if ( !of_type || equals(ops->tag_name(e), tag, true) )
+            position++;
+    }
+    return position;
+}
+
+bool css_nth_matches(int a, int b, int index)
+{
+    long long diff = (long long)index - b;
+    if ( 0 == a )
+        return 0 == diff;
+    return diff / a >= 0 && diff % a == 0;
+}
+
+bool cssprsr_match_lang(const void* element, const CssElementOps* ops, const char* range)
+{
+    if ( NULL == range )
+        return false;
+    size_t length = strlen(range);
+    for (const void* e = element; e; e = ops->parent(e)) {
+        const char* lang = ops->attribute(e, "lang");
+        if ( NULL == lang )
+            continue;
+        return has_prefix(lang, range, length, true) && (lang[length] == '\0' || lang[length] == '-');
+    }
+    return false;
+}
+
+static bool match_selector_list(const CssArray* selectors, const void* element, const CssElementOps* ops,
+                                CssNthIndexCache* cache)
+{
+    if ( NULL == selectors )
+        return false;
+    for (size_t i = 0; i < selectors->length; ++i) {
+        if ( CssMatchSuccess == match_complex(selectors->data[i], element, ops, cache) )
+            return true;
+    }
+    return false;
+}
+
+// `:nth-child(An+B of S)` only counts the siblings matching S, and the
+// element has to match it too. The cache knows nothing of S.
+static int selector_list_position(const CssArray* selectors, const void* element, const CssElementOps* ops,
+                                  CssNthIndexCache* cache, bool forward)
+{
+    if ( !match_selector_list(selectors, element, ops, cache) )
+        return 0;
+    int position = 1;
+    for (const void* e = forward ? ops->previous_sibling(element) : ops->next_sibling(element);
+         e; e = forward ? ops->previous_sibling(e) : ops->next_sibling(e)) {
+        if ( match_selector_list(selectors, e, ops, cache) )
+            position++;
+    }
+    return position;
+}
+
+static bool match_nth(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                      CssNthIndexCache* cache, bool forward, bool of_type)
+{
+    int position = selector->data->selectors
+        ? selector_list_position(selector->data->selectors, element, ops, cache, forward)
+        : cssprsr_sibling_position(element, ops, cache, forward, of_type);
+    return position && css_nth_matches(selector->data->bits.nth.a, selector->data->bits.nth.b, position);
+}
+
+static bool match_pseudo_class(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                               CssNthIndexCache* cache)
+{
+    switch ( selector->pseudo ) {
+    case CssPseudoNot:
+        return !match_selector_list(selector->data->selectors, element, ops, cache);
+    case CssPseudoAny:
+        return match_selector_list(selector->data->selectors, element, ops, cache);
+    case CssPseudoRoot:
+        return NULL == ops->parent(element);
+    case CssPseudoFirstChild:
+        return NULL == ops->previous_sibling(element);
+    case CssPseudoLastChild:
+        return NULL == ops->next_sibling(element);
+    case CssPseudoOnlyChild:
+        return NULL == ops->previous_sibling(element) && NULL == ops->next_sibling(element);
+    case CssPseudoFirstOfType:
+        return 1 == cssprsr_sibling_position(element, ops, cache, true, true);
+    case CssPseudoLastOfType:
+        return 1 == cssprsr_sibling_position(element, ops, cache, false, true);
+    case CssPseudoOnlyOfType:
+        return 1 == cssprsr_sibling_position(element, ops, cache, true, true)
+            && 1 == cssprsr_sibling_position(element, ops, cache, false, true);
+    case CssPseudoNthChild:
+        return match_nth(selector, element, ops, cache, true, false);
+    case CssPseudoNthLastChild:
+        return match_nth(selector, element, ops, cache, false, false);
+    case CssPseudoNthOfType:
+        return match_nth(selector, element, ops, cache, true, true);
+    case CssPseudoNthLastOfType:
+        return match_nth(selector, element, ops, cache, false, true);
+    case CssPseudoLang:
+        return cssprsr_match_lang(element, ops, selector->data->argument);
+    case CssPseudoHost:
+    case CssPseudoHostContext:
+    case CssPseudoUnknown:
+    case CssPseudoNotParsed:
+        return false;
+    default:
+        // Dynamic and user interface states are up to the host.
+        return NULL != ops->has_state && ops->has_state(element, selector->pseudo);
+    }
+}
+
+static bool match_simple(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                         CssNthIndexCache* cache)
+{
+    switch ( selector->match ) {
+    case CssSelMatchTag: {
+        const char* local = selector->tag->local;
+        return 0 == strcmp(local, cssAsteriskString.data) || equals(ops->tag_name(element), local, true);
+    }
+    case CssSelMatchId: {
+        const char* id = ops->id(element);
+        return has_value(id) && 0 == strcmp(id, selector->data->value);
+    }
+    case CssSelMatchClass:
+        return ops->has_class(element, selector->data->value);
+    case CssSelMatchPseudoClass:
+        return match_pseudo_class(selector, element, ops, cache);
+    case CssSelMatchPseudoElement:
+    case CssSelMatchPagePseudoClass:
+    case CssSelMatchUnknown:
+        return false;
+    default:
+        return match_attribute(selector, element, ops);
+    }
+}
+
+static bool match_compound(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                           CssNthIndexCache* cache)
+{
+    for (const CssSelector* cs = selector; cs; cs = cs->tagHistory) {
+        if ( !match_simple(cs, element, ops, cache) )
+            return false;
+        if ( CssSelRelSubSelector != cs->relation )
+            break;
+    }
+    return true;
+}
+
+// Matches `selector` against `element` and the compounds on its left against
+// the tree around it. Failures tell how far the caller can give up, which
+// keeps descendant and sibling combinators from backtracking needlessly.
+static CssMatchResult match_complex(const CssSelector* selector, const void* element, const CssElementOps* ops,
+                                    CssNthIndexCache* cache)
+{
+    if ( !match_compound(selector, element, ops, cache) )
+        return CssMatchFailsLocally;
+
+    const CssSelector* last = selector;
+    while ( CssSelRelSubSelector == last->relation && last->tagHistory )
+        last = last->tagHistory;
+    const CssSelector* next = last->tagHistory;
+    if ( NULL == next )
+        return CssMatchSuccess;
+
+    switch ( last->relation ) {
+    case CssSelRelDescendant:
+    case CssSelRelShadowDeep:
+        for (const void* e = ops->parent(element); e; e = ops->parent(e)) {
+            CssMatchResult result = match_complex(next, e, ops, cache);
+            if ( CssMatchSuccess == result || CssMatchFailsCompletely == result )
+                return result;
+        }
+        return CssMatchFailsCompletely;
+    case CssSelRelChild: {
+        const void* parent = ops->parent(element);
+        if ( NULL == parent )
+            return CssMatchFailsCompletely;
+        CssMatchResult result = match_complex(next, parent, ops, cache);
+        return CssMatchFailsAllSiblings == result ? CssMatchFailsLocally : result;
+    }
+    case CssSelRelDirectAdjacent: {
+        const void* sibling = ops->previous_sibling(element);
+        if ( NULL == sibling )
+            return CssMatchFailsAllSiblings;
+        return match_complex(next, sibling, ops, cache);
+    }
+    case CssSelRelIndirectAdjacent:
+        for (const void* e = ops->previous_sibling(element); e; e = ops->previous_sibling(e)) {
+            CssMatchResult result = match_complex(next, e, ops, cache);
+            if ( CssMatchFailsLocally != result )
+                return result;
+        }
+        return CssMatchFailsAllSiblings;
+    case CssSelRelShadowPseudo:
+    default:
+        return CssMatchFailsCompletely;
+    }
+}
+
+bool css_selector_matches(const CssSelector* selector, const void* element, const CssElementOps* ops)
+{
+    return css_selector_matches_with_cache(selector, element, ops, NULL);
+}
+
+bool css_selector_matches_with_cache(const CssSelector* selector, const void* element,
+                                     const CssElementOps* ops, CssNthIndexCache* cache)
+{
+    if ( NULL == selector || NULL == element || NULL == ops )
+        return false;
+    return CssMatchSuccess == match_complex(selector, element, ops, cache);
+}
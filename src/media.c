@@ -0,0 +1,887 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+#include <stdint.h>
+
+// Media queries.
+//
+// A query holds when its media type is `all` or that of the environment and
+// every one of its expressions holds, `not` inverting the whole. A query
+// with an unknown feature or a malformed value is invalid, and an invalid
+// query is `not all`: it holds neither with nor without `not`.
+//
+// Responsive stylesheets repeat the same few queries in hundreds of `@media`
+// rules. The cache evaluates each distinct query once, and remembers which
+// parts of the environment it reads, so a resize only evaluates again the
+// queries reading the viewport and only revisits the rules of those whose
+// result flipped.
+//
+// Most of those queries are `min-width` and `max-width` ranges, and sorting
+// their bounds gives the breakpoints of the stylesheet. A resize evaluates
+// again only the queries with a breakpoint between the old and the new size,
+// found by binary search, so it costs O(log n + changes) rather than a pass
+// over every rule.
+
+// Parts of the environment an expression depends on
+enum {
+    CssMediaDependsOnType       = 1 << 0,
+    CssMediaDependsOnWidth      = 1 << 1,
+    CssMediaDependsOnHeight     = 1 << 2,
+    CssMediaDependsOnDevice     = 1 << 3,
+    CssMediaDependsOnResolution = 1 << 4,
+    CssMediaDependsOnColor      = 1 << 5,
+    CssMediaDependsOnFontSize   = 1 << 6,
+};
+
+typedef enum {
+    CssMediaCompareEqual,
+    CssMediaCompareMin,
+    CssMediaCompareMax,
+} CssMediaCompare;
+
+typedef enum {
+    CssMediaFeatureUnknown,
+    CssMediaFeatureWidth,
+    CssMediaFeatureHeight,
+    CssMediaFeatureDeviceWidth,
+    CssMediaFeatureDeviceHeight,
+    CssMediaFeatureOrientation,
+    CssMediaFeatureAspectRatio,
+    CssMediaFeatureDeviceAspectRatio,
+    CssMediaFeatureResolution,
+    CssMediaFeatureDevicePixelRatio,
+    CssMediaFeatureColor,
+    CssMediaFeatureMonochrome,
+} CssMediaFeature;
+
+static const struct {
+    const char* name;
+    CssMediaFeature feature;
+    unsigned int dependencies;
+    bool range; // takes `min-` and `max-`
+} kMediaFeatures[] = {
+    { "width", CssMediaFeatureWidth, CssMediaDependsOnWidth, true },
+    { "height", CssMediaFeatureHeight, CssMediaDependsOnHeight, true },
+    { "device-width", CssMediaFeatureDeviceWidth, CssMediaDependsOnDevice, true },
+    { "device-height", CssMediaFeatureDeviceHeight, CssMediaDependsOnDevice, true },
+    { "orientation", CssMediaFeatureOrientation, CssMediaDependsOnWidth | CssMediaDependsOnHeight, false },
+    { "aspect-ratio", CssMediaFeatureAspectRatio, CssMediaDependsOnWidth | CssMediaDependsOnHeight, true },
+    { "device-aspect-ratio", CssMediaFeatureDeviceAspectRatio, CssMediaDependsOnDevice, true },
+    { "resolution", CssMediaFeatureResolution, CssMediaDependsOnResolution, true },
+    { "device-pixel-ratio", CssMediaFeatureDevicePixelRatio, CssMediaDependsOnResolution, true },
+    { "color", CssMediaFeatureColor, CssMediaDependsOnColor, true },
+    { "monochrome", CssMediaFeatureMonochrome, CssMediaDependsOnColor, true },
+};
+
+// Splits `min-width` into CssMediaCompareMin and CssMediaFeatureWidth. Only
+// `device-pixel-ratio` is known with its `-webkit-` prefix, as
+// `-webkit-min-device-pixel-ratio`.
+static CssMediaFeature parse_feature(const char* name, CssMediaCompare* compare, unsigned int* dependencies)
+{
+    bool prefixed = 0 == strncmp(name, "-webkit-", 8);
+    if ( prefixed )
+        name += 8;
+    *compare = CssMediaCompareEqual;
+    if ( 0 == strncmp(name, "min-", 4) ) {
+        *compare = CssMediaCompareMin;
+        name += 4;
+    } else if ( 0 == strncmp(name, "max-", 4) ) {
+        *compare = CssMediaCompareMax;
+        name += 4;
+    }
+    for (size_t i = 0; i < sizeof(kMediaFeatures) / sizeof(kMediaFeatures[0]); ++i) {
+        if ( strcmp(name, kMediaFeatures[i].name) )
+            continue;
+        if ( (CssMediaCompareEqual != *compare && !kMediaFeatures[i].range) ||
+             (prefixed && CssMediaFeatureDevicePixelRatio != kMediaFeatures[i].feature) )
+            return CssMediaFeatureUnknown;
+        *dependencies = kMediaFeatures[i].dependencies;
+        return kMediaFeatures[i].feature;
+    }
+    return CssMediaFeatureUnknown;
+}
+
+static bool compare(CssMediaCompare compare, double actual, double expected)
+{
+    switch ( compare ) {
+    case CssMediaCompareMin:
+        return actual >= expected;
+    case CssMediaCompareMax:
+        return actual <= expected;
+    default:
+        return actual == expected;
+    }
+}
+
+static bool is_length(const CssValue* value)
+{
+    if ( CSS_VALUE_CALC == value->unit )
+        return CssCalcLength == css_calc_category(value->calc);
+    return (CSS_VALUE_NUMBER == value->unit && 0 == value->fValue) || CssUnitLength == css_unit_kind(value->unit);
+}
+
+static bool length_value(const CssValue* value, const CssMediaEnv* env, double* length)
+{
+    // Relative lengths are relative to the initial font size and viewport
+    CssUnitContext context = { env->font_size, env->font_size, env->width, env->height, 0 };
+    if ( !is_length(value) )
+        return false;
+    if ( CSS_VALUE_CALC == value->unit )
+        *length = css_calc_evaluate(value->calc, &context);
+    else if ( CSS_VALUE_NUMBER == value->unit )
+        *length = 0;
+    else
+        *length = value->fValue * cssprsr_unit_scale(value->unit, &context);
+    return true;
+}
+
+static bool is_relative_length(const CssValue* value)
+{
+    switch ( value->unit ) {
+    case CSS_VALUE_EMS:
+    case CSS_VALUE_PARSER_Q_EMS:
+    case CSS_VALUE_EXS:
+    case CSS_VALUE_REMS:
+    case CSS_VALUE_CHS:
+    case CSS_VALUE_VW:
+    case CSS_VALUE_VH:
+    case CSS_VALUE_VMIN:
+    case CSS_VALUE_VMAX:
+    case CSS_VALUE_CALC:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// `16/9`, the grammar gives a number, a `/` operator and a number
+static bool ratio_value(const CssArray* values, double* numerator, double* denominator)
+{
+    if ( 3 != values->length )
+        return false;
+    const CssValue* first = values->data[0];
+    const CssValue* slash = values->data[1];
+    const CssValue* second = values->data[2];
+    if ( CSS_VALUE_NUMBER != first->unit || CSS_VALUE_NUMBER != second->unit ||
+         CSS_VALUE_PARSER_OPERATOR != slash->unit || '/' != slash->iValue ||
+         first->fValue <= 0 || second->fValue <= 0 )
+        return false;
+    *numerator = first->fValue;
+    *denominator = second->fValue;
+    return true;
+}
+
+static bool evaluate_ratio(CssMediaCompare op, double width, double height, const CssArray* values)
+{
+    double numerator, denominator;
+    if ( !ratio_value(values, &numerator, &denominator) )
+        return false;
+    // width / height against numerator / denominator, without dividing
+    return compare(op, width * denominator, height * numerator);
+}
+
+// Whether the feature of an expression is known and its value suits it. A
+// query with an expression that is not valid is `not all`.
+static bool is_valid_expression(const CssMediaQueryExp* exp)
+{
+    CssMediaCompare op;
+    unsigned int dependencies;
+    CssMediaFeature feature = parse_feature(exp->feature, &op, &dependencies);
+    const CssArray* values = exp->values;
+    if ( CssMediaFeatureUnknown == feature )
+        return false;
+    // `(min-width)` needs a value
+    if ( NULL == values || 0 == values->length )
+        return CssMediaCompareEqual == op;
+    const CssValue* value = values->data[0];
+    double numerator, denominator;
+    switch ( feature ) {
+    case CssMediaFeatureWidth:
+    case CssMediaFeatureHeight:
+    case CssMediaFeatureDeviceWidth:
+    case CssMediaFeatureDeviceHeight:
+        return 1 == values->length && is_length(value);
+    case CssMediaFeatureOrientation:
+        return 1 == values->length && CSS_VALUE_IDENT == value->unit &&
+               (CssValuePortrait == value->id || CssValueLandscape == value->id);
+    case CssMediaFeatureAspectRatio:
+    case CssMediaFeatureDeviceAspectRatio:
+        return ratio_value(values, &numerator, &denominator);
+    case CssMediaFeatureResolution:
+        return 1 == values->length && CssUnitResolution == css_unit_kind(value->unit);
+    case CssMediaFeatureDevicePixelRatio:
+        return 1 == values->length && CSS_VALUE_NUMBER == value->unit;
+    case CssMediaFeatureColor:
+    case CssMediaFeatureMonochrome:
+        return 1 == values->length && CSS_VALUE_NUMBER == value->unit && value->isInt;
+    default:
+        return false;
+    }
+}
+
+// Evaluates an expression is_valid_expression() accepts.
+static bool evaluate_expression(const CssMediaQueryExp* exp, const CssMediaEnv* env)
+{
+    CssMediaCompare op;
+    unsigned int dependencies;
+    CssMediaFeature feature = parse_feature(exp->feature, &op, &dependencies);
+    const CssArray* values = exp->values;
+    const CssValue* value = values && values->length ? values->data[0] : NULL;
+    double number = 0;
+
+    // `(width)` alone holds when the feature is not zero
+    if ( NULL == value ) {
+        switch ( feature ) {
+        case CssMediaFeatureWidth:            return 0 != env->width;
+        case CssMediaFeatureHeight:           return 0 != env->height;
+        case CssMediaFeatureDeviceWidth:      return 0 != env->device_width;
+        case CssMediaFeatureDeviceHeight:     return 0 != env->device_height;
+        case CssMediaFeatureResolution:
+        case CssMediaFeatureDevicePixelRatio: return 0 != env->resolution;
+        case CssMediaFeatureColor:            return 0 != env->color;
+        case CssMediaFeatureMonochrome:       return 0 != env->monochrome;
+        default:                              return true;
+        }
+    }
+
+    switch ( feature ) {
+    case CssMediaFeatureWidth:
+        return length_value(value, env, &number) && compare(op, env->width, number);
+    case CssMediaFeatureHeight:
+        return length_value(value, env, &number) && compare(op, env->height, number);
+    case CssMediaFeatureDeviceWidth:
+        return length_value(value, env, &number) && compare(op, env->device_width, number);
+    case CssMediaFeatureDeviceHeight:
+        return length_value(value, env, &number) && compare(op, env->device_height, number);
+    case CssMediaFeatureOrientation:
+        if ( CssValuePortrait == value->id )
+            return env->height >= env->width;
+        return env->width > env->height;
+    case CssMediaFeatureAspectRatio:
+        return evaluate_ratio(op, env->width, env->height, values);
+    case CssMediaFeatureDeviceAspectRatio:
+        return evaluate_ratio(op, env->device_width, env->device_height, values);
+    case CssMediaFeatureResolution:
+        return compare(op, env->resolution, value->fValue * cssprsr_unit_absolute_scale(value->unit));
+    case CssMediaFeatureDevicePixelRatio:
+        return compare(op, env->resolution, value->fValue);
+    case CssMediaFeatureColor:
+        return compare(op, env->color, value->fValue);
+    case CssMediaFeatureMonochrome:
+        return compare(op, env->monochrome, value->fValue);
+    default:
+        return false;
+    }
+}
+
+static const char* env_media_type(const CssMediaEnv* env)
+{
+    return NULL == env->media_type ? "screen" : env->media_type;
+}
+
+// A query using a feature it does not know, or a value not suiting its
+// feature, is `not all`, which holds neither with nor without `not`.
+static bool is_valid_query(const CssMediaQuery* query)
+{
+    for (size_t i = 0; query->expressions && i < query->expressions->length; ++i) {
+        if ( !is_valid_expression(query->expressions->data[i]) )
+            return false;
+    }
+    return true;
+}
+
+bool css_media_query_evaluate(const CssMediaQuery* query, const CssMediaEnv* env)
+{
+    if ( !is_valid_query(query) )
+        return false;
+    bool result = NULL == query->type || 0 == strcasecmp(query->type, "all") ||
+                  0 == strcasecmp(query->type, env_media_type(env));
+    if ( result && query->expressions ) {
+        for (size_t i = 0; i < query->expressions->length; ++i) {
+            if ( !evaluate_expression(query->expressions->data[i], env) ) {
+                result = false;
+                break;
+            }
+        }
+    }
+    return CssMediaQueryResNot == query->restrictor ? !result : result;
+}
+
+bool css_media_list_evaluate(const CssArray* medias, const CssMediaEnv* env)
+{
+    if ( NULL == medias || 0 == medias->length )
+        return true;
+    for (size_t i = 0; i < medias->length; ++i) {
+        if ( css_media_query_evaluate(medias->data[i], env) )
+            return true;
+    }
+    return false;
+}
+
+static unsigned int query_dependencies(const CssMediaQuery* query)
+{
+    unsigned int dependencies = 0;
+    // `not all` depends on nothing
+    if ( !is_valid_query(query) )
+        return 0;
+    if ( NULL != query->type && strcasecmp(query->type, "all") )
+        dependencies |= CssMediaDependsOnType;
+    for (size_t i = 0; query->expressions && i < query->expressions->length; ++i) {
+        const CssMediaQueryExp* exp = query->expressions->data[i];
+        CssMediaCompare op;
+        unsigned int feature_dependencies = 0;
+        if ( CssMediaFeatureUnknown == parse_feature(exp->feature, &op, &feature_dependencies) )
+            continue;
+        dependencies |= feature_dependencies;
+        for (size_t j = 0; exp->values && j < exp->values->length; ++j) {
+            const CssValue* value = exp->values->data[j];
+            if ( is_relative_length(value) )
+                dependencies |= CssMediaDependsOnFontSize | CssMediaDependsOnWidth | CssMediaDependsOnHeight;
+        }
+    }
+    return dependencies;
+}
+
+static unsigned int changed_dependencies(const CssMediaEnv* old, const CssMediaEnv* env)
+{
+    unsigned int changed = 0;
+    if ( strcasecmp(env_media_type(old), env_media_type(env)) )
+        changed |= CssMediaDependsOnType;
+    if ( old->width != env->width )
+        changed |= CssMediaDependsOnWidth;
+    if ( old->height != env->height )
+        changed |= CssMediaDependsOnHeight;
+    if ( old->device_width != env->device_width || old->device_height != env->device_height )
+        changed |= CssMediaDependsOnDevice;
+    if ( old->resolution != env->resolution )
+        changed |= CssMediaDependsOnResolution;
+    if ( old->color != env->color || old->monochrome != env->monochrome )
+        changed |= CssMediaDependsOnColor;
+    if ( old->font_size != env->font_size )
+        changed |= CssMediaDependsOnFontSize;
+    return changed;
+}
+
+// Media query cache.
+
+typedef struct {
+    // The first query of its text, the others are evaluated through it
+    const CssMediaQuery* query;
+    // Its text, key of the map the distinct queries are found in
+    const char* key;
+    unsigned int dependencies;
+    bool result;
+    // Whether its width and height expressions are all in the breakpoint
+    // lists, else it is evaluated again on any resize
+    bool indexed;
+    // Update it was last evaluated in
+    unsigned int stamp;
+    // CssMediaCacheEntry of the rules having this query in their list
+    CssArray entries;
+} CssMediaCacheQuery;
+
+typedef struct CssMediaCacheEntry {
+    const CssMediaRule* rule;
+    // Position in document order
+    unsigned int index;
+    // The `@media` rule around this one, NULL at the top level
+    struct CssMediaCacheEntry* parent;
+    // CssMediaCacheEntry of the `@media` rules right inside this one
+    CssArray children;
+    // CssMediaCacheQuery of the media list
+    CssArray queries;
+    // The media list holds
+    bool matches;
+    // The media lists of this rule and of the rules around it all hold
+    bool active;
+    bool dirty;
+} CssMediaCacheEntry;
+
+// Where a width or height expression starts or stops holding
+typedef struct {
+    double value;
+    CssMediaCacheQuery* query;
+} CssMediaBreakpoint;
+
+typedef struct {
+    CssMediaBreakpoint* data;
+    unsigned int length;
+    unsigned int capacity;
+} CssMediaBreakpointList;
+
+// An expression holds for sizes from `start` to `end`, both included. A
+// size leaving the range crosses one of them, so the queries to evaluate
+// again after a resize are found by binary search in lists sorted by start
+// and by end.
+typedef struct {
+    CssMediaBreakpointList starts;
+    CssMediaBreakpointList ends;
+} CssMediaBreakpoints;
+
+struct CssInternalMediaQueryCache {
+    CssMediaEnv env;
+    // Copy of `env.media_type`
+    char* media_type;
+    bool evaluated;
+    unsigned int stamp;
+    CssArray queries;
+    // In document order, enclosing rules first
+    CssArray entries;
+    // Same entries, by rule pointer
+    CssArray sorted;
+    // Breakpoints of the indexed queries, in px for the current font size
+    CssMediaBreakpoints width;
+    CssMediaBreakpoints height;
+    // Queries reading the viewport in a way that is not indexed
+    CssArray viewport_queries;
+    // Entries to revisit in the current update
+    CssArray dirty;
+    // Rules whose state changed in the last update
+    CssArray changed;
+};
+
+static const char* query_key(CssParser* parser, const CssMediaQuery* query)
+{
+    CssParserString buffer;
+    cssprsr_string_init(parser, &buffer);
+    cssprsr_string_append_characters(parser, CssMediaQueryResNot == query->restrictor ? "not " : "", &buffer);
+    cssprsr_string_append_characters(parser, query->type ? query->type : "all", &buffer);
+    for (size_t i = 0; query->expressions && i < query->expressions->length; ++i) {
+        const CssMediaQueryExp* exp = query->expressions->data[i];
+        cssprsr_string_append_characters(parser, " and (", &buffer);
+        cssprsr_string_append_characters(parser, exp->feature, &buffer);
+        if ( exp->raw ) {
+            cssprsr_string_append_characters(parser, ":", &buffer);
+            cssprsr_string_append_characters(parser, exp->raw, &buffer);
+        }
+        cssprsr_string_append_characters(parser, ")", &buffer);
+    }
+    const char* key = cssprsr_string_to_characters(parser, &buffer);
+    cssprsr_parser_free(parser, buffer.data);
+    return key;
+}
+
+static void add_rules(CssParser* parser, CssMediaQueryCache* cache, CssStringMap* keys,
+                      const CssArray* rules, CssMediaCacheEntry* parent)
+{
+    for (size_t i = 0; rules && i < rules->length; ++i) {
+        const CssRule* rule = rules->data[i];
+        if ( CssRuleMedia != rule->type )
+            continue;
+        const CssMediaRule* media = (const CssMediaRule*)rule;
+        CssMediaCacheEntry* entry = cssprsr_parser_alloc(parser, sizeof(CssMediaCacheEntry));
+        entry->rule = media;
+        entry->index = cache->entries.length;
+        entry->parent = parent;
+        entry->matches = false;
+        entry->active = false;
+        entry->dirty = false;
+        cssprsr_array_init(parser, 0, &entry->children);
+        cssprsr_array_init(parser, 0, &entry->queries);
+        for (size_t j = 0; media->medias && j < media->medias->length; ++j) {
+            const CssMediaQuery* query = media->medias->data[j];
+            const char* key = query_key(parser, query);
+            CssMediaCacheQuery** slot = (CssMediaCacheQuery**)cssprsr_string_map_insert(parser, key, keys);
+            if ( NULL == *slot ) {
+                *slot = cssprsr_parser_alloc(parser, sizeof(CssMediaCacheQuery));
+                (*slot)->query = query;
+                (*slot)->key = key;
+                (*slot)->dependencies = query_dependencies(query);
+                (*slot)->result = false;
+                (*slot)->indexed = false;
+                (*slot)->stamp = 0;
+                cssprsr_array_init(parser, 0, &(*slot)->entries);
+                cssprsr_array_add(parser, *slot, &cache->queries);
+            } else {
+                cssprsr_parser_free(parser, (void*) key);
+            }
+            cssprsr_array_add(parser, *slot, &entry->queries);
+            cssprsr_array_add(parser, entry, &(*slot)->entries);
+        }
+        cssprsr_array_add(parser, entry, &cache->entries);
+        if ( parent )
+            cssprsr_array_add(parser, entry, &parent->children);
+        add_rules(parser, cache, keys, media->rules, entry);
+    }
+}
+
+static int compare_rules(const void* a, const void* b)
+{
+    uintptr_t left = (uintptr_t)(*(const CssMediaCacheEntry* const*)a)->rule;
+    uintptr_t right = (uintptr_t)(*(const CssMediaCacheEntry* const*)b)->rule;
+    return left < right ? -1 : left > right;
+}
+
+static void breakpoint_list_add(CssParser* parser, CssMediaBreakpointList* list, double value, CssMediaCacheQuery* query)
+{
+    if ( list->length == list->capacity ) {
+        unsigned int capacity = list->capacity ? list->capacity * 2 : 16;
+        CssMediaBreakpoint* data = cssprsr_parser_alloc(parser, sizeof(CssMediaBreakpoint) * capacity);
+        if ( list->length )
+            memcpy(data, list->data, sizeof(CssMediaBreakpoint) * list->length);
+        if ( list->data )
+            cssprsr_parser_free(parser, list->data);
+        list->data = data;
+        list->capacity = capacity;
+    }
+    list->data[list->length].value = value;
+    list->data[list->length].query = query;
+    list->length++;
+}
+
+static int compare_breakpoints(const void* a, const void* b)
+{
+    double left = ((const CssMediaBreakpoint*)a)->value;
+    double right = ((const CssMediaBreakpoint*)b)->value;
+    return left < right ? -1 : left > right;
+}
+
+static void breakpoints_init(CssMediaBreakpoints* breakpoints)
+{
+    memset(breakpoints, 0, sizeof(CssMediaBreakpoints));
+}
+
+static void breakpoints_destroy(CssParser* parser, CssMediaBreakpoints* breakpoints)
+{
+    if ( breakpoints->starts.data )
+        cssprsr_parser_free(parser, breakpoints->starts.data);
+    if ( breakpoints->ends.data )
+        cssprsr_parser_free(parser, breakpoints->ends.data);
+    breakpoints_init(breakpoints);
+}
+
+// Adds the range of a width or height expression, false when it has none,
+// like for `(orientation: portrait)` or a length relative to the viewport.
+static bool add_breakpoints(CssParser* parser, CssMediaQueryCache* cache, CssMediaCacheQuery* query,
+                            const CssMediaQueryExp* exp, const CssMediaEnv* env)
+{
+    CssMediaCompare op;
+    unsigned int dependencies = 0;
+    CssMediaFeature feature = parse_feature(exp->feature, &op, &dependencies);
+    for (size_t i = 0; exp->values && i < exp->values->length; ++i) {
+        switch ( ((const CssValue*)exp->values->data[i])->unit ) {
+        case CSS_VALUE_VW:
+        case CSS_VALUE_VH:
+        case CSS_VALUE_VMIN:
+        case CSS_VALUE_VMAX:
+        case CSS_VALUE_CALC:
+            if ( CssMediaFeatureUnknown != feature )
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    if ( 0 == (dependencies & (CssMediaDependsOnWidth | CssMediaDependsOnHeight)) )
+        return true;
+    if ( (CssMediaFeatureWidth != feature && CssMediaFeatureHeight != feature) ||
+         NULL == exp->values || 0 == exp->values->length )
+        return false;
+    double length;
+    // An expression with a value that is not a length never holds
+    if ( 1 != exp->values->length || !length_value(exp->values->data[0], env, &length) )
+        return true;
+    CssMediaBreakpoints* breakpoints = CssMediaFeatureWidth == feature ? &cache->width : &cache->height;
+    if ( CssMediaCompareMax != op )
+        breakpoint_list_add(parser, &breakpoints->starts, length, query);
+    if ( CssMediaCompareMin != op )
+        breakpoint_list_add(parser, &breakpoints->ends, length, query);
+    return true;
+}
+
+// Lengths in media queries may be in em, so the breakpoints are in px for
+// a given font size.
+static void build_breakpoints(CssParser* parser, CssMediaQueryCache* cache, const CssMediaEnv* env)
+{
+    breakpoints_destroy(parser, &cache->width);
+    breakpoints_destroy(parser, &cache->height);
+    cache->viewport_queries.length = 0;
+    for (size_t i = 0; i < cache->queries.length; ++i) {
+        CssMediaCacheQuery* query = cache->queries.data[i];
+        if ( 0 == (query->dependencies & (CssMediaDependsOnWidth | CssMediaDependsOnHeight)) )
+            continue;
+        query->indexed = true;
+        const CssArray* expressions = query->query->expressions;
+        for (size_t j = 0; expressions && j < expressions->length; ++j) {
+            if ( !add_breakpoints(parser, cache, query, expressions->data[j], env) )
+                query->indexed = false;
+        }
+        if ( !query->indexed )
+            cssprsr_array_add(parser, query, &cache->viewport_queries);
+    }
+    CssMediaBreakpointList* lists[] = {
+        &cache->width.starts, &cache->width.ends, &cache->height.starts, &cache->height.ends
+    };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+        if ( lists[i]->length > 1 )
+            qsort(lists[i]->data, lists[i]->length, sizeof(CssMediaBreakpoint), compare_breakpoints);
+    }
+}
+
+CssMediaQueryCache* css_media_query_cache_new(const CssStylesheet* stylesheet)
+{
+    if ( NULL == stylesheet )
+        return NULL;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssMediaQueryCache* cache = cssprsr_parser_alloc(&parser, sizeof(CssMediaQueryCache));
+    memset(&cache->env, 0, sizeof(cache->env));
+    cache->media_type = NULL;
+    cache->evaluated = false;
+    cache->stamp = 0;
+    cssprsr_array_init(&parser, 0, &cache->queries);
+    cssprsr_array_init(&parser, 0, &cache->entries);
+    breakpoints_init(&cache->width);
+    breakpoints_init(&cache->height);
+    cssprsr_array_init(&parser, 0, &cache->viewport_queries);
+    cssprsr_array_init(&parser, 0, &cache->dirty);
+    cssprsr_array_init(&parser, 0, &cache->changed);
+
+    CssStringMap keys;
+    cssprsr_string_map_init(&parser, false, &keys);
+    add_rules(&parser, cache, &keys, &stylesheet->rules, NULL);
+    cssprsr_string_map_destroy(&parser, &keys);
+
+    cssprsr_array_init(&parser, cache->entries.length, &cache->sorted);
+    for (size_t i = 0; i < cache->entries.length; ++i)
+        cssprsr_array_add(&parser, cache->entries.data[i], &cache->sorted);
+    if ( cache->sorted.length > 1 )
+        qsort(cache->sorted.data, cache->sorted.length, sizeof(void*), compare_rules);
+    return cache;
+}
+
+void css_media_query_cache_destroy(CssMediaQueryCache* cache)
+{
+    if ( NULL == cache )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    for (size_t i = 0; i < cache->queries.length; ++i) {
+        CssMediaCacheQuery* query = cache->queries.data[i];
+        cssprsr_array_destroy(&parser, &query->entries);
+        cssprsr_parser_free(&parser, (void*) query->key);
+        cssprsr_parser_free(&parser, query);
+    }
+    for (size_t i = 0; i < cache->entries.length; ++i) {
+        CssMediaCacheEntry* entry = cache->entries.data[i];
+        cssprsr_array_destroy(&parser, &entry->children);
+        cssprsr_array_destroy(&parser, &entry->queries);
+        cssprsr_parser_free(&parser, entry);
+    }
+    cssprsr_array_destroy(&parser, &cache->queries);
+    cssprsr_array_destroy(&parser, &cache->entries);
+    cssprsr_array_destroy(&parser, &cache->sorted);
+    breakpoints_destroy(&parser, &cache->width);
+    breakpoints_destroy(&parser, &cache->height);
+    cssprsr_array_destroy(&parser, &cache->viewport_queries);
+    cssprsr_array_destroy(&parser, &cache->dirty);
+    cssprsr_array_destroy(&parser, &cache->changed);
+    if ( cache->media_type )
+        cssprsr_parser_free(&parser, cache->media_type);
+    cssprsr_parser_free(&parser, cache);
+}
+
+static void set_env(CssParser* parser, CssMediaQueryCache* cache, const CssMediaEnv* env)
+{
+    if ( cache->media_type )
+        cssprsr_parser_free(parser, cache->media_type);
+    cache->media_type = NULL;
+    cache->env = *env;
+    if ( env->media_type ) {
+        size_t length = strlen(env->media_type);
+        cache->media_type = cssprsr_parser_alloc(parser, length + 1);
+        memcpy(cache->media_type, env->media_type, length + 1);
+    }
+    cache->env.media_type = cache->media_type;
+}
+
+static void evaluate_query(CssParser* parser, CssMediaQueryCache* cache, CssMediaCacheQuery* query,
+                           const CssMediaEnv* env)
+{
+    if ( query->stamp == cache->stamp )
+        return;
+    query->stamp = cache->stamp;
+    bool result = css_media_query_evaluate(query->query, env);
+    if ( result == query->result )
+        return;
+    query->result = result;
+    for (size_t i = 0; i < query->entries.length; ++i) {
+        CssMediaCacheEntry* entry = query->entries.data[i];
+        if ( !entry->dirty ) {
+            entry->dirty = true;
+            cssprsr_array_add(parser, entry, &cache->dirty);
+        }
+    }
+}
+
+// First breakpoint of a sorted list at or above `value`.
+static unsigned int lower_bound(const CssMediaBreakpointList* list, double value)
+{
+    unsigned int low = 0, high = list->length;
+    while ( low < high ) {
+        unsigned int middle = low + (high - low) / 2;
+        if ( list->data[middle].value < value )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// First breakpoint of a sorted list above `value`.
+static unsigned int upper_bound(const CssMediaBreakpointList* list, double value)
+{
+    unsigned int low = 0, high = list->length;
+    while ( low < high ) {
+        unsigned int middle = low + (high - low) / 2;
+        if ( list->data[middle].value <= value )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// Evaluates again the queries with a range starting in (from, to] or ending
+// in [from, to), the size going from `from` to `to`, or the other way.
+static void cross_breakpoints(CssParser* parser, CssMediaQueryCache* cache, const CssMediaBreakpoints* breakpoints,
+                              double from, double to, const CssMediaEnv* env)
+{
+    double low = from < to ? from : to;
+    double high = from < to ? to : from;
+    for (unsigned int i = upper_bound(&breakpoints->starts, low);
+         i < breakpoints->starts.length && breakpoints->starts.data[i].value <= high; ++i)
+        evaluate_query(parser, cache, breakpoints->starts.data[i].query, env);
+    for (unsigned int i = lower_bound(&breakpoints->ends, low);
+         i < breakpoints->ends.length && breakpoints->ends.data[i].value < high; ++i)
+        evaluate_query(parser, cache, breakpoints->ends.data[i].query, env);
+}
+
+static void set_active(CssParser* parser, CssMediaQueryCache* cache, CssMediaCacheEntry* entry)
+{
+    bool active = entry->matches && (NULL == entry->parent || entry->parent->active);
+    if ( active == entry->active )
+        return;
+    entry->active = active;
+    cssprsr_array_add(parser, entry, &cache->changed);
+    for (size_t i = 0; i < entry->children.length; ++i)
+        set_active(parser, cache, entry->children.data[i]);
+}
+
+static int compare_document_order(const void* a, const void* b)
+{
+    unsigned int left = (*(const CssMediaCacheEntry* const*)a)->index;
+    unsigned int right = (*(const CssMediaCacheEntry* const*)b)->index;
+    return left < right ? -1 : left > right;
+}
+
+size_t css_media_query_cache_update(CssMediaQueryCache* cache, const CssMediaEnv* env)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    bool first = !cache->evaluated;
+    unsigned int changed = first ? 0 : changed_dependencies(&cache->env, env);
+    double old_width = cache->env.width, old_height = cache->env.height;
+    cache->evaluated = true;
+    cache->stamp++;
+    cache->dirty.length = 0;
+    cache->changed.length = 0;
+
+    if ( first ) {
+        // Every rule starts inactive, those with an empty media list hold
+        for (size_t i = 0; i < cache->entries.length; ++i) {
+            CssMediaCacheEntry* entry = cache->entries.data[i];
+            entry->dirty = true;
+            cssprsr_array_add(&parser, entry, &cache->dirty);
+        }
+    }
+    if ( first || (changed & CssMediaDependsOnFontSize) )
+        build_breakpoints(&parser, cache, env);
+
+    if ( first || (changed & ~(CssMediaDependsOnWidth | CssMediaDependsOnHeight)) ) {
+        for (size_t i = 0; i < cache->queries.length; ++i) {
+            CssMediaCacheQuery* query = cache->queries.data[i];
+            if ( first || (query->dependencies & changed) )
+                evaluate_query(&parser, cache, query, env);
+        }
+    } else if ( changed ) {
+        // A resize: only the queries with a breakpoint between the old and
+        // the new size, and those that could not be indexed
+        if ( changed & CssMediaDependsOnWidth )
+            cross_breakpoints(&parser, cache, &cache->width, old_width, env->width, env);
+        if ( changed & CssMediaDependsOnHeight )
+            cross_breakpoints(&parser, cache, &cache->height, old_height, env->height, env);
+        for (size_t i = 0; i < cache->viewport_queries.length; ++i) {
+            CssMediaCacheQuery* query = cache->viewport_queries.data[i];
+            if ( query->dependencies & changed )
+                evaluate_query(&parser, cache, query, env);
+        }
+    }
+    set_env(&parser, cache, env);
+
+    // All media lists first, then the states from the enclosing rules down,
+    // so a rule flipped with its parent is not flipped back
+    if ( cache->dirty.length > 1 )
+        qsort(cache->dirty.data, cache->dirty.length, sizeof(void*), compare_document_order);
+    for (size_t i = 0; i < cache->dirty.length; ++i) {
+        CssMediaCacheEntry* entry = cache->dirty.data[i];
+        entry->matches = 0 == entry->queries.length;
+        for (size_t j = 0; !entry->matches && j < entry->queries.length; ++j)
+            entry->matches = ((CssMediaCacheQuery*)entry->queries.data[j])->result;
+        entry->dirty = false;
+    }
+    for (size_t i = 0; i < cache->dirty.length; ++i)
+        set_active(&parser, cache, cache->dirty.data[i]);
+
+    if ( cache->changed.length > 1 )
+        qsort(cache->changed.data, cache->changed.length, sizeof(void*), compare_document_order);
+    for (size_t i = 0; i < cache->changed.length; ++i)
+        cache->changed.data[i] = (void*)((CssMediaCacheEntry*)cache->changed.data[i])->rule;
+    return cache->changed.length;
+}
+
+const CssMediaRule* const* css_media_query_cache_changed(const CssMediaQueryCache* cache)
+{
+    return (const CssMediaRule* const*)cache->changed.data;
+}
+
+bool css_media_query_cache_is_active(const CssMediaQueryCache* cache, const CssMediaRule* rule)
+{
+    size_t low = 0, high = cache->sorted.length;
+    while ( low < high ) {
+        size_t middle = low + (high - low) / 2;
+        const CssMediaCacheEntry* entry = cache->sorted.data[middle];
+        if ( entry->rule == rule )
+            return entry->active;
+        if ( (uintptr_t)entry->rule < (uintptr_t)rule )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return false;
+}
+
+size_t css_media_query_cache_distinct_count(const CssMediaQueryCache* cache)
+{
+    return cache->queries.length;
+}
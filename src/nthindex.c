@@ -0,0 +1,166 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "selector.h"
+#include "cssparser_i.h"
+
+#include <stdint.h>
+
+// Sibling positions.
+//
+// Without a cache the position of an element is a walk over its preceding or
+// following siblings, so matching `:nth-child()` against every child of a
+// long list is quadratic. Here the first lookup of an element numbers all its
+// siblings in one walk, among all of them and among those of the same type,
+// and every later lookup of any of them is a probe in a table keyed by the
+// element pointer.
+
+typedef struct {
+    const void* element;
+    unsigned int index;      // 0-based among the siblings
+    unsigned int count;      // number of siblings, the element included
+    unsigned int type_index; // same, only counting siblings of the same type
+    unsigned int type_count;
+} CssNthIndexEntry;
+
+struct CssInternalNthIndexCache {
+    // Open addressing, the capacity is 0 or a power of two
+    CssNthIndexEntry* entries;
+    unsigned int capacity;
+    unsigned int length;
+};
+
+static unsigned int pointer_hash(const void* pointer)
+{
+    unsigned long long value = (uintptr_t)pointer;
+    return (unsigned int)((value * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static CssNthIndexEntry* find(const CssNthIndexCache* cache, const void* element)
+{
+    unsigned int mask = cache->capacity - 1;
+    for (unsigned int i = pointer_hash(element) & mask; ; i = (i + 1) & mask) {
+        CssNthIndexEntry* entry = &cache->entries[i];
+        if ( NULL == entry->element || element == entry->element )
+            return entry;
+    }
+}
+
+// Makes room for `count` more entries, keeping the load factor under 1/2.
+static void reserve(CssParser* parser, CssNthIndexCache* cache, size_t count)
+{
+    unsigned int capacity = cache->capacity ? cache->capacity : 64;
+    while ( (cache->length + count) * 2 > capacity )
+        capacity *= 2;
+    if ( capacity == cache->capacity )
+        return;
+    CssNthIndexEntry* old = cache->entries;
+    unsigned int old_capacity = cache->capacity;
+    cache->entries = cssprsr_parser_alloc(parser, sizeof(CssNthIndexEntry) * capacity);
+    memset(cache->entries, 0, sizeof(CssNthIndexEntry) * capacity);
+    cache->capacity = capacity;
+    for (unsigned int i = 0; i < old_capacity; ++i) {
+        if ( old[i].element )
+            *find(cache, old[i].element) = old[i];
+    }
+    if ( old )
+        cssprsr_parser_free(parser, old);
+}
+
+static void index_siblings(CssNthIndexCache* cache, const void* element, const CssElementOps* ops)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+
+    const void* first = element;
+    for (const void* e = ops->previous_sibling(element); e; e = ops->previous_sibling(e))
+        first = e;
+    CssArray siblings;
+    cssprsr_array_init(&parser, 0, &siblings);
+    for (const void* e = first; e; e = ops->next_sibling(e))
+        cssprsr_array_add(&parser, (void*)e, &siblings);
+    reserve(&parser, cache, siblings.length);
+
+    // Tag name to the number of siblings of that type seen so far
+    CssStringMap types;
+    cssprsr_string_map_init(&parser, true, &types);
+    for (size_t i = 0; i < siblings.length; ++i) {
+        CssNthIndexEntry* entry = find(cache, siblings.data[i]);
+        if ( NULL == entry->element )
+            cache->length++;
+        void** seen = cssprsr_string_map_insert(&parser, ops->tag_name(siblings.data[i]), &types);
+        entry->element = siblings.data[i];
+        entry->index = (unsigned int)i;
+        entry->count = (unsigned int)siblings.length;
+        entry->type_index = (unsigned int)(uintptr_t)*seen;
+        *seen = (void*)((uintptr_t)*seen + 1);
+    }
+    for (size_t i = 0; i < siblings.length; ++i) {
+        CssNthIndexEntry* entry = find(cache, siblings.data[i]);
+        const char* tag = ops->tag_name(siblings.data[i]);
+        entry->type_count = (unsigned int)(uintptr_t)cssprsr_string_map_get(&types, tag);
+    }
+    cssprsr_string_map_destroy(&parser, &types);
+    cssprsr_array_destroy(&parser, &siblings);
+}
+
+int cssprsr_nth_index_position(CssNthIndexCache* cache, const void* element, const CssElementOps* ops,
+                               bool forward, bool of_type)
+{
+    CssNthIndexEntry* entry = cache->capacity ? find(cache, element) : NULL;
+    if ( NULL == entry || NULL == entry->element ) {
+        index_siblings(cache, element, ops);
+        entry = find(cache, element);
+    }
+    unsigned int index = of_type ? entry->type_index : entry->index;
+    unsigned int count = of_type ? entry->type_count : entry->count;
+    return (int)(forward ? index + 1 : count - index);
+}
+
+CssNthIndexCache* css_nth_index_cache_new(void)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssNthIndexCache* cache = cssprsr_parser_alloc(&parser, sizeof(CssNthIndexCache));
+    cache->entries = NULL;
+    cache->capacity = 0;
+    cache->length = 0;
+    return cache;
+}
+
+void css_nth_index_cache_clear(CssNthIndexCache* cache)
+{
+    if ( NULL == cache || NULL == cache->entries )
+        return;
+    memset(cache->entries, 0, sizeof(CssNthIndexEntry) * cache->capacity);
+    cache->length = 0;
+}
+
+void css_nth_index_cache_destroy(CssNthIndexCache* cache)
+{
+    if ( NULL == cache )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    if ( cache->entries )
+        cssprsr_parser_free(&parser, cache->entries);
+    cssprsr_parser_free(&parser, cache);
+}
@@ -0,0 +1,380 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Property names.
+//
+// Declarations carry the CssPropertyID of their property so that consumers
+// switch on it instead of comparing strings. Names are looked up in a
+// perfect hash table laid out like the pseudo type one in selector.c, with
+// slots holding ids into kPropertyNames. After adding a property to the enum
+// and to kPropertyNames, `tools/perfect_hash.py property` regenerates the
+// seeds and slots; test_property_map() checks them. A vendor prefix is
+// recorded apart and the rest of the name looked up, so `-webkit-transform`
+// is a transform.
+
+#define CSSPRSR_PROPERTY_BUCKETS    128
+#define CSSPRSR_PROPERTY_SLOTS      256
+#define CSSPRSR_PROPERTY_SLOT_SHIFT 24
+
+static const char* const kPropertyNames[CssPropertyCount] = {
+    [CssPropertyAlignContent]             = "align-content",
+    [CssPropertyAlignItems]               = "align-items",
+    [CssPropertyAlignSelf]                = "align-self",
+    [CssPropertyAll]                      = "all",
+    [CssPropertyAnimation]                = "animation",
+    [CssPropertyAnimationDelay]           = "animation-delay",
+    [CssPropertyAnimationDirection]       = "animation-direction",
+    [CssPropertyAnimationDuration]        = "animation-duration",
+    [CssPropertyAnimationFillMode]        = "animation-fill-mode",
+    [CssPropertyAnimationIterationCount]  = "animation-iteration-count",
+    [CssPropertyAnimationName]            = "animation-name",
+    [CssPropertyAnimationPlayState]       = "animation-play-state",
+    [CssPropertyAnimationTimingFunction]  = "animation-timing-function",
+    [CssPropertyAppearance]               = "appearance",
+    [CssPropertyBackfaceVisibility]       = "backface-visibility",
+    [CssPropertyBackground]               = "background",
+    [CssPropertyBackgroundAttachment]     = "background-attachment",
+    [CssPropertyBackgroundBlendMode]      = "background-blend-mode",
+    [CssPropertyBackgroundClip]           = "background-clip",
+    [CssPropertyBackgroundColor]          = "background-color",
+    [CssPropertyBackgroundImage]          = "background-image",
+    [CssPropertyBackgroundOrigin]         = "background-origin",
+    [CssPropertyBackgroundPosition]       = "background-position",
+    [CssPropertyBackgroundPositionX]      = "background-position-x",
+    [CssPropertyBackgroundPositionY]      = "background-position-y",
+    [CssPropertyBackgroundRepeat]         = "background-repeat",
+    [CssPropertyBackgroundSize]           = "background-size",
+    [CssPropertyBorder]                   = "border",
+    [CssPropertyBorderBottom]             = "border-bottom",
+    [CssPropertyBorderBottomColor]        = "border-bottom-color",
+    [CssPropertyBorderBottomLeftRadius]   = "border-bottom-left-radius",
+    [CssPropertyBorderBottomRightRadius]  = "border-bottom-right-radius",
+    [CssPropertyBorderBottomStyle]        = "border-bottom-style",
+    [CssPropertyBorderBottomWidth]        = "border-bottom-width",
+    [CssPropertyBorderCollapse]           = "border-collapse",
+    [CssPropertyBorderColor]              = "border-color",
+    [CssPropertyBorderImage]              = "border-image",
+    [CssPropertyBorderImageOutset]        = "border-image-outset",
+    [CssPropertyBorderImageRepeat]        = "border-image-repeat",
+    [CssPropertyBorderImageSlice]         = "border-image-slice",
+    [CssPropertyBorderImageSource]        = "border-image-source",
+    [CssPropertyBorderImageWidth]         = "border-image-width",
+    [CssPropertyBorderLeft]               = "border-left",
+    [CssPropertyBorderLeftColor]          = "border-left-color",
+    [CssPropertyBorderLeftStyle]          = "border-left-style",
+    [CssPropertyBorderLeftWidth]          = "border-left-width",
+    [CssPropertyBorderRadius]             = "border-radius",
+    [CssPropertyBorderRight]              = "border-right",
+    [CssPropertyBorderRightColor]         = "border-right-color",
+    [CssPropertyBorderRightStyle]         = "border-right-style",
+    [CssPropertyBorderRightWidth]         = "border-right-width",
+    [CssPropertyBorderSpacing]            = "border-spacing",
+    [CssPropertyBorderStyle]              = "border-style",
+    [CssPropertyBorderTop]                = "border-top",
+    [CssPropertyBorderTopColor]           = "border-top-color",
+    [CssPropertyBorderTopLeftRadius]      = "border-top-left-radius",
+    [CssPropertyBorderTopRightRadius]     = "border-top-right-radius",
+    [CssPropertyBorderTopStyle]           = "border-top-style",
+    [CssPropertyBorderTopWidth]           = "border-top-width",
+    [CssPropertyBorderWidth]              = "border-width",
+    [CssPropertyBottom]                   = "bottom",
+    [CssPropertyBoxDecorationBreak]       = "box-decoration-break",
+    [CssPropertyBoxShadow]                = "box-shadow",
+    [CssPropertyBoxSizing]                = "box-sizing",
+    [CssPropertyBreakAfter]               = "break-after",
+    [CssPropertyBreakBefore]              = "break-before",
+    [CssPropertyBreakInside]              = "break-inside",
+    [CssPropertyCaptionSide]              = "caption-side",
+    [CssPropertyCaretColor]               = "caret-color",
+    [CssPropertyClear]                    = "clear",
+    [CssPropertyClip]                     = "clip",
+    [CssPropertyClipPath]                 = "clip-path",
+    [CssPropertyColor]                    = "color",
+    [CssPropertyColumnCount]              = "column-count",
+    [CssPropertyColumnFill]               = "column-fill",
+    [CssPropertyColumnGap]                = "column-gap",
+    [CssPropertyColumnRule]               = "column-rule",
+    [CssPropertyColumnRuleColor]          = "column-rule-color",
+    [CssPropertyColumnRuleStyle]          = "column-rule-style",
+    [CssPropertyColumnRuleWidth]          = "column-rule-width",
+    [CssPropertyColumnSpan]               = "column-span",
+    [CssPropertyColumnWidth]              = "column-width",
+    [CssPropertyColumns]                  = "columns",
+    [CssPropertyContent]                  = "content",
+    [CssPropertyCounterIncrement]         = "counter-increment",
+    [CssPropertyCounterReset]             = "counter-reset",
+    [CssPropertyCursor]                   = "cursor",
+    [CssPropertyDirection]                = "direction",
+    [CssPropertyDisplay]                  = "display",
+    [CssPropertyEmptyCells]               = "empty-cells",
+    [CssPropertyFilter]                   = "filter",
+    [CssPropertyFlex]                     = "flex",
+    [CssPropertyFlexBasis]                = "flex-basis",
+    [CssPropertyFlexDirection]            = "flex-direction",
+    [CssPropertyFlexFlow]                 = "flex-flow",
+    [CssPropertyFlexGrow]                 = "flex-grow",
+    [CssPropertyFlexShrink]               = "flex-shrink",
+    [CssPropertyFlexWrap]                 = "flex-wrap",
+    [CssPropertyFloat]                    = "float",
+    [CssPropertyFont]                     = "font",
+    [CssPropertyFontFamily]               = "font-family",
+    [CssPropertyFontFeatureSettings]      = "font-feature-settings",
+    [CssPropertyFontKerning]              = "font-kerning",
+    [CssPropertyFontSize]                 = "font-size",
+    [CssPropertyFontSizeAdjust]           = "font-size-adjust",
+    [CssPropertyFontStretch]              = "font-stretch",
+    [CssPropertyFontStyle]                = "font-style",
+    [CssPropertyFontVariant]              = "font-variant",
+    [CssPropertyFontVariantCaps]          = "font-variant-caps",
+    [CssPropertyFontVariantLigatures]     = "font-variant-ligatures",
+    [CssPropertyFontVariantNumeric]       = "font-variant-numeric",
+    [CssPropertyFontWeight]               = "font-weight",
+    [CssPropertyGap]                      = "gap",
+    [CssPropertyGrid]                     = "grid",
+    [CssPropertyGridArea]                 = "grid-area",
+    [CssPropertyGridAutoColumns]          = "grid-auto-columns",
+    [CssPropertyGridAutoFlow]             = "grid-auto-flow",
+    [CssPropertyGridAutoRows]             = "grid-auto-rows",
+    [CssPropertyGridColumn]               = "grid-column",
+    [CssPropertyGridColumnEnd]            = "grid-column-end",
+    [CssPropertyGridColumnGap]            = "grid-column-gap",
+    [CssPropertyGridColumnStart]          = "grid-column-start",
+    [CssPropertyGridGap]                  = "grid-gap",
+    [CssPropertyGridRow]                  = "grid-row",
+    [CssPropertyGridRowEnd]               = "grid-row-end",
+    [CssPropertyGridRowGap]               = "grid-row-gap",
+    [CssPropertyGridRowStart]             = "grid-row-start",
+    [CssPropertyGridTemplate]             = "grid-template",
+    [CssPropertyGridTemplateAreas]        = "grid-template-areas",
+    [CssPropertyGridTemplateColumns]      = "grid-template-columns",
+    [CssPropertyGridTemplateRows]         = "grid-template-rows",
+    [CssPropertyHeight]                   = "height",
+    [CssPropertyHyphens]                  = "hyphens",
+    [CssPropertyImageRendering]           = "image-rendering",
+    [CssPropertyIsolation]                = "isolation",
+    [CssPropertyJustifyContent]           = "justify-content",
+    [CssPropertyJustifyItems]             = "justify-items",
+    [CssPropertyJustifySelf]              = "justify-self",
+    [CssPropertyLeft]                     = "left",
+    [CssPropertyLetterSpacing]            = "letter-spacing",
+    [CssPropertyLineHeight]               = "line-height",
+    [CssPropertyListStyle]                = "list-style",
+    [CssPropertyListStyleImage]           = "list-style-image",
+    [CssPropertyListStylePosition]        = "list-style-position",
+    [CssPropertyListStyleType]            = "list-style-type",
+    [CssPropertyMargin]                   = "margin",
+    [CssPropertyMarginBottom]             = "margin-bottom",
+    [CssPropertyMarginLeft]               = "margin-left",
+    [CssPropertyMarginRight]              = "margin-right",
+    [CssPropertyMarginTop]                = "margin-top",
+    [CssPropertyMask]                     = "mask",
+    [CssPropertyMaskImage]                = "mask-image",
+    [CssPropertyMaxHeight]                = "max-height",
+    [CssPropertyMaxWidth]                 = "max-width",
+    [CssPropertyMinHeight]                = "min-height",
+    [CssPropertyMinWidth]                 = "min-width",
+    [CssPropertyMixBlendMode]             = "mix-blend-mode",
+    [CssPropertyObjectFit]                = "object-fit",
+    [CssPropertyObjectPosition]           = "object-position",
+    [CssPropertyOpacity]                  = "opacity",
+    [CssPropertyOrder]                    = "order",
+    [CssPropertyOrphans]                  = "orphans",
+    [CssPropertyOutline]                  = "outline",
+    [CssPropertyOutlineColor]             = "outline-color",
+    [CssPropertyOutlineOffset]            = "outline-offset",
+    [CssPropertyOutlineStyle]             = "outline-style",
+    [CssPropertyOutlineWidth]             = "outline-width",
+    [CssPropertyOverflow]                 = "overflow",
+    [CssPropertyOverflowWrap]             = "overflow-wrap",
+    [CssPropertyOverflowX]                = "overflow-x",
+    [CssPropertyOverflowY]                = "overflow-y",
+    [CssPropertyPadding]                  = "padding",
+    [CssPropertyPaddingBottom]            = "padding-bottom",
+    [CssPropertyPaddingLeft]              = "padding-left",
+    [CssPropertyPaddingRight]             = "padding-right",
+    [CssPropertyPaddingTop]               = "padding-top",
+    [CssPropertyPageBreakAfter]           = "page-break-after",
+    [CssPropertyPageBreakBefore]          = "page-break-before",
+    [CssPropertyPageBreakInside]          = "page-break-inside",
+    [CssPropertyPerspective]              = "perspective",
+    [CssPropertyPerspectiveOrigin]        = "perspective-origin",
+    [CssPropertyPlaceContent]             = "place-content",
+    [CssPropertyPlaceItems]               = "place-items",
+    [CssPropertyPlaceSelf]                = "place-self",
+    [CssPropertyPointerEvents]            = "pointer-events",
+    [CssPropertyPosition]                 = "position",
+    [CssPropertyQuotes]                   = "quotes",
+    [CssPropertyResize]                   = "resize",
+    [CssPropertyRight]                    = "right",
+    [CssPropertyRowGap]                   = "row-gap",
+    [CssPropertyScrollBehavior]           = "scroll-behavior",
+    [CssPropertySpeak]                    = "speak",
+    [CssPropertySrc]                      = "src",
+    [CssPropertyTabSize]                  = "tab-size",
+    [CssPropertyTableLayout]              = "table-layout",
+    [CssPropertyTextAlign]                = "text-align",
+    [CssPropertyTextAlignLast]            = "text-align-last",
+    [CssPropertyTextDecoration]           = "text-decoration",
+    [CssPropertyTextDecorationColor]      = "text-decoration-color",
+    [CssPropertyTextDecorationLine]       = "text-decoration-line",
+    [CssPropertyTextDecorationStyle]      = "text-decoration-style",
+    [CssPropertyTextIndent]               = "text-indent",
+    [CssPropertyTextJustify]              = "text-justify",
+    [CssPropertyTextOverflow]             = "text-overflow",
+    [CssPropertyTextRendering]            = "text-rendering",
+    [CssPropertyTextShadow]               = "text-shadow",
+    [CssPropertyTextSizeAdjust]           = "text-size-adjust",
+    [CssPropertyTextTransform]            = "text-transform",
+    [CssPropertyTextUnderlinePosition]    = "text-underline-position",
+    [CssPropertyTop]                      = "top",
+    [CssPropertyTouchAction]              = "touch-action",
+    [CssPropertyTransform]                = "transform",
+    [CssPropertyTransformOrigin]          = "transform-origin",
+    [CssPropertyTransformStyle]           = "transform-style",
+    [CssPropertyTransition]               = "transition",
+    [CssPropertyTransitionDelay]          = "transition-delay",
+    [CssPropertyTransitionDuration]       = "transition-duration",
+    [CssPropertyTransitionProperty]       = "transition-property",
+    [CssPropertyTransitionTimingFunction] = "transition-timing-function",
+    [CssPropertyUnicodeBidi]              = "unicode-bidi",
+    [CssPropertyUnicodeRange]             = "unicode-range",
+    [CssPropertyUserSelect]               = "user-select",
+    [CssPropertyVerticalAlign]            = "vertical-align",
+    [CssPropertyVisibility]               = "visibility",
+    [CssPropertyWhiteSpace]               = "white-space",
+    [CssPropertyWidows]                   = "widows",
+    [CssPropertyWidth]                    = "width",
+    [CssPropertyWillChange]               = "will-change",
+    [CssPropertyWordBreak]                = "word-break",
+    [CssPropertyWordSpacing]              = "word-spacing",
+    [CssPropertyWordWrap]                 = "word-wrap",
+    [CssPropertyWritingMode]              = "writing-mode",
+    [CssPropertyZIndex]                   = "z-index",
+    [CssPropertyZoom]                     = "zoom",
+};
+
+static const unsigned char kPropertySeeds[CSSPRSR_PROPERTY_BUCKETS] = {
+     14,   4,   7,   1,   5,   0,   0,   1,  15,  10,   1,   0,   6,   0,   6,   5,
+      2,   1,   3,   1,   0,   1,   0,   1,   0,   3,   8,   3,   0,   5,   4,   0,
+      3, 103,  15,   0,   5,   0,  16,   0,   9,   0,   2,   0,  10,   7,   0,  13,
+      0,   2,   0,   2,   0,   1,   1,   4,  35,   0,  18,   0,   0,   7,   0,   0,
+     23,  10,   0,   0,   0,   4,  10,  29,   0,  17,   0,   0,   0,   0,   0,   4,
+      0,  11,   0,   0,   0,  32,   0,   2,   0,   6,   0,   0,  12,   0,   9,   5,
+     12,   1,  15,  10,   8,   3,   0,   0,   2,   1,   2,   7,   0,   4,  16,   0,
+     33,  18,   3,   1,  23,   4,   1,   0,   9,   2,   0,   9,   9,   2,   8,   4,
+};
+
+// CssPropertyID of the name in each slot, 0 for none
+static const unsigned short kPropertySlots[CSSPRSR_PROPERTY_SLOTS] = {
+     79,  34,   0,   0, 132, 191,  70,  97, 204,  47,  46, 207, 100, 226,  48,   0,
+    157,  20,   0,  36, 196,   0,  35, 232, 206,  67,  42,   0, 140,   0,  92, 120,
+    143,  89, 144, 173,   0,  74, 235,   0, 139, 148, 192, 225, 199,  80, 109,  33,
+    208,  44,   0, 190, 168,   0,  82,  87, 129,  76, 182, 211, 154,  63,  16, 222,
+     15,  25,  55, 138,  11, 193,  31, 114, 223,  12, 161,   4,  99,  24, 227,  93,
+    176,  50,   0, 127,  91, 135,   0,  75,  68,  90, 185,   0, 213, 110, 119,  53,
+    194,  95, 122, 220, 159,  65,  78,  30,  69,  26,  37,  51,  66,  94,  38, 202,
+    186, 101,  81, 150,  21,  56, 183,   0, 175,   0, 158, 160, 171, 216, 200, 197,
+     39,  29, 151, 228,  13,  23, 233, 134, 149, 108, 203, 230,  77, 189, 188,  52,
+    116,  19, 124,  84, 174,  28, 163,  18, 107, 147,  40, 103, 105, 167,  85, 142,
+    130,  86,  45, 184, 217, 178, 125, 170,  60, 172,  43, 198, 201,  14,  71,  73,
+    177, 155, 113, 153, 117,  96,  72,  17,  88, 165,  64, 133, 181,  22, 112, 214,
+    141,  83, 218,  41,  59, 231, 104, 219, 152, 121, 195,   0,   0,   0,   0, 209,
+    234,   3, 145, 111, 102, 137, 221,  98, 169,  32,  58, 118,   2, 126, 212,  54,
+    210, 115,   9,   0, 162, 106, 164,   5, 229,   7, 166, 146, 123,  10, 179,  61,
+    187,  49,   8, 224,  27, 205, 128, 215,  57,  62, 156, 131, 136,   0,   6, 180,
+};
+
+static CssPropertyID property_slot(const char* name)
+{
+    unsigned int hash = cssprsr_string_hash(name, true);
+    unsigned int seed = kPropertySeeds[hash & (CSSPRSR_PROPERTY_BUCKETS - 1)];
+    return (CssPropertyID)kPropertySlots[((hash ^ seed) * 16777619u) >> CSSPRSR_PROPERTY_SLOT_SHIFT];
+}
+
+static CssPropertyID name_to_property_id(const char* name)
+{
+    CssPropertyID id = property_slot(name);
+    if ( CssPropertyUnknown == id || 0 != strcasecmp(kPropertyNames[id], name) )
+        return CssPropertyUnknown;
+    return id;
+}
+
+static const struct {
+    const char* prefix;
+    size_t length;
+    CssVendorPrefix vendor;
+} kVendorPrefixes[] = {
+    {"-webkit-", 8, CssVendorWebKit},
+    {"-moz-",    5, CssVendorMoz},
+    {"-ms-",     4, CssVendorMs},
+    {"-o-",      3, CssVendorO},
+};
+
+CssPropertyID cssprsr_property_id(const char* name, CssVendorPrefix* vendor)
+{
+    *vendor = CssVendorNone;
+    if ( NULL == name )
+        return CssPropertyUnknown;
+    if ( '-' != name[0] )
+        return name_to_property_id(name);
+    if ( '-' == name[1] )
+        return CssPropertyCustom;
+    for ( size_t i = 0; i < sizeof(kVendorPrefixes) / sizeof(kVendorPrefixes[0]); i++ ) {
+        if ( 0 == strncasecmp(name, kVendorPrefixes[i].prefix, kVendorPrefixes[i].length) ) {
+            *vendor = kVendorPrefixes[i].vendor;
+            return name_to_property_id(name + kVendorPrefixes[i].length);
+        }
+    }
+    return CssPropertyUnknown;
+}
+
+CssPropertyID css_property_id(const char* name)
+{
+    CssVendorPrefix vendor;
+    return cssprsr_property_id(name, &vendor);
+}
+
+const char* css_property_name(CssPropertyID id)
+{
+    if ( id <= CssPropertyCustom || id >= CssPropertyCount )
+        return NULL;
+    return kPropertyNames[id];
+}
+
+#if CSSPRSR_RPARSER_DEBUG
+
+void test_property_map()
+{
+    size_t found = 0;
+    for ( size_t i = 0; i < CSSPRSR_PROPERTY_SLOTS; i++ ) {
+        CssPropertyID id = (CssPropertyID)kPropertySlots[i];
+        if ( CssPropertyUnknown == id )
+            continue;
+        assert(property_slot(kPropertyNames[id]) == id);
+        assert(css_property_id(kPropertyNames[id]) == id);
+        found++;
+    }
+    assert(found == CssPropertyCount - CssPropertyCustom - 1);
+}
+
+#endif // #if CSSPRSR_RPARSER_DEBUG
@@ -0,0 +1,551 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+#include <limits.h>
+
+// Incremental reparse.
+//
+// A valid rule always starts at a token boundary at the top level or inside a
+// block, so the text of a rule tokenizes the same on its own as it does in the
+// stylesheet. An edit is therefore handled by reparsing a piece of the new
+// input as a fragment and checking that the piece still ends on the same rule
+// boundary, which proves the text following it is not affected.
+//
+// Errors are less local. After a syntax error the parser stays quiet until a
+// few tokens went through, so whether an error is reported depends on the
+// text right before it, and some errors are recovered without a report at
+// all. The piece must start after a rule without errors and must not report
+// one among its first tokens, see cssprsr_parse_piece(), and the errors at
+// its end must come out as they did, otherwise a larger piece or the whole
+// input is parsed again.
+
+static void shift_range(CssSourceRange* range, unsigned int from, long delta)
+{
+    if ( range->start >= from )
+        range->start = (unsigned int)((long)range->start + delta);
+    if ( range->end >= from )
+        range->end = (unsigned int)((long)range->end + delta);
+}
+
+static void shift_declarations(CssArray* declarations, unsigned int from, long delta)
+{
+    if ( NULL == declarations )
+        return;
+    for (size_t i = 0; i < declarations->length; ++i) {
+        shift_range(&((CssDeclaration*)declarations->data[i])->range, from, delta);
+    }
+}
+
+// Moves every offset at or after `from` by `delta`.
+static void shift_rule(CssRule* rule, unsigned int from, long delta)
+{
+    // Nothing past the end of a rule is nested in it.
+    if ( rule->range.end < from )
+        return;
+    shift_range(&rule->range, from, delta);
+    switch ( rule->type ) {
+    case CssRuleStyle: {
+        CssStyleRule* style = (CssStyleRule*)rule;
+        for (size_t i = 0; i < style->selectors->length; ++i) {
+            shift_range(&((CssSelector*)style->selectors->data[i])->range, from, delta);
+        }
+        shift_declarations(style->declarations, from, delta);
+        break;
+    }
+    case CssRuleFontFace:
+        shift_declarations(((CssFontFaceRule*)rule)->declarations, from, delta);
+        break;
+    case CssRuleMedia: {
+        CssArray* rules = ((CssMediaRule*)rule)->rules;
+        for (size_t i = 0; i < rules->length; ++i) {
+            shift_rule(rules->data[i], from, delta);
+        }
+        break;
+    }
+    case CssRuleKeyframes: {
+        CssArray* keyframes = ((CssKeyframesRule*)rule)->keyframes;
+        for (size_t i = 0; keyframes && i < keyframes->length; ++i) {
+            CssKeyframe* keyframe = keyframes->data[i];
+            shift_range(&keyframe->range, from, delta);
+            shift_declarations(keyframe->declarations, from, delta);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static const char kReparseSentinel[] = "\n*{}";
+
+// A comment or string still open at the end of a fragment is scanned
+// differently than in the whole input, where it may swallow the text that
+// follows.
+static bool has_open_token(const char* s, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        char c = s[i];
+        if ( c == '\\' ) {
+            i++;
+        } else if ( c == '"' || c == '\'' ) {
+            for (i++; i < length && s[i] != c && s[i] != '\n'; ++i) {
+                if ( s[i] == '\\' )
+                    i++;
+            }
+            if ( i >= length )
+                return true;
+        } else if ( c == '/' && i + 1 < length && s[i + 1] == '*' ) {
+            for (i += 2; i + 1 < length && !(s[i] == '*' && s[i + 1] == '/'); ++i)
+                ;
+            if ( i + 1 >= length )
+                return true;
+            i++;
+        }
+    }
+    return false;
+}
+
+// Whether the replaced or the inserted text, with a byte of context on each
+// side, holds a comment or string delimiter. Those can span rules, adding or
+// removing one may change how everything after it is tokenized, beginning
+// with text before the reparsed piece, like a comment left open.
+static bool touches_delimiters(const char* s, size_t length, size_t start, size_t end)
+{
+    size_t from = start > 0 ? start - 1 : 0;
+    size_t to = end < length ? end + 1 : length;
+    for (size_t i = from; i < to; ++i) {
+        char c = s[i];
+        if ( c == '"' || c == '\'' || c == '\\' )
+            return true;
+        if ( i + 1 < to && ((c == '/' && s[i + 1] == '*') || (c == '*' && s[i + 1] == '/')) )
+            return true;
+    }
+    return false;
+}
+
+// Index of the rule containing an offset, or the length of the list.
+static size_t child_at_offset(CssArray* rules, unsigned int offset)
+{
+    size_t first = 0, count = rules->length;
+    while ( count > 0 ) {
+        size_t step = count / 2;
+        if ( ((CssRule*)rules->data[first + step])->range.start <= offset ) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    if ( first > 0 && offset < ((CssRule*)rules->data[first - 1])->range.end )
+        return first - 1;
+    return rules->length;
+}
+
+static void shift_rules(CssArray* rules, size_t index, unsigned int from, long delta)
+{
+    for (; index < rules->length; ++index) {
+        shift_rule(rules->data[index], from, delta);
+    }
+}
+
+// Whether an error of the output starts in [from, to].
+static bool has_error_in(const CssOutput* output, unsigned int from, unsigned int to)
+{
+    for (size_t i = 0; i < output->errors.length; ++i) {
+        const CssError* e = output->errors.data[i];
+        if ( e->first_offset >= from && e->first_offset <= to )
+            return true;
+    }
+    return false;
+}
+
+// Whether the fragment parsed at `base` of the new input reports from
+// `fresh_start` the same errors as the old input does for the sentinel rule.
+static bool sentinel_errors_match(const CssOutput* output, const CssRule* sentinel, const CssOutput* fragment,
+                                  unsigned int fresh_start, unsigned int base, long delta)
+{
+    size_t j = 0;
+    while ( j < fragment->errors.length && ((CssError*)fragment->errors.data[j])->first_offset < fresh_start )
+        j++;
+    for (size_t i = 0; i < output->errors.length; ++i) {
+        const CssError* e = output->errors.data[i];
+        if ( e->first_offset < sentinel->range.start || e->first_offset > sentinel->range.end )
+            continue;
+        if ( j == fragment->errors.length )
+            return false;
+        const CssError* fresh = fragment->errors.data[j++];
+        if ( (long)fresh->first_offset + base != (long)e->first_offset + delta || strcmp(fresh->message, e->message) )
+            return false;
+    }
+    return j == fragment->errors.length;
+}
+
+// Replaces the errors reported in [from, to) of the old input by the errors of
+// a fragment parsed at `base` of the new input.
+static void splice_errors(CssParser* parser, CssOutput* output, unsigned int from, unsigned int to,
+                          long delta, CssOutput* fragment, unsigned int base)
+{
+    CssArray* errors = &output->errors;
+    size_t index = 0;
+    for (size_t i = 0; i < errors->length;) {
+        CssError* e = errors->data[i];
+        if ( e->first_offset >= from && e->first_offset < to ) {
+            free(cssprsr_array_remove_at(parser, (int)i, errors));
+            continue;
+        }
+        if ( e->first_offset < from )
+            index = i + 1;
+        if ( e->first_offset >= to ) {
+            e->first_offset = (unsigned int)((long)e->first_offset + delta);
+            e->last_offset = (unsigned int)((long)e->last_offset + delta);
+        }
+        i++;
+    }
+    if ( NULL == fragment )
+        return;
+    for (size_t i = 0; i < fragment->errors.length; ++i) {
+        CssError* e = fragment->errors.data[i];
+        e->first_offset += base;
+        e->last_offset += base;
+        cssprsr_array_insert_at(parser, e, (int)index++, errors);
+    }
+    fragment->errors.length = 0;
+}
+
+static void resolve_errors(CssParser* parser, CssOutput* output)
+{
+    if ( 0 == output->errors.length )
+        return;
+    CssLineIndex* index = cssprsr_line_index_new(parser, output->source, output->source_length);
+    for (size_t i = 0; i < output->errors.length; ++i) {
+        CssError* e = output->errors.data[i];
+        unsigned int line, column;
+        cssprsr_line_index_lookup(index, e->first_offset, &line, &column);
+        e->first_line = line;
+        e->first_column = column;
+        cssprsr_line_index_lookup(index, e->last_offset, &line, &column);
+        e->last_line = line;
+        e->last_column = column;
+    }
+    cssprsr_line_index_destroy(parser, index);
+}
+
+static void destroy_declarations(CssParser* parser, CssArray* declarations)
+{
+    if ( NULL == declarations )
+        return;
+    for (size_t i = 0; i < declarations->length; ++i) {
+        cssprsr_destroy_declaration(parser, declarations->data[i]);
+    }
+    cssprsr_array_destroy(parser, declarations);
+    cssprsr_parser_free(parser, declarations);
+}
+
+static CssArray** rule_declarations(CssRule* rule)
+{
+    switch ( rule->type ) {
+    case CssRuleStyle:
+        return &((CssStyleRule*)rule)->declarations;
+    case CssRuleFontFace:
+        return &((CssFontFaceRule*)rule)->declarations;
+    default:
+        return NULL;
+    }
+}
+
+// Offset of the `{` opening the block of a rule, comments skipped.
+static unsigned int rule_block_start(const char* source, CssRule* rule)
+{
+    unsigned int i = rule->range.start;
+    if ( CssRuleStyle == rule->type ) {
+        CssArray* selectors = ((CssStyleRule*)rule)->selectors;
+        i = ((CssSelector*)selectors->data[selectors->length - 1])->range.end;
+    }
+    while ( i < rule->range.end && source[i] != '{' ) {
+        if ( source[i] == '/' && source[i + 1] == '*' ) {
+            const char* close = strstr(source + i + 2, "*/");
+            if ( NULL == close )
+                break;
+            i = (unsigned int)(close - source) + 2;
+        } else {
+            i++;
+        }
+    }
+    return i;
+}
+
+// Reparses the innermost rule containing the edit. Only its declarations are
+// replaced when the edit is inside its block.
+static bool reparse_rule(CssParser* parser, CssOutput* output, const char* source,
+                         unsigned int start, unsigned int end, long delta)
+{
+    CssArray* rules = &output->stylesheet->rules;
+    CssArray* parent = NULL;
+    CssRule* rule = NULL;
+    CssRule* outer = NULL;
+    size_t top = 0, position = 0;
+    for (CssArray* list = rules; list;) {
+        size_t index = child_at_offset(list, start);
+        if ( index == list->length )
+            break;
+        CssRule* child = list->data[index];
+        if ( !(child->range.start < start && end < child->range.end) )
+            break;
+        if ( list == rules )
+            top = index;
+        parent = list;
+        position = index;
+        outer = rule;
+        rule = child;
+        list = CssRuleMedia == child->type ? ((CssMediaRule*)child)->rules : NULL;
+    }
+    if ( NULL == rule || output->source[rule->range.end - 1] != '}' )
+        return false;
+
+    // The parser must reach the rule in a clean state, through a sibling or
+    // the opening of the rule around it, and leave it as clean.
+    unsigned int before = position > 0 ? ((CssRule*)parent->data[position - 1])->range.start
+                                       : outer ? outer->range.start : 0;
+    if ( has_error_in(output, before, rule->range.end) )
+        return false;
+    unsigned int after = (unsigned int)output->source_length;
+    if ( position + 1 < parent->length )
+        after = ((CssRule*)parent->data[position + 1])->range.end;
+    else if ( top + 1 < rules->length )
+        after = ((CssRule*)rules->data[top + 1])->range.end;
+
+    // The rule is followed by a sentinel rule, which only comes out intact if
+    // the closing brace of the rule still closes it.
+    unsigned int length = (unsigned int)((long)(rule->range.end - rule->range.start) + delta);
+    if ( has_open_token(source + rule->range.start, length) )
+        return false;
+    char* text = cssprsr_parser_alloc(parser, length + sizeof(kReparseSentinel));
+    memcpy(text, source + rule->range.start, length);
+    memcpy(text + length, kReparseSentinel, sizeof(kReparseSentinel));
+    CssOutput* fragment = cssprsr_parse_piece(text, length + sizeof(kReparseSentinel) - 1, output->flags);
+    cssprsr_parser_free(parser, text);
+    if ( NULL == fragment )
+        return false;
+    CssArray* fresh_rules = &fragment->stylesheet->rules;
+    CssRule* fresh = fresh_rules->length == 2 ? fresh_rules->data[0] : NULL;
+    CssRule* sentinel = fresh_rules->length == 2 ? fresh_rules->data[1] : NULL;
+    if ( NULL == fresh || fresh->type != rule->type
+         || fresh->range.start != 0 || fresh->range.end != length
+         || sentinel->range.start != length + 1
+         || fragment->stylesheet->imports.length ) {
+        css_destroy_output(fragment);
+        return false;
+    }
+    // Errors at the sentinel, or errors of the new rule quieting errors
+    // that follow it, change what is reported after the rule.
+    bool errors_follow = has_error_in(output, rule->range.end, after);
+    for (size_t i = 0; i < fragment->errors.length; ++i) {
+        CssError* e = fragment->errors.data[i];
+        if ( errors_follow || e->first_offset >= length ) {
+            css_destroy_output(fragment);
+            return false;
+        }
+    }
+
+    unsigned int base = rule->range.start;
+    unsigned int old_end = rule->range.end;
+    shift_rule(fresh, 0, base);
+
+    // Everything from the end of the old rule moves, including the end of
+    // the rule itself and of the rules around it.
+    shift_rules(rules, top, old_end, delta);
+    shift_rules(&output->stylesheet->imports, 0, old_end, delta);
+
+    CssArray** declarations = rule_declarations(rule);
+    if ( declarations && start > rule_block_start(output->source, rule) ) {
+        // Keep the rule and its selectors, swap the declaration block.
+        CssArray** fresh_declarations = rule_declarations(fresh);
+        destroy_declarations(parser, *declarations);
+        *declarations = *fresh_declarations;
+        *fresh_declarations = NULL;
+    } else {
+        cssprsr_destroy_rule(parser, rule);
+        parent->data[position] = fresh;
+        cssprsr_array_remove_at(parser, 0, fresh_rules);
+    }
+
+    splice_errors(parser, output, base, old_end, delta, fragment, base);
+    css_destroy_output(fragment);
+    return true;
+}
+
+// Reparses the top-level rules touched by the edit, together with the first
+// untouched rule following them to prove the boundary did not move.
+static bool reparse_rules(CssParser* parser, CssOutput* output, const char* source, size_t length,
+                          unsigned int start, unsigned int end, long delta)
+{
+    CssStylesheet* sheet = output->stylesheet;
+    CssArray* rules = &sheet->rules;
+
+    unsigned int from = 0, before = 0;
+    if ( sheet->imports.length ) {
+        CssRule* last = sheet->imports.data[sheet->imports.length - 1];
+        if ( start <= last->range.end )
+            return false;
+        from = last->range.end;
+        before = last->range.start;
+    }
+
+    // Rules touching the edit, adjacent ones included.
+    size_t first = 0;
+    while ( first < rules->length && ((CssRule*)rules->data[first])->range.end < start )
+        first++;
+    // A last rule left open runs to the end of the input, through the edit.
+    if ( first == rules->length && first > 0 ) {
+        CssRule* last = rules->data[first - 1];
+        if ( output->source[last->range.end - 1] != '}' )
+            first--;
+    }
+    size_t next = first;
+    while ( next < rules->length && ((CssRule*)rules->data[next])->range.start <= end )
+        next++;
+    if ( first > 0 ) {
+        from = ((CssRule*)rules->data[first - 1])->range.end;
+        before = ((CssRule*)rules->data[first - 1])->range.start;
+    }
+    // The piece starts after a rule, which must have left the parser clean.
+    if ( has_error_in(output, before, from) )
+        return false;
+
+    // The fragment runs to the end of the following rule, or of the input.
+    CssRule* sentinel = next < rules->length ? rules->data[next] : NULL;
+    unsigned int old_to = sentinel ? sentinel->range.start : (unsigned int)output->source_length;
+    size_t to = sentinel ? (size_t)((long)sentinel->range.end + delta) : length;
+
+    if ( sentinel && has_open_token(source + from, to - from) )
+        return false;
+    CssOutput* fragment = cssprsr_parse_piece(source + from, to - from, output->flags);
+    if ( NULL == fragment )
+        return false;
+    CssArray* fresh = &fragment->stylesheet->rules;
+    if ( fragment->stylesheet->imports.length ) {
+        css_destroy_output(fragment);
+        return false;
+    }
+    for (size_t i = 0; i < fresh->length; ++i) {
+        shift_rule(fresh->data[i], 0, from);
+    }
+    if ( sentinel ) {
+        CssRule* last = fresh->length ? fresh->data[fresh->length - 1] : NULL;
+        if ( NULL == last || last->type != sentinel->type
+             || last->range.start != (unsigned int)((long)sentinel->range.start + delta)
+             || last->range.end != (unsigned int)to ) {
+            css_destroy_output(fragment);
+            return false;
+        }
+        // The errors of the sentinel must be the same too, they tell the
+        // parser leaves it in the same state.
+        unsigned int sentinel_start = last->range.start - from;
+        if ( !sentinel_errors_match(output, sentinel, fragment, sentinel_start, from, delta) ) {
+            css_destroy_output(fragment);
+            return false;
+        }
+        // The sentinel parsed the same, keep the old one and its errors.
+        for (size_t i = fragment->errors.length; i > 0; --i) {
+            CssError* e = fragment->errors.data[i - 1];
+            if ( e->first_offset >= sentinel_start )
+                free(cssprsr_array_remove_at(parser, (int)(i - 1), &fragment->errors));
+        }
+        cssprsr_destroy_rule(parser, cssprsr_array_pop(parser, fresh));
+    }
+
+    for (size_t i = first; i < next; ++i) {
+        cssprsr_destroy_rule(parser, cssprsr_array_remove_at(parser, (int)first, rules));
+    }
+    shift_rules(rules, first, old_to, delta);
+    shift_rules(&sheet->imports, 0, old_to, delta);
+    for (size_t i = 0; i < fresh->length; ++i) {
+        cssprsr_array_insert_at(parser, fresh->data[i], (int)(first + i), rules);
+    }
+    fresh->length = 0;
+
+    // Without a sentinel the fragment also reports the errors at the end of
+    // the input.
+    splice_errors(parser, output, from, sentinel ? old_to : UINT_MAX, delta, fragment, from);
+    css_destroy_output(fragment);
+    return true;
+}
+
+static void reparse_all(CssOutput* output, const char* source, size_t length)
+{
+    CssOutput* fresh = cssprsr_parse_string(source, length, CssParserModeStylesheet, output->flags);
+    if ( NULL == fresh )
+        return;
+
+    // Swap the trees so the caller's output stays valid, the old ones are
+    // released with the temporary output.
+    CssStylesheet* sheet = output->stylesheet;
+    CssArray errors = output->errors;
+    output->stylesheet = fresh->stylesheet;
+    output->errors = fresh->errors;
+    // The source was decoded by the first parse, keep what it detected.
+    output->stylesheet->encoding = sheet->encoding;
+    sheet->encoding = NULL;
+    fresh->stylesheet = sheet;
+    fresh->errors = errors;
+    css_destroy_output(fresh);
+}
+
+bool css_reparse_range(CssOutput* output, unsigned int edit_start, unsigned int old_len, const char* new_text)
+{
+    if ( NULL == output || NULL == new_text || NULL == output->source
+         || CssParserModeStylesheet != output->mode
+         || !(output->flags & CssParserFlagSourceRanges) )
+        return false;
+    if ( edit_start > output->source_length || old_len > output->source_length - edit_start )
+        return false;
+
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+
+    // Build the new input.
+    size_t new_len = strlen(new_text);
+    size_t length = output->source_length - old_len + new_len;
+    char* source = cssprsr_parser_alloc(&parser, length + 1);
+    memcpy(source, output->source, edit_start);
+    memcpy(source + edit_start, new_text, new_len);
+    memcpy(source + edit_start + new_len, output->source + edit_start + old_len,
+           output->source_length - edit_start - old_len);
+    source[length] = '\0';
+
+    unsigned int edit_end = edit_start + old_len;
+    long delta = (long)new_len - (long)old_len;
+    if ( touches_delimiters(output->source, output->source_length, edit_start, edit_end)
+         || touches_delimiters(source, length, edit_start, edit_start + new_len) ) {
+        reparse_all(output, source, length);
+    } else if ( !reparse_rule(&parser, output, source, edit_start, edit_end, delta)
+         && !reparse_rules(&parser, output, source, length, edit_start, edit_end, delta) ) {
+        reparse_all(output, source, length);
+    }
+
+    cssprsr_parser_free(&parser, (void*) output->source);
+    output->source = source;
+    output->source_length = length;
+    resolve_errors(&parser, output);
+    return true;
+}
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Rule index.
+//
+// Every selector is filed under one key of its rightmost compound, the most
+// selective one: its id, else its first class, else its tag name. Selectors
+// without any of them go to the universal list. An element can only match a
+// selector filed under its own id, one of its classes or its tag, so looking
+// those buckets up gives every candidate without touching the other rules.
+//
+// Stylesheets repeat selectors, across media rules and in rules split to
+// override a few declarations. Equal selectors are compiled once, into one
+// program shared by their entries: matching runs the bytecode of the first,
+// and the memory of the compiled form grows with the distinct selectors only.
+
+struct CssInternalRuleIndex {
+    // Key to CssArray of CssRuleIndexEntry, tag names ignore case
+    CssStringMap ids;
+    CssStringMap classes;
+    CssStringMap tags;
+    CssArray /* CssRuleIndexEntry */ universal;
+    CssRuleIndexEntry* entries;
+    unsigned int length;
+    // `entries` in cascade order
+    const CssRuleIndexEntry** by_specificity;
+    unsigned int unique_count;
+    // One entry per distinct selector, at the `unique` of the entries
+    CssSelectorProgram* program;
+};
+
+static void map_destroy(CssParser* parser, CssStringMap* map)
+{
+    for (unsigned int i = 0; i < map->capacity; ++i) {
+        CssArray* entries = map->entries[i].value;
+        if ( entries ) {
+            cssprsr_array_destroy(parser, entries);
+            cssprsr_parser_free(parser, entries);
+        }
+    }
+    cssprsr_string_map_destroy(parser, map);
+}
+
+static void map_add(CssParser* parser, CssStringMap* map, const char* key, CssRuleIndexEntry* entry)
+{
+    CssArray** entries = (CssArray**)cssprsr_string_map_insert(parser, key, map);
+    if ( NULL == *entries )
+        *entries = cssprsr_new_array(parser);
+    cssprsr_array_add(parser, entry, *entries);
+}
+
+// Numbers the distinct selectors, through a table of the first entry of each.
+static void number_unique_selectors(CssParser* parser, CssRuleIndex* index)
+{
+    unsigned int capacity = 16;
+    while ( capacity < index->length * 2 )
+        capacity *= 2;
+    unsigned int mask = capacity - 1;
+    // Entry index + 1, 0 for free slots
+    unsigned int* slots = cssprsr_parser_alloc(parser, sizeof(unsigned int) * capacity);
+    unsigned int* hashes = cssprsr_parser_alloc(parser, sizeof(unsigned int) * (index->length ? index->length : 1));
+    memset(slots, 0, sizeof(unsigned int) * capacity);
+    index->unique_count = 0;
+    for (unsigned int i = 0; i < index->length; ++i) {
+        CssRuleIndexEntry* entry = &index->entries[i];
+        unsigned int hash = hashes[i] = css_selector_hash(entry->selector);
+        for (unsigned int j = hash & mask; ; j = (j + 1) & mask) {
+            if ( 0 == slots[j] ) {
+                slots[j] = i + 1;
+                entry->unique = index->unique_count++;
+                break;
+            }
+            CssRuleIndexEntry* first = &index->entries[slots[j] - 1];
+            if ( hashes[slots[j] - 1] == hash && css_selector_equals(first->selector, entry->selector) ) {
+                entry->unique = first->unique;
+                break;
+            }
+        }
+    }
+    cssprsr_parser_free(parser, hashes);
+    cssprsr_parser_free(parser, slots);
+}
+
+static CssSelectorProgram* compile_unique_selectors(CssParser* parser, const CssRuleIndex* index)
+{
+    CssArray selectors;
+    cssprsr_array_init(parser, index->unique_count, &selectors);
+    for (unsigned int i = 0; i < index->length; ++i) {
+        // The first entry of a selector takes the next number
+        if ( index->entries[i].unique == selectors.length )
+            cssprsr_array_add(parser, index->entries[i].selector, &selectors);
+    }
+    CssSelectorProgram* program = css_selector_program_new(&selectors);
+    cssprsr_array_destroy(parser, &selectors);
+    return program;
+}
+
+static unsigned int count_selectors(CssArray* rules)
+{
+    unsigned int count = 0;
+    for (size_t i = 0; i < rules->length; ++i) {
+        CssRule* rule = rules->data[i];
+        if ( CssRuleStyle == rule->type )
+            count += ((CssStyleRule*)rule)->selectors->length;
+        else if ( CssRuleMedia == rule->type && ((CssMediaRule*)rule)->rules )
+            count += count_selectors(((CssMediaRule*)rule)->rules);
+    }
+    return count;
+}
+
+static void index_selector(CssParser* parser, CssRuleIndex* index, CssRuleIndexEntry* entry)
+{
+    const char* id = NULL;
+    const char* klass = NULL;
+    const char* tag = NULL;
+    // The rightmost compound ends at the first combinator.
+    for (const CssSelector* cs = entry->selector; cs; cs = cs->tagHistory) {
+        switch ( cs->match ) {
+        case CssSelMatchId:
+            id = cs->data->value;
+            break;
+        case CssSelMatchClass:
+            if ( NULL == klass )
+                klass = cs->data->value;
+            break;
+        case CssSelMatchTag:
+            if ( strcmp(cs->tag->local, cssAsteriskString.data) )
+                tag = cs->tag->local;
+            break;
+        default:
+            break;
+        }
+        if ( CssSelRelSubSelector != cs->relation )
+            break;
+    }
+    if ( id )
+        map_add(parser, &index->ids, id, entry);
+    else if ( klass )
+        map_add(parser, &index->classes, klass, entry);
+    else if ( tag )
+        map_add(parser, &index->tags, tag, entry);
+    else
+        cssprsr_array_add(parser, entry, &index->universal);
+}
+
+static void index_rules(CssParser* parser, CssRuleIndex* index, CssArray* rules)
+{
+    for (size_t i = 0; i < rules->length; ++i) {
+        CssRule* rule = rules->data[i];
+        if ( CssRuleMedia == rule->type && ((CssMediaRule*)rule)->rules ) {
+            index_rules(parser, index, ((CssMediaRule*)rule)->rules);
+            continue;
+        }
+        if ( CssRuleStyle != rule->type )
+            continue;
+        CssStyleRule* style = (CssStyleRule*)rule;
+        for (size_t j = 0; j < style->selectors->length; ++j) {
+            CssRuleIndexEntry* entry = &index->entries[index->length];
+            entry->rule = style;
+            entry->selector = style->selectors->data[j];
+            entry->order = index->length++;
+            entry->specificity = css_calc_specificity_for_selector(entry->selector);
+            css_selector_ancestor_hashes(entry->selector, &entry->ancestors);
+            index_selector(parser, index, entry);
+        }
+    }
+}
+
+CssRuleIndex* css_rule_index_new(CssStylesheet* stylesheet)
+{
+    if ( NULL == stylesheet )
+        return NULL;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssRuleIndex* index = cssprsr_parser_alloc(&parser, sizeof(CssRuleIndex));
+    cssprsr_string_map_init(&parser, false, &index->ids);
+    cssprsr_string_map_init(&parser, false, &index->classes);
+    cssprsr_string_map_init(&parser, true, &index->tags);
+    cssprsr_array_init(&parser, 0, &index->universal);
+    unsigned int count = count_selectors(&stylesheet->rules);
+    index->entries = cssprsr_parser_alloc(&parser, sizeof(CssRuleIndexEntry) * (count ? count : 1));
+    index->length = 0;
+    index_rules(&parser, index, &stylesheet->rules);
+    number_unique_selectors(&parser, index);
+    index->program = compile_unique_selectors(&parser, index);
+    index->by_specificity = cssprsr_parser_alloc(&parser, sizeof(CssRuleIndexEntry*) * (count ? count : 1));
+    for (unsigned int i = 0; i < index->length; ++i) {
+        index->by_specificity[i] = &index->entries[i];
+    }
+    css_rule_index_sort(index->by_specificity, index->length);
+    return index;
+}
+
+void css_rule_index_destroy(CssRuleIndex* index)
+{
+    if ( NULL == index )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    map_destroy(&parser, &index->ids);
+    map_destroy(&parser, &index->classes);
+    map_destroy(&parser, &index->tags);
+    cssprsr_array_destroy(&parser, &index->universal);
+    cssprsr_parser_free(&parser, index->entries);
+    cssprsr_parser_free(&parser, (void*)index->by_specificity);
+    css_selector_program_destroy(index->program);
+    cssprsr_parser_free(&parser, index);
+}
+
+static size_t collect(const CssArray* entries, const CssRuleIndexEntry** candidates, size_t capacity, size_t count)
+{
+    if ( NULL == entries )
+        return count;
+    for (size_t i = 0; i < entries->length; ++i, ++count) {
+        if ( count < capacity )
+            candidates[count] = entries->data[i];
+    }
+    return count;
+}
+
+size_t css_rule_index_collect(const CssRuleIndex* index, const char* tag, const char* id,
+                              const char* const* classes, size_t class_count,
+                              const CssRuleIndexEntry** candidates, size_t capacity)
+{
+    size_t count = 0;
+    count = collect(cssprsr_string_map_get(&index->ids, id), candidates, capacity, count);
+    for (size_t i = 0; i < class_count; ++i) {
+        count = collect(cssprsr_string_map_get(&index->classes, classes[i]), candidates, capacity, count);
+    }
+    count = collect(cssprsr_string_map_get(&index->tags, tag), candidates, capacity, count);
+    count = collect(&index->universal, candidates, capacity, count);
+    return count;
+}
+
+size_t css_rule_index_length(const CssRuleIndex* index)
+{
+    return index->length;
+}
+
+size_t css_rule_index_unique_count(const CssRuleIndex* index)
+{
+    return index->unique_count;
+}
+
+const CssSelectorProgram* css_rule_index_program(const CssRuleIndex* index)
+{
+    return index->program;
+}
+
+const CssRuleIndexEntry* const* css_rule_index_by_specificity(const CssRuleIndex* index)
+{
+    return index->by_specificity;
+}
+
+static int compare_cascade_order(const void* a, const void* b)
+{
+    const CssRuleIndexEntry* first = *(const CssRuleIndexEntry* const*)a;
+    const CssRuleIndexEntry* second = *(const CssRuleIndexEntry* const*)b;
+    if ( first->specificity != second->specificity )
+        return first->specificity < second->specificity ? -1 : 1;
+    if ( first->order != second->order )
+        return first->order < second->order ? -1 : 1;
+    return 0;
+}
+
+void css_rule_index_sort(const CssRuleIndexEntry** entries, size_t count)
+{
+    if ( count > 1 )
+        qsort(entries, count, sizeof(CssRuleIndexEntry*), compare_cascade_order);
+}
@@ -21,6 +21,7 @@
  ******************************************************************************/
 #include "selector.h"
 
+#include <limits.h>
 #include <strings.h>
 
 #undef	assert
@@ -55,12 +56,108 @@ CssPseudoType cssprsr_parse_pseudo_type(const char* name, bool hasArguments)
     if (pseudoType != CssPseudoUnknown)
         return pseudoType;
     
-    if (cssprsr_string_has_prefix(name, "-webkit-"))
+    if (cssprsr_string_has_prefix(name, "-webkit-")
+        || cssprsr_string_has_prefix(name, "-moz-")
+        || cssprsr_string_has_prefix(name, "-ms-")
+        || cssprsr_string_has_prefix(name, "-o-"))
         return CssPseudoWebKitCustomElement;
     
     return CssPseudoUnknown;
 }
 
+static bool is_nth_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static const char* skip_nth_space(const char* c)
+{
+    while (is_nth_space(*c))
+        c++;
+    return c;
+}
+
+// Digits only, saturating, returns false when there are none.
+static bool parse_nth_integer(const char** c, int* value)
+{
+    if (!isdigit((unsigned char)**c))
+        return false;
+    int number = 0;
+    for (; isdigit((unsigned char)**c); (*c)++) {
+        int digit = **c - '0';
+        number = number > (INT_MAX - digit) / 10 ? INT_MAX : number * 10 + digit;
+    }
+    *value = number;
+    return true;
+}
+
+// Whether the argument ends at `c`, or goes on with ` of S` when `selectors`
+// takes the text of S.
+static bool is_nth_end(const char* c, const char** selectors)
+{
+    const char* end = skip_nth_space(c);
+    if ('\0' == *end)
+        return true;
+    if (NULL == selectors || end == c || 0 != strncasecmp(end, "of", 2) || !is_nth_space(end[2]))
+        return false;
+    *selectors = skip_nth_space(end + 2);
+    return true;
+}
+
+static bool is_nth_keyword(const char* c, const char* keyword, const char** selectors)
+{
+    size_t length = strlen(keyword);
+    return 0 == strncasecmp(c, keyword, length) && is_nth_end(c + length, selectors);
+}
+
+// Parses `An+B`, `odd` and `even`. The sign of A sticks to it and the one of
+// B may stand apart from both A and the digits: `-n+3`, `2n - 1`, `+5`.
+// With `selectors`, also `An+B of S`, and sets it to the text of S then.
+bool cssprsr_parse_nth(const char* argument, int* a, int* b, const char** selectors)
+{
+    if (NULL == argument)
+        return false;
+    if (selectors)
+        *selectors = NULL;
+    const char* c = skip_nth_space(argument);
+    if (is_nth_keyword(c, "odd", selectors)) {
+        *a = 2;
+        *b = 1;
+        return true;
+    }
+    if (is_nth_keyword(c, "even", selectors)) {
+        *a = 2;
+        *b = 0;
+        return true;
+    }
+    int sign = 1;
+    if (*c == '+' || *c == '-') {
+        sign = *c == '-' ? -1 : 1;
+        c++;
+    }
+    int number;
+    bool digits = parse_nth_integer(&c, &number);
+    if (*c != 'n' && *c != 'N') {
+        if (!digits)
+            return false;
+        *a = 0;
+        *b = sign * number;
+        return is_nth_end(c, selectors);
+    }
+    *a = sign * (digits ? number : 1);
+    *b = 0;
+    c++;
+    const char* sign_char = skip_nth_space(c);
+    if (*sign_char == '+' || *sign_char == '-') {
+        sign = *sign_char == '-' ? -1 : 1;
+        c = skip_nth_space(sign_char + 1);
+        if (!parse_nth_integer(&c, &number))
+            return false;
+        *b = sign * number;
+    }
+    return is_nth_end(c, selectors);
+}
+
 void cssprsr_selector_extract_pseudo_type(CssSelector* selector)
 {
     if (selector->pseudo == CssPseudoNotParsed)
@@ -70,6 +167,26 @@ void cssprsr_selector_extract_pseudo_type(CssSelector* selector)
         return;
     bool hasArguments = (NULL != selector->data->argument) || (NULL != selector->data->selectors);    
     selector->pseudo = cssprsr_parse_pseudo_type(selector->data->value, hasArguments);
+
+    const char* of = NULL;
+    switch (selector->pseudo) {
+        case CssPseudoNthChild:
+        case CssPseudoNthLastChild:
+            // The selectors of `An+B of S` are parsed along with the argument,
+            // see cssprsr_selector_set_nth_argument()
+            if (!cssprsr_parse_nth(selector->data->argument, &selector->data->bits.nth.a, &selector->data->bits.nth.b, &of)
+                || (NULL != of && NULL == selector->data->selectors))
+                selector->pseudo = CssPseudoUnknown;
+            break;
+        case CssPseudoNthOfType:
+        case CssPseudoNthLastOfType:
+            // Matching reads a and b, an argument that is not An+B never matches
+            if (!cssprsr_parse_nth(selector->data->argument, &selector->data->bits.nth.a, &selector->data->bits.nth.b, NULL))
+                selector->pseudo = CssPseudoUnknown;
+            break;
+        default:
+            break;
+    }
     
     bool element = false; // pseudo-element
     bool compat = false; // single colon compatbility mode
@@ -260,38 +377,28 @@ bool cssprsr_selector_is_insertion_point_crossing(CssSelector* selector)
         || (selector->match == CssSelMatchPseudoElement && selector->pseudo == CssPseudoContent);
 }
 
-CssParserString* cssprsr_build_relation_selector_string(CssParser* parser, const char* relation, CssParserString* string, CssParserString* next, CssSelector* tagHistory)
+// Type and namespace names, `*` stands for any.
+static void append_name(CssParser* parser, const char* name, CssParserString* string)
 {
-    if ( NULL != relation ) {
-        cssprsr_string_prepend_characters(parser, relation, string);
-    }
-    
-    if ( NULL != next ) {
-        cssprsr_string_append_string(parser, next, string);
-    }
-    
-    CssParserString * result = cssprsr_selector_to_string(parser, tagHistory, (CssParserString*)string);
-    cssprsr_parser_free(parser, (void*) string->data);
-    cssprsr_parser_free(parser, (void*) string);
-    return result;
+    if ( 0 == strcmp(name, "*") )
+        cssprsr_string_append_characters(parser, name, string);
+    else
+        cssprsr_string_append_identifier(parser, name, string);
 }
 
-CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* selector, CssParserString* next)
+// Appends the compound starting at `selector`, returns its last simple
+// selector, the one holding the combinator to the next compound.
+static const CssSelector* append_compound(CssParser* parser, const CssSelector* selector, CssParserString* string)
 {
-    CssParserString* string = cssprsr_parser_alloc(parser, sizeof(CssParserString));
-    cssprsr_string_init(parser, string);
-    
     bool tag_is_implicit = true;
     
     if (selector->match == CssSelMatchTag && tag_is_implicit)
     {
-        if ( NULL == selector->tag->prefix )
-            cssprsr_string_append_characters(parser, selector->tag->local, string);
-        else {
-            cssprsr_string_append_characters(parser, selector->tag->prefix, string);
+        if ( NULL != selector->tag->prefix ) {
+            append_name(parser, selector->tag->prefix, string);
             cssprsr_string_append_characters(parser, "|", string);
-            cssprsr_string_append_characters(parser, selector->tag->local, string);
         }
+        append_name(parser, selector->tag->local, string);
     }
 
     const CssSelector* cs = selector;
@@ -299,10 +406,10 @@ CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* sele
     while (true) {
         if (cs->match == CssSelMatchId) {
             cssprsr_string_append_characters(parser, "#", string);
-            cssprsr_string_append_characters(parser, cs->data->value, string);
+            cssprsr_string_append_identifier(parser, cs->data->value, string);
         } else if (cs->match == CssSelMatchClass) {
             cssprsr_string_append_characters(parser, ".", string);
-            cssprsr_string_append_characters(parser, cs->data->value, string);
+            cssprsr_string_append_identifier(parser, cs->data->value, string);
         } else if (cs->match == CssSelMatchPseudoClass || cs->match == CssSelMatchPagePseudoClass) {
             cssprsr_string_append_characters(parser, ":", string);
             cssprsr_string_append_characters(parser, cs->data->value, string);
@@ -315,10 +422,7 @@ CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* sele
                     if ( cs->data->selectors ) {
                         CssArray* sels = cs->data->selectors;
                         for (size_t i=0; i<sels->length; i++) {
-                            CssParserString* str = cssprsr_selector_to_string(parser, sels->data[i], NULL);
-                            cssprsr_string_append_string(parser, str, string);
-                            cssprsr_parser_free(parser, (void*) str->data);
-                            cssprsr_parser_free(parser, (void*) str);
+                            cssprsr_selector_append_string(parser, sels->data[i], string);
                             if ( i != sels->length -1 ) {
                                 cssprsr_string_append_characters(parser, ", ", string);
                             }
@@ -345,10 +449,10 @@ CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* sele
         } else if (cssprsr_selector_is_attribute(cs)) {
             cssprsr_string_append_characters(parser, "[", string);
             if (NULL != cs->data->attribute->prefix) {
-                cssprsr_string_append_characters(parser, cs->data->attribute->prefix, string);
+                append_name(parser, cs->data->attribute->prefix, string);
                 cssprsr_string_append_characters(parser, "|", string);
             }
-            cssprsr_string_append_characters(parser, cs->data->attribute->local, string);
+            cssprsr_string_append_identifier(parser, cs->data->attribute->local, string);
             switch (cs->match) {
                 case CssSelMatchAttrExact:
                     cssprsr_string_append_characters(parser, "=", string);
@@ -375,9 +479,7 @@ CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* sele
                     break;
             }
             if (cs->match != CssSelMatchAttrSet) {
-                cssprsr_string_append_characters(parser, "\"", string);
-                cssprsr_string_append_characters(parser, cs->data->value, string);
-                cssprsr_string_append_characters(parser, "\"", string);
+                cssprsr_string_append_quoted(parser, cs->data->value, string);
                 if (cs->data->bits.attrMatchType == CssAMTCaseInsensitive)
                     cssprsr_string_append_characters(parser, " i", string);
                 cssprsr_string_append_characters(parser, "]", string);
@@ -387,69 +489,123 @@ CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* sele
             break;
         cs = cs->tagHistory;
     }
+    return cs;
+}
 
-    CssSelector* tagHistory = cs->tagHistory;
+static const char* relation_string(CssSelectorRelation relation)
+{
+    switch (relation) {
+        case CssSelRelDescendant:
+            return " ";
+        case CssSelRelChild:
+            return " > ";
+        case CssSelRelShadowDeep:
+            return " /deep/ ";
+        case CssSelRelDirectAdjacent:
+            return " + ";
+        case CssSelRelIndirectAdjacent:
+            return " ~ ";
+        default:
+            return "";
+    }
+}
 
-    if ( NULL != tagHistory ) {
-        switch (cs->relation) {
-            case CssSelRelDescendant:
-            {
-                return cssprsr_build_relation_selector_string(parser, " ", string, next, tagHistory);
-            }
-            case CssSelRelChild:
-            {
-                return cssprsr_build_relation_selector_string(parser, " > ", string, next, tagHistory);
-            }
-            case CssSelRelShadowDeep:
-            {
-                return cssprsr_build_relation_selector_string(parser, " /deep/ ", string, next, tagHistory);
-            }
-            case CssSelRelDirectAdjacent:
-            {
-                return cssprsr_build_relation_selector_string(parser, " + ", string, next, tagHistory);
-            }
-            case CssSelRelIndirectAdjacent:
-            {
-                return cssprsr_build_relation_selector_string(parser, " ~ ", string, next, tagHistory);
-            }
-            case CssSelRelSubSelector:
-            {
-                return NULL;
-            }
-            case CssSelRelShadowPseudo:
-            {
-                return cssprsr_build_relation_selector_string(parser, NULL, string, next, tagHistory);
-            }
+#define CSSPRSR_SELECTOR_INLINE_COMPOUNDS 16
+
+void cssprsr_selector_append_string(CssParser* parser, const CssSelector* selector, CssParserString* string)
+{
+    // Compounds are chained right to left and written left to right, their
+    // last simple selectors are gathered first to walk them backwards.
+    const CssSelector* inline_lasts[CSSPRSR_SELECTOR_INLINE_COMPOUNDS];
+    const CssSelector** lasts = inline_lasts;
+    size_t capacity = CSSPRSR_SELECTOR_INLINE_COMPOUNDS;
+    size_t count = 0;
+    for (const CssSelector* cs = selector; cs; cs = cs->tagHistory) {
+        if (cs->relation == CssSelRelSubSelector && cs->tagHistory)
+            continue;
+        if (count == capacity) {
+            const CssSelector** grown = cssprsr_parser_alloc(parser, sizeof(CssSelector*) * capacity * 2);
+            memcpy(grown, lasts, sizeof(CssSelector*) * count);
+            if (lasts != inline_lasts)
+                cssprsr_parser_free(parser, (void*) lasts);
+            lasts = grown;
+            capacity *= 2;
         }
+        lasts[count++] = cs;
     }
-    
+
+    for (size_t i = count; i-- > 0; ) {
+        append_compound(parser, i ? lasts[i - 1]->tagHistory : selector, string);
+        if (i)
+            cssprsr_string_append_characters(parser, relation_string(lasts[i - 1]->relation), string);
+    }
+
+    if (lasts != inline_lasts)
+        cssprsr_parser_free(parser, (void*) lasts);
+}
+
+CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* selector, CssParserString* next)
+{
+    CssParserString* string = cssprsr_parser_alloc(parser, sizeof(CssParserString));
+    cssprsr_string_init(parser, string);
+    cssprsr_selector_append_string(parser, selector, string);
     if ( NULL != next ) {
-        cssprsr_string_append_string(parser, (CssParserString*)next, string);
+        cssprsr_string_append_string(parser, next, string);
     }
-    
-    return (CssParserString*)string;
+    return string;
 }
 
-unsigned calc_specificity_for_one_selector(const CssSelector* selector)
+static const unsigned idMask = 0xff0000;
+static const unsigned classMask = 0xff00;
+static const unsigned elementMask = 0xff;
+
+// Adds two specificities, each component saturates on its own.
+static unsigned add_specificity(unsigned total, unsigned specificity)
+{
+    unsigned result = 0;
+    const unsigned masks[] = { idMask, classMask, elementMask };
+    for (size_t i = 0; i < sizeof(masks) / sizeof(masks[0]); i++) {
+        unsigned sum = (total & masks[i]) + (specificity & masks[i]);
+        result |= sum > masks[i] ? masks[i] : sum;
+    }
+    return result;
+}
+
+static unsigned calc_specificity_for_one_selector(const CssSelector* selector)
 {
     switch ( selector->match ) {
         case CssSelMatchId:
             return 0x10000;
             
         case CssSelMatchPseudoClass:
+            // :not() counts as its most specific argument, :nth-child(An+B
+            // of S) as a pseudo-class plus the most specific of S
+            if ( selector->data->selectors && (selector->pseudo == CssPseudoNot
+                 || selector->pseudo == CssPseudoNthChild || selector->pseudo == CssPseudoNthLastChild) ) {
+                unsigned max = 0;
+                CssArray* selectors = selector->data->selectors;
+                for (size_t i = 0; i < selectors->length; i++) {
+                    unsigned specificity = css_calc_specificity_for_selector(selectors->data[i]);
+                    if ( specificity > max )
+                        max = specificity;
+                }
+                return selector->pseudo == CssPseudoNot ? max : add_specificity(0x100, max);
+            }
+            return 0x100;
         case CssSelMatchAttrExact:
         case CssSelMatchClass:
         case CssSelMatchAttrSet:
         case CssSelMatchAttrList:
         case CssSelMatchAttrHyphen:
-        case CssSelMatchPseudoElement:
         case CssSelMatchAttrContain:
         case CssSelMatchAttrBegin:
         case CssSelMatchAttrEnd:
             return 0x100;
             
+        case CssSelMatchPseudoElement:
+            return 1;
         case CssSelMatchTag:
-            return !strcasecmp(selector->tag->local, "*") ? 0 : 1;
+            return strcmp(selector->tag->local, cssAsteriskString.data) ? 1 : 0;
         case CssSelMatchUnknown:
         case CssSelMatchPagePseudoClass:
             return 0;
@@ -458,199 +614,366 @@ unsigned calc_specificity_for_one_selector(const CssSelector* selector)
     return 0;
 }
 
+unsigned cssprsr_selector_calc_specificity(const CssSelector* selector)
+{
+    unsigned total = 0;
+    for (const CssSelector * next = selector; next; next = next->tagHistory)
+        total = add_specificity(total, calc_specificity_for_one_selector(next));
+    return total;
+}
+
 unsigned css_calc_specificity_for_selector(CssSelector* selector)
 {
     if ( NULL == selector ) {
         return 0;
     }
-    
-    static const unsigned idMask = 0xff0000;
-    static const unsigned classMask = 0xff00;
-    static const unsigned elementMask = 0xff;
-    
-    unsigned total = 0;
-    unsigned temp = 0;
-    
-    for (const CssSelector * next = selector; next; next = next->tagHistory)
-    {
-        temp = total + calc_specificity_for_one_selector(next);
-
-        if ((temp & idMask) < (total & idMask))
-            total |= idMask;
-        else if ((temp & classMask) < (total & classMask))
-            total |= classMask;
-        else if ((temp & elementMask) < (total & elementMask))
-            total |= elementMask;
-        else
-            total = temp;
+    // Selectors of a selector list have it computed once by the parser.
+    if ( selector->specificity )
+        return (unsigned)selector->specificity;
+    return cssprsr_selector_calc_specificity(selector);
+}
+
+// Canonical form, for css_selector_hash() and css_selector_equals(): tag
+// and attribute names ignore case, so do attribute values with the `i`
+// flag, a lone `*` tag is dropped, nth arguments compare by their a and b,
+// and the simple selectors of a compound compare as an unordered set.
+
+static bool is_implicit_universal(const CssSelector* selector)
+{
+    return selector->match == CssSelMatchTag && NULL == selector->tag->prefix
+        && 0 == strcmp(selector->tag->local, cssAsteriskString.data);
+}
+
+static bool is_nth(const CssSelector* selector)
+{
+    switch (selector->pseudo) {
+        case CssPseudoNthChild:
+        case CssPseudoNthLastChild:
+        case CssPseudoNthOfType:
+        case CssPseudoNthLastOfType:
+            return true;
+        default:
+            return false;
     }
-        
-    return total;
 }
 
-// Could be made smaller and faster by replacing pointer with an
-// offset into a string buffer and making the bit fields smaller but
-// that could not be maintained by hand.
+static unsigned mix_hash(unsigned hash, unsigned value)
+{
+    return (hash ^ value) * 16777619u;
+}
+
+static unsigned hash_string(const char* str, bool ignore_case)
+{
+    return NULL == str ? 0 : cssprsr_string_hash(str, ignore_case);
+}
+
+static bool equal_strings(const char* a, const char* b, bool ignore_case)
+{
+    if (NULL == a || NULL == b)
+        return a == b;
+    return 0 == (ignore_case ? strcasecmp(a, b) : strcmp(a, b));
+}
+
+static unsigned hash_simple(const CssSelector* selector)
+{
+    unsigned hash = mix_hash(2166136261u, selector->match);
+    if (selector->match == CssSelMatchTag) {
+        hash = mix_hash(hash, hash_string(selector->tag->prefix, false));
+        return mix_hash(hash, hash_string(selector->tag->local, true));
+    }
+    if (cssprsr_selector_is_attribute(selector)) {
+        bool ignore_case = selector->data->bits.attrMatchType == CssAMTCaseInsensitive;
+        hash = mix_hash(hash, hash_string(selector->data->attribute->prefix, false));
+        hash = mix_hash(hash, hash_string(selector->data->attribute->local, true));
+        return mix_hash(hash, hash_string(selector->data->value, ignore_case));
+    }
+    if (selector->match == CssSelMatchId || selector->match == CssSelMatchClass)
+        return mix_hash(hash, hash_string(selector->data->value, false));
+
+    hash = mix_hash(hash, selector->pseudo);
+    hash = mix_hash(hash, hash_string(selector->data->value, true));
+    if (is_nth(selector)) {
+        hash = mix_hash(hash, (unsigned)selector->data->bits.nth.a);
+        hash = mix_hash(hash, (unsigned)selector->data->bits.nth.b);
+    } else {
+        hash = mix_hash(hash, hash_string(selector->data->argument, true));
+    }
+    if (selector->data->selectors) {
+        CssArray* selectors = selector->data->selectors;
+        for (size_t i = 0; i < selectors->length; i++)
+            hash = mix_hash(hash, css_selector_hash(selectors->data[i]));
+    }
+    return hash;
+}
+
+static bool equal_simple(const CssSelector* x, const CssSelector* y)
+{
+    if (x->match != y->match)
+        return false;
+    if (x->match == CssSelMatchTag)
+        return equal_strings(x->tag->prefix, y->tag->prefix, false)
+            && equal_strings(x->tag->local, y->tag->local, true);
+    if (cssprsr_selector_is_attribute(x)) {
+        bool ignore_case = x->data->bits.attrMatchType == CssAMTCaseInsensitive;
+        return x->data->bits.attrMatchType == y->data->bits.attrMatchType
+            && equal_strings(x->data->attribute->prefix, y->data->attribute->prefix, false)
+            && equal_strings(x->data->attribute->local, y->data->attribute->local, true)
+            && equal_strings(x->data->value, y->data->value, ignore_case);
+    }
+    if (x->match == CssSelMatchId || x->match == CssSelMatchClass)
+        return equal_strings(x->data->value, y->data->value, false);
+
+    if (x->pseudo != y->pseudo || !equal_strings(x->data->value, y->data->value, true))
+        return false;
+    if (is_nth(x)) {
+        if (x->data->bits.nth.a != y->data->bits.nth.a || x->data->bits.nth.b != y->data->bits.nth.b)
+            return false;
+    } else if (!equal_strings(x->data->argument, y->data->argument, true)) {
+        return false;
+    }
+    CssArray* xs = x->data->selectors;
+    CssArray* ys = y->data->selectors;
+    if (NULL == xs || NULL == ys)
+        return xs == ys;
+    if (xs->length != ys->length)
+        return false;
+    for (size_t i = 0; i < xs->length; i++) {
+        if (!css_selector_equals(xs->data[i], ys->data[i]))
+            return false;
+    }
+    return true;
+}
+
+// Last simple selector of the compound starting at `selector`.
+static const CssSelector* compound_end(const CssSelector* selector)
+{
+    while (selector->relation == CssSelRelSubSelector && selector->tagHistory)
+        selector = selector->tagHistory;
+    return selector;
+}
+
+#define CSSPRSR_COMPOUND_MAX_SIMPLES 64
+
+static bool equal_compounds(const CssSelector* x, const CssSelector* x_end, const CssSelector* y, const CssSelector* y_end)
+{
+    // Each simple selector of `x` takes an unused equal one of `y`.
+    unsigned long long used = 0;
+    size_t x_count = 0, y_count = 0;
+    for (const CssSelector* cs = y; ; cs = cs->tagHistory) {
+        if (!is_implicit_universal(cs))
+            y_count++;
+        if (cs == y_end)
+            break;
+    }
+    for (const CssSelector* cs = x; ; cs = cs->tagHistory) {
+        if (!is_implicit_universal(cs)) {
+            if (++x_count > CSSPRSR_COMPOUND_MAX_SIMPLES)
+                return false;
+            size_t i = 0;
+            const CssSelector* other = y;
+            for (; ; other = other->tagHistory) {
+                if (!is_implicit_universal(other)) {
+                    if (!(used & (1ull << i)) && equal_simple(cs, other))
+                        break;
+                    i++;
+                }
+                if (other == y_end)
+                    return false;
+            }
+            used |= 1ull << i;
+        }
+        if (cs == x_end)
+            break;
+    }
+    return x_count == y_count;
+}
+
+unsigned css_selector_hash(const CssSelector* selector)
+{
+    unsigned hash = 2166136261u;
+    for (const CssSelector* compound = selector; compound; ) {
+        const CssSelector* end = compound_end(compound);
+        // Summed, the order of the simple selectors does not count.
+        unsigned sum = 0;
+        for (const CssSelector* cs = compound; ; cs = cs->tagHistory) {
+            if (!is_implicit_universal(cs))
+                sum += hash_simple(cs);
+            if (cs == end)
+                break;
+        }
+        hash = mix_hash(hash, sum);
+        compound = end->tagHistory;
+        if (compound)
+            hash = mix_hash(hash, end->relation);
+    }
+    return hash;
+}
+
+bool css_selector_equals(const CssSelector* x, const CssSelector* y)
+{
+    while (x && y) {
+        const CssSelector* x_end = compound_end(x);
+        const CssSelector* y_end = compound_end(y);
+        if (!equal_compounds(x, x_end, y, y_end))
+            return false;
+        x = x_end->tagHistory;
+        y = y_end->tagHistory;
+        if (x && y && x_end->relation != y_end->relation)
+            return false;
+    }
+    return x == y;
+}
+
+// Pseudo-class and pseudo-element names, with vendor prefixed aliases, in
+// a perfect hash table. A name hashes with cssprsr_string_hash() ignoring
+// case, the low bits pick a bucket and the seed of the bucket mixed into
+// the hash gives the one slot the name can be in. The seeds and slots are
+// generated by `tools/perfect_hash.py pseudo`, which takes biggest buckets
+// first and for each the first seed placing all its names in free slots: to
+// add a name, write its entry anywhere in the table and run it again.
+// test_pseudo_type_map() checks the result.
 typedef struct {
     const char* string;
+    bool hasArguments;
     unsigned type:8;
 } CssNameToPseudoStruct;
 
-// These tables should be kept sorted.
-const static CssNameToPseudoStruct kPseudoTypeWithoutArgumentsMap[] = {
-    {"-internal-list-box",            CssPseudoListBox},
-    {"-internal-media-controls-cast-button", CssPseudoWebKitCustomElement},
-    {"-internal-media-controls-overlay-cast-button", CssPseudoWebKitCustomElement},
-    {"-internal-spatial-navigation-focus", CssPseudoSpatialNavFocus},
-    {"-webkit-any-link",              CssPseudoAnyLink},
-    {"-webkit-autofill",              CssPseudoAutofill},
-    {"-webkit-drag",                  CssPseudoDrag},
-    {"-webkit-full-page-media",       CssPseudoFullPageMedia},
-    {"-webkit-full-screen",           CssPseudoFullScreen},
-    {"-webkit-full-screen-ancestor",  CssPseudoFullScreenAncestor},
-    {"-webkit-full-screen-document",  CssPseudoFullScreenDocument},
-    {"-webkit-resizer",               CssPseudoResizer},
-    {"-webkit-scrollbar",             CssPseudoScrollbar},
-    {"-webkit-scrollbar-button",      CssPseudoScrollbarButton},
-    {"-webkit-scrollbar-corner",      CssPseudoScrollbarCorner},
-    {"-webkit-scrollbar-thumb",       CssPseudoScrollbarThumb},
-    {"-webkit-scrollbar-track",       CssPseudoScrollbarTrack},
-    {"-webkit-scrollbar-track-piece", CssPseudoScrollbarTrackPiece},
-    {"active",                        CssPseudoActive},
-    {"after",                         CssPseudoAfter},
-    {"backdrop",                      CssPseudoBackdrop},
-    {"before",                        CssPseudoBefore},
-    {"checked",                       CssPseudoChecked},
-    {"content",                       CssPseudoContent},
-    {"corner-present",                CssPseudoCornerPresent},
-    {"cue",                           CssPseudoWebKitCustomElement},
-    {"decrement",                     CssPseudoDecrement},
-    {"default",                       CssPseudoDefault},
-    {"disabled",                      CssPseudoDisabled},
-    {"double-button",                 CssPseudoDoubleButton},
-    {"empty",                         CssPseudoEmpty},
-    {"enabled",                       CssPseudoEnabled},
-    {"end",                           CssPseudoEnd},
-    {"first",                         CssPseudoFirstPage},
-    {"first-child",                   CssPseudoFirstChild},
-    {"first-letter",                  CssPseudoFirstLetter},
-    {"first-line",                    CssPseudoFirstLine},
-    {"first-of-type",                 CssPseudoFirstOfType},
-    {"focus",                         CssPseudoFocus},
-    {"future",                        CssPseudoFutureCue},
-    {"horizontal",                    CssPseudoHorizontal},
-    {"host",                          CssPseudoHost},
-    {"hover",                         CssPseudoHover},
-    {"in-range",                      CssPseudoInRange},
-    {"increment",                     CssPseudoIncrement},
-    {"indeterminate",                 CssPseudoIndeterminate},
-    {"invalid",                       CssPseudoInvalid},
-    {"last-child",                    CssPseudoLastChild},
-    {"last-of-type",                  CssPseudoLastOfType},
-    {"left",                          CssPseudoLeftPage},
-    {"link",                          CssPseudoLink},
-    {"no-button",                     CssPseudoNoButton},
-    {"only-child",                    CssPseudoOnlyChild},
-    {"only-of-type",                  CssPseudoOnlyOfType},
-    {"optional",                      CssPseudoOptional},
-    {"out-of-range",                  CssPseudoOutOfRange},
-    {"past",                          CssPseudoPastCue},
-    {"read-only",                     CssPseudoReadOnly},
-    {"read-write",                    CssPseudoReadWrite},
-    {"required",                      CssPseudoRequired},
-    {"right",                         CssPseudoRightPage},
-    {"root",                          CssPseudoRoot},
-    {"scope",                         CssPseudoScope},
-    {"selection",                     CssPseudoSelection},
-    {"shadow",                        CssPseudoShadow},
-    {"single-button",                 CssPseudoSingleButton},
-    {"start",                         CssPseudoStart},
-    {"target",                        CssPseudoTarget},
-    {"unresolved",                    CssPseudoUnresolved},
-    {"valid",                         CssPseudoValid},
-    {"vertical",                      CssPseudoVertical},
-    {"visited",                       CssPseudoVisited},
-    {"window-inactive",               CssPseudoWindowInactive},
+#define CSSPRSR_PSEUDO_BUCKETS 32
+#define CSSPRSR_PSEUDO_SLOTS   128
+#define CSSPRSR_PSEUDO_SLOT_SHIFT 25
+
+static const unsigned char kPseudoTypeSeeds[CSSPRSR_PSEUDO_BUCKETS] = {
+      2,   2,   0,   0,   5,  31,  15,  10,   0,  64,   0,   6,   1,   2,   2,   0,
+      0,   1,   4,   3,   8,   2,   8,   2,   0,   2,   0,   0,  22,   4,   1,   8,
 };
 
-const static CssNameToPseudoStruct kPseudoTypeWithArgumentsMap[] = {
-    {"-webkit-any(",      CssPseudoAny},
-    {"cue(",              CssPseudoCue},
-    {"host(",             CssPseudoHost},
-    {"host-context(",     CssPseudoHostContext},
-    {"lang(",             CssPseudoLang},
-    {"not(",              CssPseudoNot},
-    {"nth-child(",        CssPseudoNthChild},
-    {"nth-last-child(",   CssPseudoNthLastChild},
-    {"nth-last-of-type(", CssPseudoNthLastOfType},
-    {"nth-of-type(",      CssPseudoNthOfType},
+static const CssNameToPseudoStruct kPseudoTypeMap[CSSPRSR_PSEUDO_SLOTS] = {
+    [  0] = {"vertical",                                     false, CssPseudoVertical},
+    [  1] = {"-webkit-scrollbar",                            false, CssPseudoScrollbar},
+    [  2] = {"first-of-type",                                false, CssPseudoFirstOfType},
+    [  3] = {"not(",                                         true , CssPseudoNot},
+    [  4] = {"cue",                                          false, CssPseudoWebKitCustomElement},
+    [  5] = {"invalid",                                      false, CssPseudoInvalid},
+    [  6] = {"unresolved",                                   false, CssPseudoUnresolved},
+    [  7] = {"-internal-media-controls-overlay-cast-button", false, CssPseudoWebKitCustomElement},
+    [ 10] = {"-internal-media-controls-cast-button",         false, CssPseudoWebKitCustomElement},
+    [ 11] = {"first-letter",                                 false, CssPseudoFirstLetter},
+    [ 12] = {"start",                                        false, CssPseudoStart},
+    [ 13] = {"shadow",                                       false, CssPseudoShadow},
+    [ 14] = {"optional",                                     false, CssPseudoOptional},
+    [ 15] = {"-internal-list-box",                           false, CssPseudoListBox},
+    [ 16] = {"-webkit-full-screen",                          false, CssPseudoFullScreen},
+    [ 17] = {"nth-last-child(",                              true , CssPseudoNthLastChild},
+    [ 18] = {"-ms-fullscreen",                               false, CssPseudoFullScreen},
+    [ 19] = {"last-child",                                   false, CssPseudoLastChild},
+    [ 21] = {"cue(",                                         true , CssPseudoCue},
+    [ 22] = {"first-child",                                  false, CssPseudoFirstChild},
+    [ 23] = {"selection",                                    false, CssPseudoSelection},
+    [ 24] = {"no-button",                                    false, CssPseudoNoButton},
+    [ 29] = {"left",                                         false, CssPseudoLeftPage},
+    [ 31] = {"host-context(",                                true , CssPseudoHostContext},
+    [ 33] = {"-internal-spatial-navigation-focus",           false, CssPseudoSpatialNavFocus},
+    [ 34] = {"enabled",                                      false, CssPseudoEnabled},
+    [ 35] = {"right",                                        false, CssPseudoRightPage},
+    [ 36] = {"root",                                         false, CssPseudoRoot},
+    [ 37] = {"scope",                                        false, CssPseudoScope},
+    [ 38] = {"horizontal",                                   false, CssPseudoHorizontal},
+    [ 39] = {"visited",                                      false, CssPseudoVisited},
+    [ 40] = {"decrement",                                    false, CssPseudoDecrement},
+    [ 44] = {"corner-present",                               false, CssPseudoCornerPresent},
+    [ 45] = {"-moz-selection",                               false, CssPseudoSelection},
+    [ 46] = {"read-write",                                   false, CssPseudoReadWrite},
+    [ 49] = {"indeterminate",                                false, CssPseudoIndeterminate},
+    [ 51] = {"first",                                        false, CssPseudoFirstPage},
+    [ 52] = {"end",                                          false, CssPseudoEnd},
+    [ 55] = {"-moz-read-write",                              false, CssPseudoReadWrite},
+    [ 57] = {"host(",                                        true , CssPseudoHost},
+    [ 58] = {"-webkit-any-link",                             false, CssPseudoAnyLink},
+    [ 59] = {"-webkit-autofill",                             false, CssPseudoAutofill},
+    [ 61] = {"double-button",                                false, CssPseudoDoubleButton},
+    [ 62] = {"host",                                         false, CssPseudoHost},
+    [ 63] = {"past",                                         false, CssPseudoPastCue},
+    [ 64] = {"nth-child(",                                   true , CssPseudoNthChild},
+    [ 65] = {"active",                                       false, CssPseudoActive},
+    [ 66] = {"increment",                                    false, CssPseudoIncrement},
+    [ 69] = {"nth-of-type(",                                 true , CssPseudoNthOfType},
+    [ 70] = {"backdrop",                                     false, CssPseudoBackdrop},
+    [ 72] = {"-webkit-any(",                                 true , CssPseudoAny},
+    [ 74] = {"target",                                       false, CssPseudoTarget},
+    [ 75] = {"-moz-read-only",                               false, CssPseudoReadOnly},
+    [ 76] = {"fullscreen",                                   false, CssPseudoFullScreen},
+    [ 78] = {"read-only",                                    false, CssPseudoReadOnly},
+    [ 79] = {"content",                                      false, CssPseudoContent},
+    [ 81] = {"autofill",                                     false, CssPseudoAutofill},
+    [ 82] = {"default",                                      false, CssPseudoDefault},
+    [ 86] = {"valid",                                        false, CssPseudoValid},
+    [ 87] = {"single-button",                                false, CssPseudoSingleButton},
+    [ 88] = {"any-link",                                     false, CssPseudoAnyLink},
+    [ 89] = {"-webkit-scrollbar-track",                      false, CssPseudoScrollbarTrack},
+    [ 91] = {"after",                                        false, CssPseudoAfter},
+    [ 92] = {"only-child",                                   false, CssPseudoOnlyChild},
+    [ 94] = {"empty",                                        false, CssPseudoEmpty},
+    [ 95] = {"focus",                                        false, CssPseudoFocus},
+    [ 97] = {"-webkit-scrollbar-button",                     false, CssPseudoScrollbarButton},
+    [ 98] = {"hover",                                        false, CssPseudoHover},
+    [100] = {"-webkit-full-page-media",                      false, CssPseudoFullPageMedia},
+    [101] = {"required",                                     false, CssPseudoRequired},
+    [102] = {"-webkit-scrollbar-corner",                     false, CssPseudoScrollbarCorner},
+    [103] = {"-webkit-resizer",                              false, CssPseudoResizer},
+    [104] = {"-moz-full-screen",                             false, CssPseudoFullScreen},
+    [106] = {"before",                                       false, CssPseudoBefore},
+    [107] = {"checked",                                      false, CssPseudoChecked},
+    [108] = {"-webkit-full-screen-document",                 false, CssPseudoFullScreenDocument},
+    [109] = {"-webkit-full-screen-ancestor",                 false, CssPseudoFullScreenAncestor},
+    [110] = {"in-range",                                     false, CssPseudoInRange},
+    [111] = {"-webkit-drag",                                 false, CssPseudoDrag},
+    [112] = {"-webkit-scrollbar-track-piece",                false, CssPseudoScrollbarTrackPiece},
+    [113] = {"disabled",                                     false, CssPseudoDisabled},
+    [115] = {"-webkit-scrollbar-thumb",                      false, CssPseudoScrollbarThumb},
+    [117] = {"last-of-type",                                 false, CssPseudoLastOfType},
+    [118] = {"window-inactive",                              false, CssPseudoWindowInactive},
+    [119] = {"-moz-any-link",                                false, CssPseudoAnyLink},
+    [120] = {"out-of-range",                                 false, CssPseudoOutOfRange},
+    [121] = {"only-of-type",                                 false, CssPseudoOnlyOfType},
+    [122] = {"future",                                       false, CssPseudoFutureCue},
+    [124] = {"link",                                         false, CssPseudoLink},
+    [125] = {"lang(",                                        true , CssPseudoLang},
+    [126] = {"nth-last-of-type(",                            true , CssPseudoNthLastOfType},
+    [127] = {"first-line",                                   false, CssPseudoFirstLine},
 };
 
-static const CssNameToPseudoStruct* lower_bound(const CssNameToPseudoStruct *map,
-                                                   size_t count, const char* key);
+static const CssNameToPseudoStruct* pseudo_type_slot(const char* name)
+{
+    unsigned int hash = cssprsr_string_hash(name, true);
+    unsigned int seed = kPseudoTypeSeeds[hash & (CSSPRSR_PSEUDO_BUCKETS - 1)];
+    return &kPseudoTypeMap[((hash ^ seed) * 16777619u) >> CSSPRSR_PSEUDO_SLOT_SHIFT];
+}
 
 static CssPseudoType name_to_pseudo_type(const char* name, bool hasArguments)
 {
     if (NULL == name)
         return CssPseudoUnknown;
     
-    const CssNameToPseudoStruct* pseudoTypeMap;
-    size_t count;
-    
-    if (hasArguments) {
-        pseudoTypeMap = kPseudoTypeWithArgumentsMap;
-        count = sizeof(kPseudoTypeWithArgumentsMap) / sizeof(CssNameToPseudoStruct);
-    } else {
-        pseudoTypeMap = kPseudoTypeWithoutArgumentsMap;
-        count = sizeof(kPseudoTypeWithoutArgumentsMap) / sizeof(CssNameToPseudoStruct);
-    }
-    
-    const CssNameToPseudoStruct* match = lower_bound(pseudoTypeMap, count, name);
-    if ( match == (pseudoTypeMap + count)
+    const CssNameToPseudoStruct* match = pseudo_type_slot(name);
+    if ( NULL == match->string
+         || match->hasArguments != hasArguments
          || 0 != strcasecmp(match->string, name) )
         return CssPseudoUnknown;
     
     return match->type;
 }
 
-static const CssNameToPseudoStruct* lower_bound(const CssNameToPseudoStruct *array,
-                                                   size_t size, const char* key) {
-    const CssNameToPseudoStruct* it;
-    const CssNameToPseudoStruct* first = array;
-    size_t count = size, step;
-    while (count > 0) {
-        it = first;
-        step = count / 2;
-        it += step;
-        if (strncmp(it->string, key, strlen(key)) < 0) {
-            first = ++it;
-            count -= step + 1;
-        } else count = step;
-    }
-    return first;
-}
-
 #if CSSPRSR_RPARSER_DEBUG
 
-void test_lower_bound()
+void test_pseudo_type_map()
 {
-    const CssNameToPseudoStruct* pseudoTypeMap;
-    size_t count;
-    
-    pseudoTypeMap = kPseudoTypeWithArgumentsMap;
-    count = sizeof(kPseudoTypeWithArgumentsMap) / sizeof(CssNameToPseudoStruct);
-    
-    for ( size_t i = 0; i < count; i++ ) {
-        const CssNameToPseudoStruct* res = lower_bound(pseudoTypeMap, count, pseudoTypeMap[i].string);
-        assert(pseudoTypeMap[i].type == res->type);
-    }
-    
-    pseudoTypeMap = kPseudoTypeWithoutArgumentsMap;
-    count = sizeof(kPseudoTypeWithoutArgumentsMap) / sizeof(CssNameToPseudoStruct);
-    
-    for ( size_t i = 0; i < count; i++ ) {
-        const CssNameToPseudoStruct* res = lower_bound(pseudoTypeMap, count, pseudoTypeMap[i].string);
-        assert(pseudoTypeMap[i].type == res->type);
+    for ( size_t i = 0; i < CSSPRSR_PSEUDO_SLOTS; i++ ) {
+        const CssNameToPseudoStruct* entry = &kPseudoTypeMap[i];
+        if ( NULL == entry->string )
+            continue;
+        assert(pseudo_type_slot(entry->string) == entry);
+        assert(name_to_pseudo_type(entry->string, entry->hasArguments) == entry->type);
+        assert(entry->hasArguments == (entry->string[strlen(entry->string) - 1] == '('));
     }
 }
 
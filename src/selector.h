@@ -29,8 +29,13 @@
 extern "C" {
 #endif
 
+void cssprsr_selector_append_string(CssParser* parser, const CssSelector* selector, CssParserString* string);
 CssParserString* cssprsr_selector_to_string(CssParser* parser, CssSelector* selector, CssParserString* next);
     
+unsigned cssprsr_selector_calc_specificity(const CssSelector* selector);
+CssPseudoType cssprsr_parse_pseudo_type(const char* name, bool hasArguments);
+bool cssprsr_parse_nth(const char* argument, int* a, int* b, const char** selectors);
+
 bool cssprsr_selector_crosses_tree_scopes(const CssSelector* selector);
 bool cssprsr_selector_matches_pseudo_element(CssSelector* selector);
 bool cssprsr_selector_is_custom_pseudo_element(CssSelector* selector);
@@ -44,6 +49,25 @@ bool cssprsr_selector_is_shadow_pseudo_element(CssSelector* selector);
 bool cssprsr_selector_is_host_pseudo_class(CssSelector* selector);
 bool cssprsr_selector_is_tree_boundary_crossing(CssSelector* selector);
 bool cssprsr_selector_is_insertion_point_crossing(CssSelector* selector);
+
+// Matching, see matcher.c
+typedef enum {
+    CssMatchSuccess,
+    CssMatchFailsLocally,
+    // No sibling further away can match either
+    CssMatchFailsAllSiblings,
+    // No ancestor further away can match either
+    CssMatchFailsCompletely,
+} CssMatchResult;
+
+bool cssprsr_match_attribute_value(CssSelectorMatch match, const char* actual, const char* value, bool ignore_case);
+int cssprsr_sibling_position(const void* element, const CssElementOps* ops, CssNthIndexCache* cache,
+                             bool forward, bool of_type);
+bool cssprsr_match_lang(const void* element, const CssElementOps* ops, const char* range);
+
+// Sibling positions, see nthindex.c. 0 when the cache cannot tell.
+int cssprsr_nth_index_position(CssNthIndexCache* cache, const void* element, const CssElementOps* ops,
+                               bool forward, bool of_type);
     
 #ifdef __cplusplus
 }
@@ -0,0 +1,706 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Shorthand expansion.
+//
+// With CssParserFlagExpandShorthands a shorthand declaration is split into
+// its longhands as it is parsed, so a block is expanded once and the
+// cascade and the comparers only ever see longhands. Each shorthand has a
+// function assigning its values to the slots of its longhands, slots left
+// empty are set to `initial` as the shorthand resets them. A value that
+// does not fit the grammar of the shorthand keeps it whole rather than
+// guessing.
+
+#define CSSPRSR_SHORTHAND_MAX_LONGHANDS 12
+
+typedef bool (*CssValueTest)(const CssValue* value);
+
+struct CssShorthand;
+
+// Fills the slots of the longhands from the values, false to keep the
+// shorthand.
+typedef bool (*CssShorthandExpand)(CssParser* parser, const struct CssShorthand* shorthand,
+                                   const CssArray* values, CssArray** slots);
+
+typedef struct CssShorthand {
+    CssPropertyID id;
+    CssPropertyID longhands[CSSPRSR_SHORTHAND_MAX_LONGHANDS];
+    size_t count;
+    CssShorthandExpand expand;
+    // Components in their slot order, for the generic expansions
+    CssValueTest tests[4];
+} CssShorthand;
+
+static bool is_keyword(const CssValue* value, CssValueID id)
+{
+    return CSS_VALUE_IDENT == value->unit && id == value->id;
+}
+
+static bool is_css_wide_keyword(const CssValue* value)
+{
+    return is_keyword(value, CssValueInherit) || is_keyword(value, CssValueInitial) ||
+           is_keyword(value, CssValueUnset) || is_keyword(value, CssValueRevert);
+}
+
+static bool is_operator(const CssValue* value, int op)
+{
+    return CSS_VALUE_PARSER_OPERATOR == value->unit && op == value->iValue;
+}
+
+static bool is_length(const CssValue* value)
+{
+    if ( CSS_VALUE_CALC == value->unit )
+        return CssCalcLength == css_calc_category(value->calc);
+    if ( CSS_VALUE_NUMBER == value->unit )
+        return 0 == value->fValue;
+    return CssUnitLength == css_unit_kind(value->unit);
+}
+
+static bool is_length_percentage(const CssValue* value)
+{
+    if ( CSS_VALUE_CALC == value->unit ) {
+        CssCalcCategory category = css_calc_category(value->calc);
+        return CssCalcLength == category || CssCalcPercent == category || CssCalcPercentLength == category;
+    }
+    return CSS_VALUE_PERCENTAGE == value->unit || is_length(value);
+}
+
+static bool is_number(const CssValue* value)
+{
+    return CSS_VALUE_NUMBER == value->unit && value->fValue >= 0;
+}
+
+static bool is_margin(const CssValue* value)
+{
+    return is_length_percentage(value) || is_keyword(value, CssValueAuto);
+}
+
+static bool is_line_width(const CssValue* value)
+{
+    return is_length(value) || is_keyword(value, CssValueThin) ||
+           is_keyword(value, CssValueMedium) || is_keyword(value, CssValueThick);
+}
+
+static bool is_line_style(const CssValue* value)
+{
+    if ( CSS_VALUE_IDENT != value->unit )
+        return false;
+    switch ( value->id ) {
+    case CssValueNone:
+    case CssValueHidden:
+    case CssValueDotted:
+    case CssValueDashed:
+    case CssValueSolid:
+    case CssValueDouble:
+    case CssValueGroove:
+    case CssValueRidge:
+    case CssValueInset:
+    case CssValueOutset:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Named colors of these shorthands are resolved while parsing
+static bool is_color(const CssValue* value)
+{
+    return CSS_VALUE_RGBCOLOR == value->unit || is_keyword(value, CssValueCurrentcolor);
+}
+
+static bool is_image(const CssValue* value)
+{
+    if ( CSS_VALUE_URI == value->unit )
+        return true;
+    return CSS_VALUE_PARSER_FUNCTION == value->unit &&
+           (strstr(value->function->name, "gradient(") || strstr(value->function->name, "image"));
+}
+
+static bool is_gap(const CssValue* value)
+{
+    return is_length_percentage(value) || is_keyword(value, CssValueNormal);
+}
+
+static bool is_overflow(const CssValue* value)
+{
+    if ( CSS_VALUE_IDENT != value->unit )
+        return false;
+    switch ( value->id ) {
+    case CssValueVisible:
+    case CssValueHidden:
+    case CssValueClip:
+    case CssValueScroll:
+    case CssValueAuto:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_flex_direction(const CssValue* value)
+{
+    return is_keyword(value, CssValueRow) || is_keyword(value, CssValueRowReverse) ||
+           is_keyword(value, CssValueColumn) || is_keyword(value, CssValueColumnReverse);
+}
+
+static bool is_flex_wrap(const CssValue* value)
+{
+    return is_keyword(value, CssValueNowrap) || is_keyword(value, CssValueWrap) ||
+           is_keyword(value, CssValueWrapReverse);
+}
+
+static bool is_flex_basis(const CssValue* value)
+{
+    return is_length_percentage(value) || is_keyword(value, CssValueAuto) ||
+           is_keyword(value, CssValueMinContent) || is_keyword(value, CssValueMaxContent) ||
+           is_keyword(value, CssValueFitContent);
+}
+
+static bool is_column_width(const CssValue* value)
+{
+    return is_length(value) || is_keyword(value, CssValueAuto);
+}
+
+static bool is_column_count(const CssValue* value)
+{
+    return (CSS_VALUE_NUMBER == value->unit && value->isInt && value->fValue > 0) ||
+           is_keyword(value, CssValueAuto);
+}
+
+static bool is_list_style_position(const CssValue* value)
+{
+    return is_keyword(value, CssValueInside) || is_keyword(value, CssValueOutside);
+}
+
+// Counter styles are custom idents, `none` is left to the caller
+static bool is_list_style_type(const CssValue* value)
+{
+    if ( CSS_VALUE_STRING == value->unit )
+        return true;
+    return CSS_VALUE_IDENT == value->unit && !is_css_wide_keyword(value) &&
+           !is_keyword(value, CssValueNone) && !is_list_style_position(value);
+}
+
+static bool is_text_decoration_line(const CssValue* value)
+{
+    return is_keyword(value, CssValueUnderline) || is_keyword(value, CssValueOverline) ||
+           is_keyword(value, CssValueLineThrough) || is_keyword(value, CssValueBlink);
+}
+
+static bool is_text_decoration_style(const CssValue* value)
+{
+    return is_keyword(value, CssValueSolid) || is_keyword(value, CssValueDouble) ||
+           is_keyword(value, CssValueDotted) || is_keyword(value, CssValueDashed);
+}
+
+static bool is_font_style(const CssValue* value)
+{
+    return is_keyword(value, CssValueItalic) || is_keyword(value, CssValueOblique);
+}
+
+static bool is_font_weight(const CssValue* value)
+{
+    if ( CSS_VALUE_NUMBER == value->unit )
+        return value->fValue >= 1 && value->fValue <= 1000;
+    return is_keyword(value, CssValueBold) || is_keyword(value, CssValueBolder) ||
+           is_keyword(value, CssValueLighter);
+}
+
+static bool is_font_size(const CssValue* value)
+{
+    if ( is_length_percentage(value) )
+        return true;
+    if ( CSS_VALUE_IDENT != value->unit )
+        return false;
+    switch ( value->id ) {
+    case CssValueXxSmall:
+    case CssValueXSmall:
+    case CssValueSmall:
+    case CssValueMedium:
+    case CssValueLarge:
+    case CssValueXLarge:
+    case CssValueXxLarge:
+    case CssValueLarger:
+    case CssValueSmaller:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_font_family(const CssValue* value)
+{
+    return CSS_VALUE_STRING == value->unit || (CSS_VALUE_IDENT == value->unit && !is_css_wide_keyword(value));
+}
+
+static bool is_system_font(const CssValue* value)
+{
+    return is_keyword(value, CssValueCaption) || is_keyword(value, CssValueIcon) ||
+           is_keyword(value, CssValueMenu) || is_keyword(value, CssValueMessageBox) ||
+           is_keyword(value, CssValueSmallCaption) || is_keyword(value, CssValueStatusBar);
+}
+
+static bool is_repeat(const CssValue* value)
+{
+    return is_keyword(value, CssValueRepeat) || is_keyword(value, CssValueNoRepeat) ||
+           is_keyword(value, CssValueSpace) || is_keyword(value, CssValueRound);
+}
+
+static bool is_attachment(const CssValue* value)
+{
+    return is_keyword(value, CssValueScroll) || is_keyword(value, CssValueFixed) ||
+           is_keyword(value, CssValueLocal);
+}
+
+static bool is_position(const CssValue* value)
+{
+    return is_length_percentage(value) || is_keyword(value, CssValueLeft) ||
+           is_keyword(value, CssValueRight) || is_keyword(value, CssValueTop) ||
+           is_keyword(value, CssValueBottom) || is_keyword(value, CssValueCenter);
+}
+
+static bool is_box(const CssValue* value)
+{
+    return is_keyword(value, CssValueBorderBox) || is_keyword(value, CssValuePaddingBox) ||
+           is_keyword(value, CssValueContentBox);
+}
+
+static void add_value(CssParser* parser, CssArray** slot, CssValue* value)
+{
+    if ( NULL == *slot )
+        *slot = cssprsr_new_array(parser);
+    cssprsr_array_add(parser, value, *slot);
+}
+
+static void add_copy(CssParser* parser, CssArray** slot, const CssValue* value)
+{
+    add_value(parser, slot, cssprsr_copy_value(parser, value));
+}
+
+static CssValue* new_keyword(CssParser* parser, CssValueID id)
+{
+    CssValue* value = cssprsr_new_value(parser);
+    value->id = id;
+    value->isInt = false;
+    value->unit = CSS_VALUE_IDENT;
+    value->string = css_value_name(id);
+    return value;
+}
+
+// `raw` is the text of the number with its unit
+static CssValue* new_number(CssParser* parser, double number, CssValueUnit unit, const char* raw)
+{
+    CssParserString text = { (char*)raw, strlen(raw), 0 };
+    CssValue* value = cssprsr_new_value(parser);
+    value->id = CssValueInvalid;
+    value->isInt = CSS_VALUE_NUMBER == unit;
+    value->fValue = number;
+    value->unit = unit;
+    value->raw = cssprsr_string_to_characters(parser, &text);
+    return value;
+}
+
+static void copy_slot(CssParser* parser, const CssArray* from, CssArray** to)
+{
+    for (size_t i = 0; from && i < from->length; ++i)
+        add_copy(parser, to, from->data[i]);
+}
+
+// Top, right, bottom and left from one to four values.
+static bool expand_box(CssParser* parser, const CssShorthand* shorthand, const CssArray* values, CssArray** slots)
+{
+    if ( values->length > 4 )
+        return false;
+    for (size_t i = 0; i < values->length; ++i) {
+        if ( !shorthand->tests[0](values->data[i]) )
+            return false;
+    }
+    static const size_t kSides[4][4] = {
+        { 0, 0, 0, 0 },
+        { 0, 1, 0, 1 },
+        { 0, 1, 2, 1 },
+        { 0, 1, 2, 3 },
+    };
+    for (size_t side = 0; side < 4; ++side)
+        add_copy(parser, &slots[side], values->data[kSides[values->length - 1][side]]);
+    return true;
+}
+
+// One or two values, the second defaulting to the first.
+static bool expand_pair(CssParser* parser, const CssShorthand* shorthand, const CssArray* values, CssArray** slots)
+{
+    if ( values->length > 2 )
+        return false;
+    for (size_t i = 0; i < values->length; ++i) {
+        if ( !shorthand->tests[0](values->data[i]) )
+            return false;
+    }
+    add_copy(parser, &slots[0], values->data[0]);
+    add_copy(parser, &slots[1], values->data[values->length - 1]);
+    return true;
+}
+
+// Each value goes to the first free component accepting it, in any order.
+static bool expand_any_order(CssParser* parser, const CssShorthand* shorthand, const CssArray* values,
+                             CssArray** slots)
+{
+    for (size_t i = 0; i < values->length; ++i) {
+        size_t j = 0;
+        while ( j < shorthand->count && (NULL != slots[j] || !shorthand->tests[j](values->data[i])) )
+            j++;
+        if ( j == shorthand->count )
+            return false;
+        add_copy(parser, &slots[j], values->data[i]);
+    }
+    return true;
+}
+
+// Width, style and color of the four sides at once.
+static bool expand_border(CssParser* parser, const CssShorthand* shorthand, const CssArray* values, CssArray** slots)
+{
+    static const CssShorthand kSide = {
+        CssPropertyBorderTop, { CssPropertyBorderTopWidth, CssPropertyBorderTopStyle, CssPropertyBorderTopColor }, 3,
+        expand_any_order, { is_line_width, is_line_style, is_color },
+    };
+    if ( !expand_any_order(parser, &kSide, values, slots) )
+        return false;
+    for (size_t side = 1; side < 4; ++side) {
+        for (size_t i = 0; i < 3; ++i)
+            copy_slot(parser, slots[i], &slots[side * 3 + i]);
+    }
+    return true;
+}
+
+// `none` sets both the type and the image that are not otherwise given.
+static bool expand_list_style(CssParser* parser, const CssShorthand* shorthand, const CssArray* values,
+                              CssArray** slots)
+{
+    const CssValue* none = NULL;
+    size_t nones = 0;
+    for (size_t i = 0; i < values->length; ++i) {
+        const CssValue* value = values->data[i];
+        CssArray** slot = NULL;
+        if ( is_keyword(value, CssValueNone) ) {
+            none = value;
+            nones++;
+            continue;
+        }
+        if ( is_list_style_type(value) )
+            slot = &slots[0];
+        else if ( is_list_style_position(value) )
+            slot = &slots[1];
+        else if ( is_image(value) )
+            slot = &slots[2];
+        if ( NULL == slot || NULL != *slot )
+            return false;
+        add_copy(parser, slot, value);
+    }
+    if ( nones > (size_t)(NULL == slots[0]) + (NULL == slots[2]) )
+        return false;
+    if ( none && NULL == slots[0] )
+        add_copy(parser, &slots[0], none);
+    if ( none && NULL == slots[2] )
+        add_copy(parser, &slots[2], none);
+    return true;
+}
+
+// Grow, shrink and basis. A lone number is the grow factor with a zero
+// basis, `none` and `auto` stand for `0 0 auto` and `1 1 auto`.
+static bool expand_flex(CssParser* parser, const CssShorthand* shorthand, const CssArray* values, CssArray** slots)
+{
+    const CssValue* factors[2] = { NULL, NULL };
+    const CssValue* basis = NULL;
+    size_t count = 0;
+    if ( 1 == values->length && (is_keyword(values->data[0], CssValueNone) ||
+                                 is_keyword(values->data[0], CssValueAuto)) ) {
+        bool none = is_keyword(values->data[0], CssValueNone);
+        add_value(parser, &slots[0], new_number(parser, none ? 0 : 1, CSS_VALUE_NUMBER, none ? "0" : "1"));
+        add_value(parser, &slots[1], new_number(parser, none ? 0 : 1, CSS_VALUE_NUMBER, none ? "0" : "1"));
+        add_value(parser, &slots[2], new_keyword(parser, CssValueAuto));
+        return true;
+    }
+    // The factors are next to each other, before or after the basis. Zero
+    // is a factor rather than a length.
+    size_t i = 0;
+    if ( i < values->length && !is_number(values->data[i]) && is_flex_basis(values->data[i]) )
+        basis = values->data[i++];
+    while ( i < values->length && count < 2 && is_number(values->data[i]) )
+        factors[count++] = values->data[i++];
+    if ( NULL == basis && 0 < count && i < values->length && is_flex_basis(values->data[i]) )
+        basis = values->data[i++];
+    if ( i != values->length )
+        return false;
+    if ( 0 == count )
+        add_value(parser, &slots[0], new_number(parser, 1, CSS_VALUE_NUMBER, "1"));
+    else
+        add_copy(parser, &slots[0], factors[0]);
+    if ( count < 2 )
+        add_value(parser, &slots[1], new_number(parser, 1, CSS_VALUE_NUMBER, "1"));
+    else
+        add_copy(parser, &slots[1], factors[1]);
+    if ( basis )
+        add_copy(parser, &slots[2], basis);
+    else
+        add_value(parser, &slots[2], new_number(parser, 0, CSS_VALUE_PERCENTAGE, "0%"));
+    return true;
+}
+
+// Any of the line keywords, a style and a color.
+static bool expand_text_decoration(CssParser* parser, const CssShorthand* shorthand, const CssArray* values,
+                                   CssArray** slots)
+{
+    for (size_t i = 0; i < values->length; ++i) {
+        const CssValue* value = values->data[i];
+        if ( is_keyword(value, CssValueNone) && NULL == slots[0] && 1 == values->length ) {
+            add_copy(parser, &slots[0], value);
+        } else if ( is_text_decoration_line(value) ) {
+            // The lines given are one run of keywords
+            if ( NULL != slots[0] && !is_text_decoration_line(values->data[i - 1]) )
+                return false;
+            add_copy(parser, &slots[0], value);
+        } else if ( NULL == slots[1] && is_text_decoration_style(value) ) {
+            add_copy(parser, &slots[1], value);
+        } else if ( NULL == slots[2] && is_color(value) ) {
+            add_copy(parser, &slots[2], value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// `[style || variant || weight]? size [/ line-height]? family`, a `normal`
+// in front standing for any of the first three.
+static bool expand_font(CssParser* parser, const CssShorthand* shorthand, const CssArray* values, CssArray** slots)
+{
+    enum { Style, Variant, Weight, Stretch, Size, LineHeight, Family };
+    size_t i = 0, prefixes = 0;
+    if ( 1 == values->length && is_system_font(values->data[0]) )
+        return false;
+    for (; i < values->length && prefixes < 3; ++i, ++prefixes) {
+        const CssValue* value = values->data[i];
+        if ( is_keyword(value, CssValueNormal) )
+            continue;
+        if ( NULL == slots[Style] && is_font_style(value) )
+            add_copy(parser, &slots[Style], value);
+        else if ( NULL == slots[Variant] && is_keyword(value, CssValueSmallCaps) )
+            add_copy(parser, &slots[Variant], value);
+        else if ( NULL == slots[Weight] && is_font_weight(value) )
+            add_copy(parser, &slots[Weight], value);
+        else
+            break;
+    }
+    if ( i == values->length || !is_font_size(values->data[i]) )
+        return false;
+    add_copy(parser, &slots[Size], values->data[i++]);
+    if ( i < values->length && is_operator(values->data[i], '/') ) {
+        const CssValue* height = ++i < values->length ? values->data[i] : NULL;
+        if ( NULL == height || !(is_keyword(height, CssValueNormal) || is_number(height) ||
+                                 is_length_percentage(height)) )
+            return false;
+        add_copy(parser, &slots[LineHeight], height);
+        i++;
+    }
+    if ( i == values->length )
+        return false;
+    // Names separated by commas, a name may be several idents
+    for (size_t j = i; j < values->length; ++j) {
+        const CssValue* value = values->data[j];
+        bool comma = is_operator(value, ',');
+        if ( comma ? (j == i || j + 1 == values->length || is_operator(values->data[j - 1], ',')) :
+                     !is_font_family(value) )
+            return false;
+        add_copy(parser, &slots[Family], value);
+    }
+    return true;
+}
+
+// A single layer, its components in any order. The size follows the
+// position after a `/`, and one box sets both the origin and the clip.
+static bool expand_background(CssParser* parser, const CssShorthand* shorthand, const CssArray* values,
+                              CssArray** slots)
+{
+    enum { Color, Image, Repeat, Attachment, Position, Size, Origin, Clip };
+    for (size_t i = 0; i < values->length; ++i) {
+        const CssValue* value = values->data[i];
+        if ( NULL == slots[Color] && is_color(value) ) {
+            add_copy(parser, &slots[Color], value);
+        } else if ( NULL == slots[Image] && (is_image(value) || is_keyword(value, CssValueNone)) ) {
+            add_copy(parser, &slots[Image], value);
+        } else if ( NULL == slots[Repeat] && (is_keyword(value, CssValueRepeatX) || is_keyword(value, CssValueRepeatY)) ) {
+            add_copy(parser, &slots[Repeat], value);
+        } else if ( NULL == slots[Repeat] && is_repeat(value) ) {
+            add_copy(parser, &slots[Repeat], value);
+            if ( i + 1 < values->length && is_repeat(values->data[i + 1]) )
+                add_copy(parser, &slots[Repeat], values->data[++i]);
+        } else if ( NULL == slots[Attachment] && is_attachment(value) ) {
+            add_copy(parser, &slots[Attachment], value);
+        } else if ( NULL == slots[Position] && is_position(value) ) {
+            for (size_t n = 0; n < 4 && i < values->length && is_position(values->data[i]); ++n)
+                add_copy(parser, &slots[Position], values->data[i++]);
+            if ( i < values->length && is_operator(values->data[i], '/') ) {
+                if ( ++i == values->length )
+                    return false;
+                if ( is_keyword(values->data[i], CssValueCover) || is_keyword(values->data[i], CssValueContain) ) {
+                    add_copy(parser, &slots[Size], values->data[i++]);
+                } else {
+                    for (size_t n = 0; n < 2 && i < values->length &&
+                         (is_length_percentage(values->data[i]) || is_keyword(values->data[i], CssValueAuto)); ++n)
+                        add_copy(parser, &slots[Size], values->data[i++]);
+                    if ( NULL == slots[Size] )
+                        return false;
+                }
+            }
+            i--;
+        } else if ( NULL == slots[Clip] && is_box(value) ) {
+            add_copy(parser, NULL == slots[Origin] ? &slots[Origin] : &slots[Clip], value);
+            if ( NULL == slots[Clip] && (i + 1 == values->length || !is_box(values->data[i + 1])) )
+                add_copy(parser, &slots[Clip], value);
+        } else {
+            // Several layers, or what is not a component
+            return false;
+        }
+    }
+    return true;
+}
+
+static const CssShorthand kShorthands[] = {
+    { CssPropertyBackground,
+      { CssPropertyBackgroundColor, CssPropertyBackgroundImage, CssPropertyBackgroundRepeat,
+        CssPropertyBackgroundAttachment, CssPropertyBackgroundPosition, CssPropertyBackgroundSize,
+        CssPropertyBackgroundOrigin, CssPropertyBackgroundClip }, 8, expand_background, { NULL } },
+    { CssPropertyBorder,
+      { CssPropertyBorderTopWidth, CssPropertyBorderTopStyle, CssPropertyBorderTopColor,
+        CssPropertyBorderRightWidth, CssPropertyBorderRightStyle, CssPropertyBorderRightColor,
+        CssPropertyBorderBottomWidth, CssPropertyBorderBottomStyle, CssPropertyBorderBottomColor,
+        CssPropertyBorderLeftWidth, CssPropertyBorderLeftStyle, CssPropertyBorderLeftColor }, 12, expand_border, { NULL } },
+    { CssPropertyBorderBottom,
+      { CssPropertyBorderBottomWidth, CssPropertyBorderBottomStyle, CssPropertyBorderBottomColor }, 3,
+      expand_any_order, { is_line_width, is_line_style, is_color } },
+    { CssPropertyBorderColor,
+      { CssPropertyBorderTopColor, CssPropertyBorderRightColor, CssPropertyBorderBottomColor,
+        CssPropertyBorderLeftColor }, 4, expand_box, { is_color } },
+    { CssPropertyBorderLeft,
+      { CssPropertyBorderLeftWidth, CssPropertyBorderLeftStyle, CssPropertyBorderLeftColor }, 3,
+      expand_any_order, { is_line_width, is_line_style, is_color } },
+    { CssPropertyBorderRadius,
+      { CssPropertyBorderTopLeftRadius, CssPropertyBorderTopRightRadius, CssPropertyBorderBottomRightRadius,
+        CssPropertyBorderBottomLeftRadius }, 4, expand_box, { is_length_percentage } },
+    { CssPropertyBorderRight,
+      { CssPropertyBorderRightWidth, CssPropertyBorderRightStyle, CssPropertyBorderRightColor }, 3,
+      expand_any_order, { is_line_width, is_line_style, is_color } },
+    { CssPropertyBorderStyle,
+      { CssPropertyBorderTopStyle, CssPropertyBorderRightStyle, CssPropertyBorderBottomStyle,
+        CssPropertyBorderLeftStyle }, 4, expand_box, { is_line_style } },
+    { CssPropertyBorderTop,
+      { CssPropertyBorderTopWidth, CssPropertyBorderTopStyle, CssPropertyBorderTopColor }, 3,
+      expand_any_order, { is_line_width, is_line_style, is_color } },
+    { CssPropertyBorderWidth,
+      { CssPropertyBorderTopWidth, CssPropertyBorderRightWidth, CssPropertyBorderBottomWidth,
+        CssPropertyBorderLeftWidth }, 4, expand_box, { is_line_width } },
+    { CssPropertyColumnRule,
+      { CssPropertyColumnRuleWidth, CssPropertyColumnRuleStyle, CssPropertyColumnRuleColor }, 3,
+      expand_any_order, { is_line_width, is_line_style, is_color } },
+    { CssPropertyColumns,
+      { CssPropertyColumnWidth, CssPropertyColumnCount }, 2, expand_any_order,
+      { is_column_width, is_column_count } },
+    { CssPropertyFlex,
+      { CssPropertyFlexGrow, CssPropertyFlexShrink, CssPropertyFlexBasis }, 3, expand_flex, { NULL } },
+    { CssPropertyFlexFlow,
+      { CssPropertyFlexDirection, CssPropertyFlexWrap }, 2, expand_any_order,
+      { is_flex_direction, is_flex_wrap } },
+    { CssPropertyFont,
+      { CssPropertyFontStyle, CssPropertyFontVariant, CssPropertyFontWeight, CssPropertyFontStretch,
+        CssPropertyFontSize, CssPropertyLineHeight, CssPropertyFontFamily }, 7, expand_font, { NULL } },
+    { CssPropertyGap,
+      { CssPropertyRowGap, CssPropertyColumnGap }, 2, expand_pair, { is_gap } },
+    { CssPropertyListStyle,
+      { CssPropertyListStyleType, CssPropertyListStylePosition, CssPropertyListStyleImage }, 3,
+      expand_list_style, { NULL } },
+    { CssPropertyMargin,
+      { CssPropertyMarginTop, CssPropertyMarginRight, CssPropertyMarginBottom, CssPropertyMarginLeft }, 4,
+      expand_box, { is_margin } },
+    { CssPropertyOutline,
+      { CssPropertyOutlineWidth, CssPropertyOutlineStyle, CssPropertyOutlineColor }, 3,
+      expand_any_order, { is_line_width, is_line_style, is_color } },
+    { CssPropertyOverflow,
+      { CssPropertyOverflowX, CssPropertyOverflowY }, 2, expand_pair, { is_overflow } },
+    { CssPropertyPadding,
+      { CssPropertyPaddingTop, CssPropertyPaddingRight, CssPropertyPaddingBottom, CssPropertyPaddingLeft }, 4,
+      expand_box, { is_length_percentage } },
+    { CssPropertyTextDecoration,
+      { CssPropertyTextDecorationLine, CssPropertyTextDecorationStyle, CssPropertyTextDecorationColor }, 3,
+      expand_text_decoration, { NULL } },
+};
+
+static const CssShorthand* find_shorthand(CssPropertyID id)
+{
+    size_t low = 0, high = sizeof(kShorthands) / sizeof(kShorthands[0]);
+    while ( low < high ) {
+        size_t middle = low + (high - low) / 2;
+        if ( kShorthands[middle].id == id )
+            return &kShorthands[middle];
+        if ( kShorthands[middle].id < id )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return NULL;
+}
+
+bool cssprsr_expand_shorthand(CssParser* parser, const CssDeclaration* declaration, CssArray* declarations)
+{
+    // Prefixed shorthands expand to prefixed longhands that may not exist
+    if ( CssVendorNone != declaration->vendor || NULL == declaration->values || 0 == declaration->values->length )
+        return false;
+    const CssShorthand* shorthand = find_shorthand(declaration->id);
+    if ( NULL == shorthand || cssprsr_values_have_var(declaration->values) )
+        return false;
+
+    const CssArray* values = declaration->values;
+    CssArray* slots[CSSPRSR_SHORTHAND_MAX_LONGHANDS] = { NULL };
+    bool expanded = true;
+    if ( 1 == values->length && is_css_wide_keyword(values->data[0]) ) {
+        for (size_t i = 0; i < shorthand->count; ++i)
+            add_copy(parser, &slots[i], values->data[0]);
+    } else {
+        expanded = shorthand->expand(parser, shorthand, values, slots);
+    }
+    for (size_t i = 0; i < shorthand->count; ++i) {
+        if ( !expanded ) {
+            if ( slots[i] ) {
+                for (size_t j = 0; j < slots[i]->length; ++j)
+                    cssprsr_destroy_value(parser, slots[i]->data[j]);
+                cssprsr_array_destroy(parser, slots[i]);
+                cssprsr_parser_free(parser, slots[i]);
+            }
+            continue;
+        }
+        if ( NULL == slots[i] )
+            add_value(parser, &slots[i], new_keyword(parser, CssValueInitial));
+        CssDeclaration* longhand = cssprsr_new_longhand_declaration(parser, declaration, shorthand->longhands[i],
+                                                                    slots[i]);
+        cssprsr_array_add(parser, longhand, declarations);
+    }
+    return expanded;
+}
@@ -19,6 +19,7 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  ******************************************************************************/
+#include "charset.h"
 #include "cssparser_i.h"
 
 #undef	assert
@@ -27,6 +28,9 @@
 static inline double cssprsr_characters_to_double(const char* data, size_t length, bool* ok);
 static inline bool cssprsr_is_html_space(char c);
 static inline char* cssprsr_normalize_text(yy_size_t* length, char *origin_text, yy_size_t origin_length, int tok);
+static char* cssprsr_unescape_text(CssParser* parser, char* text, yy_size_t* length);
+static inline int cssprsr_to_ascii_hex_value(char c);
+static inline bool cssprsr_is_ascii_hex_digit(char c);
 
 #ifdef CSSPRSR_RFELX_DEBUG
 #if CSSPRSR_RFELX_DEBUG
@@ -89,6 +93,9 @@ int cssprsr_tokenize(CSSPARSERSTYPE* lval , CSSPARSERLTYPE* loc, yyscan_t scanne
         case CSSPRSR_RCSS_HOSTCONTEXTFUNCTION:
         case CSSPRSR_RCSS_UNICODERANGE:
         {
+            // Escapes are rare, only tokens holding a backslash are decoded.
+            if ( memchr(text, '\\', length) )
+                text = cssprsr_unescape_text(parser, text, &length);
             lval->string.data = text;
             lval->string.length = length;
         }
@@ -116,11 +123,16 @@ int cssprsr_tokenize(CSSPARSERSTYPE* lval , CSSPARSERLTYPE* loc, yyscan_t scanne
             length--;
         case CSSPRSR_RCSS_GRADS:
         case CSSPRSR_RCSS_TURNS:
+        case CSSPRSR_RCSS_VMIN:
+        case CSSPRSR_RCSS_VMAX:
+        case CSSPRSR_RCSS_DPPX:
+        case CSSPRSR_RCSS_DPCM:
             length--;
         case CSSPRSR_RCSS_DEGS:
         case CSSPRSR_RCSS_RADS:
         case CSSPRSR_RCSS_KHERTZ:
         case CSSPRSR_RCSS_REMS:
+        case CSSPRSR_RCSS_DPI:
             length--;
         case CSSPRSR_RCSS_MSECS:
         case CSSPRSR_RCSS_HERTZ:
@@ -132,6 +144,10 @@ int cssprsr_tokenize(CSSPARSERSTYPE* lval , CSSPARSERLTYPE* loc, yyscan_t scanne
         case CSSPRSR_RCSS_INS:
         case CSSPRSR_RCSS_PTS:
         case CSSPRSR_RCSS_PCS:
+        case CSSPRSR_RCSS_CHS:
+        case CSSPRSR_RCSS_VW:
+        case CSSPRSR_RCSS_VH:
+        case CSSPRSR_RCSS_FR:
             length--;
         case CSSPRSR_RCSS_SECS:
         case CSSPRSR_RCSS_PERCENTAGE:
@@ -154,6 +170,233 @@ int cssprsr_tokenize(CSSPARSERSTYPE* lval , CSSPARSERLTYPE* loc, yyscan_t scanne
     return tok;
 }
 
+// Whether a custom property name like `--main-color` starts at `offset`,
+// the scanner splits it into `-` and the ident `-main-color`.
+static bool cssprsr_starts_custom_name(const CssParser* parser, unsigned int offset)
+{
+    if ( offset + 1 >= parser->source_length || '-' != parser->source[offset] )
+        return false;
+    unsigned char c = (unsigned char)parser->source[offset + 1];
+    return isalpha(c) || '_' == c || '\\' == c || c >= 0x80;
+}
+
+static bool cssprsr_is_function_token(int tok)
+{
+    switch ( tok ) {
+        case CSSPRSR_RCSS_FUNCTION:
+        case CSSPRSR_RCSS_ANYFUNCTION:
+        case CSSPRSR_RCSS_CUEFUNCTION:
+        case CSSPRSR_RCSS_NOTFUNCTION:
+        case CSSPRSR_RCSS_CALCFUNCTION:
+        case CSSPRSR_RCSS_MINFUNCTION:
+        case CSSPRSR_RCSS_MAXFUNCTION:
+        case CSSPRSR_RCSS_HOSTFUNCTION:
+        case CSSPRSR_RCSS_HOSTCONTEXTFUNCTION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether the function is one of the two taking `An+B of S`.
+static bool cssprsr_is_nth_child_function(const CssParserString* name)
+{
+    return (10 == name->length && 0 == strncasecmp(name->data, "nth-child(", 10))
+        || (15 == name->length && 0 == strncasecmp(name->data, "nth-last-child(", 15));
+}
+
+static bool cssprsr_is_name_char(unsigned char c)
+{
+    return isalnum(c) || '-' == c || '_' == c || '\\' == c || c >= 0x80;
+}
+
+// Index of the last character of the escape, string or comment starting at
+// `i`, `i` itself for any other character.
+static size_t cssprsr_skip_text(const char* source, size_t length, size_t i)
+{
+    char c = source[i];
+    if ( '\\' == c )
+        return i + 1;
+    if ( '"' == c || '\'' == c ) {
+        for (i++; i < length && c != source[i]; ++i) {
+            if ( '\\' == source[i] )
+                i++;
+        }
+        return i;
+    }
+    if ( '/' == c && i + 1 < length && '*' == source[i + 1] ) {
+        for (i += 2; i + 1 < length && !('*' == source[i] && '/' == source[i + 1]); ++i)
+            ;
+        return i + 1;
+    }
+    return i;
+}
+
+// Whether the function argument starting at `offset` has the word `of` at
+// its top level, and where the `)` closing it is. Strings, comments and
+// nested blocks are skipped, the end of a rule stops the search.
+static bool cssprsr_find_nth_selectors(const CssParser* parser, unsigned int offset, unsigned int* close)
+{
+    const char* source = parser->source;
+    size_t length = parser->source_length;
+    unsigned int depth = 0;
+    bool of = false;
+    for (size_t i = offset; i < length; i = cssprsr_skip_text(source, length, i) + 1) {
+        char c = source[i];
+        switch ( c ) {
+            case '(':
+            case '[':
+                depth++;
+                break;
+            case ')':
+            case ']':
+                if ( 0 == depth ) {
+                    *close = (unsigned int)i;
+                    return of && ')' == c;
+                }
+                depth--;
+                break;
+            case '{':
+            case '}':
+            case ';':
+                return false;
+            case 'o':
+            case 'O':
+                if ( 0 == depth && i > offset && cssprsr_is_html_space(source[i - 1])
+                     && i + 1 < length && 'f' == tolower((unsigned char)source[i + 1])
+                     && (i + 2 == length || !cssprsr_is_name_char((unsigned char)source[i + 2])) )
+                    of = true;
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+// Whether the text from `offset` is the rest of a selector: the scanner
+// sees `b:nth-child(` in declarations too, but only a selector goes on with
+// a `{` before the end of its declaration.
+static bool cssprsr_in_selector(const CssParser* parser, unsigned int offset)
+{
+    switch ( parser->output->mode ) {
+        case CssParserModeSelector:
+            return true;
+        case CssParserModeStylesheet:
+        case CssParserModeRule:
+            break;
+        default:
+            return false;
+    }
+    const char* source = parser->source;
+    size_t length = parser->source_length;
+    for (size_t i = offset; i < length; i = cssprsr_skip_text(source, length, i) + 1) {
+        if ( '{' == source[i] )
+            return true;
+        if ( '}' == source[i] || ';' == source[i] )
+            return false;
+    }
+    return false;
+}
+
+// Next scanner token, dropping the ones a pending token stands for.
+static int cssprsr_lex_unskipped(CSSPARSERSTYPE* lval, CSSPARSERLTYPE* loc, yyscan_t scanner, CssParser* parser)
+{
+    int tok = cssprsr_lex(lval, loc, scanner, parser);
+    while ( tok && loc->first_offset < parser->skip_until )
+        tok = cssprsr_lex(lval, loc, scanner, parser);
+    return tok;
+}
+
+// Joins the two tokens of a custom property name into one ident, or one
+// function when followed by `(`.
+static int cssprsr_next_joined_token(CSSPARSERSTYPE* lval, CSSPARSERLTYPE* loc, yyscan_t scanner, CssParser* parser)
+{
+    if ( parser->has_pending_token ) {
+        parser->has_pending_token = false;
+        *lval = parser->pending_lval;
+        *loc = parser->pending_loc;
+        return parser->pending_token;
+    }
+    int tok = cssprsr_lex_unskipped(lval, loc, scanner, parser);
+    if ( '-' != tok || !cssprsr_starts_custom_name(parser, loc->last_offset) )
+        return tok;
+    CSSPARSERSTYPE minus_lval = *lval;
+    CSSPARSERLTYPE minus_loc = *loc;
+    // The scanner reads a copy of the input, the `-` is in that buffer
+    const char* minus_text = cssprsr_get_text(scanner);
+    tok = cssprsr_lex_unskipped(lval, loc, scanner, parser);
+    if ( loc->first_offset != minus_loc.first_offset + 1 ||
+         (CSSPRSR_RCSS_IDENT != tok && !cssprsr_is_function_token(tok)) ) {
+        // Not a name after all, the `-` goes first
+        parser->has_pending_token = true;
+        parser->pending_token = tok;
+        parser->pending_lval = *lval;
+        parser->pending_loc = *loc;
+        *lval = minus_lval;
+        *loc = minus_loc;
+        return '-';
+    }
+    if ( lval->string.data == minus_text + 1 ) {
+        // Without escapes the name is the scanner's text, the first `-` is
+        // still right before it
+        lval->string.data--;
+    } else {
+        char* name = cssprsr_parser_alloc(parser, lval->string.length + 1);
+        name[0] = '-';
+        memcpy(name + 1, lval->string.data, lval->string.length);
+        if ( NULL == parser->unescaped_texts )
+            parser->unescaped_texts = cssprsr_new_array(parser);
+        cssprsr_array_add(parser, name, parser->unescaped_texts);
+        lval->string.data = name;
+    }
+    lval->string.length++;
+    loc->first_offset = minus_loc.first_offset;
+    // `--webkit-calc(` is not calc()
+    return cssprsr_is_function_token(tok) ? CSSPRSR_RCSS_FUNCTION : tok;
+}
+
+/**
+ *  Next token for bison. The two tokens of a custom property name become
+ *  one ident, or one function when followed by `(`. The argument of
+ *  `:nth-child(An+B of S)` becomes one NTH token, the scanner having none
+ *  for it, and the selectors of S are parsed with the pseudo-class, see
+ *  cssprsr_selector_set_nth_argument().
+ *
+ *  @param lval    the medium for flex and bison
+ *  @param loc     location of the token
+ *  @param scanner flex state
+ *  @param parser  the parser
+ *
+ *  @return the type of token
+ */
+int cssprsr_next_token(CSSPARSERSTYPE* lval, CSSPARSERLTYPE* loc, yyscan_t scanner, CssParser* parser)
+{
+    parser->token_count++;
+    int tok = cssprsr_next_joined_token(lval, loc, scanner, parser);
+    unsigned int close = 0;
+    if ( CSSPRSR_RCSS_FUNCTION == tok && ':' == parser->last_token && cssprsr_is_nth_child_function(&lval->string)
+         && cssprsr_find_nth_selectors(parser, loc->last_offset, &close)
+         && cssprsr_in_selector(parser, close + 1) ) {
+        unsigned int first = loc->last_offset;
+        unsigned int last = close;
+        while ( first < last && cssprsr_is_html_space(parser->source[first]) )
+            first++;
+        while ( last > first && cssprsr_is_html_space(parser->source[last - 1]) )
+            last--;
+        parser->has_pending_token = true;
+        parser->pending_token = CSSPRSR_RCSS_NTH;
+        parser->pending_lval.string.data = (char*)parser->source + first;
+        parser->pending_lval.string.length = last - first;
+        parser->pending_loc.first_offset = first;
+        parser->pending_loc.last_offset = last;
+        // The scanner goes on at the `)`
+        parser->skip_until = close;
+    }
+    parser->last_token = tok;
+    return tok;
+}
+
 /**
  *  Format token
  *
@@ -204,6 +447,101 @@ static inline char* cssprsr_normalize_text(yy_size_t* length, char *origin_text,
     return start;
 }
 
+/**
+ *  Decodes the escapes of a token
+ *
+ *  Refs: https://www.w3.org/TR/css-syntax-3/#consume-escaped-code-point
+ *
+ *  @param text      token text
+ *  @param length    length of the token text
+ *  @param output    receives the decoded text, NULL to only measure it
+ *  @param in_place  set to false when the output would overtake the input
+ *
+ *  @return length of the decoded text
+ */
+static yy_size_t cssprsr_decode_escapes(const char* text, yy_size_t length, char* output, bool* in_place)
+{
+    yy_size_t i = 0, o = 0;
+    while ( i < length ) {
+        if ( text[i] != '\\' ) {
+            if ( output )
+                output[o] = text[i];
+            i++;
+            o++;
+            continue;
+        }
+        i++;
+        if ( i == length )
+            break;
+        if ( text[i] == '\n' || text[i] == '\f' ) {
+            // An escaped newline continues a string.
+            i++;
+            continue;
+        }
+        if ( text[i] == '\r' ) {
+            i++;
+            if ( i < length && text[i] == '\n' )
+                i++;
+            continue;
+        }
+        if ( !cssprsr_is_ascii_hex_digit(text[i]) ) {
+            if ( output )
+                output[o] = text[i];
+            i++;
+            o++;
+            continue;
+        }
+        unsigned int c = 0;
+        for (int n = 0; n < 6 && i < length && cssprsr_is_ascii_hex_digit(text[i]); ++n, ++i)
+            c = (c << 4) | cssprsr_to_ascii_hex_value(text[i]);
+        // A single whitespace terminates the escape, CRLF counts as one.
+        if ( i + 1 < length && text[i] == '\r' && text[i + 1] == '\n' )
+            i += 2;
+        else if ( i < length && cssprsr_is_html_space(text[i]) )
+            i++;
+        if ( c == 0 || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF )
+            c = CSSPRSR_REPLACEMENT_CHARACTER;
+        char bytes[4];
+        size_t n = cssprsr_utf8_encode(c, bytes);
+        if ( output )
+            memcpy(output + o, bytes, n);
+        o += n;
+        // Only `\0` grows, into a 3 bytes U+FFFD.
+        if ( o > i )
+            *in_place = false;
+    }
+    return o;
+}
+
+/**
+ *  Replaces the escapes of a token by the characters they stand for
+ *
+ *  The text is decoded in the scanner buffer, which the grammar copies from
+ *  anyway. The rare texts growing while decoded go to a buffer owned by the
+ *  parser instead.
+ *
+ *  @param parser
+ *  @param text     token text, in the scanner buffer
+ *  @param length   length of the token text, updated
+ *
+ *  @return the decoded text
+ */
+static char* cssprsr_unescape_text(CssParser* parser, char* text, yy_size_t* length)
+{
+    bool in_place = true;
+    yy_size_t decoded_length = cssprsr_decode_escapes(text, *length, NULL, &in_place);
+    char* output = text;
+    if ( !in_place ) {
+        output = cssprsr_parser_alloc(parser, decoded_length);
+        if ( NULL == parser->unescaped_texts )
+            parser->unescaped_texts = cssprsr_new_array(parser);
+        cssprsr_array_add(parser, output, parser->unescaped_texts);
+    }
+    cssprsr_decode_escapes(text, *length, output, &in_place);
+    *length = decoded_length;
+    return output;
+}
+
 double cssprsr_characters_to_double(const char* data, size_t length, bool* ok)
 {
     if (!length) {
@@ -287,13 +625,13 @@ inline bool cssprsr_is_html_space(char c)
     return c <= ' ' && (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f');
 }
 
-//inline int cssprsr_to_ascii_hex_value(char c)
-//{
-//    //    ASSERT(isASCIIHexDigit(c));
-//    return c < 'A' ? c - '0' : (c - 'A' + 10) & 0xF;
-//}
+inline int cssprsr_to_ascii_hex_value(char c)
+{
+    assert(cssprsr_is_ascii_hex_digit(c));
+    return c < 'A' ? c - '0' : (c - 'A' + 10) & 0xF;
+}
 
-//inline bool cssprsr_is_ascii_hex_digit(char c)
-//{
-//    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
-//}
+inline bool cssprsr_is_ascii_hex_digit(char c)
+{
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
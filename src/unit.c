@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+// Unit conversion.
+//
+// Every unit converts to the canonical unit of its kind by a factor: px for
+// lengths, deg for angles, ms for times, Hz for frequencies and dppx for
+// resolutions. Absolute units have fixed factors, font and viewport
+// relative units and percentages take theirs from a CssUnitContext. The
+// factors of a context are computed once into a table indexed by unit, so
+// converting values is a multiplication by a table entry, without a switch
+// per value.
+
+#define CSSPRSR_UNIT_PX_PER_IN 96.0
+#define CSSPRSR_UNIT_PI 3.14159265358979323846
+
+double cssprsr_unit_absolute_scale(CssValueUnit unit)
+{
+    switch ( unit ) {
+    case CSS_VALUE_PX:   return 1;
+    case CSS_VALUE_CM:   return CSSPRSR_UNIT_PX_PER_IN / 2.54;
+    case CSS_VALUE_MM:   return CSSPRSR_UNIT_PX_PER_IN / 25.4;
+    case CSS_VALUE_IN:   return CSSPRSR_UNIT_PX_PER_IN;
+    case CSS_VALUE_PT:   return CSSPRSR_UNIT_PX_PER_IN / 72;
+    case CSS_VALUE_PC:   return CSSPRSR_UNIT_PX_PER_IN / 6;
+    case CSS_VALUE_DEG:  return 1;
+    case CSS_VALUE_RAD:  return 180 / CSSPRSR_UNIT_PI;
+    case CSS_VALUE_GRAD: return 0.9;
+    case CSS_VALUE_TURN: return 360;
+    case CSS_VALUE_MS:   return 1;
+    case CSS_VALUE_S:    return 1000;
+    case CSS_VALUE_HZ:   return 1;
+    case CSS_VALUE_KHZ:  return 1000;
+    case CSS_VALUE_DPPX: return 1;
+    case CSS_VALUE_DPI:  return 1 / CSSPRSR_UNIT_PX_PER_IN;
+    case CSS_VALUE_DPCM: return 2.54 / CSSPRSR_UNIT_PX_PER_IN;
+    default:             return 0;
+    }
+}
+
+double cssprsr_unit_scale(CssValueUnit unit, const CssUnitContext* context)
+{
+    double width = context->viewport_width, height = context->viewport_height;
+    switch ( unit ) {
+    case CSS_VALUE_NUMBER:
+        return 1;
+    case CSS_VALUE_PERCENTAGE:
+        return context->percentage_basis / 100;
+    case CSS_VALUE_EMS:
+    case CSS_VALUE_PARSER_Q_EMS:
+        return context->font_size;
+    case CSS_VALUE_EXS:
+    case CSS_VALUE_CHS:
+        // Without font metrics both are taken as half an em
+        return context->font_size / 2;
+    case CSS_VALUE_REMS:
+        return context->root_font_size;
+    case CSS_VALUE_VW:
+        return width / 100;
+    case CSS_VALUE_VH:
+        return height / 100;
+    case CSS_VALUE_VMIN:
+        return (width < height ? width : height) / 100;
+    case CSS_VALUE_VMAX:
+        return (width > height ? width : height) / 100;
+    default:
+        return cssprsr_unit_absolute_scale(unit);
+    }
+}
+
+CssUnitKind css_unit_kind(CssValueUnit unit)
+{
+    switch ( unit ) {
+    case CSS_VALUE_NUMBER:
+        return CssUnitNumber;
+    case CSS_VALUE_PERCENTAGE:
+        return CssUnitPercent;
+    case CSS_VALUE_PX:
+    case CSS_VALUE_CM:
+    case CSS_VALUE_MM:
+    case CSS_VALUE_IN:
+    case CSS_VALUE_PT:
+    case CSS_VALUE_PC:
+    case CSS_VALUE_EMS:
+    case CSS_VALUE_PARSER_Q_EMS:
+    case CSS_VALUE_EXS:
+    case CSS_VALUE_REMS:
+    case CSS_VALUE_CHS:
+    case CSS_VALUE_VW:
+    case CSS_VALUE_VH:
+    case CSS_VALUE_VMIN:
+    case CSS_VALUE_VMAX:
+        return CssUnitLength;
+    case CSS_VALUE_DEG:
+    case CSS_VALUE_RAD:
+    case CSS_VALUE_GRAD:
+    case CSS_VALUE_TURN:
+        return CssUnitAngle;
+    case CSS_VALUE_MS:
+    case CSS_VALUE_S:
+        return CssUnitTime;
+    case CSS_VALUE_HZ:
+    case CSS_VALUE_KHZ:
+        return CssUnitFrequency;
+    case CSS_VALUE_DPPX:
+    case CSS_VALUE_DPI:
+    case CSS_VALUE_DPCM:
+        return CssUnitResolution;
+    default:
+        return CssUnitNone;
+    }
+}
+
+void css_unit_scales_init(CssUnitScales* scales, const CssUnitContext* context)
+{
+    scales->context = *context;
+    for (size_t unit = 0; unit < CSS_UNIT_SCALES_SIZE; ++unit) {
+        scales->factors[unit] = CssUnitNone == css_unit_kind((CssValueUnit) unit) ?
+                                0 : cssprsr_unit_scale((CssValueUnit) unit, context);
+    }
+}
+
+// The table stops at the last unit below the parser-only ones, `__qem` is
+// folded onto em.
+static inline size_t scale_index(CssValueUnit unit)
+{
+    if ( (size_t) unit < CSS_UNIT_SCALES_SIZE )
+        return unit;
+    return CSS_VALUE_PARSER_Q_EMS == unit ? CSS_VALUE_EMS : CSS_VALUE_UNKNOWN;
+}
+
+void css_numbers_to_canonical(const double* numbers, const CssValueUnit* units, size_t count,
+                              const CssUnitScales* scales, double* out)
+{
+    const double* factors = scales->factors;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = numbers[i] * factors[scale_index(units[i])];
+    }
+}
+
+static bool value_to_canonical(const CssValue* value, const CssUnitScales* scales, double* out)
+{
+    if ( CSS_VALUE_CALC == value->unit ) {
+        *out = css_calc_evaluate(value->calc, &scales->context);
+        return true;
+    }
+    double factor = scales->factors[scale_index(value->unit)];
+    // Units that are not numeric have no factor, numeric ones only get a
+    // zero one from the context, like a zero font size
+    if ( 0 == factor && CssUnitNone == css_unit_kind(value->unit) ) {
+        *out = 0;
+        return false;
+    }
+    *out = value->fValue * factor;
+    return true;
+}
+
+size_t css_values_to_canonical(const CssArray* values, const CssUnitScales* scales, double* out)
+{
+    size_t converted = 0;
+    for (size_t i = 0; i < values->length; ++i) {
+        if ( value_to_canonical(values->data[i], scales, &out[i]) )
+            converted++;
+    }
+    return converted;
+}
+
+size_t css_declarations_to_canonical(const CssArray* declarations, const CssUnitScales* scales, double* out)
+{
+    size_t written = 0;
+    for (size_t i = 0; i < declarations->length; ++i) {
+        const CssDeclaration* declaration = declarations->data[i];
+        if ( NULL == declaration->values )
+            continue;
+        css_values_to_canonical(declaration->values, scales, out + written);
+        written += declaration->values->length;
+    }
+    return written;
+}
@@ -0,0 +1,590 @@
+/*******************************************************************************
+ * Copyright (c) 2015 QFish <im@qfi.sh>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+#include "cssparser_i.h"
+
+#include <stdint.h>
+
+// Custom properties.
+//
+// The parser keeps the value of custom properties, and of declarations
+// referring to them, as written. Each such value is split once into a
+// template: literal spans of the text and `var()` references with their
+// fallbacks, so that substituting is a matter of appending strings.
+//
+// The custom properties of an element only depend on those of its parent
+// and on its cascaded style, so they are computed once per pair and shared
+// by every element with the same pair. They are resolved when computed,
+// following references through the element first, then its ancestors. A
+// property met again while it is being resolved closes a cycle, and every
+// property of the cycle becomes invalid. Substituted declarations are
+// remembered per set of custom properties as well.
+
+typedef struct CssVarTemplate CssVarTemplate;
+
+typedef struct {
+    // Literal text, or the name of a reference
+    const char* text;
+    size_t length;
+    bool reference;
+    // What a reference stands for when the property is invalid, NULL
+    // without a fallback
+    CssVarTemplate* fallback;
+} CssVarSegment;
+
+struct CssVarTemplate {
+    CssVarSegment* segments;
+    unsigned int length;
+};
+
+typedef struct {
+    const void* first;
+    const void* second;
+    void* value;
+} CssVarSlot;
+
+// Open addressing over pointer pairs, the capacity is 0 or a power of two.
+typedef struct {
+    CssVarSlot* slots;
+    unsigned int capacity;
+    unsigned int length;
+} CssVarMap;
+
+typedef enum {
+    CssCustomPropertyUnresolved,
+    CssCustomPropertyResolving,
+    CssCustomPropertyResolved,
+} CssCustomPropertyState;
+
+typedef struct {
+    const CssDeclaration* declaration;
+    // Substituted value, NULL when invalid
+    const char* value;
+    CssCustomPropertyState state;
+    bool cyclic;
+} CssCustomProperty;
+
+struct CssInternalCustomProperties {
+    const CssCustomProperties* parent;
+    // Declared on the element, by name
+    CssCustomProperty* properties;
+    unsigned int length;
+    // Substituted values by declaration
+    CssVarMap substitutions;
+};
+
+struct CssInternalVariableResolver {
+    // Templates by declaration
+    CssVarMap templates;
+    // Custom properties by style and parent
+    CssVarMap sets;
+    // Stands for the elements without custom properties
+    CssCustomProperties root;
+    // Properties being resolved, innermost last
+    CssArray stack;
+};
+
+bool cssprsr_values_have_var(const CssArray* values)
+{
+    for (size_t i = 0; values && i < values->length; ++i) {
+        const CssValue* value = values->data[i];
+        if ( CSS_VALUE_PARSER_LIST == value->unit && cssprsr_values_have_var(value->list) )
+            return true;
+        if ( CSS_VALUE_PARSER_FUNCTION == value->unit &&
+             (0 == strcasecmp(value->function->name, "var(") || cssprsr_values_have_var(value->function->args)) )
+            return true;
+    }
+    return false;
+}
+
+static unsigned int pointer_hash(const void* first, const void* second)
+{
+    uint64_t key = (uint64_t)(uintptr_t)first * 0x9E3779B97F4A7C15ull ^ (uint64_t)(uintptr_t)second;
+    key ^= key >> 29;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 32;
+    return (unsigned int)key;
+}
+
+static CssVarSlot* map_find(const CssVarMap* map, const void* first, const void* second)
+{
+    unsigned int mask = map->capacity - 1;
+    for (unsigned int i = pointer_hash(first, second) & mask; ; i = (i + 1) & mask) {
+        CssVarSlot* slot = &map->slots[i];
+        if ( NULL == slot->first || (slot->first == first && slot->second == second) )
+            return slot;
+    }
+}
+
+// Makes room for one more entry, keeping the load factor under 1/2.
+static void map_reserve(CssParser* parser, CssVarMap* map)
+{
+    unsigned int capacity = map->capacity ? map->capacity : 16;
+    while ( (map->length + 1) * 2 > capacity )
+        capacity *= 2;
+    if ( capacity == map->capacity )
+        return;
+    CssVarSlot* slots = map->slots;
+    unsigned int old_capacity = map->capacity;
+    map->slots = cssprsr_parser_alloc(parser, sizeof(CssVarSlot) * capacity);
+    memset(map->slots, 0, sizeof(CssVarSlot) * capacity);
+    map->capacity = capacity;
+    for (unsigned int i = 0; i < old_capacity; ++i) {
+        if ( slots[i].first )
+            *map_find(map, slots[i].first, slots[i].second) = slots[i];
+    }
+    if ( slots )
+        cssprsr_parser_free(parser, slots);
+}
+
+static void map_insert(CssVarMap* map, CssVarSlot* slot, const void* first, const void* second, void* value)
+{
+    slot->first = first;
+    slot->second = second;
+    slot->value = value;
+    map->length++;
+}
+
+static void map_clear(CssParser* parser, CssVarMap* map, void (*deallocator)(CssParser*, void*))
+{
+    for (unsigned int i = 0; i < map->capacity; ++i) {
+        if ( map->slots[i].first && map->slots[i].value )
+            deallocator(parser, map->slots[i].value);
+    }
+    if ( map->slots )
+        memset(map->slots, 0, sizeof(CssVarSlot) * map->capacity);
+    map->length = 0;
+}
+
+static void map_destroy(CssParser* parser, CssVarMap* map, void (*deallocator)(CssParser*, void*))
+{
+    map_clear(parser, map, deallocator);
+    if ( map->slots )
+        cssprsr_parser_free(parser, map->slots);
+    map->slots = NULL;
+    map->capacity = 0;
+}
+
+static bool is_name_char(unsigned char c)
+{
+    return c >= 0x80 || isalnum(c) || '-' == c || '_' == c;
+}
+
+// Offset after the string, comment or escape at `i`, `i` when there is none.
+static size_t skip_opaque(const char* text, size_t i, size_t length)
+{
+    if ( '"' == text[i] || '\'' == text[i] ) {
+        char quote = text[i++];
+        while ( i < length && text[i] != quote ) {
+            if ( '\\' == text[i] && i + 1 < length )
+                i++;
+            i++;
+        }
+        return i < length ? i + 1 : length;
+    }
+    if ( '/' == text[i] && i + 1 < length && '*' == text[i + 1] ) {
+        for (i += 2; i + 1 < length; ++i) {
+            if ( '*' == text[i] && '/' == text[i + 1] )
+                return i + 2;
+        }
+        return length;
+    }
+    if ( '\\' == text[i] )
+        return i + 1 < length ? i + 2 : length;
+    return i;
+}
+
+// Offset of the `)` closing the block `i` is in, `length` if unbalanced.
+static size_t find_close(const char* text, size_t i, size_t length)
+{
+    int depth = 0;
+    while ( i < length ) {
+        size_t next = skip_opaque(text, i, length);
+        if ( next != i ) {
+            i = next;
+            continue;
+        }
+        char c = text[i];
+        if ( '(' == c || '[' == c || '{' == c ) {
+            depth++;
+        } else if ( ')' == c || ']' == c || '}' == c ) {
+            if ( 0 == depth )
+                return i;
+            depth--;
+        }
+        i++;
+    }
+    return length;
+}
+
+static bool is_var_function(const char* text, size_t i, size_t length)
+{
+    return i + 4 <= length && 0 == strncasecmp(text + i, "var(", 4) &&
+           (0 == i || !is_name_char((unsigned char)text[i - 1]));
+}
+
+static void add_segment(CssParser* parser, CssVarTemplate* template, const CssVarSegment* segment)
+{
+    // Templates are built once, growing them one segment at a time is fine
+    CssVarSegment* segments = cssprsr_parser_alloc(parser, sizeof(CssVarSegment) * (template->length + 1));
+    if ( template->length ) {
+        memcpy(segments, template->segments, sizeof(CssVarSegment) * template->length);
+        cssprsr_parser_free(parser, template->segments);
+    }
+    segments[template->length++] = *segment;
+    template->segments = segments;
+}
+
+static void add_literal(CssParser* parser, CssVarTemplate* template, const char* text, size_t length)
+{
+    if ( 0 == length )
+        return;
+    CssVarSegment segment = { text, length, false, NULL };
+    add_segment(parser, template, &segment);
+}
+
+static CssVarTemplate* compile_template(CssParser* parser, const char* text, size_t length)
+{
+    CssVarTemplate* template = cssprsr_parser_alloc(parser, sizeof(CssVarTemplate));
+    template->segments = NULL;
+    template->length = 0;
+    size_t literal = 0, i = 0;
+    while ( i < length ) {
+        size_t next = skip_opaque(text, i, length);
+        if ( next != i ) {
+            i = next;
+            continue;
+        }
+        if ( !is_var_function(text, i, length) ) {
+            i++;
+            continue;
+        }
+        size_t j = i + 4;
+        while ( j < length && isspace((unsigned char)text[j]) )
+            j++;
+        size_t name = j;
+        if ( j + 2 < length && '-' == text[j] && '-' == text[j + 1] ) {
+            for (j += 2; j < length; ++j) {
+                if ( '\\' == text[j] && j + 1 < length )
+                    j++;
+                else if ( !is_name_char((unsigned char)text[j]) )
+                    break;
+            }
+        }
+        size_t name_length = j - name;
+        while ( j < length && isspace((unsigned char)text[j]) )
+            j++;
+        size_t close = length;
+        CssVarTemplate* fallback = NULL;
+        if ( name_length > 2 && j < length && ')' == text[j] ) {
+            close = j;
+        } else if ( name_length > 2 && j < length && ',' == text[j] ) {
+            close = find_close(text, j + 1, length);
+            size_t start = j + 1, end = close;
+            while ( start < end && isspace((unsigned char)text[start]) )
+                start++;
+            while ( end > start && isspace((unsigned char)text[end - 1]) )
+                end--;
+            if ( close < length )
+                fallback = compile_template(parser, text + start, end - start);
+        }
+        // Malformed references stay as they are
+        if ( close == length ) {
+            i += 4;
+            continue;
+        }
+        add_literal(parser, template, text + literal, i - literal);
+        char* copy = cssprsr_parser_alloc(parser, name_length + 1);
+        memcpy(copy, text + name, name_length);
+        copy[name_length] = '\0';
+        CssVarSegment segment = { copy, name_length, true, fallback };
+        add_segment(parser, template, &segment);
+        i = literal = close + 1;
+    }
+    add_literal(parser, template, text + literal, length - literal);
+    return template;
+}
+
+static void destroy_template(CssParser* parser, void* data)
+{
+    CssVarTemplate* template = data;
+    for (unsigned int i = 0; i < template->length; ++i) {
+        if ( !template->segments[i].reference )
+            continue;
+        cssprsr_parser_free(parser, (void*)template->segments[i].text);
+        if ( template->segments[i].fallback )
+            destroy_template(parser, template->segments[i].fallback);
+    }
+    if ( template->segments )
+        cssprsr_parser_free(parser, template->segments);
+    cssprsr_parser_free(parser, template);
+}
+
+static const CssVarTemplate* declaration_template(CssParser* parser, CssVariableResolver* resolver,
+                                                  const CssDeclaration* declaration)
+{
+    map_reserve(parser, &resolver->templates);
+    CssVarSlot* slot = map_find(&resolver->templates, declaration, NULL);
+    if ( slot->first )
+        return slot->value;
+    const char* text = declaration->string ? declaration->string : "";
+    CssVarTemplate* template = compile_template(parser, text, strlen(text));
+    map_insert(&resolver->templates, slot, declaration, NULL, template);
+    return template;
+}
+
+static void free_text(CssParser* parser, void* text)
+{
+    cssprsr_parser_free(parser, text);
+}
+
+static void destroy_set(CssParser* parser, void* data)
+{
+    CssCustomProperties* set = data;
+    for (unsigned int i = 0; i < set->length; ++i) {
+        if ( set->properties[i].value )
+            cssprsr_parser_free(parser, (void*)set->properties[i].value);
+    }
+    if ( set->properties )
+        cssprsr_parser_free(parser, set->properties);
+    map_destroy(parser, &set->substitutions, free_text);
+    cssprsr_parser_free(parser, set);
+}
+
+static CssCustomProperty* find_property(const CssCustomProperties* set, const char* name)
+{
+    unsigned int low = 0, high = set->length;
+    while ( low < high ) {
+        unsigned int middle = low + (high - low) / 2;
+        int order = strcmp(set->properties[middle].declaration->property, name);
+        if ( 0 == order )
+            return &set->properties[middle];
+        if ( order < 0 )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return NULL;
+}
+
+static const char* resolve_property(CssParser* parser, CssVariableResolver* resolver,
+                                    CssCustomProperties* set, CssCustomProperty* property);
+
+static const char* lookup(CssParser* parser, CssVariableResolver* resolver, CssCustomProperties* set,
+                          const char* name)
+{
+    CssCustomProperty* property = find_property(set, name);
+    if ( property )
+        return resolve_property(parser, resolver, set, property);
+    return css_custom_properties_get(set->parent, name);
+}
+
+static bool substitute(CssParser* parser, CssVariableResolver* resolver, CssCustomProperties* set,
+                       const CssVarTemplate* template, CssParserString* output)
+{
+    for (unsigned int i = 0; i < template->length; ++i) {
+        const CssVarSegment* segment = &template->segments[i];
+        CssParserString text = { (char*)segment->text, segment->length, segment->length };
+        if ( !segment->reference ) {
+            cssprsr_string_append_string(parser, &text, output);
+            continue;
+        }
+        const char* value = lookup(parser, resolver, set, segment->text);
+        if ( value )
+            cssprsr_string_append_characters(parser, value, output);
+        else if ( NULL == segment->fallback || !substitute(parser, resolver, set, segment->fallback, output) )
+            return false;
+    }
+    return true;
+}
+
+static const char* substitute_text(CssParser* parser, CssVariableResolver* resolver, CssCustomProperties* set,
+                                   const CssDeclaration* declaration)
+{
+    const CssVarTemplate* template = declaration_template(parser, resolver, declaration);
+    CssParserString output;
+    cssprsr_string_init(parser, &output);
+    const char* text = NULL;
+    if ( substitute(parser, resolver, set, template, &output) )
+        text = cssprsr_string_to_characters(parser, &output);
+    cssprsr_parser_free(parser, output.data);
+    return text;
+}
+
+static const char* copy_text(CssParser* parser, const char* text)
+{
+    if ( NULL == text )
+        return NULL;
+    size_t length = strlen(text);
+    char* copy = cssprsr_parser_alloc(parser, length + 1);
+    memcpy(copy, text, length + 1);
+    return copy;
+}
+
+static const char* resolve_property(CssParser* parser, CssVariableResolver* resolver,
+                                    CssCustomProperties* set, CssCustomProperty* property)
+{
+    if ( CssCustomPropertyResolved == property->state )
+        return property->value;
+    if ( CssCustomPropertyResolving == property->state ) {
+        // Everything from the property up to here refers back to it
+        for (size_t i = resolver->stack.length; i > 0; --i) {
+            CssCustomProperty* member = resolver->stack.data[i - 1];
+            member->cyclic = true;
+            if ( member == property )
+                break;
+        }
+        return NULL;
+    }
+
+    property->state = CssCustomPropertyResolving;
+    cssprsr_array_add(parser, property, &resolver->stack);
+    const char* text = property->declaration->string ? property->declaration->string : "";
+    const char* value = NULL;
+    if ( 0 == strcasecmp(text, "inherit") || 0 == strcasecmp(text, "unset") ) {
+        value = copy_text(parser, css_custom_properties_get(set->parent, property->declaration->property));
+    } else if ( 0 != strcasecmp(text, "initial") ) {
+        value = substitute_text(parser, resolver, set, property->declaration);
+    }
+    cssprsr_array_pop(parser, &resolver->stack);
+    if ( property->cyclic && value ) {
+        cssprsr_parser_free(parser, (void*)value);
+        value = NULL;
+    }
+    property->value = value;
+    property->state = CssCustomPropertyResolved;
+    return value;
+}
+
+CssVariableResolver* css_variable_resolver_new(void)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    CssVariableResolver* resolver = cssprsr_parser_alloc(&parser, sizeof(CssVariableResolver));
+    memset(resolver, 0, sizeof(CssVariableResolver));
+    cssprsr_array_init(&parser, 0, &resolver->stack);
+    return resolver;
+}
+
+void css_variable_resolver_clear(CssVariableResolver* resolver)
+{
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    map_clear(&parser, &resolver->sets, destroy_set);
+    map_clear(&parser, &resolver->templates, destroy_template);
+    map_clear(&parser, &resolver->root.substitutions, free_text);
+}
+
+void css_variable_resolver_destroy(CssVariableResolver* resolver)
+{
+    if ( NULL == resolver )
+        return;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    map_destroy(&parser, &resolver->sets, destroy_set);
+    map_destroy(&parser, &resolver->templates, destroy_template);
+    map_destroy(&parser, &resolver->root.substitutions, free_text);
+    cssprsr_array_destroy(&parser, &resolver->stack);
+    cssprsr_parser_free(&parser, resolver);
+}
+
+const CssCustomProperties* css_variable_resolver_compute(CssVariableResolver* resolver,
+                                                         const CssCustomProperties* parent,
+                                                         const CssCascadedStyle* style)
+{
+    if ( 0 == style->custom_length )
+        return parent;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    map_reserve(&parser, &resolver->sets);
+    CssVarSlot* slot = map_find(&resolver->sets, style, parent);
+    if ( slot->first )
+        return slot->value;
+
+    CssCustomProperties* set = cssprsr_parser_alloc(&parser, sizeof(CssCustomProperties));
+    memset(set, 0, sizeof(CssCustomProperties));
+    set->parent = parent;
+    set->length = style->custom_length;
+    set->properties = cssprsr_parser_alloc(&parser, sizeof(CssCustomProperty) * set->length);
+    for (unsigned int i = 0; i < set->length; ++i) {
+        set->properties[i].declaration = style->custom[i];
+        set->properties[i].value = NULL;
+        set->properties[i].state = CssCustomPropertyUnresolved;
+        set->properties[i].cyclic = false;
+    }
+    for (unsigned int i = 0; i < set->length; ++i)
+        resolve_property(&parser, resolver, set, &set->properties[i]);
+    map_insert(&resolver->sets, slot, style, parent, set);
+    return set;
+}
+
+const char* css_custom_properties_get(const CssCustomProperties* properties, const char* name)
+{
+    for (const CssCustomProperties* set = properties; set; set = set->parent) {
+        const CssCustomProperty* property = find_property(set, name);
+        if ( property )
+            return property->value;
+    }
+    return NULL;
+}
+
+const char* css_variable_resolver_substitute(CssVariableResolver* resolver, const CssCustomProperties* properties,
+                                             const CssDeclaration* declaration)
+{
+    if ( NULL == declaration->string )
+        return declaration->raw;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    // Sets are created by the resolver, it may update them
+    CssCustomProperties* set = properties ? (CssCustomProperties*)properties : &resolver->root;
+    map_reserve(&parser, &set->substitutions);
+    CssVarSlot* slot = map_find(&set->substitutions, declaration, NULL);
+    if ( slot->first )
+        return slot->value;
+    const char* text = substitute_text(&parser, resolver, set, declaration);
+    map_insert(&set->substitutions, slot, declaration, NULL, (void*)text);
+    return text;
+}
+
+static size_t collect_references(const CssVarTemplate* template, const char** names, size_t capacity, size_t count)
+{
+    for (unsigned int i = 0; i < template->length; ++i) {
+        const CssVarSegment* segment = &template->segments[i];
+        if ( !segment->reference )
+            continue;
+        if ( count < capacity )
+            names[count] = segment->text;
+        count++;
+        if ( segment->fallback )
+            count = collect_references(segment->fallback, names, capacity, count);
+    }
+    return count;
+}
+
+size_t css_variable_resolver_references(CssVariableResolver* resolver, const CssDeclaration* declaration,
+                                        const char** names, size_t capacity)
+{
+    if ( NULL == declaration->string )
+        return 0;
+    CssParser parser;
+    parser.options = &kCssDefaultOptions;
+    return collect_references(declaration_template(&parser, resolver, declaration), names, capacity, 0);
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Regenerate the perfect hash tables of names.
+
+    tools/perfect_hash.py pseudo     # kPseudoTypeMap in src/selector.c
+    tools/perfect_hash.py property   # kPropertySlots in src/property.c
+    tools/perfect_hash.py value      # kValueSlots in src/keyword.c
+
+A name hashes like cssprsr_string_hash() ignoring case, the low bits pick a
+bucket and the seed of the bucket mixed into the hash gives the one slot the
+name can be in. Buckets are placed biggest first, ties in the order their
+first name comes, and each takes the first seed putting all its names in
+distinct free slots.
+
+Names come from the tree itself:
+- pseudo: the entries of kPseudoTypeMap, in alphabetical order. To add one,
+  write its entry anywhere in the table with any index.
+- property: kPropertyNames, in the order of the CssPropertyID enum.
+- value: kValueNames, in the order of the CssValueID enum.
+
+The seed and slot tables are rewritten in place, and the pseudo one sorted
+by slot. With no name added the files come out unchanged. If a bucket finds
+no seed, raise the SLOTS define of the table, and its SLOT_SHIFT with it.
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+MASK = 0xFFFFFFFF
+
+
+def string_hash(name):
+    # cssprsr_string_hash(name, true)
+    h = 2166136261
+    for c in name.lower().encode():
+        h = ((h ^ c) * 16777619) & MASK
+    return h
+
+
+def mix(h, seed, spread):
+    if spread:
+        seed = (seed * 0x9E3779B9) & MASK
+    return ((h ^ seed) * 16777619) & MASK
+
+
+def search(names, buckets, slots, shift, spread):
+    groups = {}
+    for name in names:
+        groups.setdefault(string_hash(name) & (buckets - 1), []).append(name)
+    seeds = [0] * buckets
+    table = [None] * slots
+    for bucket in sorted(groups, key=lambda b: -len(groups[b])):
+        for seed in range(256):
+            pos = [mix(string_hash(n), seed, spread) >> shift for n in groups[bucket]]
+            if len(set(pos)) == len(pos) and all(table[p] is None for p in pos):
+                break
+        else:
+            sys.exit('no seed for bucket %d: %s' % (bucket, ', '.join(groups[bucket])))
+        seeds[bucket] = seed
+        for p, name in zip(pos, groups[bucket]):
+            table[p] = name
+    return seeds, table
+
+
+def read(path):
+    with open(os.path.join(ROOT, path), newline='') as f:
+        return f.read()
+
+
+def write(path, text):
+    with open(os.path.join(ROOT, path), 'w', newline='') as f:
+        f.write(text)
+
+
+def define(src, name):
+    return int(re.search(r'#define %s\s+(\d+)' % name, src).group(1))
+
+
+def enum_values(prefix, type_name):
+    header = read('src/cssparser.h').replace('\r\n', '\n')
+    body = re.search(r'typedef enum \{\n(.*?)\n\} %s;' % type_name, header, re.S).group(1)
+    values = {}
+    value = 0
+    for ident, explicit in re.findall(r'^\s*(%s\w+)\s*(?:=\s*(\w+))?,?' % prefix, body, re.M):
+        value = int(explicit, 0) if explicit else value
+        values[ident] = value
+        value += 1
+    return values
+
+
+def rows(values):
+    return '\n'.join('    ' + ' '.join('%3d,' % v for v in values[i:i + 16])
+                     for i in range(0, len(values), 16))
+
+
+def replace_table(src, declaration, body):
+    pattern = re.escape(declaration) + r' = \{\n.*?\n\};'
+    return re.sub(pattern, lambda m: declaration + ' = {\n' + body + '\n};', src, count=1, flags=re.S)
+
+
+def pseudo():
+    path = 'src/selector.c'
+    src = read(path)
+    buckets = define(src, 'CSSPRSR_PSEUDO_BUCKETS')
+    slots = define(src, 'CSSPRSR_PSEUDO_SLOTS')
+    shift = define(src, 'CSSPRSR_PSEUDO_SLOT_SHIFT')
+    declaration = 'static const CssNameToPseudoStruct kPseudoTypeMap[CSSPRSR_PSEUDO_SLOTS]'
+    table = re.search(re.escape(declaration) + r' = \{\n(.*?)\n\};', src, re.S).group(1)
+    entries = {}
+    for name, args, type_name in re.findall(r'\{"([^"]*)",\s*(true|false)\s*,\s*(\w+)\}', table):
+        entries[name] = (args, type_name)
+    seeds, names = search(sorted(entries), buckets, slots, shift, False)
+    width = max(len(n) for n in entries) + 3
+    lines = []
+    for i, name in enumerate(names):
+        if name is not None:
+            args, type_name = entries[name]
+            lines.append('    [%3d] = {%s %s, %s},'
+                         % (i, ('"%s",' % name).ljust(width), args.ljust(5), type_name))
+    src = replace_table(src, 'static const unsigned char kPseudoTypeSeeds[CSSPRSR_PSEUDO_BUCKETS]', rows(seeds))
+    write(path, replace_table(src, declaration, '\n'.join(lines)))
+
+
+def ids(path, names_table, prefix, type_name, macro, seeds_table, slots_table, spread):
+    src = read(path)
+    buckets = define(src, macro + '_BUCKETS')
+    slots = define(src, macro + '_SLOTS')
+    shift = define(src, macro + '_SLOT_SHIFT')
+    values = enum_values(prefix, type_name)
+    table = re.search(re.escape(names_table) + r' = \{\n(.*?)\n\};', src, re.S).group(1)
+    name_ids = {name: values[ident] for ident, name in re.findall(r'\[(\w+)\]\s*= "([^"]*)"', table)}
+    seeds, names = search(sorted(name_ids, key=name_ids.get), buckets, slots, shift, spread)
+    src = replace_table(src, seeds_table, rows(seeds))
+    write(path, replace_table(src, slots_table, rows([0 if n is None else name_ids[n] for n in names])))
+
+
+def main():
+    tables = {
+        'pseudo': pseudo,
+        'property': lambda: ids('src/property.c',
+                                'static const char* const kPropertyNames[CssPropertyCount]',
+                                'CssProperty', 'CssPropertyID', 'CSSPRSR_PROPERTY',
+                                'static const unsigned char kPropertySeeds[CSSPRSR_PROPERTY_BUCKETS]',
+                                'static const unsigned short kPropertySlots[CSSPRSR_PROPERTY_SLOTS]',
+                                False),
+        'value': lambda: ids('src/keyword.c',
+                             'static const char* const kValueNames[CssValueCount]',
+                             'CssValue', 'CssValueID', 'CSSPRSR_VALUE',
+                             'static const unsigned char kValueSeeds[CSSPRSR_VALUE_BUCKETS]',
+                             'static const unsigned short kValueSlots[CSSPRSR_VALUE_SLOTS]',
+                             True),
+    }
+    if len(sys.argv) != 2 or sys.argv[1] not in tables:
+        sys.exit('usage: %s pseudo|property|value' % sys.argv[0])
+    tables[sys.argv[1]]()
+
+
+if __name__ == '__main__':
+    main()